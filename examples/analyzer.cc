@@ -88,8 +88,7 @@ public:
   int getFrameHeight() const;
   int getRunningFrameCount() const;
 
-  bool setBlockSizeBuffer(unsigned char *buf, size_t buf_sz);
-  bool setBandFlagsBuffer(unsigned int *buf, size_t buf_sz);
+  bool getSideData(daala_side_data *sd);
 };
 
 bool DaalaDecoder::readPage() {
@@ -234,18 +233,12 @@ int DaalaDecoder::getRunningFrameCount() const {
   return frame;
 }
 
-bool DaalaDecoder::setBlockSizeBuffer(unsigned char *buf, size_t buf_sz) {
+bool DaalaDecoder::getSideData(daala_side_data *sd) {
   if (dctx == NULL) {
     return false;
   }
-  return daala_decode_ctl(dctx, OD_DECCTL_SET_BSIZE_BUFFER, buf, buf_sz) == 0;
-}
-
-bool DaalaDecoder::setBandFlagsBuffer(unsigned int *buf, size_t buf_sz) {
-  if (dctx == NULL) {
-    return false;
-  }
-  return daala_decode_ctl(dctx, OD_DECCTL_SET_FLAGS_BUFFER, buf, buf_sz) == 0;
+  sd->version = OD_SIDE_DATA_VERSION;
+  return daala_decode_ctl(dctx, OD_DECCTL_GET_SIDE_DATA, sd, sizeof(*sd)) == 0;
 }
 
 #define MIN_ZOOM (1)
@@ -266,13 +259,12 @@ private:
   int zoom;
   unsigned char *pixels;
 
-  unsigned char *bsize;
-  unsigned int bsize_len;
+  // These point into the decoder, and are valid until the next frame.
+  const unsigned char *bsize;
   int bstride;
   bool show_blocks;
 
-  unsigned int *flags;
-  unsigned int flags_len;
+  const unsigned int *flags;
   int fstride;
   bool show_skip;
   bool show_noref;
@@ -385,8 +377,8 @@ BEGIN_EVENT_TABLE(TestFrame, wxFrame)
 END_EVENT_TABLE()
 
 TestPanel::TestPanel(wxWindow *parent, const wxString &path) : wxPanel(parent),
- pixels(NULL), zoom(0), bsize(NULL), bsize_len(0), show_blocks(false),
- flags(NULL), flags_len(0), show_skip(false), show_noref(false),
+ pixels(NULL), zoom(0), bsize(NULL), show_blocks(false),
+ flags(NULL), show_skip(false), show_noref(false),
  show_padding(false), plane_mask(OD_ALL_MASK), path(path) {
 }
 
@@ -401,34 +393,6 @@ bool TestPanel::open(const wxString &path) {
   if (!setZoom(MIN_ZOOM)) {
     return false;
   }
-  int nhsb = dd.getFrameWidth() >> OD_LOG_BSIZE0 + OD_NBSIZES - 1;
-  int nvsb = dd.getFrameHeight() >> OD_LOG_BSIZE0 + OD_NBSIZES - 1;
-  bsize_len = sizeof(*bsize)*nhsb*4*nvsb*4;
-  bsize = (unsigned char *)malloc(bsize_len);
-  if (bsize == NULL) {
-    bsize_len = 0;
-    close();
-    return false;
-  }
-  bstride = nhsb*4;
-  if (!dd.setBlockSizeBuffer(bsize, bsize_len)) {
-    close();
-    return false;
-  }
-  flags_len = sizeof(*flags)*nhsb*8*nvsb*8;
-  flags = (unsigned int *)malloc(flags_len);
-  if (flags == NULL) {
-    flags_len = 0;
-    fprintf(stderr,"Could not allocate memory\n");
-    close();
-    return false;
-  }
-  fstride = nhsb*8;
-  if (!dd.setBandFlagsBuffer(flags, flags_len)) {
-    fprintf(stderr,"Could not set flags buffer\n");
-    close();
-    return false;
-  }
   if (!nextFrame()) {
     close();
     return false;
@@ -441,9 +405,7 @@ void TestPanel::close() {
   dd.close();
   free(pixels);
   pixels = NULL;
-  free(bsize);
   bsize = NULL;
-  free(flags);
   flags = NULL;
 }
 
@@ -657,6 +619,15 @@ void TestPanel::setShowNoRef(bool show_noref) {
 
 bool TestPanel::nextFrame() {
   if (dd.step()) {
+    daala_side_data sd;
+    if (!dd.getSideData(&sd)) {
+      fprintf(stderr, "Could not get the side data\n");
+      return false;
+    }
+    bsize = sd.bsize;
+    bstride = sd.bstride;
+    flags = sd.flags;
+    fstride = sd.fstride;
     render();
     ((TestFrame *)GetParent())->SetTitle(path +
      wxString::Format(wxT(" (%d,%d) Frame %d - Daala Stream Analyzer"),
@@ -668,8 +639,6 @@ bool TestPanel::nextFrame() {
 
 void TestPanel::restart() {
   dd.restart();
-  dd.setBlockSizeBuffer(bsize, bsize_len);
-  dd.setBandFlagsBuffer(flags, flags_len);
   nextFrame();
 }
 
@@ -59,10 +59,12 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
 #include "../src/logging.h"
 #include "../include/daala/daaladec.h"
 
-const char *optstring = "o:r";
+const char *optstring = "o:rs:i:";
 struct option options [] = {
   { "output", required_argument, NULL, 'o' },
   { "raw", no_argument, NULL, 'r' }, /*Disable YUV4MPEG2 headers:*/
+  { "start", required_argument, NULL, 's' },
+  { "index", required_argument, NULL, 'i' },
   { "version", no_argument, NULL, 0},
   { NULL, 0, NULL, 0 }
 };
@@ -94,6 +96,10 @@ int stateflag = 0;
 int videobuf_ready = 0;
 int raw = 0;
 
+/* packets to discard and decoded frames to drop after seeking */
+int skip_packets = 0;
+ogg_int64_t drop_frames = 0;
+
 FILE *outfile = NULL;
 
 int got_sigint = 0;
@@ -156,6 +162,82 @@ static int queue_page(ogg_page *page) {
   return 0;
 }
 
+/* Loads the seek index from index_name, or builds it by scanning the whole
+    file (and saves it to index_name, if given). */
+static daala_seek_index *load_seek_index(FILE *in, const char *index_name) {
+  daala_seek_index *idx;
+  ogg_sync_state sy;
+  ogg_page page;
+  ogg_int64_t offset;
+  FILE *f;
+  if (index_name != NULL && (f = fopen(index_name, "rb")) != NULL) {
+    unsigned char *buf;
+    long sz;
+    idx = NULL;
+    if (fseek(f, 0, SEEK_END) == 0 && (sz = ftell(f)) > 0
+     && fseek(f, 0, SEEK_SET) == 0 && (buf = malloc(sz)) != NULL) {
+      if (fread(buf, 1, sz, f) == (size_t)sz) {
+        idx = daala_seek_index_load(buf, sz);
+      }
+      free(buf);
+    }
+    fclose(f);
+    if (idx != NULL) return idx;
+    fprintf(stderr, "Ignoring invalid seek index '%s'.\n", index_name);
+  }
+  idx = daala_seek_index_alloc(to.serialno);
+  if (idx == NULL || fseek(in, 0, SEEK_SET) != 0) return NULL;
+  ogg_sync_init(&sy);
+  offset = 0;
+  for (;;) {
+    long ret;
+    ret = ogg_sync_pageseek(&sy, &page);
+    if (ret == 0) {
+      if (buffer_data(in, &sy) == 0) break;
+      continue;
+    }
+    /* negative values are bytes skipped while looking for a page */
+    if (ret > 0 && daala_seek_index_add_page(idx, &page, offset) < 0) break;
+    offset += ret < 0 ? -ret : ret;
+  }
+  ogg_sync_clear(&sy);
+  if (index_name != NULL && (f = fopen(index_name, "wb")) != NULL) {
+    const unsigned char *buf;
+    int sz;
+    sz = daala_seek_index_save(idx, &buf);
+    if (sz > 0 && fwrite(buf, 1, sz, f) < (size_t)sz) {
+      fprintf(stderr, "Error writing seek index '%s'.\n", index_name);
+    }
+    fclose(f);
+  }
+  return idx;
+}
+
+/* Repositions the input at the keyframe before start_frame. */
+static int seek_to_frame(FILE *in, ogg_int64_t start_frame,
+ const char *index_name) {
+  daala_seek_index *idx;
+  ogg_int64_t keyframe;
+  ogg_int64_t offset;
+  idx = load_seek_index(in, index_name);
+  if (idx == NULL) return -1;
+  if (daala_seek_index_lookup(idx, start_frame, &keyframe, &offset,
+   &skip_packets) < 0) {
+    daala_seek_index_free(idx);
+    return -1;
+  }
+  daala_seek_index_free(idx);
+  /* fseek() only takes a long, which limits this example to 2 GB files on
+      some platforms. */
+  if (fseek(in, (long)offset, SEEK_SET) != 0) return -1;
+  ogg_sync_reset(&oy);
+  ogg_stream_reset(&to);
+  drop_frames = start_frame - keyframe;
+  fprintf(stderr, "Seeking to keyframe %lld to start at frame %lld\n",
+   (long long)keyframe, (long long)start_frame);
+  return 0;
+}
+
 static void usage(void) {
   fprintf(stderr,
    "Usage: dumpvid [options] [<file.ogv>] [-o outfile.y4m]\n"
@@ -166,6 +248,10 @@ static void usage(void) {
    "                            decompressed data is sent to stdout.\n"
    "  -r --raw                  Output raw YUV with no framing instead\n"
    "                            of YUV4MPEG2 (the default).\n"
+   "  -s --start <frame>        Start decoding at the given frame,\n"
+   "                            seeking to the keyframe before it.\n"
+   "  -i --index <file>         Seek index sidecar file. It is read if\n"
+   "                            it exists and written otherwise.\n"
    "     --version              Displays version information.\n");
   exit(EXIT_FAILURE);
 }
@@ -187,6 +273,8 @@ int main(int argc, char *argv[]) {
   ogg_int32_t pic_height = 0;
   ogg_int32_t fps_num = 0;
   ogg_int32_t fps_denom = 0;
+  ogg_int64_t start_frame = 0;
+  const char *index_name = NULL;
   FILE *infile = stdin;
   outfile = stdout;
   daala_log_init();
@@ -217,6 +305,15 @@ int main(int argc, char *argv[]) {
         raw = 1;
         break;
       }
+      case 's': {
+        start_frame = atol(optarg);
+        if (start_frame < 0) usage();
+        break;
+      }
+      case 'i': {
+        index_name = optarg;
+        break;
+      }
       case 0: {
         if (strcmp(options[long_option_index].name, "version") == 0) {
           version();
@@ -370,6 +467,13 @@ int main(int argc, char *argv[]) {
      di.pixel_aspect_numerator, di.pixel_aspect_denominator,
      CHROMA_TYPES[pix_fmt]);
   }
+  if (daala_p && start_frame > 0) {
+    if (infile == stdin || seek_to_frame(infile, start_frame, index_name) < 0) {
+      fprintf(stderr, "Unable to seek to frame %lld.\n",
+       (long long)start_frame);
+      exit(1);
+    }
+  }
   /* install signal handler */
   signal(SIGINT, sigint_handler);
 
@@ -398,7 +502,17 @@ int main(int argc, char *argv[]) {
   while (!got_sigint) {
     while (daala_p && !videobuf_ready) {
       if (ogg_stream_packetout(&to, &op) > 0) {
+        if (skip_packets > 0) {
+          skip_packets--;
+          continue;
+        }
         if (daala_decode_packet_in(dd, &img, &op) >= 0) {
+          /* frames between the keyframe and the start frame are decoded
+              but not output */
+          if (drop_frames > 0) {
+            drop_frames--;
+            continue;
+          }
           videobuf_ready = 1;
           frames++;
         }
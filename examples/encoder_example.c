@@ -29,6 +29,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <math.h>
 #include <string.h>
 #include <time.h>
@@ -377,12 +378,15 @@ static const struct option OPTIONS[] = {
   { "no-mc-use-chroma", no_argument, NULL, 0 },
   { "mc-use-satd", no_argument, NULL, 0 },
   { "no-mc-use-satd", no_argument, NULL, 0 },
+  { "mc-subpel-cache", no_argument, NULL, 0 },
+  { "no-mc-subpel-cache", no_argument, NULL, 0 },
   { "activity-masking", no_argument, NULL, 0 },
   { "no-activity-masking", no_argument, NULL, 0 },
   { "qm", required_argument, NULL, 0 },
   { "mv-res-min", required_argument, NULL, 0 },
   { "mv-level-min", required_argument, NULL, 0 },
   { "mv-level-max", required_argument, NULL, 0 },
+  { "realtime", no_argument, NULL, 0 },
   { "version", no_argument, NULL, 0},
   { NULL, 0, NULL, 0 }
 };
@@ -416,6 +420,12 @@ static void usage(void) {
    "     --[no-]mc-use-satd          Control whether the SATD metric should\n"
    "                                 be used in the motion estimation.\n"
    "                                 --no-mc-use-satd is implied by default.\n"
+   "     --[no-]mc-subpel-cache      Control whether the motion estimation\n"
+   "                                 should interpolate each sub-pel phase of\n"
+   "                                 the reference once per frame. Faster,\n"
+   "                                 but may use many frame-sized buffers.\n"
+   "                                 --no-mc-subpel-cache is implied by\n"
+   "                                 default.\n"
    "     --[no-]activity-masking     Control whether activity masking should\n"
    "                                 be used in quantization.\n"
    "                                 --activity-masking is implied by default.\n"
@@ -429,6 +439,8 @@ static void usage(void) {
    "                                 0 (default) and 6.\n"
    "     --mv-level-max <n>          Maximum motion vectors level between\n"
    "                                 0 and 6 (default).\n"
+   "     --realtime                  Lower the complexity as needed to keep\n"
+   "                                 up with the input frame rate.\n"
    "     --version                   Displays version information."
    " encoder_example accepts only uncompressed YUV4MPEG2 video.\n\n");
   exit(1);
@@ -466,11 +478,13 @@ int main(int argc, char **argv) {
   int interactive;
   int mc_use_chroma;
   int mc_use_satd;
+  int mc_subpel_cache;
   int use_activity_masking;
   int qm;
   int mv_res_min;
   int mv_level_min;
   int mv_level_max;
+  int realtime;
   daala_log_init();
 #if defined(_WIN32)
   _setmode(_fileno(stdin), _O_BINARY);
@@ -495,8 +509,10 @@ int main(int argc, char **argv) {
   complexity = 7;
   mc_use_chroma = 1;
   mc_use_satd = 0;
+  mc_subpel_cache = 0;
   use_activity_masking = 1;
   qm = 1;
+  realtime = 0;
   mv_res_min = 0;
 #if OD_THOR_SUBPEL_SIMD
   mv_res_min = 1;
@@ -585,6 +601,12 @@ int main(int argc, char **argv) {
         else if (strcmp(OPTIONS[loi].name, "no-mc-use-satd") == 0) {
           mc_use_satd = 0;
         }
+        else if (strcmp(OPTIONS[loi].name, "mc-subpel-cache") == 0) {
+          mc_subpel_cache = 1;
+        }
+        else if (strcmp(OPTIONS[loi].name, "no-mc-subpel-cache") == 0) {
+          mc_subpel_cache = 0;
+        }
         else if (strcmp(OPTIONS[loi].name, "activity-masking") == 0) {
           use_activity_masking = 1;
         }
@@ -633,6 +655,9 @@ int main(int argc, char **argv) {
             exit(1);
           }
         }
+        else if (strcmp(OPTIONS[loi].name, "realtime") == 0) {
+          realtime = 1;
+        }
         else if (strcmp(OPTIONS[loi].name, "version") == 0) {
           version();
         }
@@ -678,9 +703,29 @@ int main(int argc, char **argv) {
   daala_encode_ctl(dd, OD_SET_USE_ACTIVITY_MASKING, &use_activity_masking,
    sizeof(use_activity_masking));
   daala_encode_ctl(dd, OD_SET_MV_RES_MIN, &mv_res_min, sizeof(mv_res_min));
+  /*The cache is sized for the resolution set just above.*/
+  if (daala_encode_ctl(dd, OD_SET_MC_SUBPEL_CACHE, &mc_subpel_cache,
+   sizeof(mc_subpel_cache)) < 0) {
+    fprintf(stderr, "Not enough memory for the sub-pel cache.\n");
+    exit(1);
+  }
   daala_encode_ctl(dd, OD_SET_QM, &qm, sizeof(qm));
   daala_encode_ctl(dd, OD_SET_MV_LEVEL_MIN, &mv_level_min, sizeof(mv_level_min));
   daala_encode_ctl(dd, OD_SET_MV_LEVEL_MAX, &mv_level_max, sizeof(mv_level_max));
+  if (realtime) {
+    double budget;
+    int deadline;
+    if (avin.video_fps_n <= 0 || avin.video_fps_d <= 0) {
+      fprintf(stderr,
+       "--realtime needs an input with a valid frame rate\n");
+      exit(1);
+    }
+    /*A deadline of 0 would disable the controller, and one that does not
+       fit in an int is as good as none.*/
+    budget = 1000000.0*avin.video_fps_d/avin.video_fps_n;
+    deadline = budget < 1 ? 1 : budget > INT_MAX ? INT_MAX : (int)budget;
+    daala_encode_ctl(dd, OD_SET_FRAME_DEADLINE, &deadline, sizeof(deadline));
+  }
   /*Write the bitstream header packets with proper page interleave.*/
   /*The first packet for each logical stream will get its own page
      automatically.*/
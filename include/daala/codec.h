@@ -124,11 +124,52 @@ extern "C" {
 /**The maximum number of color planes allowed in a single frame.*/
 # define OD_NPLANES_MAX (4)
 
+/**\name Bit accounting techniques
+ * The coding tools the bits of a frame are attributed to in a
+ *  #daala_accounting.*/
+/*@{*/
+/**Bits not attributed to any other technique.*/
+# define OD_ACCT_TECH_UNKNOWN (0)
+/**The frame header, quantization matrices and quantizers.*/
+# define OD_ACCT_TECH_FRAME (1)
+/**The flags that split a block into smaller ones.*/
+# define OD_ACCT_TECH_BLOCK_SIZE (2)
+/**Intra prediction modes (currently unused).*/
+# define OD_ACCT_TECH_INTRA_MODE (3)
+/**DC coefficients.*/
+# define OD_ACCT_TECH_DC_COEFF (4)
+/**AC coefficients, along with the skip flag coded with them.*/
+# define OD_ACCT_TECH_AC_COEFFS (5)
+/**The motion vector grid.*/
+# define OD_ACCT_TECH_MOTION_VECTORS (6)
+/**The deringing filter flags.*/
+# define OD_ACCT_TECH_CLPF (7)
+/**The number of techniques.*/
+# define OD_ACCT_NTECHS (8)
+/*@}*/
+
+/**\name Bit accounting planes
+ * The planes the bits of a frame are attributed to in a #daala_accounting.*/
+/*@{*/
+/**Bits not attributed to any plane.*/
+# define OD_ACCT_PLANE_UNKNOWN (0)
+/**Bits shared by all of the planes.*/
+# define OD_ACCT_PLANE_FRAME (1)
+# define OD_ACCT_PLANE_LUMA (2)
+# define OD_ACCT_PLANE_CB (3)
+# define OD_ACCT_PLANE_CR (4)
+# define OD_ACCT_PLANE_ALPHA (5)
+/**The number of planes.*/
+# define OD_ACCT_NPLANES (6)
+/*@}*/
+
 typedef struct od_img_plane od_img_plane;
 typedef struct od_img od_img;
 typedef struct daala_plane_info daala_plane_info;
 typedef struct daala_info daala_info;
 typedef struct daala_comment daala_comment;
+typedef struct daala_allocator daala_allocator;
+typedef struct daala_accounting daala_accounting;
 
 const char *daala_version_string(void);
 
@@ -237,6 +278,54 @@ struct daala_comment {
 void daala_comment_init(daala_comment *dc);
 void daala_comment_clear(daala_comment *dc);
 
+/**Memory allocation callbacks for a codec instance.
+ * An instance created with one of these gets every buffer it owns through
+ *  it, for its whole lifetime, so an application can, e.g., carve all of an
+ *  instance's memory out of a single pre-sized arena, or recycle the blocks
+ *  of a freed instance for the next one.
+ * The library copies this structure, but the callbacks and  ctx must stay
+ *  valid until the instance is freed.
+ * The callbacks are only ever invoked from calls on the instance that owns
+ *  them, so an allocator used by a single instance needs no locking.*/
+struct daala_allocator {
+  /**Returns a block of at least  size bytes aligned for any type, or
+      <tt>NULL</tt> on failure.*/
+  void *(*alloc)(void *ctx, size_t size);
+  /**Releases a block returned by  alloc.
+     This is never called with a <tt>NULL</tt> pointer.
+     An arena that is discarded as a whole can make this a no-op.*/
+  void (*release)(void *ctx, void *ptr);
+  /**Opaque data passed to both callbacks.*/
+  void *ctx;
+};
+
+/**Where the bits of the last frame went, as returned by #OD_GET_ACCOUNTING
+ *  and #OD_DECCTL_GET_ACCOUNTING.
+ * All of the counts are in 1/8th bits.
+ * The arrays belong to the codec instance, and remain valid until the next
+ *  frame is encoded or decoded.*/
+struct daala_accounting {
+  /**The size of the frame, i.e., the sum of all of the entries in
+      frac_bits.*/
+  uint32_t total;
+  /**The bits spent on each technique in each plane.
+     The count for technique <tt>t</tt> in plane <tt>p</tt> is at index
+      <tt>t*#OD_ACCT_NPLANES + p</tt>.*/
+  const uint32_t *frac_bits;
+  /**The number of superblocks across the frame.*/
+  int nhsb;
+  /**The number of superblocks down the frame.*/
+  int nvsb;
+  /**The bits spent on each technique in each superblock, summed over all
+      of the planes.
+     The count for technique <tt>t</tt> in superblock
+      (<tt>sbx</tt>, <tt>sby</tt>) is at index
+      <tt>(sby*nhsb + sbx)*#OD_ACCT_NTECHS + t</tt>.
+     The frame header, the quantizers and the motion vectors do not belong to
+      any one superblock, and are only counted in frac_bits.*/
+  const uint32_t *sb_frac_bits;
+};
+
 int64_t daala_granule_basetime(void *encdec, int64_t granpos);
 double daala_granule_time(void *encdec, int64_t granpos);
 /**Determines whether a Daala packet is a header or not.
@@ -36,14 +36,92 @@ extern "C" {
 #  pragma GCC visibility push(default)
 # endif
 
+/** Copy the block sizes of each decoded frame into a user supplied buffer.
+ * #OD_DECCTL_GET_SIDE_DATA returns the same data without the copy.
+ * \param[in]  <tt>unsigned char*</tt>: A buffer with one byte per 8x8 block
+ *              of the frame, i.e., <tt>nhsb*4*nvsb*4</tt> bytes. */
 #define OD_DECCTL_SET_BSIZE_BUFFER (7001)
+/** Copy the PVQ band flags of each decoded frame into a user supplied
+ *  buffer.
+ * #OD_DECCTL_GET_SIDE_DATA returns the same data without the copy.
+ * \param[in]  <tt>unsigned int*</tt>: A buffer with one entry per 4x4
+ *              block of the frame, i.e., <tt>nhsb*8*nvsb*8</tt> entries. */
 #define OD_DECCTL_SET_FLAGS_BUFFER (7003)
+/** Copy the motion vector grid of each decoded frame into a user supplied
+ *  buffer.
+ * Grid points that were not coded are reported as zero vectors.
+ * #OD_DECCTL_GET_SIDE_DATA returns the same data without the copy, along
+ *  with the \c mv_valid map that tells them apart from coded zero vectors.
+ * \param[in]  <tt>int16_t*</tt>: A buffer with the horizontal and vertical
+ *              components of each grid point, laid out like the \c mv
+ *              side data, i.e., <tt>2*(nhmvbs + 1)*(nvmvbs + 1)</tt>
+ *              entries. */
 #define OD_DECCTL_SET_MV_BUFFER    (7005)
 /** Copy the motion compensated reference into a user supplied od_img.
  * \param[in]  <tt>od_img*</tt>: Pointer to the user supplied od_img.
  *              Image must be allocated by the caller, and must be the
  *              same format as the decoder output images. */
 #define OD_DECCTL_SET_MC_IMG       (7007)
+/** Decode reduced-resolution thumbnails instead of full frames.
+ * Only the DC and low-order coefficients of each block are inverse
+ *  transformed, and lapping, deringing and the reference frame update are
+ *  skipped, so each output pixel approximates the average of a
+ *  2^<tt>shift</tt> by 2^<tt>shift</tt> area of the full frame.
+ * The whole packet must still be entropy decoded, because the coefficients
+ *  of all blocks share the same adaptive contexts.
+ * While this is enabled, only keyframes can be decoded: other packets are
+ *  rejected with #OD_EIMPL.
+ * Full-resolution decoding can resume at the next keyframe after it is
+ *  disabled.
+ * \param[in]  <tt>int</tt>: The log2 of the reduction factor, between 2 (1/4
+ *              scale) and 5 (1/32 scale), inclusive, or 0 to disable
+ *              thumbnail decoding (the default). */
+#define OD_DECCTL_SET_THUMBNAIL_SCALE (7009)
+/** Report rows of each decoded frame as soon as they are final, before
+ *  daala_decode_packet_in() returns.
+ * The callback is given the same image daala_decode_packet_in() returns,
+ *  and a range of rows in luma pixels whose contents, in every plane, will
+ *  not change again until the next packet is decoded.
+ * Each row of the picture is reported exactly once per frame, from the top
+ *  down.
+ * The deringing flags follow all of the coefficients in a packet, so no rows
+ *  can be final until the whole packet has been entropy decoded.
+ * After that, the lapping, deringing and smoothing filters and the output
+ *  conversion run one superblock row at a time, so an application that hands
+ *  the rows off to another thread can start on the top of the frame while
+ *  the decoder finishes the rest of it and updates its reference frames.
+ * The callback must not call back into the decoder.
+ * \param[in]  <tt>daala_row_callback*</tt>: The callback to use, or
+ *              <tt>NULL</tt> to disable it (the default).
+ *              The structure is copied, so it need not outlive this call.*/
+#define OD_DECCTL_SET_ROW_CALLBACK (7011)
+/** Get where the bits of the last decoded frame went, by technique, plane
+ *  and superblock.
+ * The counts match those the encoder reports with #OD_GET_ACCOUNTING for the
+ *  same frame, except that the deringing flags are not counted when
+ *  decoding thumbnails, since they are not decoded.
+ * This is only available if the library was built with bit accounting
+ *  enabled.
+ * \param[out] <tt>daala_accounting*</tt>: Returns the counts for the last
+ *              frame.
+ *              The arrays it points to remain valid until the next packet
+ *              is decoded.
+ * \retval OD_EIMPL The library was built without bit accounting. */
+#define OD_DECCTL_GET_ACCOUNTING (7013)
+/** Get read-only views of the decoder state that describes the last decoded
+ *  frame: its block sizes, flags, motion vectors and quantizers.
+ * Nothing is copied: the arrays belong to the decoder, and remain valid
+ *  until the next call to daala_decode_packet_in().
+ * The caller must set the <tt>version</tt> field to #OD_SIDE_DATA_VERSION
+ *  (the version it was compiled against) before the call.
+ * \param[in,out] <tt>daala_side_data*</tt>: Returns the side data of the
+ *                 last decoded frame.
+ * \retval OD_EINVAL The version or size of the structure is not supported.*/
+#define OD_DECCTL_GET_SIDE_DATA (7015)
+
+/**The current version of #daala_side_data.
+ * Later versions will only add fields to the end of the structure.*/
+#define OD_SIDE_DATA_VERSION (1)
 
 /**\name Decoder state
    The following data structures are opaque, and their contents are not
@@ -61,6 +139,85 @@ typedef struct daala_dec_ctx daala_dec_ctx;
 typedef struct daala_setup_info daala_setup_info;
 /*@}*/
 
+/**A function called by daala_decode_packet_in() as rows of the output
+    become final.
+   \param ctx The context pointer from the #daala_row_callback.
+   \param img The image being decoded.
+   \param y0 The first final row, in luma pixels.
+   \param y1 One past the last final row, in luma pixels.
+              The corresponding rows of a plane with vertical decimation
+               <tt>ydec</tt> run from <tt>y0 >> ydec</tt> up to, but not
+               including, <tt>(y1 + (1 << ydec) - 1) >> ydec</tt>.*/
+typedef void (*daala_row_func)(void *ctx, const od_img *img, int y0, int y1);
+
+/**A callback registered with #OD_DECCTL_SET_ROW_CALLBACK.*/
+typedef struct daala_row_callback daala_row_callback;
+
+struct daala_row_callback {
+  daala_row_func func;
+  void *ctx;
+};
+
+/**Per-frame decoder state returned by #OD_DECCTL_GET_SIDE_DATA.
+ * Positions are in luma pixels of the frame, which is padded to a whole
+ *  number of 32x32 superblocks.*/
+typedef struct daala_side_data daala_side_data;
+
+struct daala_side_data {
+  /**The version of this structure, #OD_SIDE_DATA_VERSION.
+     This must be set by the caller.*/
+  int version;
+  /**Whether the frame was a keyframe.*/
+  int is_keyframe;
+  /**The quantizer of each plane, or 0 for a lossless plane.*/
+  int quantizer[OD_NPLANES_MAX];
+  /**The number of superblocks across the frame.*/
+  int nhsb;
+  /**The number of superblocks down the frame.*/
+  int nvsb;
+  /**The block size of each 8x8 block, as the log2 of the block size minus
+      2: 0 means the 8x8 block is split into 4x4 blocks, and 3 that it is
+      part of a 32x32 block.
+     The entry of the 8x8 block in column <tt>i</tt> and row <tt>j</tt> is
+      <tt>bsize[j*bstride + i]</tt>, for <tt>i < nhsb*4</tt> and
+      <tt>j < nvsb*4</tt>.*/
+  const unsigned char *bsize;
+  int bstride;
+  /**The PVQ band flags of each luma block, stored in the entry of its
+      top-left 4x4 block: the flags of the 4x4 block in column <tt>i</tt>
+      and row <tt>j</tt> are <tt>flags[j*fstride + i]</tt>.
+     Bit <tt>2*b</tt> is set if band <tt>b</tt> was skipped, and bit
+      <tt>2*b + 1</tt> if it was coded without a reference.
+     The entries of the other 4x4 blocks are zero, as are all of the flags
+      for frames coded with the Haar wavelet.*/
+  const unsigned int *flags;
+  int fstride;
+  /**Whether each superblock was skipped entirely, at
+      <tt>sb_skip[sby*nhsb + sbx]</tt>.
+     These are all zero for frames coded with the Haar wavelet.*/
+  const unsigned char *sb_skip;
+  /**Whether the deringing filter was applied to each superblock, indexed
+      like sb_skip.
+     This is <tt>NULL</tt> when decoding thumbnails, which skips the
+      filter.*/
+  const unsigned char *clpf;
+  /**The number of motion vector blocks across the frame.
+     The grid has <tt>nhmvbs + 1</tt> points across, 4 pixels apart.*/
+  int nhmvbs;
+  /**The number of motion vector blocks down the frame.*/
+  int nvmvbs;
+  /**The motion vectors, in 1/8th pixels, or <tt>NULL</tt> for keyframes.
+     The horizontal and vertical components of the vector at grid point
+      (<tt>vx</tt>, <tt>vy</tt>) are <tt>mv[2*(vy*mv_stride + vx)]</tt> and
+      <tt>mv[2*(vy*mv_stride + vx) + 1]</tt>.*/
+  const int16_t *mv;
+  /**Whether each grid point was coded, indexed by
+      <tt>vy*mv_stride + vx</tt>, or <tt>NULL</tt> for keyframes.
+     The vectors of points that were not coded are zero.*/
+  const unsigned char *mv_valid;
+  int mv_stride;
+};
+
 /**\defgroup decfuncs Functions for Decoding*/
 /*@{*/
 /**\name Functions for decoding
@@ -118,6 +275,37 @@ int daala_decode_header_in(daala_info *info,
  * \retval NULL If the decoding parameters were invalid.*/
 daala_dec_ctx *daala_decode_alloc(const daala_info *info,
  const daala_setup_info *setup);
+/**Allocates a decoder instance whose memory all comes from an
+ *  application-provided allocator.
+ * \param info  A #daala_info struct filled via daala_decode_header_in().
+ * \param setup A #daala_setup_info handle returned via
+ *               daala_decode_header_in().
+ * \param alloc The allocator to use for the lifetime of the instance, or
+ *               <tt>NULL</tt> to use the C library heap, as
+ *               daala_decode_alloc() does.
+ *              The callbacks are only invoked while allocating or freeing
+ *               the instance; decoding frames allocates nothing.
+ * \return The initialized #daala_dec_ctx handle.
+ * \retval NULL If the decoding parameters were invalid, \a alloc did not
+ *               provide both callbacks, or an allocation failed.*/
+daala_dec_ctx *daala_decode_alloc_with_allocator(const daala_info *info,
+ const daala_setup_info *setup, const daala_allocator *alloc);
+/**Prepares a decoder instance to decode a new, independent stream, reusing
+ *  all of its memory.
+ * Settings made with daala_decode_ctl() are kept.
+ * Decoding resumes at the first keyframe of the new stream.
+ * \param dec  A #daala_dec_ctx handle.
+ * \param info A #daala_info struct filled via daala_decode_header_in() for
+ *              the new stream, or <tt>NULL</tt> to keep the current
+ *              parameters.
+ *             The picture size must round up to the same frame size (a
+ *              multiple of 32 pixels), and the number of planes and their
+ *              subsampling must be unchanged.
+ * \retval 0         Success.
+ * \retval OD_EFAULT \a dec was <tt>NULL</tt>.
+ * \retval OD_EINVAL \a info needs buffers of a different size.
+ *                   Allocate a new instance instead.*/
+int daala_decode_reset(daala_dec_ctx *dec, const daala_info *info);
 /**Releases all storage used for the decoder setup information.
  * This should be called after you no longer want to create any decoders for
  *  a stream whose headers you have parsed with daala_decode_header_in().
@@ -145,6 +333,86 @@ int daala_decode_packet_in(daala_dec_ctx *dec, od_img *img,
  const ogg_packet *op);
 /*@}*/
 
+/**\name Functions for seeking
+ * A seek index records the byte offset of every keyframe in an Ogg Daala
+ *  stream, so that an application can jump close to any frame without
+ *  decoding everything before it.
+ * It is built once by passing every page of the file to
+ *  daala_seek_index_add_page(), and can be saved to a compact sidecar buffer
+ *  with daala_seek_index_save() and restored with daala_seek_index_load().
+ * A restored index cannot be extended: if the file has grown since, build a
+ *  new index from its first page.
+ * To seek to a frame:
+ * - Call daala_seek_index_lookup() to find the nearest preceding keyframe,
+ *    the offset to resume reading from, and the number of packets to skip.
+ * - Reposition the input at that offset and reset the
+ *    <tt>ogg_sync_state</tt> and <tt>ogg_stream_state</tt>.
+ * - Discard that many packets.
+ *   The next one is the keyframe, and decoding can resume from it as usual.
+ *   The frames between it and the target can then be decoded and dropped.*/
+/*@{*/
+/**The seek index.
+   Its contents are not publicly defined by this API.*/
+typedef struct daala_seek_index daala_seek_index;
+/**Allocates an empty seek index.
+ * \param serialno The serial number of the Daala logical stream to index.
+ * \return The new #daala_seek_index handle.
+ * \retval NULL If there was a memory allocation failure.*/
+daala_seek_index *daala_seek_index_alloc(int serialno);
+/**Adds an Ogg page to the index.
+ * Pages must be added in the order they appear in the file, starting with
+ *  the first page of the stream.
+ * Pages that belong to other logical streams are ignored.
+ * \param idx A #daala_seek_index handle.
+ * \param og The page to add.
+ * \param offset The byte offset of the start of the page in the file.
+ * \retval 0 Success.
+ * \retval OD_EFAULT \a idx or \a og was <tt>NULL</tt>, or there was a
+ *                    memory allocation failure.
+ * \retval OD_EINVAL \a offset was before the previous page, the page
+ *                    could not be added to the stream, or \a idx was
+ *                    restored with daala_seek_index_load().*/
+int daala_seek_index_add_page(daala_seek_index *idx, ogg_page *og,
+ int64_t offset);
+/**Finds the nearest keyframe at or before a given frame.
+ * \param idx A #daala_seek_index handle.
+ * \param frame The number of the frame to seek to, counting the first video
+ *               packet of the stream as frame 0.
+ * \param[out] keyframe The number of the keyframe that was found.
+ * \param[out] offset The byte offset of the page to resume reading at.
+ * \param[out] skip The number of packets a freshly reset
+ *                  <tt>ogg_stream_state</tt> returns from that page before
+ *                  the keyframe.
+ * \retval 0 Success.
+ * \retval OD_EFAULT \a idx, \a keyframe, \a offset or \a skip was
+ *                    <tt>NULL</tt>.
+ * \retval OD_EINVAL No keyframe precedes \a frame.*/
+int daala_seek_index_lookup(const daala_seek_index *idx, int64_t frame,
+ int64_t *keyframe, int64_t *offset, int *skip);
+/**Serializes the index.
+ * \param idx A #daala_seek_index handle.
+ * \param[out] buf Returns a pointer to the serialized index.
+ *                 The memory is owned by the index, and remains valid until
+ *                  the next call to this function or daala_seek_index_free().
+ * \return The size of the serialized index in bytes.
+ * \retval OD_EFAULT \a idx or \a buf was <tt>NULL</tt>.*/
+int daala_seek_index_save(daala_seek_index *idx, const unsigned char **buf);
+/**Restores an index serialized with daala_seek_index_save().
+ * The restored index can only be used with daala_seek_index_lookup() and
+ *  daala_seek_index_save(): no further pages can be added to it.
+ * \param buf The serialized index.
+ * \param buf_sz The size of \a buf in bytes.
+ * \return The restored #daala_seek_index handle.
+ * \retval NULL If the data was not a valid index, or there was a memory
+ *               allocation failure.*/
+daala_seek_index *daala_seek_index_load(const unsigned char *buf,
+ size_t buf_sz);
+/**Frees a seek index.
+ * \param idx A #daala_seek_index handle.
+ *            This can safely be <tt>NULL</tt>.*/
+void daala_seek_index_free(daala_seek_index *idx);
+/*@}*/
+
 /** \defgroup decctlcodes Configuration keys for the decoder ctl interface.
  * Decoder CTL settings.
  *
@@ -46,6 +46,41 @@ extern "C" {
 typedef struct daala_enc_ctx daala_enc_ctx;
 /*@}*/
 
+/**The most frames that can wait to be encoded after being submitted with
+    daala_encode_img_submit().*/
+#define OD_SUBMIT_QUEUE_MAX (16)
+
+/**\name Flags for daala_encode_img_submit()*/
+/*@{*/
+/**The image is laid out the way the encoder stores its own copy of the
+    input, so it can be encoded directly from the caller's buffers.
+   Each plane must be the size of the frame (the picture size rounded up to a
+    multiple of 32 pixels, then decimated), with a stride of the luma frame
+    width plus twice the padding returned by #OD_GET_INPUT_PADDING, shifted
+    right by the horizontal decimation.
+   The padding, shifted right by the decimation, must also be addressable on
+    every side of each plane.
+   The encoder overwrites the part of each plane outside the picture, and the
+    padding around it.*/
+#define OD_SUBMIT_PADDED (1)
+/*@}*/
+
+/**A function called once the encoder is done reading a frame submitted with
+    daala_encode_img_submit().
+   Afterwards, the caller may reuse or free the image data.
+   The callback must not call back into the encoder.
+   \param ctx The context pointer from the #daala_img_release.
+   \param img A copy of the image structure that was submitted.*/
+typedef void (*daala_img_release_func)(void *ctx, od_img *img);
+
+/**A callback passed to daala_encode_img_submit().*/
+typedef struct daala_img_release daala_img_release;
+
+struct daala_img_release {
+  daala_img_release_func func;
+  void *ctx;
+};
+
 /**\defgroup encfuncs Functions for Encoding*/
 /*@{*/
 /**\name Functions for encoding
@@ -65,6 +100,9 @@ typedef struct daala_enc_ctx daala_enc_ctx;
  *   - Submit the compressed frame via daala_encode_img_in().
  *   - Repeatedly call daala_encode_packet_out() to retrieve any video data
  *      packets that are ready.
+ * - Alternatively, queue up to #OD_SUBMIT_QUEUE_MAX frames at a time with
+ *    daala_encode_img_submit(), and repeatedly call daala_encode_packet_out()
+ *    to encode them and retrieve their packets, whenever convenient.
  * - Call daala_encode_free() to release all encoder memory.*/
 /*@{*/
 /**Allocates and initializes an encoder instance.
@@ -73,6 +111,44 @@ typedef struct daala_enc_ctx daala_enc_ctx;
  * \return The initialized #daala_enc_ctx handle.
  * \retval NULL if the encoding parameters were invalid.*/
 daala_enc_ctx *daala_encode_create(const daala_info *info);
+/**Allocates and initializes an encoder instance whose memory all comes from
+ *  an application-provided allocator.
+ * \param info  A #daala_info struct filled with the desired encoding
+ *               parameters.
+ * \param alloc The allocator to use for the lifetime of the instance, or
+ *               <tt>NULL</tt> to use the C library heap, as
+ *               daala_encode_create() does.
+ *              The callbacks are only invoked while creating, resetting or
+ *               freeing the instance, by the daala_encode_ctl() calls
+ *               documented to allocate (#OD_SET_MC_SUBPEL_CACHE), or while
+ *               encoding a frame that needs larger output buffers than any
+ *               frame before it.
+ * \return The initialized #daala_enc_ctx handle.
+ * \retval NULL if the encoding parameters were invalid, \a alloc did not
+ *               provide both callbacks, or an allocation failed.*/
+daala_enc_ctx *daala_encode_create_with_allocator(const daala_info *info,
+ const daala_allocator *alloc);
+/**Prepares an encoder instance to encode a new, independent stream, reusing
+ *  all of its memory.
+ * This is much cheaper than freeing the instance and creating a new one.
+ * Afterwards, the instance behaves as if it was just created, except that
+ *  settings made with daala_encode_ctl() are kept: the header packets must
+ *  be retrieved again, and the first frame is a keyframe.
+ * Frames still queued with daala_encode_img_submit() are dropped, and
+ *  their release callbacks invoked.
+ * \param enc  A #daala_enc_ctx handle.
+ * \param info The parameters of the new stream, or <tt>NULL</tt> to keep
+ *              the current ones.
+ *             The picture size must round up to the same frame size (a
+ *              multiple of 32 pixels), and the number of planes and their
+ *              subsampling must be unchanged.
+ * \retval 0         Success.
+ * \retval OD_EFAULT \a enc was <tt>NULL</tt>, or the cache of
+ *                    #OD_SET_MC_SUBPEL_CACHE could not be reallocated, in
+ *                    which case it is turned off.
+ * \retval OD_EINVAL \a info needs buffers of a different size.
+ *                   Create a new instance instead.*/
+int daala_encode_reset(daala_enc_ctx *enc, const daala_info *info);
 /**Encoder control function.
  * This is used to provide advanced control of the encoding process.
  * \param enc A #daala_enc_ctx handle.
@@ -110,9 +186,75 @@ int daala_encode_flush_header(daala_enc_ctx *enc,
  * \retval 0 Success.
  * \retval OD_EFAULT \a enc or \a img was <tt>NULL</tt>.
  * \retval OD_EINVAL The image size does not match the frame size the encoder
- *                   was initialized with, or encoding has already
- *                    completed.*/
+ *                   was initialized with, its layout does not match the one
+ *                    required by #OD_SET_INPUT_PADDED, frames queued with
+ *                    daala_encode_img_submit() are still waiting, or
+ *                    encoding has already completed.*/
 int daala_encode_img_in(daala_enc_ctx *enc, od_img *img, int duration);
+/**Submits the same uncompressed frame to several encoders at once.
+ * This is intended for encoding a quality ladder, where each encoder is
+ *  configured with its own #OD_SET_QUANT (or other settings), but all of them
+ *  compress the same source.
+ * The input frame is copied and padded only once, and that copy is shared by
+ *  all of the encoders (with #OD_SET_INPUT_PADDED, it is padded in place
+ *  and not copied at all).
+ * The source statistics used by the open-loop block-size decision are also
+ *  computed only once.
+ * Everything that depends on an encoder's own reconstruction, such as motion
+ *  estimation and block-size RDO, still runs separately for each encoder, so
+ *  the packets are the same as with daala_encode_img_in().
+ * Each encoder produces its own packets, which must still be retrieved with
+ *  daala_encode_packet_out().
+ * \param encs An array of #daala_enc_ctx handles.
+ *             All of them must have been created with the same frame and
+ *              picture size and plane layout.
+ * \param nencs The number of handles in \a encs.
+ * \param img A buffer of image data to encode.
+ * \param duration The duration to display the frame for, in timebase units.
+ *                 If a non-zero frame duration was specified in the header,
+ *                  then this parameter is ignored.
+ * \retval 0 Success.
+ * \retval OD_EFAULT \a encs, one of its elements, or \a img was
+ *                    <tt>NULL</tt>, or \a nencs was not positive.
+ * \retval OD_EINVAL The image size does not match the frame size the encoders
+ *                    were initialized with, the encoders do not all share
+ *                    the same frame size, or encoding has already completed
+ *                    for one of them.
+ *                   In this case no encoder consumes the frame.*/
+int daala_encode_img_in_multi(daala_enc_ctx **encs, int nencs, od_img *img,
+ int duration);
+/**Queues an uncompressed frame to be encoded, without copying it.
+ * The frame is encoded by a later call to daala_encode_packet_out(), once
+ *  the packets of all the frames queued before it have been retrieved.
+ * Until then, the caller must not modify or free the image data.
+ * The frame cannot be mixed with ones submitted with daala_encode_img_in()
+ *  while it is still queued.
+ * \param enc A #daala_enc_ctx handle.
+ * \param img A buffer of image data to encode.
+ *            The structure itself is copied, so it need not outlive this
+ *             call.
+ * \param duration The duration to display the frame for, in timebase units.
+ *                 If a non-zero frame duration was specified in the header,
+ *                  then this parameter is ignored.
+ * \param flags #OD_SUBMIT_PADDED if the image is already laid out like the
+ *               encoder's own input buffer, or 0 to have it copied into that
+ *               buffer when it is encoded.
+ * \param release The callback to invoke once the encoder is done reading the
+ *                 image data, or <tt>NULL</tt> for none.
+ *                This happens inside daala_encode_packet_out(), as soon as the
+ *                 frame has been copied or, with #OD_SUBMIT_PADDED, encoded,
+ *                 or inside daala_encode_reset() or daala_encode_free() if
+ *                 the frame is dropped.
+ *                The structure is copied, so it need not outlive this call.
+ * \retval 0 Success.
+ * \retval OD_EFAULT \a enc or \a img was <tt>NULL</tt>.
+ * \retval OD_EINVAL The image size or layout does not match the frame size
+ *                    the encoder was initialized with, #OD_SUBMIT_QUEUE_MAX
+ *                    frames are already queued, or encoding has already
+ *                    completed.
+ *                   In this case the release callback is not invoked.*/
+int daala_encode_img_submit(daala_enc_ctx *enc, od_img *img, int duration,
+ int flags, const daala_img_release *release);
 /**Retrieves encoded video data packets.
  * This should be called repeatedly after each frame is submitted to flush any
  *  encoded packets, until it returns 0.
@@ -121,10 +263,14 @@ int daala_encode_img_in(daala_enc_ctx *enc, od_img *img, int duration);
  * \note Current the encoder operates in a one-frame-in, one-packet-out
  *        manner.
  *       However, this may be changed in the future.
+ * If frames were queued with daala_encode_img_submit(), each call that
+ *  finds no packet ready encodes the next one of them, so this should be
+ *  called until it returns 0 to drain the queue.
  * \param enc A #daala_enc_ctx handle.
  * \param last Set this flag to a non-zero value if no more uncompressed
  *              frames will be submitted.
  *             This ensures that a proper EOS flag is set on the last packet.
+ *             It only takes effect on the packet of the last queued frame.
  * \param op An <tt>ogg_packet</tt> structure to fill.
  *           All of the elements of this structure will be set, including a
  *            pointer to the video data.
@@ -137,6 +283,8 @@ int daala_encode_img_in(daala_enc_ctx *enc, od_img *img, int duration);
 int daala_encode_packet_out(daala_enc_ctx *enc,
  int last, ogg_packet *op);
 /**Frees an allocated encoder instance.
+ * Frames still queued with daala_encode_img_submit() are dropped, and their
+ *  release callbacks invoked.
  * \param enc A #daala_enc_ctx handle.*/
 void daala_encode_free(daala_enc_ctx *enc);
 /*@}*/
@@ -174,6 +322,68 @@ void daala_encode_free(daala_enc_ctx *enc);
  * \param[in]  _buf <tt>int</tt>: 0 => flat quantization matrix,
  *                   1 => HVS (the default). */
 #define OD_SET_QM 4008
+/** Set the time of the first frame, in timebase units.
+ * This lets a stream be encoded in independent chunks that start at
+ *  keyframes, each with its own encoder, e.g. on several threads.
+ * A chunk encoder must be created with the same #daala_info as the others,
+ *  and its start time must be a multiple of the keyframe rate.
+ * It then places keyframes and computes the <tt>granulepos</tt> of its
+ *  packets exactly as a single encoder for the whole stream would, so the
+ *  packets of all the chunks can simply be concatenated in order (using the
+ *  header packets of any one of the encoders).
+ * This must be set before the first frame is submitted.
+ * \param[in]  _buf <tt>int64_t</tt>: The time of the first frame.
+ * \retval OD_EINVAL The time was negative or not a multiple of the keyframe
+ *                    rate, or a frame has already been submitted. */
+#define OD_SET_START_TIME 4010
+/** Set a per-frame time budget for real-time encoding.
+ * The encoder measures the wall-clock time it spends on each frame and
+ *  lowers the complexity it uses for the following frames when a frame
+ *  overruns the budget.
+ * Past complexity 0, it further limits the sub-pel motion search to 1/4 and
+ *  then 1/2 pel.
+ * Once several frames in a row finish with time to spare, it raises the
+ *  complexity again, up to the level set with #OD_SET_COMPLEXITY.
+ * To target a frame rate, use a budget of 1000000/fps.
+ * This changes the encoded bitstream from one run to the next, since it
+ *  depends on the load of the host.
+ * \see OD_GET_FRAME_COMPLEXITY
+ * \param[in]  _buf <tt>int</tt>: The budget in microseconds, or 0 to always
+ *                   use the configured complexity (the default).
+ * \retval OD_EINVAL The budget was negative. */
+#define OD_SET_FRAME_DEADLINE 4012
+/** Get the complexity level used for the last encoded frame.
+ * This is the level set with #OD_SET_COMPLEXITY unless a budget was set with
+ *  #OD_SET_FRAME_DEADLINE, in which case it may be lower.
+ * \param[out] _buf <tt>int</tt>: Returns a value in the range 0...10,
+ *                   inclusive. */
+#define OD_GET_FRAME_COMPLEXITY 4014
+/** Get where the bits of the last encoded frame went, by technique, plane
+ *  and superblock.
+ * The counts come from the position of the entropy coder after each
+ *  symbol, so they add up to the size it reports for the frame, which can
+ *  be a few bits short of the final packet size.
+ * This is only available if the library was built with bit accounting
+ *  enabled.
+ * \param[out] _buf #daala_accounting: Returns the counts for the last frame.
+ *                   The arrays it points to remain valid until the next
+ *                   frame is encoded.
+ * \retval OD_EIMPL The library was built without bit accounting. */
+#define OD_GET_ACCOUNTING 4016
+/** Get the padding the encoder keeps around each side of its input frame,
+ *  for laying out images submitted with #OD_SUBMIT_PADDED.
+ * \param[out] _buf <tt>int</tt>: Returns the padding in luma pixels. */
+#define OD_GET_INPUT_PADDING 4018
+/** Whether daala_encode_img_in() and daala_encode_img_in_multi() should read
+ *  the caller's image in place instead of copying it into the encoder's own
+ *  input buffer.
+ * The image must then be laid out as described for #OD_SUBMIT_PADDED, and
+ *  the encoder overwrites its padding.
+ * For daala_encode_img_in_multi(), the setting of the first encoder applies.
+ * This does not change the encoded bitstream.
+ * \param[in]  _buf <tt>int</tt>: 0 to copy the input (the default), a
+ *                   non-zero value to read it in place. */
+#define OD_SET_INPUT_PADDED 4020
 
 /** Whether the motion compensation search should use the chroma planes in
     addition to the luma plane.
@@ -198,6 +408,21 @@ void daala_encode_free(daala_enc_ctx *enc);
  * \param[in]  _buf <tt>int</tt>: 0 to disable the use of SATD (the default),
  *                   a non-zero value otherwise. */
 #define OD_SET_MC_USE_SATD 4108
+/** Whether the motion compensation search should interpolate each sub-pel
+ *  phase of the luma reference plane once per frame and reuse it for every
+ *  candidate, instead of filtering each candidate block separately.
+ * Each phase is stored in its own plane of the frame size plus 16 pixels
+ *  on each side.
+ * These are allocated by this call, for every phase allowed by the current
+ *  #OD_SET_MV_RES_MIN: 63 planes with 0 (1/8 pel), 15 with 1 and 3 with 2,
+ *  or over 130 MB for 1080p at 1/8 pel.
+ * Changing #OD_SET_MV_RES_MIN or calling daala_encode_reset() while the
+ *  cache is on reallocates it, and turning it off frees it.
+ * This does not change the encoded bitstream.
+ * \param[in]  _buf <tt>int</tt>: 0 to disable the cache (the default),
+ *                   a non-zero value otherwise.
+ * \retval OD_EFAULT The cache could not be allocated, and is off.*/
+#define OD_SET_MC_SUBPEL_CACHE 4110
 
 /*@}*/
 
@@ -41,12 +41,13 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
   For simply recording the symbol and having no context it would look like:
     od_ec_acct_add_label(&enc->ec.acct, "motion-flags-level-2", 0);
     ...
-    od_ec_acct_record(&enc->ec.acct, "motion-flags-level-2", mvp->valid, 2, 0);
-    od_ec_encode_bool_q15(&enc->ec, mvp->valid, 16384);
+    od_ec_acct_record(&enc->ec.acct, "motion-flags-level-2",
+     valid[vy][vx], 2, 0);
+    od_ec_encode_bool_q15(&enc->ec, valid[vy][vx], 16384);
   Here's an example record cal of the same thing but with 9 contexts:
-   od_ec_acct_record(&enc->ec.acct, "motion-flags-level-4", mvp->valid, 2,
-    3 * (vx > 0 && vy > 0 ? grid[vy - 1][vx - 1].valid : 0)
-     + (vy > 0 ? grid[vy - 1][vx + 1].valid : 0)
+   od_ec_acct_record(&enc->ec.acct, "motion-flags-level-4", valid[vy][vx], 2,
+    3 * (vx > 0 && vy > 0 ? valid[vy - 1][vx - 1] : 0)
+     + (vy > 0 ? valid[vy - 1][vx + 1] : 0)
      + (grid[vy - 1][vx].mv[0] == grid[vy][vx + 1].mv[0] &&
      grid[vy - 1][vx].mv[1] == grid[vy][vx + 1].mv[1])
      + (grid[vy + 1][vx].mv[0] == grid[vy][vx + 1].mv[0] &&
@@ -67,7 +68,8 @@ static const char *OD_ACCT_TECHNIQUE_NAMES[OD_ACCT_NTECHS] = {
   "intra-mode",
   "dc-coeff",
   "ac-coeffs",
-  "motion-vectors"
+  "motion-vectors",
+  "clpf"
 };
 
 static const char *OD_ACCT_PLANE_NAMES[OD_ACCT_NPLANES] = {
@@ -89,34 +91,29 @@ static const unsigned int OD_ACCT_INDICES[OD_ACCT_NCATS] = {
   OD_ACCT_NPLANES
 };
 
-void od_acct_init(od_acct *acct) {
-  char  fname[1024];
-  const char *pre;
-  const char *suf;
-  int   rv;
-  pre = "acct-";
-  suf = getenv("OD_ACCT_SUFFIX");
-  if (!suf) {
-    pre = "acct";
-    suf = "";
-  }
-  rv = snprintf(fname, sizeof(fname), "%s%s.json", pre, suf);
-  (void)rv;
-  OD_ASSERT(rv >= 0 && ((size_t)rv) < sizeof(fname));
-  acct->fp = fopen(fname, "w");
-  OD_ASSERT(acct->fp);
-  od_acct_reset(acct);
+int od_acct_init(od_acct *acct, int nhsb, int nvsb,
+ const daala_allocator *alloc) {
+  acct->alloc = alloc;
+  acct->nhsb = nhsb;
+  acct->nvsb = nvsb;
+  acct->sb_frac_bits = (uint32_t *)od_malloc(alloc,
+   sizeof(*acct->sb_frac_bits)*nhsb*nvsb*OD_ACCT_NTECHS);
+  if (OD_UNLIKELY(!acct->sb_frac_bits)) return OD_EFAULT;
+  acct->paused = 0;
+  od_acct_reset(acct, 0);
+  return 0;
 }
 
 void od_acct_clear(od_acct *acct) {
-  OD_ASSERT(acct->fp);
-  fclose(acct->fp);
+  od_free(acct->alloc, acct->sb_frac_bits);
+  acct->sb_frac_bits = NULL;
 }
 
-void od_acct_reset(od_acct *acct) {
+/*Starts counting a new frame with the entropy coder at position
+   frac_bits.*/
+void od_acct_reset(od_acct *acct, uint32_t frac_bits) {
   int i;
-  /* Calling od_ec_enc_tell_frac() on a reset od_ec_enc struct returns 8. */
-  acct->last_frac_bits = 8;
+  acct->last_frac_bits = frac_bits;
   /* Set the initial state for each category to unknown. */
   for (i = 0; i < OD_ACCT_NCATS; i++) {
     acct->state[i] = 0;
@@ -124,6 +121,8 @@ void od_acct_reset(od_acct *acct) {
   for (i = 0; i < OD_ACCT_SIZE; i++) {
     acct->frac_bits[i] = 0;
   }
+  acct->sbi = -1;
+  OD_CLEAR(acct->sb_frac_bits, acct->nhsb*acct->nvsb*OD_ACCT_NTECHS);
 }
 
 static int od_acct_index(unsigned int state[OD_ACCT_NCATS]) {
@@ -131,15 +130,20 @@ static int od_acct_index(unsigned int state[OD_ACCT_NCATS]) {
   int cat;
   index = state[0];
   for (cat = (int)OD_ACCT_CAT_PLANE; cat < OD_ACCT_NCATS; cat++) {
-    index = (index*OD_ACCT_INDICES[OD_ACCT_NCATS - cat]) + state[cat];
+    index = (index*OD_ACCT_INDICES[cat]) + state[cat];
   }
   return index;
 }
 
 void od_acct_update_frac_bits(od_acct *acct, uint32_t frac_bits) {
   uint32_t frac_bits_diff;
+  if (acct->paused) return;
   frac_bits_diff = frac_bits - acct->last_frac_bits;
   acct->frac_bits[od_acct_index(acct->state)] += frac_bits_diff;
+  if (acct->sbi >= 0) {
+    acct->sb_frac_bits[acct->sbi*OD_ACCT_NTECHS
+     + acct->state[OD_ACCT_CAT_TECHNIQUE]] += frac_bits_diff;
+  }
   acct->last_frac_bits = frac_bits;
 }
 
@@ -156,6 +160,45 @@ void od_acct_update(od_acct *acct, uint32_t frac_bits,
   od_acct_set_category(acct, cat, value);
 }
 
+/*Charges the following bits to superblock sbi, or to no superblock if sbi
+   is negative.*/
+void od_acct_set_sb(od_acct *acct, uint32_t frac_bits, int sbi) {
+  OD_ASSERT(sbi < acct->nhsb*acct->nvsb);
+  od_acct_update_frac_bits(acct, frac_bits);
+  acct->sbi = sbi;
+}
+
+/*Charges the bits coded up to position frac_bits, then stops counting bits
+   until od_acct_resume().
+  The categories can still be changed in the meantime.
+  This lets the encoder run trial encodes that it rolls back afterwards.*/
+void od_acct_pause(od_acct *acct, uint32_t frac_bits) {
+  od_acct_update_frac_bits(acct, frac_bits);
+  acct->paused = 1;
+}
+
+/*Resumes counting bits from entropy coder position frac_bits.*/
+void od_acct_resume(od_acct *acct, uint32_t frac_bits) {
+  acct->paused = 0;
+  acct->last_frac_bits = frac_bits;
+}
+
+static uint32_t od_acct_total(const od_acct *acct) {
+  uint32_t total;
+  int i;
+  total = 0;
+  for (i = 0; i < OD_ACCT_SIZE; i++) total += acct->frac_bits[i];
+  return total;
+}
+
+void od_acct_export(const od_acct *acct, daala_accounting *out) {
+  out->total = od_acct_total(acct);
+  out->frac_bits = acct->frac_bits;
+  out->nhsb = acct->nhsb;
+  out->nvsb = acct->nvsb;
+  out->sb_frac_bits = acct->sb_frac_bits;
+}
+
 static int od_acct_next_state(unsigned int state[OD_ACCT_NCATS],
  int skip) {
   int i;
@@ -214,33 +257,32 @@ void od_acct_print(od_acct *acct, FILE *_fp) {
   while (od_acct_next_state(state, OD_ACCT_NCATS));
 }
 
-void od_acct_write(od_acct *acct, int64_t cur_time) {
+void od_acct_write(od_acct *acct, FILE *_fp, int64_t cur_time) {
   int cat;
   unsigned int value;
   long fsize;
-  OD_ASSERT(acct->fp);
-  fsize = ftell(acct->fp);
+  fsize = ftell(_fp);
   if (fsize == 0) {
-    fprintf(acct->fp, "[");
+    fprintf(_fp, "[");
   }
   else {
-    fseek(acct->fp, fsize - 1, SEEK_SET);
-    fprintf(acct->fp, ",\n");
+    fseek(_fp, fsize - 1, SEEK_SET);
+    fprintf(_fp, ",\n");
   }
-  fprintf(acct->fp, "{\n");
-  fprintf(acct->fp, "  \"frame\": %" OD_I64FMT ",\n", (long long)cur_time);
-  fprintf(acct->fp, "  \"total\": %u,\n", acct->last_frac_bits-8);
+  fprintf(_fp, "{\n");
+  fprintf(_fp, "  \"frame\": %" OD_I64FMT ",\n", (long long)cur_time);
+  fprintf(_fp, "  \"total\": %u,\n", od_acct_total(acct));
   for (cat = 0; cat < OD_ACCT_NCATS; cat++) {
-    fprintf(acct->fp, "%s  \"%s\": {\n", cat > 0 ? ",\n" : "",
+    fprintf(_fp, "%s  \"%s\": {\n", cat > 0 ? ",\n" : "",
      OD_ACCT_CATEGORY_NAMES[cat]);
     for (value = 0; value < OD_ACCT_INDICES[cat]; value++) {
-      fprintf(acct->fp, "%s    \"%s\": %i", value > 0 ? ",\n" : "",
+      fprintf(_fp, "%s    \"%s\": %i", value > 0 ? ",\n" : "",
        OD_ACCT_CATEGORY_VALUE_NAMES[cat][value],
        od_acct_get_total(acct, cat, value));
     }
-    fprintf(acct->fp, "\n  }");
+    fprintf(_fp, "\n  }");
   }
-  fprintf(acct->fp, "\n}]");
+  fprintf(_fp, "\n}]");
 }
 
 void od_ec_acct_init(od_ec_acct *acct) {
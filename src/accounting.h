@@ -36,61 +36,69 @@ enum od_acct_category {
 
 typedef enum od_acct_category od_acct_category;
 
-enum od_acct_technique {
-  OD_ACCT_TECH_UNKNOWN = 0,
-  OD_ACCT_TECH_FRAME = 1,
-  OD_ACCT_TECH_BLOCK_SIZE = 2,
-  OD_ACCT_TECH_INTRA_MODE = 3,
-  OD_ACCT_TECH_DC_COEFF = 4,
-  OD_ACCT_TECH_AC_COEFFS = 5,
-  OD_ACCT_TECH_MOTION_VECTORS = 6,
-  OD_ACCT_NTECHS
-};
-
-typedef enum od_acct_technique od_acct_technique;
-
-enum od_acct_plane {
-  OD_ACCT_PLANE_UNKNOWN = 0,
-  OD_ACCT_PLANE_FRAME = 1,
-  OD_ACCT_PLANE_LUMA = 2,
-  OD_ACCT_PLANE_CB = 3,
-  OD_ACCT_PLANE_CR = 4,
-  OD_ACCT_PLANE_ALPHA = 5,
-  OD_ACCT_NPLANES
-};
-
-typedef enum od_acct_plane od_acct_plane;
-
-/*typedef enum od_acct_band od_acct_band;*/
+/*The techniques and planes (OD_ACCT_TECH_* and OD_ACCT_PLANE_*) are defined
+   in codec.h, since the counts are exported through the public API.*/
 
 #if defined(OD_ACCOUNTING)
 # define OD_ACCT_UPDATE(acct, frac_bits, cat, value) \
  od_acct_update(acct, frac_bits, cat, value)
+# define OD_ACCT_SET_CATEGORY(acct, cat, value) \
+ od_acct_set_category(acct, cat, value)
+# define OD_ACCT_SET_SB(acct, frac_bits, sbi) \
+ od_acct_set_sb(acct, frac_bits, sbi)
+# define OD_ACCT_RESET(acct, frac_bits) od_acct_reset(acct, frac_bits)
+# define OD_ACCT_PAUSE(acct, frac_bits) od_acct_pause(acct, frac_bits)
+# define OD_ACCT_RESUME(acct, frac_bits) od_acct_resume(acct, frac_bits)
 #else
 # define OD_ACCT_UPDATE(acct, frac_bits, cat, value)
+# define OD_ACCT_SET_CATEGORY(acct, cat, value)
+# define OD_ACCT_SET_SB(acct, frac_bits, sbi)
+# define OD_ACCT_RESET(acct, frac_bits)
+# define OD_ACCT_PAUSE(acct, frac_bits)
+# define OD_ACCT_RESUME(acct, frac_bits)
 #endif
 
 #define OD_ACCT_SIZE (OD_ACCT_NTECHS*OD_ACCT_NPLANES)
 
 typedef struct od_acct od_acct;
 
+/*Attributes the bits of a frame to the current value of each category as
+   the entropy coder position moves forward.
+  Each update charges everything coded since the previous update to the
+   categories in effect until then, so a symbol is counted under the
+   categories set before it was coded.*/
 struct od_acct {
-  FILE *fp;
+  /*The allocator sb_frac_bits comes from.*/
+  const daala_allocator *alloc;
+  /*The entropy coder position at the last update, in 1/8th bits.*/
   uint32_t last_frac_bits;
   unsigned int state[OD_ACCT_NCATS];
   uint32_t frac_bits[OD_ACCT_SIZE];
+  /*The superblock being coded, or -1 outside of any superblock.*/
+  int sbi;
+  int nhsb;
+  int nvsb;
+  /*The bits of each superblock by technique, nhsb*nvsb*OD_ACCT_NTECHS.*/
+  uint32_t *sb_frac_bits;
+  /*Set while the encoder codes symbols it will roll back.*/
+  int paused;
 };
 
-void od_acct_init(od_acct *acct);
+int od_acct_init(od_acct *acct, int nhsb, int nvsb,
+ const daala_allocator *alloc);
 void od_acct_clear(od_acct *acct);
-void od_acct_reset(od_acct *acct);
+void od_acct_reset(od_acct *acct, uint32_t frac_bits);
 void od_acct_update_frac_bits(od_acct *acct, uint32_t frac_bits);
 void od_acct_set_category(od_acct *acct, od_acct_category cat,
  unsigned int value);
 void od_acct_update(od_acct *acct, uint32_t frac_bits,
  od_acct_category cat, unsigned int value);
+void od_acct_set_sb(od_acct *acct, uint32_t frac_bits, int sbi);
+void od_acct_pause(od_acct *acct, uint32_t frac_bits);
+void od_acct_resume(od_acct *acct, uint32_t frac_bits);
+void od_acct_export(const od_acct *acct, daala_accounting *out);
 void od_acct_print(od_acct *acct, FILE *_fp);
-void od_acct_write(od_acct *acct, int64_t cur_time);
+void od_acct_write(od_acct *acct, FILE *_fp, int64_t cur_time);
 
 typedef struct od_ec_acct_data od_ec_acct_data;
 
@@ -0,0 +1,193 @@
+/*Daala video codec
+Copyright (c) 2016 Daala project contributors.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+- Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+- Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+
+#if defined(HAVE_CONFIG_H)
+# include "config.h"
+#endif
+
+#include <arm_neon.h>
+#include "armint.h"
+#include "../filter.h"
+
+/*Filters four pixels with the constrained lowpass filter, given their four
+   neighbors.*/
+OD_SIMD_INLINE int32x4_t od_clpf_kernel_neon(int32x4_t x, int32x4_t a,
+ int32x4_t b, int32x4_t c, int32x4_t d) {
+  int32x4_t sum;
+  int32x4_t delta;
+  uint32x4_t off;
+  sum = vaddq_s32(vaddq_s32(a, b), vaddq_s32(c, d));
+  sum = vsubq_s32(sum, vshlq_n_s32(x, 2));
+  delta = vabsq_s32(sum);
+  /*Turn off the filter above a threshold of 16 pixels.*/
+  off = vcgtq_s32(delta, vdupq_n_s32(16 << OD_COEFF_SHIFT));
+  delta = vshrq_n_s32(vaddq_s32(delta, vdupq_n_s32(2)), 2);
+  delta = vminq_s32(delta, vdupq_n_s32(1 << OD_COEFF_SHIFT));
+  delta = vbslq_s32(off, vdupq_n_s32(0), delta);
+  delta = vbslq_s32(vcltq_s32(sum, vdupq_n_s32(0)), vnegq_s32(delta), delta);
+  return vaddq_s32(x, delta);
+}
+
+/*Filters one row of n >= 8 pixels.
+  a and d are the rows above and below, which the caller points back at x on
+   the frame edges.
+  The left and right frame edges are only checked outside the inner loop, by
+   duplicating the edge pixel into the missing neighbor.*/
+static void od_clpf_row_neon(od_coeff *y, const od_coeff *x,
+ const od_coeff *a, const od_coeff *d, int n, int left, int right) {
+  int32x4_t xx;
+  int32x4_t bb;
+  int32x4_t cc;
+  int j;
+  xx = vld1q_s32(x);
+  if (left) bb = vextq_s32(vdupq_n_s32(x[0]), xx, 3);
+  else bb = vld1q_s32(x - 1);
+  cc = vld1q_s32(x + 1);
+  vst1q_s32(y, od_clpf_kernel_neon(xx, vld1q_s32(a), bb, cc, vld1q_s32(d)));
+  for (j = 4; j < n - 4; j += 4) {
+    xx = vld1q_s32(x + j);
+    bb = vld1q_s32(x + j - 1);
+    cc = vld1q_s32(x + j + 1);
+    vst1q_s32(y + j, od_clpf_kernel_neon(xx, vld1q_s32(a + j), bb, cc,
+     vld1q_s32(d + j)));
+  }
+  xx = vld1q_s32(x + j);
+  bb = vld1q_s32(x + j - 1);
+  if (right) cc = vextq_s32(xx, vdupq_n_s32(x[j + 3]), 1);
+  else cc = vld1q_s32(x + j + 1);
+  vst1q_s32(y + j, od_clpf_kernel_neon(xx, vld1q_s32(a + j), bb, cc,
+   vld1q_s32(d + j)));
+}
+
+void od_clpf_neon(od_coeff *y, int ystride, const od_coeff *x, int xstride,
+ int ln, int sbx, int sby, int nhsb, int nvsb) {
+  int i;
+  int n;
+  n = 1 << ln;
+  if (n < 8) {
+    od_clpf_c(y, ystride, x, xstride, ln, sbx, sby, nhsb, nvsb);
+    return;
+  }
+  for (i = 0; i < n; i++) {
+    const od_coeff *row;
+    row = x + i*xstride;
+    od_clpf_row_neon(y + i*ystride, row,
+     sby > 0 || i > 0 ? row - xstride : row,
+     sby < nvsb - 1 || i < n - 1 ? row + xstride : row,
+     n, sbx == 0, sbx == nhsb - 1);
+  }
+#if defined(OD_CHECKASM)
+  {
+    od_coeff ref[OD_BSIZE_MAX*OD_BSIZE_MAX];
+    od_clpf_c(ref, OD_BSIZE_MAX, x, xstride, ln, sbx, sby, nhsb, nvsb);
+    od_filter_check("od_clpf", ref, OD_BSIZE_MAX, y, ystride, n);
+  }
+#endif
+}
+
+/*Evaluates four pixels of the bilinear surface of a row.
+  jj holds the column indices, base the terms that are constant along the
+   row, and ia3 the x*y coefficient already multiplied by the row index.
+  shift holds -ln, since NEON shifts right by negative left shifts.*/
+OD_SIMD_INLINE int32x4_t od_bilinear_pred_neon(int32x4_t jj, int32x4_t a0,
+ int32x4_t a1, int32x4_t ia3, int32x4_t base, int32x4_t shift) {
+  int32x4_t t;
+  t = vshlq_s32(vmulq_s32(jj, ia3), shift);
+  t = vaddq_s32(vaddq_s32(vmulq_s32(jj, a1), base), t);
+  return vaddq_s32(a0, vshlq_s32(t, shift));
+}
+
+/*The bilinear surface is recomputed on the second pass instead of being
+   stored, which avoids the intermediate block buffer of the C version.*/
+void od_bilinear_smooth_neon(od_coeff *x, int ln, int stride, int q,
+ int pli) {
+  static const int32_t OD_COLUMNS[4] = {0, 1, 2, 3};
+  od_coeff a[4];
+  int32x4_t a0;
+  int32x4_t a1;
+  int32x4_t shift;
+  int32x4_t dist;
+  int32x2_t dist2;
+  int32x4_t ww;
+  int32x4_t jj;
+  int w;
+  int i;
+  int j;
+  int n;
+#if defined(OD_CHECKASM)
+  od_coeff ref[OD_BSIZE_MAX*OD_BSIZE_MAX];
+#endif
+  n = 1 << ln;
+  if (n < 4) {
+    od_bilinear_smooth_c(x, ln, stride, q, pli);
+    return;
+  }
+#if defined(OD_CHECKASM)
+  for (i = 0; i < n; i++) OD_COPY(ref + i*OD_BSIZE_MAX, x + i*stride, n);
+  od_bilinear_smooth_c(ref, ln, OD_BSIZE_MAX, q, pli);
+#endif
+  od_bilinear_smooth_coeffs(a, x, ln, stride);
+  a0 = vdupq_n_s32(a[0]);
+  a1 = vdupq_n_s32(a[1]);
+  shift = vdupq_n_s32(-ln);
+  dist = vdupq_n_s32(0);
+  for (i = 0; i < n; i++) {
+    int32x4_t base;
+    int32x4_t ia3;
+    base = vdupq_n_s32(i*a[2] + n/2);
+    ia3 = vdupq_n_s32(i*a[3]);
+    jj = vld1q_s32(OD_COLUMNS);
+    for (j = 0; j < n; j += 4) {
+      int32x4_t diff;
+      diff = vsubq_s32(od_bilinear_pred_neon(jj, a0, a1, ia3, base, shift),
+       vld1q_s32(x + i*stride + j));
+      dist = vmlaq_s32(dist, diff, diff);
+      jj = vaddq_s32(jj, vdupq_n_s32(4));
+    }
+  }
+  dist2 = vadd_s32(vget_low_s32(dist), vget_high_s32(dist));
+  dist2 = vpadd_s32(dist2, dist2);
+  w = od_bilinear_smooth_weight(vget_lane_s32(dist2, 0) >> 2*ln, q, pli);
+  ww = vdupq_n_s32(w);
+  for (i = 0; i < n; i++) {
+    int32x4_t base;
+    int32x4_t ia3;
+    base = vdupq_n_s32(i*a[2] + n/2);
+    ia3 = vdupq_n_s32(i*a[3]);
+    jj = vld1q_s32(OD_COLUMNS);
+    for (j = 0; j < n; j += 4) {
+      int32x4_t xx;
+      int32x4_t t;
+      xx = vld1q_s32(x + i*stride + j);
+      t = vsubq_s32(xx, od_bilinear_pred_neon(jj, a0, a1, ia3, base, shift));
+      t = vmlaq_s32(vdupq_n_s32(128), ww, t);
+      vst1q_s32(x + i*stride + j, vsubq_s32(xx, vshrq_n_s32(t, 8)));
+      jj = vaddq_s32(jj, vdupq_n_s32(4));
+    }
+  }
+#if defined(OD_CHECKASM)
+  od_filter_check("od_bilinear_smooth", ref, OD_BSIZE_MAX, x, stride, n);
+#endif
+}
@@ -38,5 +38,9 @@ void od_bin_fdct4x4_neon(od_coeff *y, int ystride,
  const od_coeff *x, int xstride);
 void od_bin_idct4x4_neon(od_coeff *y, int ystride,
  const od_coeff *x, int xstride);
+void od_clpf_neon(od_coeff *y, int ystride, const od_coeff *x, int xstride,
+ int ln, int sbx, int sby, int nhsb, int nvsb);
+void od_bilinear_smooth_neon(od_coeff *x, int ln, int stride, int q,
+ int pli);
 
 #endif
@@ -34,6 +34,8 @@ void od_state_opt_vtbl_init_arm(od_state *_state){
   od_state_opt_vtbl_init_c(_state);
   _state->cpu_flags=od_cpu_flags_get();
   if(_state->cpu_flags&OD_CPU_ARM_NEON){
+    _state->opt_vtbl.clpf = od_clpf_neon;
+    _state->opt_vtbl.bilinear_smooth = od_bilinear_smooth_neon;
   }
 }
 
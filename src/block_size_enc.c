@@ -46,90 +46,216 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
    used to square integers, but not circles. */
 #define OD_SQUARE(x) ((int)(x)*(int)(x))
 
-/* Compute statistics used to determine how to split a superblock.
- * @param [in]      img    Image on which to compute the statistics, a margin
- *                          of OD_MAX_OVERLAP pixels is required around the
- *                          superblock
- * @param [in]      stride Image stride
- * @param [out]     stats  Computed statistics
- */
-static void od_compute_stats(const signed char *img, int stride,
- od_superblock_stats *stats) {
-  const signed char *x;
-  int i;
-  int j;
-  int off8;
-  int32_t (*Sx2)[OD_SIZE2_SUMS];
-  int32_t (*Sxx2)[OD_SIZE2_SUMS];
-  int32_t (*Sx4)[OD_SIZE4_SUMS];
-  int32_t (*Sxx4)[OD_SIZE4_SUMS];
-  int32_t (*Sx8)[OD_SIZE8_SUMS];
-  int32_t (*Sxx8)[OD_SIZE8_SUMS];
-  int32_t (*Var4)[OD_SIZE4_SUMS];
-  int32_t (*invVar4)[OD_SIZE4_SUMS];
-  int32_t (*Var8)[OD_SIZE8_SUMS];
-  int32_t (*invVar8)[OD_SIZE8_SUMS];
+int od_block_size_comp_init(od_block_size_comp *bs, int nhsb, int nvsb,
+ const daala_allocator *alloc) {
+  size_t size2;
+  size_t size4;
+  size_t size8;
+  OD_CLEAR(bs, 1);
+  bs->alloc = alloc;
+  bs->nhsb = nhsb;
+  bs->nvsb = nvsb;
+  size2 = OD_FRAME_SIZE2_SUMS(nhsb)*(size_t)OD_FRAME_SIZE2_SUMS(nvsb);
+  size4 = OD_FRAME_SIZE4_SUMS(nhsb)*(size_t)OD_FRAME_SIZE4_SUMS(nvsb);
+  size8 = OD_FRAME_SIZE8_SUMS(nhsb)*(size_t)OD_FRAME_SIZE8_SUMS(nvsb);
+  bs->Sx2 = (int32_t *)od_malloc(alloc, sizeof(*bs->Sx2)*size2);
+  bs->Sxx2 = (int32_t *)od_malloc(alloc, sizeof(*bs->Sxx2)*size2);
+  bs->psy_frame.Var4 = (int32_t *)od_malloc(alloc, sizeof(int32_t)*size4);
+  bs->psy_frame.invVar4 = (int32_t *)od_malloc(alloc, sizeof(int32_t)*size4);
+  bs->psy_frame.Var8 = (int32_t *)od_malloc(alloc, sizeof(int32_t)*size8);
+  bs->psy_frame.invVar8 = (int32_t *)od_malloc(alloc, sizeof(int32_t)*size8);
+  bs->img_frame.Var4 = (int32_t *)od_malloc(alloc, sizeof(int32_t)*size4);
+  bs->img_frame.invVar4 = (int32_t *)od_malloc(alloc, sizeof(int32_t)*size4);
+  bs->img_frame.Var8 = (int32_t *)od_malloc(alloc, sizeof(int32_t)*size8);
+  bs->img_frame.invVar8 = (int32_t *)od_malloc(alloc, sizeof(int32_t)*size8);
+  if (OD_UNLIKELY(!bs->Sx2 || !bs->Sxx2
+   || !bs->psy_frame.Var4 || !bs->psy_frame.invVar4
+   || !bs->psy_frame.Var8 || !bs->psy_frame.invVar8
+   || !bs->img_frame.Var4 || !bs->img_frame.invVar4
+   || !bs->img_frame.Var8 || !bs->img_frame.invVar8)) {
+    od_block_size_comp_clear(bs);
+    return OD_EFAULT;
+  }
+  return OD_SUCCESS;
+}
 
-  Sx2 = stats->Sx2;
-  Sxx2 = stats->Sxx2;
-  Sx4 = stats->Sx4;
-  Sxx4 = stats->Sxx4;
-  Sx8 = stats->Sx8;
-  Sxx8 = stats->Sxx8;
-  Var4 = stats->Var4;
-  invVar4 = stats->invVar4;
-  Var8 = stats->Var8;
-  invVar8 = stats->invVar8;
+void od_block_size_comp_clear(od_block_size_comp *bs) {
+  od_free(bs->alloc, bs->Sx2);
+  od_free(bs->alloc, bs->Sxx2);
+  od_free(bs->alloc, bs->psy_frame.Var4);
+  od_free(bs->alloc, bs->psy_frame.invVar4);
+  od_free(bs->alloc, bs->psy_frame.Var8);
+  od_free(bs->alloc, bs->psy_frame.invVar8);
+  od_free(bs->alloc, bs->img_frame.Var4);
+  od_free(bs->alloc, bs->img_frame.invVar4);
+  od_free(bs->alloc, bs->img_frame.Var8);
+  od_free(bs->alloc, bs->img_frame.invVar8);
+  OD_CLEAR(bs, 1);
+}
 
-  x = img - OD_BLOCK_OFFSET(stride);
-  for (i = 0; i < OD_SIZE2_SUMS; i++) {
-    for (j = 0; j < OD_SIZE2_SUMS; j++) {
-      Sx2[i][j] = x[2*j] + x[2*j + 1] + x[2*j + stride] + x[2*j+stride + 1];
-      Sxx2[i][j] = OD_SQUARE(x[2*j]) + OD_SQUARE(x[2*j + 1])
-       + OD_SQUARE(x[2*j + stride]) + OD_SQUARE(x[2*j + stride + 1]);
+void od_bs_sums_2x2_c(int32_t *sx2, int32_t *sxx2,
+ const unsigned char *img, int istride, const unsigned char *pred,
+ int pstride, int n) {
+  int j;
+  if (pred == NULL) {
+    for (j = 0; j < n; j++) {
+      int a;
+      int b;
+      int c;
+      int d;
+      a = img[2*j] - 128;
+      b = img[2*j + 1] - 128;
+      c = img[2*j + istride] - 128;
+      d = img[2*j + istride + 1] - 128;
+      sx2[j] = a + b + c + d;
+      sxx2[j] = OD_SQUARE(a) + OD_SQUARE(b) + OD_SQUARE(c) + OD_SQUARE(d);
     }
-    x += 2*stride;
   }
-  for (i = 0; i < OD_SIZE4_SUMS; i++) {
-    for (j = 0; j < OD_SIZE4_SUMS; j++) {
-      Sx4[i][j] = Sx2[i][j] + Sx2[i][j + 1]
-       + Sx2[i + 1][j] + Sx2[i + 1][j + 1];
-      Sxx4[i][j] = Sxx2[i][j] + Sxx2[i][j + 1]
-       + Sxx2[i + 1][j] + Sxx2[i + 1][j + 1];
+  else {
+    for (j = 0; j < n; j++) {
+      int a;
+      int b;
+      int c;
+      int d;
+      a = OD_CLAMPI(-128, img[2*j] - pred[2*j], 127);
+      b = OD_CLAMPI(-128, img[2*j + 1] - pred[2*j + 1], 127);
+      c = OD_CLAMPI(-128, img[2*j + istride] - pred[2*j + pstride], 127);
+      d = OD_CLAMPI(-128,
+       img[2*j + istride + 1] - pred[2*j + pstride + 1], 127);
+      sx2[j] = a + b + c + d;
+      sxx2[j] = OD_SQUARE(a) + OD_SQUARE(b) + OD_SQUARE(c) + OD_SQUARE(d);
     }
   }
-  off8 = OD_MAX_OVERLAP - 2*OD_MAX_OVERLAP_8;
-  OD_ASSERT(off8 >= 0);
-  for (i = 0; i < OD_SIZE8_SUMS; i++) {
-    for (j = 0; j < OD_SIZE8_SUMS; j++) {
-      Sx8[i][j] = Sx4[2*i + off8][2*j+off8] + Sx4[2*i + off8][2*j + 2 + off8]
-       + Sx4[2*i + 2 + off8][2*j + off8] + Sx4[2*i + 2 + off8][2*j + 2 + off8];
-      Sxx8[i][j] = Sxx4[2*i + off8][2*j + off8]
-       + Sxx4[2*i + off8][2*j + 2 + off8]
-       + Sxx4[2*i + 2 + off8][2*j + off8]
-       + Sxx4[2*i + 2 + off8][2*j + 2 + off8];
-    }
+}
+
+/* Compute statistics used to determine how to split the superblocks of a
+ *  plane.
+ * Each 4x4 and 8x8 variance is computed once, even when it lies in the
+ *  margin shared by two superblocks.
+ * @param [in,out]  bs       Block size state, whose Sx2 and Sxx2 are used
+ *                            as scratch space
+ * @param [in]      img      Image on which to compute the statistics, a
+ *                            margin of 2*OD_MAX_OVERLAP pixels is required
+ *                            around the plane
+ * @param [in]      stride   Image stride
+ * @param [in]      pred     Prediction to subtract from img, or NULL
+ * @param [in]      pstride  Prediction stride
+ * @param [in]      sums_2x2 Function computing one row of 2x2 sums
+ * @param [out]     stats    Computed statistics
+ */
+static void od_compute_stats(od_block_size_comp *bs,
+ const unsigned char *img, int stride, const unsigned char *pred, int pstride,
+ od_bs_sums_2x2_func sums_2x2, od_frame_stats *stats) {
+  const int32_t *Sx2;
+  const int32_t *Sxx2;
+  int stride2;
+  int stride4;
+  int stride8;
+  int i;
+  int j;
+  int off8;
+  stride2 = OD_FRAME_SIZE2_SUMS(bs->nhsb);
+  stride4 = OD_FRAME_SIZE4_SUMS(bs->nhsb);
+  stride8 = OD_FRAME_SIZE8_SUMS(bs->nhsb);
+  img -= OD_BLOCK_OFFSET(stride);
+  if (pred != NULL) pred -= OD_BLOCK_OFFSET(pstride);
+  for (i = 0; i < OD_FRAME_SIZE2_SUMS(bs->nvsb); i++) {
+    (*sums_2x2)(bs->Sx2 + i*stride2, bs->Sxx2 + i*stride2,
+     img + 2*i*stride, stride, pred == NULL ? NULL : pred + 2*i*pstride,
+     pstride, stride2);
   }
-  for (i = 0; i < OD_SIZE4_SUMS; i++) {
-    for (j = 0; j < OD_SIZE4_SUMS; j++) {
+  Sx2 = bs->Sx2;
+  Sxx2 = bs->Sxx2;
+  for (i = 0; i < OD_FRAME_SIZE4_SUMS(bs->nvsb); i++) {
+    for (j = 0; j < stride4; j++) {
+      int32_t sx4;
+      int32_t sxx4;
+      int32_t var;
       int32_t var_floor;
-      Var4[i][j] = (Sxx4[i][j] - (OD_SQUARE(Sx4[i][j]) >> 4)) >> 5;
-      var_floor = 4 + ((Sx4[i][j]+(128<<4)) >> 8);
-      if (Var4[i][j] < var_floor) Var4[i][j] = var_floor;
-      invVar4[i][j] = 16384/Var4[i][j];
+      sx4 = Sx2[i*stride2 + j] + Sx2[i*stride2 + j + 1]
+       + Sx2[(i + 1)*stride2 + j] + Sx2[(i + 1)*stride2 + j + 1];
+      sxx4 = Sxx2[i*stride2 + j] + Sxx2[i*stride2 + j + 1]
+       + Sxx2[(i + 1)*stride2 + j] + Sxx2[(i + 1)*stride2 + j + 1];
+      var = (sxx4 - (OD_SQUARE(sx4) >> 4)) >> 5;
+      var_floor = 4 + ((sx4 + (128 << 4)) >> 8);
+      if (var < var_floor) var = var_floor;
+      stats->Var4[i*stride4 + j] = var;
+      stats->invVar4[i*stride4 + j] = 16384/var;
     }
   }
-  for (i = 0; i < OD_SIZE8_SUMS; i++) {
-    for (j = 0; j < OD_SIZE8_SUMS; j++) {
+  /*The 8x8 blocks start every 4 pixels, off8 2x2 blocks into the margin, and
+     each one covers 4x4 of the 2x2 blocks.*/
+  off8 = OD_MAX_OVERLAP - 2*OD_MAX_OVERLAP_8;
+  OD_ASSERT(off8 >= 0);
+  for (i = 0; i < OD_FRAME_SIZE8_SUMS(bs->nvsb); i++) {
+    for (j = 0; j < stride8; j++) {
+      int32_t sx8;
+      int32_t sxx8;
+      int32_t var;
       int32_t var_floor;
-      Var8[i][j] = (Sxx8[i][j] - (OD_SQUARE(Sx8[i][j]) >> 6)) >> 5;
-      var_floor = 4 + ((Sx8[i][j]+(128<<6)) >> 8);
-      if (Var8[i][j] < var_floor) Var8[i][j] = var_floor;
-      invVar8[i][j] = 16384/Var8[i][j];
+      int k;
+      int m;
+      sx8 = 0;
+      sxx8 = 0;
+      for (k = 0; k < 4; k++) {
+        for (m = 0; m < 4; m++) {
+          sx8 += Sx2[(2*i + off8 + k)*stride2 + 2*j + off8 + m];
+          sxx8 += Sxx2[(2*i + off8 + k)*stride2 + 2*j + off8 + m];
+        }
+      }
+      var = (sxx8 - (OD_SQUARE(sx8) >> 6)) >> 5;
+      var_floor = 4 + ((sx8 + (128 << 6)) >> 8);
+      if (var < var_floor) var = var_floor;
+      stats->Var8[i*stride8 + j] = var;
+      stats->invVar8[i*stride8 + j] = 16384/var;
     }
   }
 }
 
+/* Compute the statistics used by `od_split_superblock` for a whole plane.
+ * @param [in,out]  bs          Block size state, initialized with
+ *                               `od_block_size_comp_init` to the size of
+ *                               the plane in superblocks
+ * @param [in]      psy_img     Image on which to compute the psy model
+ *                               (should not be a residual), a margin of
+ *                               2*OD_MAX_OVERLAP pixels is required around
+ *                               the plane
+ * @param [in]      stride      Image stride
+ * @param [in]      pred        Prediction input (NULL means no prediction
+ *                               available)
+ * @param [in]      pred_stride Prediction input stride
+ * @param [in]      shared_psy  Statistics already computed from the same
+ *                               psy_img by another block size state, or
+ *                               NULL to compute them
+ * @param [in]      sums_2x2    Function computing one row of 2x2 sums
+ */
+void od_compute_frame_stats(od_block_size_comp *bs,
+ const unsigned char *psy_img, int stride,
+ const unsigned char *pred, int pred_stride,
+ const od_frame_stats *shared_psy, od_bs_sums_2x2_func sums_2x2) {
+  if (shared_psy != NULL) bs->psy = shared_psy;
+  else {
+    od_compute_stats(bs, psy_img, stride, NULL, 0, sums_2x2, &bs->psy_frame);
+    bs->psy = &bs->psy_frame;
+  }
+  bs->has_pred = pred != NULL && pred != psy_img;
+  if (bs->has_pred) {
+    od_compute_stats(bs, psy_img, stride, pred, pred_stride, sums_2x2,
+     &bs->img_frame);
+  }
+}
+
+/* Point `stats` at the statistics of superblock (sbx, sby) in `frame`. */
+static void od_superblock_stats_init(od_superblock_stats *stats,
+ const od_frame_stats *frame, int nhsb, int sbx, int sby) {
+  stats->stride4 = OD_FRAME_SIZE4_SUMS(nhsb);
+  stats->Var4 = frame->Var4 + 16*sby*stats->stride4 + 16*sbx;
+  stats->invVar4 = frame->invVar4 + 16*sby*stats->stride4 + 16*sbx;
+  stats->stride8 = OD_FRAME_SIZE8_SUMS(nhsb);
+  stats->Var8 = frame->Var8 + 8*sby*stats->stride8 + 8*sbx;
+  stats->invVar8 = frame->invVar8 + 8*sby*stats->stride8 + 8*sbx;
+}
+
 /* Number of overlapping 4x4 blocks along one direction of the block. */
 static int od_count_overlapping4x4(int bsize) {
   int non_overlapped_count_4x4;
@@ -188,7 +314,7 @@ static unsigned int od_overlap_var4x4[OD_BLOCK_SIZES] = { 1, 1, 2, 3 };
  * @param x         x offset of the block inside the 32x32 superblock
  * @retval block noise
  */
-static int od_noise_var4x4(od_superblock_stats *img_stats,
+static int od_noise_var4x4(const od_superblock_stats *img_stats,
  int bsize, int y, int x) {
   int i;
   int j;
@@ -204,8 +330,8 @@ static int od_noise_var4x4(od_superblock_stats *img_stats,
   sum_var = 0;
   for (i = -overlap; i < length + overlap; i++) {
     for (j = -overlap; j < length + overlap; j++) {
-      sum_var += img_stats->Var4
-       [OD_MAX_OVERLAP + y/2 + i][OD_MAX_OVERLAP + x/2 + j];
+      sum_var += img_stats->Var4[(OD_MAX_OVERLAP + y/2 + i)*img_stats->stride4
+       + OD_MAX_OVERLAP + x/2 + j];
     }
   }
   return sum_var/(count*count);
@@ -222,7 +348,7 @@ static int od_noise_var4x4(od_superblock_stats *img_stats,
  * @param x         x offset of the block inside the 32x32 superblock
  * @param noise     Noise of the block
  */
-static float od_psy_var4x4(od_superblock_stats *psy_stats,
+static float od_psy_var4x4(const od_superblock_stats *psy_stats,
  int bsize, int y, int x, int noise) {
   int i;
   int j;
@@ -238,8 +364,8 @@ static float od_psy_var4x4(od_superblock_stats *psy_stats,
   psy = 0;
   for (i = -overlap; i < length + overlap; i++) {
     for (j = -overlap; j < length + overlap; j++) {
-      psy += OD_LOG2(1 + noise*psy_stats->invVar4
-       [OD_MAX_OVERLAP + y/2 + i][OD_MAX_OVERLAP + x/2 + j]/16384.f);
+      psy += OD_LOG2(1 + noise*psy_stats->invVar4[(OD_MAX_OVERLAP + y/2 + i)*
+       psy_stats->stride4 + OD_MAX_OVERLAP + x/2 + j]/16384.f);
     }
   }
   return OD_MAXF(psy/(count*count) - 1.f, 0);
@@ -263,7 +389,7 @@ static int od_count_overlapping8x8(int bsize) {
 static unsigned int od_overlap_var8x8[OD_BLOCK_SIZES] = { 0, 0, 1, 1 };
 
 /* Same as `od_noise_var4x4` but using overlapping 8x8 blocks. */
-static int od_noise_var8x8(od_superblock_stats *img_stats,
+static int od_noise_var8x8(const od_superblock_stats *img_stats,
  int bsize, int y, int x) {
   int i;
   int j;
@@ -280,15 +406,15 @@ static int od_noise_var8x8(od_superblock_stats *img_stats,
   sum_var = 0;
   for (i = -overlap; i < length + overlap; i++) {
     for (j = -overlap; j < length + overlap; j++) {
-      sum_var += img_stats->Var8
-       [OD_MAX_OVERLAP_8 + y/4 + i][OD_MAX_OVERLAP_8 + x/4 + j];
+      sum_var += img_stats->Var8[(OD_MAX_OVERLAP_8 + y/4 + i)*
+       img_stats->stride8 + OD_MAX_OVERLAP_8 + x/4 + j];
     }
   }
   return sum_var/(count*count);
 }
 
 /* Same as `od_psy_var4x4` but using overlapping 8x8 blocks. */
-static float od_psy_var8x8(od_superblock_stats *psy_stats,
+static float od_psy_var8x8(const od_superblock_stats *psy_stats,
  int bsize, int y, int x, int noise) {
   int i;
   int j;
@@ -305,8 +431,8 @@ static float od_psy_var8x8(od_superblock_stats *psy_stats,
   psy = 0;
   for (i = -overlap; i < length + overlap; i++) {
     for (j = -overlap; j < length + overlap; j++) {
-      psy += OD_LOG2(1 + noise*psy_stats->invVar8
-       [OD_MAX_OVERLAP_8 + y/4 + i][OD_MAX_OVERLAP_8 + x/4 + j]/16384.f);
+      psy += OD_LOG2(1 + noise*psy_stats->invVar8[(OD_MAX_OVERLAP_8 + y/4 + i)*
+       psy_stats->stride8 + OD_MAX_OVERLAP_8 + x/4 + j]/16384.f);
     }
   }
   return OD_MAXF(psy/(count*count) - 1.f, 0);
@@ -316,58 +442,41 @@ static float od_psy_var8x8(od_superblock_stats *psy_stats,
  * activity masking model. The masking at any given point is assumed to be
  * proportional to the local variance. The decision is made using a simple
  * dynamic programming algorithm, working from 8x8 decisions up to 32x32.
- * @param [scratch] bs          Scratch space for computation
- * @param [in]      psy_img     Image on which to compute the psy model
- *                               (should not be a residual)
- * @param [in]      stride      Image stride
- * @param [in]      pred        Prediction input (NULL means no prediction
- *                               available)
- * @param [in]      pred_stride Prediction input stride
+ * @param [in]      bs          Block size state, after a call to
+ *                               `od_compute_frame_stats`
+ * @param [in]      sbx         Horizontal index of the superblock
+ * @param [in]      sby         Vertical index of the superblock
  * @param [out]     bsize       Decision for each 8x8 block in the image
  *                               (see OD_BLOCK_* macros in block_size.h for
  *                               possible values)
  * @param [in]      q           Quality tuning parameter
  */
-void od_split_superblock(od_block_size_comp *bs,
- const unsigned char *psy_img, int stride,
- const unsigned char *pred, int pred_stride, int bsize[4][4], int q) {
+void od_split_superblock(od_block_size_comp *bs, int sbx, int sby,
+ int bsize[4][4], int q) {
   int i;
   int j;
   /* Tuning parameter for block decision (higher values results in smaller
       blocks) */
   double psy_lambda;
-  const unsigned char *x0;
   double cg4;
   double cg8;
-  x0 = psy_img - OD_BLOCK_OFFSET(stride);
+  OD_ASSERT(sbx >= 0 && sbx < bs->nhsb);
+  OD_ASSERT(sby >= 0 && sby < bs->nvsb);
   /* The passed in q value is now a quantizer with the same scaling as
      the coefficients. */
   psy_lambda = q ? 6*sqrt((double)(1<<OD_COEFF_SHIFT)/q) : 6;
-  for (i = 0; i < 2*OD_SIZE2_SUMS; i++) {
-    for (j = 0; j < 2*OD_SIZE2_SUMS; j++) {
-      bs->res[i][j] = (int)x0[i*stride + j] - 128;
-    }
-  }
   cg4 = OD_CG4;
   cg8 = OD_CG8;
-  od_compute_stats(&bs->res[2*OD_MAX_OVERLAP][2*OD_MAX_OVERLAP],
-   2*OD_SIZE2_SUMS, &bs->psy_stats);
-  if (psy_img == pred || pred == NULL) {
-    OD_COPY(&bs->img_stats, &bs->psy_stats, 1);
+  od_superblock_stats_init(&bs->psy_stats, bs->psy, bs->nhsb,
+   sbx, sby);
+  if (!bs->has_pred) {
+    bs->img_stats = bs->psy_stats;
   }
   else {
-    const unsigned char *p0;
     cg4 -= .01*OD_MAXI((q >> OD_COEFF_SHIFT) - 40, 0);
     cg8 -= .005*OD_MAXI(((q >> OD_COEFF_SHIFT) - 40), 0);
-    p0 = pred - OD_BLOCK_OFFSET(pred_stride);
-    for (i = 0; i < 2*OD_SIZE2_SUMS; i++) {
-      for (j = 0; j < 2*OD_SIZE2_SUMS; j++) {
-        bs->res[i][j] = OD_CLAMPI(-128, (int)x0[i*stride + j]
-         - (int)p0[i*pred_stride + j], 127);
-      }
-    }
-    od_compute_stats(&bs->res[2*OD_MAX_OVERLAP][2*OD_MAX_OVERLAP],
-     2*OD_SIZE2_SUMS, &bs->img_stats);
+    od_superblock_stats_init(&bs->img_stats, &bs->img_frame, bs->nhsb,
+     sbx, sby);
   }
   /* Compute 4x4 masking */
   for (i = 0; i < 8; i++) {
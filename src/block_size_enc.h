@@ -33,62 +33,86 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
 /*Maximum overlap returned by od_overlap_var8x8 in units of 4x4 blocks.*/
 # define OD_MAX_OVERLAP_8 (1)
 
-/*Number of 2x2 blocks along one direction of a superblock, plus OD_MAX_OVERLAP
-   extra blocks on each side to account for lapping.*/
-# define OD_SIZE2_SUMS (16 + 2*OD_MAX_OVERLAP)
-/*Number of overlapping 4x4 blocks along one direction of a superblock, plus
-   OD_MAX_OVERLAP extra blocks on each side to account for lapping.
-  The distance between two overlapping blocks is 2 pixels.*/
-# define OD_SIZE4_SUMS (15 + 2*OD_MAX_OVERLAP)
-/*Number of overlapping 8x8 blocks along one direction of a superblock, plus
-   OD_MAX_OVERLAP_8 extra blocks on each side to account for lapping.
-  The distance between two overlapping blocks is 4 pixels.*/
-# define OD_SIZE8_SUMS (7 + 2*OD_MAX_OVERLAP_8)
-
-/*Offset between the first pixel used in `od_compute_stats` and the pixel at
-   offset (0,0) in the current superblock.*/
+/*Offset between the first pixel used in `od_compute_frame_stats` and the
+   pixel at offset (0,0) in the plane.*/
 # define OD_BLOCK_OFFSET(stride)\
   ((2*OD_MAX_OVERLAP)*(stride) + (2*OD_MAX_OVERLAP))
 
-/*This struct can be made a lot smaller by using temporary values,
-  but as it is, it's much easier to debug and modify.*/
+/*Number of 2x2 blocks along one direction of a plane of n superblocks, plus
+   OD_MAX_OVERLAP extra blocks on each side to account for lapping.
+  A single superblock is the special case n == 1.*/
+# define OD_FRAME_SIZE2_SUMS(n) (16*(n) + 2*OD_MAX_OVERLAP)
+/*Number of overlapping 4x4 blocks along one direction of a plane of n
+   superblocks, with the same margins as for a single superblock.*/
+# define OD_FRAME_SIZE4_SUMS(n) (OD_FRAME_SIZE2_SUMS(n) - 1)
+/*Number of overlapping 8x8 blocks along one direction of a plane of n
+   superblocks, with the same margins as for a single superblock.*/
+# define OD_FRAME_SIZE8_SUMS(n) (8*(n) - 1 + 2*OD_MAX_OVERLAP_8)
+
+/*Frame-level statistics used to determine how to split superblocks.
+  Neighboring superblocks share the overlapping parts of their margins, so
+   these are computed once per frame by `od_compute_frame_stats` instead of
+   once per superblock.*/
+typedef struct {
+  /*Var4[(16*sby + OD_MAX_OVERLAP + y)*stride4 + 16*sbx + OD_MAX_OVERLAP + x] =
+     Variance of the 4x4 block at offset (2*x, 2*y) in superblock
+     (sbx, sby), with stride4 = OD_FRAME_SIZE4_SUMS(nhsb).*/
+  int32_t *Var4;
+  /*invVar4[i] = 16384/Var4[i]*/
+  int32_t *invVar4;
+  /*Var8[(8*sby + OD_MAX_OVERLAP_8 + y)*stride8
+     + 8*sbx + OD_MAX_OVERLAP_8 + x] =
+     Variance of the 8x8 block at offset (4*x, 4*y) in superblock
+     (sbx, sby), with stride8 = OD_FRAME_SIZE8_SUMS(nhsb).*/
+  int32_t *Var8;
+  /*invVar8[i] = 16384/Var8[i]*/
+  int32_t *invVar8;
+} od_frame_stats;
+
+/*The statistics of a single superblock, pointing into an od_frame_stats.*/
 typedef struct {
-  /*Sx2[OD_MAX_OVERLAP + y][OD_MAX_OVERLAP + x] =
-     Sum of the values in the 2x2 block at offset (2*x, 2*y).*/
-  int32_t Sx2[OD_SIZE2_SUMS][OD_SIZE2_SUMS];
-  /*Sxx2[OD_MAX_OVERLAP + y][OD_MAX_OVERLAP + x] =
-     Sum of the squared values in the 2x2 block at offset (2*x, 2*y).*/
-  int32_t Sxx2[OD_SIZE2_SUMS][OD_SIZE2_SUMS];
-  /*Sx4[OD_MAX_OVERLAP + y][OD_MAX_OVERLAP + x] =
-     Sum of the values in the 4x4 block at offset (2*x, 2*y).*/
-  int32_t Sx4[OD_SIZE4_SUMS][OD_SIZE4_SUMS];
-  /*Sxx4[OD_MAX_OVERLAP + y][OD_MAX_OVERLAP + x] =
-     Sum of the squared values in the 2x2 block at offset (2*x, 2*y).*/
-  int32_t Sxx4[OD_SIZE4_SUMS][OD_SIZE4_SUMS];
-  /*Sx8[OD_MAX_OVERLAP_8 + y][OD_MAX_OVERLAP_8 + x] =
-     Sum of the values in the 8x8 block at offset (4*x, 4*y).*/
-  int32_t Sx8[OD_SIZE8_SUMS][OD_SIZE8_SUMS];
-  /*Sxx8[OD_MAX_OVERLAP_8 + y][OD_MAX_OVERLAP_8 + x] =
-     Sum of the squared values in the 8x8 block at offset (4*x, 4*y).*/
-  int32_t Sxx8[OD_SIZE8_SUMS][OD_SIZE8_SUMS];
-  /*Var4[OD_MAX_OVERLAP + y][OD_MAX_OVERLAP + x] =
+  /*Var4[(OD_MAX_OVERLAP + y)*stride4 + OD_MAX_OVERLAP + x] =
      Variance of the 4x4 block at offset (2*x, 2*y).*/
-  int32_t Var4[OD_SIZE4_SUMS][OD_SIZE4_SUMS];
-  /*invVar4[y][x] = 16384/Var4[y][x]*/
-  int32_t invVar4[OD_SIZE4_SUMS][OD_SIZE4_SUMS];
-  /*Var8[OD_MAX_OVERLAP_8 + y][OD_MAX_OVERLAP_8 + x] =
+  const int32_t *Var4;
+  /*invVar4[i] = 16384/Var4[i]*/
+  const int32_t *invVar4;
+  int stride4;
+  /*Var8[(OD_MAX_OVERLAP_8 + y)*stride8 + OD_MAX_OVERLAP_8 + x] =
      Variance of the 8x8 block at offset (4*x, 4*y).*/
-  int32_t Var8[OD_SIZE8_SUMS][OD_SIZE8_SUMS];
-  /*invVar8[y][x] = 16384/Var8[y][x]*/
-  int32_t invVar8[OD_SIZE8_SUMS][OD_SIZE8_SUMS];
+  const int32_t *Var8;
+  /*invVar8[i] = 16384/Var8[i]*/
+  const int32_t *invVar8;
+  int stride8;
 } od_superblock_stats;
 
+/*Computes the sums and sums of squares of one row of n 2x2 blocks.
+  The values summed are img - 128 when pred is NULL, and the residual
+   img - pred clamped to [-128, 127] otherwise.*/
+typedef void (*od_bs_sums_2x2_func)(int32_t *sx2, int32_t *sxx2,
+ const unsigned char *img, int istride, const unsigned char *pred,
+ int pstride, int n);
+
 typedef struct {
+  /* Size of the plane in superblocks. */
+  int nhsb;
+  int nvsb;
+  /* Whether img_frame was computed from a prediction, or is the same as
+     psy_frame. */
+  int has_pred;
+  /* The allocator the buffers come from, or NULL for the C library. */
+  const daala_allocator *alloc;
+  /* Scratch space for the 2x2 sums of a whole plane. */
+  int32_t *Sx2;
+  int32_t *Sxx2;
+  od_frame_stats img_frame;
+  od_frame_stats psy_frame;
+  /* The source statistics of the current frame: either psy_frame, or the
+     psy_frame of another od_block_size_comp that saw the same input. */
+  const od_frame_stats *psy;
+
   od_superblock_stats img_stats;
   od_superblock_stats psy_stats;
 
-  signed char res[2*OD_SIZE2_SUMS][2*OD_SIZE2_SUMS];
-
   /* 4x4 metrics */
   int32_t noise4_4[8][8];
   int32_t noise4_8[4][4];
@@ -112,8 +136,17 @@ typedef struct {
   float dec_gain16[2][2];
 } od_block_size_comp;
 
-void od_split_superblock(od_block_size_comp *bs,
+int od_block_size_comp_init(od_block_size_comp *bs, int nhsb, int nvsb,
+ const daala_allocator *alloc);
+void od_block_size_comp_clear(od_block_size_comp *bs);
+void od_bs_sums_2x2_c(int32_t *sx2, int32_t *sxx2,
+ const unsigned char *img, int istride, const unsigned char *pred,
+ int pstride, int n);
+void od_compute_frame_stats(od_block_size_comp *bs,
  const unsigned char *psy_img, int stride,
- const unsigned char *pred, int pred_stride, int dec[4][4], int q);
+ const unsigned char *pred, int pred_stride,
+ const od_frame_stats *shared_psy, od_bs_sums_2x2_func sums_2x2);
+void od_split_superblock(od_block_size_comp *bs, int sbx, int sby,
+ int dec[4][4], int q);
 
 #endif
@@ -26,6 +26,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
 # define _decint_H (1)
 # include "../include/daala/daaladec.h"
 # include "state.h"
+# include "accounting.h"
 
 typedef struct daala_dec_ctx od_dec_ctx;
 
@@ -33,6 +34,15 @@ typedef struct daala_dec_ctx od_dec_ctx;
 /*Next packet to read: Data packet.*/
 # define OD_PACKET_DATA (0)
 
+/*Bit accounting wrappers that read the decoder position, which matches the
+   encoder position after the same symbols.*/
+# define OD_DEC_ACCT_UPDATE(dec, cat, value) \
+  OD_ACCT_UPDATE(&(dec)->acct, od_ec_dec_tell_frac(&(dec)->ec), cat, value)
+# define OD_DEC_ACCT_SET_SB(dec, sbi) \
+  OD_ACCT_SET_SB(&(dec)->acct, od_ec_dec_tell_frac(&(dec)->ec), sbi)
+# define OD_DEC_ACCT_RESET(dec) \
+  OD_ACCT_RESET(&(dec)->acct, od_ec_dec_tell_frac(&(dec)->ec))
+
 struct daala_dec_ctx {
   od_state state;
   oggbyte_buffer obb;
@@ -47,8 +57,28 @@ struct daala_dec_ctx {
    are set via daala_decode_ctl with OD_DECCTL_SET_FLAGS_BUFFER.*/
   unsigned int *user_flags;
   int user_fstride;
+  /*The band flags of the luma blocks of the last frame, with a stride of
+     nhsb*8, for OD_DECCTL_GET_SIDE_DATA.*/
+  unsigned int *flags;
+  /*Whether the last frame was a keyframe.*/
+  int is_keyframe;
   od_mv_grid_pt *user_mv_grid;
   od_img *user_mc_img;
+  /*Log2 of the reduction factor for DC-only thumbnail decoding, set via
+     daala_decode_ctl with OD_DECCTL_SET_THUMBNAIL_SCALE, or 0 to decode
+     full-resolution frames.*/
+  int thumb_shift;
+  /*Called as rows of the output become final, set via daala_decode_ctl
+     with OD_DECCTL_SET_ROW_CALLBACK.
+    func is NULL when there is no callback.*/
+  daala_row_callback row_cb;
+#if defined(OD_ACCOUNTING)
+  /*Where the bits of the last frame went, for OD_DECCTL_GET_ACCOUNTING.*/
+  od_acct acct;
+#endif
+  /*Scratch space for the 8-bit motion-compensated prediction of a single
+     superblock before it is moved into mctmp.*/
+  OD_ALIGN16(unsigned char mc_sb_buf[OD_BSIZE_MAX*OD_BSIZE_MAX]);
 };
 
 /*Stub for the daala_setup_info.*/
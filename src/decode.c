@@ -46,39 +46,82 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
 #include "quantizer.h"
 
 static int od_dec_init(od_dec_ctx *dec, const daala_info *info,
- const daala_setup_info *setup) {
+ const daala_setup_info *setup, const daala_allocator *alloc) {
   int ret;
   (void)setup;
-  ret = od_state_init(&dec->state, info);
+  /*Only motion compensation reads the reference frames, and it clamps its
+     reads to the frame, so they are stored without padding.*/
+  ret = od_state_init(&dec->state, info, alloc, 0);
   if (ret < 0) return ret;
   dec->packet_state = OD_PACKET_DATA;
   dec->user_bsize = NULL;
   dec->user_flags = NULL;
   dec->user_mv_grid = NULL;
   dec->user_mc_img = NULL;
+  dec->thumb_shift = 0;
+  dec->row_cb.func = NULL;
+  dec->row_cb.ctx = NULL;
+  dec->is_keyframe = 0;
+  OD_CLEAR(dec->quantizer, OD_NPLANES_MAX);
+  dec->flags = (unsigned int *)od_calloc(&dec->state.alloc,
+   dec->state.nhsb*8*dec->state.nvsb*8, sizeof(*dec->flags));
+  if (OD_UNLIKELY(!dec->flags)) {
+    od_state_clear(&dec->state);
+    return OD_EFAULT;
+  }
+#if defined(OD_ACCOUNTING)
+  if (OD_UNLIKELY(od_acct_init(&dec->acct, dec->state.nhsb, dec->state.nvsb,
+   &dec->state.alloc) < 0)) {
+    od_free(&dec->state.alloc, dec->flags);
+    od_state_clear(&dec->state);
+    return OD_EFAULT;
+  }
+#endif
   return 0;
 }
 
 static void od_dec_clear(od_dec_ctx *dec) {
+#if defined(OD_ACCOUNTING)
+  od_acct_clear(&dec->acct);
+#endif
+  od_free(&dec->state.alloc, dec->flags);
   od_state_clear(&dec->state);
 }
 
 daala_dec_ctx *daala_decode_alloc(const daala_info *info,
  const daala_setup_info *setup) {
+  return daala_decode_alloc_with_allocator(info, setup, NULL);
+}
+
+daala_dec_ctx *daala_decode_alloc_with_allocator(const daala_info *info,
+ const daala_setup_info *setup, const daala_allocator *alloc) {
   od_dec_ctx *dec;
   if (info == NULL) return NULL;
-  dec = (od_dec_ctx *)malloc(sizeof(*dec));
-  if (od_dec_init(dec, info, setup) < 0) {
-    free(dec);
+  dec = (od_dec_ctx *)od_malloc(alloc, sizeof(*dec));
+  if (dec == NULL) return NULL;
+  if (od_dec_init(dec, info, setup, alloc) < 0) {
+    od_free(alloc, dec);
     return NULL;
   }
   return dec;
 }
 
+int daala_decode_reset(daala_dec_ctx *dec, const daala_info *info) {
+  int ret;
+  if (dec == NULL) return OD_EFAULT;
+  ret = od_state_reset(&dec->state, info);
+  if (ret < 0) return ret;
+  dec->packet_state = OD_PACKET_DATA;
+  return 0;
+}
+
 void daala_decode_free(daala_dec_ctx *dec) {
   if (dec != NULL) {
+    daala_allocator alloc;
+    /*The allocator lives in the context we are about to free.*/
+    alloc = dec->state.alloc;
     od_dec_clear(dec);
-    free(dec);
+    od_free(&alloc, dec);
   }
 }
 
@@ -122,22 +165,80 @@ int daala_decode_ctl(daala_dec_ctx *dec, int req, void *buf, size_t buf_sz) {
       dec->user_mc_img = buf;
       return 0;
     }
+    case OD_DECCTL_SET_THUMBNAIL_SCALE : {
+      int shift;
+      if (dec == NULL || buf == NULL) return OD_EFAULT;
+      if (buf_sz != sizeof(int)) return OD_EINVAL;
+      shift = *(int *)buf;
+      if (shift != 0 && (shift < 2 || shift > OD_LOG_BSIZE_MAX)) {
+        return OD_EINVAL;
+      }
+      dec->thumb_shift = shift;
+      return 0;
+    }
+    case OD_DECCTL_SET_ROW_CALLBACK : {
+      if (dec == NULL) return OD_EFAULT;
+      if (buf == NULL) {
+        dec->row_cb.func = NULL;
+        dec->row_cb.ctx = NULL;
+        return 0;
+      }
+      if (buf_sz != sizeof(daala_row_callback)) return OD_EINVAL;
+      dec->row_cb = *(daala_row_callback *)buf;
+      return 0;
+    }
+    case OD_DECCTL_GET_SIDE_DATA : {
+      daala_side_data *sd;
+      od_state *state;
+      if (dec == NULL || buf == NULL) return OD_EFAULT;
+      if (buf_sz != sizeof(daala_side_data)) return OD_EINVAL;
+      sd = (daala_side_data *)buf;
+      if (sd->version != OD_SIDE_DATA_VERSION) return OD_EINVAL;
+      state = &dec->state;
+      sd->is_keyframe = dec->is_keyframe;
+      OD_COPY(sd->quantizer, dec->quantizer, OD_NPLANES_MAX);
+      sd->nhsb = state->nhsb;
+      sd->nvsb = state->nvsb;
+      sd->bsize = state->bsize;
+      sd->bstride = state->bstride;
+      sd->flags = dec->flags;
+      sd->fstride = state->nhsb*8;
+      sd->sb_skip = state->sb_skip_flags;
+      sd->clpf = dec->thumb_shift ? NULL : state->clpf_flags;
+      sd->nhmvbs = state->nhmvbs;
+      sd->nvmvbs = state->nvmvbs;
+      /*Both grids are single allocations with contiguous rows.*/
+      sd->mv = dec->is_keyframe ? NULL : state->mv_grid[0][0].mv;
+      sd->mv_valid = dec->is_keyframe ? NULL : state->mv_valid[0];
+      sd->mv_stride = state->nhmvbs + 1;
+      return 0;
+    }
+    case OD_DECCTL_GET_ACCOUNTING : {
+      if (dec == NULL || buf == NULL) return OD_EFAULT;
+      if (buf_sz != sizeof(daala_accounting)) return OD_EINVAL;
+#if defined(OD_ACCOUNTING)
+      od_acct_export(&dec->acct, (daala_accounting *)buf);
+      return 0;
+#else
+      return OD_EIMPL;
+#endif
+    }
     default: return OD_EIMPL;
   }
 }
 
 static void od_dec_blank_img(od_img *img) {
   int pli;
-  int frame_buf_width;
-  int frame_buf_height;
-  int plane_buf_width;
-  int plane_buf_height;
-  frame_buf_width = img->width + (OD_UMV_PADDING << 1);
-  frame_buf_height = img->height + (OD_UMV_PADDING << 1);
   for (pli = 0; pli < img->nplanes; pli++) {
-    plane_buf_width = (frame_buf_width << 1) >> img->planes[pli].xdec;
-    plane_buf_height = (frame_buf_height << 1) >> img->planes[pli].ydec;
-    memset(img->planes[pli].data, 128, plane_buf_width*plane_buf_height);
+    int plane_width;
+    int plane_height;
+    int y;
+    plane_width = img->width >> img->planes[pli].xdec;
+    plane_height = img->height >> img->planes[pli].ydec;
+    for (y = 0; y < plane_height; y++) {
+      memset(img->planes[pli].data + img->planes[pli].ystride*y, 128,
+       plane_width);
+    }
   }
 }
 
@@ -175,8 +276,12 @@ static void od_decode_mv(daala_dec_ctx *dec, od_mv_grid_pt *mvg, int vx,
   }
   if (ox && od_ec_dec_bits(&dec->ec, 1)) ox = -ox;
   if (oy && od_ec_dec_bits(&dec->ec, 1)) oy = -oy;
-  mvg->mv[0] = (pred[0] + ox) << mv_res;
-  mvg->mv[1] = (pred[1] + oy) << mv_res;
+  /*Keep the vector representable in an od_mv_grid_pt, so that it stays a
+     multiple of the resolution and cannot wrap around.*/
+  mvg->mv[0] = OD_CLAMPI(OD_MV_MIN >> mv_res, pred[0] + ox,
+   OD_MV_MAX >> mv_res) << mv_res;
+  mvg->mv[1] = OD_CLAMPI(OD_MV_MIN >> mv_res, pred[1] + oy,
+   OD_MV_MAX >> mv_res) << mv_res;
 }
 
 struct od_mb_dec_ctx {
@@ -427,7 +532,7 @@ static void od_block_decode(daala_dec_ctx *dec, od_mb_dec_ctx *ctx, int bs,
   /*Apply forward transform to MC predictor.*/
   if (!ctx->is_keyframe) {
     if (ctx->use_haar_wavelet) {
-      od_haar(md + bo, w, mc + bo, w, bs + 2);
+      (*dec->state.opt_vtbl.haar)(md + bo, w, mc + bo, w, bs + 2);
     }
     else {
       (*dec->state.opt_vtbl.fdct_2d[bs])(md + bo, w, mc + bo, w);
@@ -449,7 +554,7 @@ static void od_block_decode(daala_dec_ctx *dec, od_mb_dec_ctx *ctx, int bs,
     }
   }
   else {
-    od_raster_to_coding_order(predt,  n, &pred[0], n);
+    (*OD_RASTER_TO_CODING_ORDER[bs])(predt, &pred[0], n);
   }
   quant = OD_MAXI(1, dec->quantizer[pli]);
   if (lossless) dc_quant = 1;
@@ -457,6 +562,7 @@ static void od_block_decode(daala_dec_ctx *dec, od_mb_dec_ctx *ctx, int bs,
     dc_quant = OD_MAXI(1, quant*
      dec->state.pvq_qm_q4[pli][od_qm_get_index(bs, 0)] >> 4);
   }
+  OD_DEC_ACCT_UPDATE(dec, OD_ACCT_CAT_TECHNIQUE, OD_ACCT_TECH_AC_COEFFS);
   if (ctx->use_haar_wavelet) {
     od_wavelet_unquantize(dec, bs + 2, pred, predt, dec->quantizer[pli], pli);
   }
@@ -465,10 +571,14 @@ static void od_block_decode(daala_dec_ctx *dec, od_mb_dec_ctx *ctx, int bs,
     od_pvq_decode(dec, predt, pred, quant, pli, bs,
      OD_PVQ_BETA[use_masking][pli][bs], OD_ROBUST_STREAM, ctx->is_keyframe,
      &flags, skip);
-    if (pli == 0 && dec->user_flags != NULL) {
-      dec->user_flags[by*dec->user_fstride + bx] = flags;
+    if (pli == 0) {
+      dec->flags[by*(dec->state.nhsb*8) + bx] = flags;
+      if (dec->user_flags != NULL) {
+        dec->user_flags[by*dec->user_fstride + bx] = flags;
+      }
     }
   }
+  OD_DEC_ACCT_UPDATE(dec, OD_ACCT_CAT_TECHNIQUE, OD_ACCT_TECH_DC_COEFF);
   if (!ctx->is_keyframe) {
     int has_dc_skip;
     has_dc_skip = !ctx->is_keyframe && !ctx->use_haar_wavelet;
@@ -492,15 +602,18 @@ static void od_block_decode(daala_dec_ctx *dec, od_mb_dec_ctx *ctx, int bs,
     }
   }
   else {
-    od_coding_order_to_raster(&d[bo], w, pred, n);
+    (*OD_CODING_ORDER_TO_RASTER[bs])(&d[bo], w, pred);
   }
   if (ctx->use_haar_wavelet) {
-    od_haar_inv(c + bo, w, d + bo, w, bs + 2);
+    (*dec->state.opt_vtbl.haar_inv)(c + bo, w, d + bo, w, bs + 2);
   }
   else {
     od_apply_qm(d + bo, w, d + bo, w, bs, xdec, 1, qm);
-    /*Apply the inverse transform.*/
-    (*dec->state.opt_vtbl.idct_2d[bs])(c + bo, w, d + bo, w);
+    /*Apply the inverse transform, unless we only want a thumbnail, which is
+       built from the low-order coefficients once the frame is decoded.*/
+    if (!dec->thumb_shift) {
+      (*dec->state.opt_vtbl.idct_2d[bs])(c + bo, w, d + bo, w);
+    }
   }
 }
 
@@ -623,9 +736,16 @@ static void od_decode_recursive(daala_dec_ctx *dec, od_mb_dec_ctx *ctx, int pli,
      the skip value to the PVQ decoder. */
   if (ctx->use_haar_wavelet) obs = bsi;
   else if (pli == 0) {
+    OD_DEC_ACCT_UPDATE(dec, OD_ACCT_CAT_TECHNIQUE, OD_ACCT_TECH_BLOCK_SIZE);
     skip = od_decode_cdf_adapt(&dec->ec,
      dec->state.adapt.skip_cdf[2*bsi + (pli != 0)], 4 + (bsi > 0),
      dec->state.adapt.skip_increment);
+    /*The encoder codes the skip flag of an unsplit block along with its
+       coefficients, so it counts as a split flag only when it is one.*/
+    if (skip < 4) {
+      OD_ACCT_SET_CATEGORY(&dec->acct, OD_ACCT_CAT_TECHNIQUE,
+       OD_ACCT_TECH_AC_COEFFS);
+    }
     /*Save superblock skip value for use by CLP filter.*/
     if (bsi == OD_NBSIZES - 1) {
       dec->state.sb_skip_flags[by*dec->state.nhsb + bx] = skip == 2;
@@ -659,6 +779,7 @@ static void od_decode_recursive(daala_dec_ctx *dec, od_mb_dec_ctx *ctx, int pli,
     }
     if (pli > 0 && !ctx->use_haar_wavelet) {
       /* Decode the skip for chroma. */
+      OD_DEC_ACCT_UPDATE(dec, OD_ACCT_CAT_TECHNIQUE, OD_ACCT_TECH_AC_COEFFS);
       skip = od_decode_cdf_adapt(&dec->ec,
        dec->state.adapt.skip_cdf[2*bsi + (pli != 0)], 4,
        dec->state.adapt.skip_increment);
@@ -675,6 +796,7 @@ static void od_decode_recursive(daala_dec_ctx *dec, od_mb_dec_ctx *ctx, int pli,
       od_prefilter_split(ctx->mc + bo, w, bs, f);
     }
     if (ctx->is_keyframe) {
+      OD_DEC_ACCT_UPDATE(dec, OD_ACCT_CAT_TECHNIQUE, OD_ACCT_TECH_DC_COEFF);
       od_decode_haar_dc_level(dec, ctx, pli, 2*bx, 2*by, bsi - 1, xdec, &hgrad,
        &vgrad);
     }
@@ -686,9 +808,11 @@ static void od_decode_recursive(daala_dec_ctx *dec, od_mb_dec_ctx *ctx, int pli,
      hgrad, vgrad);
     od_decode_recursive(dec, ctx, pli, 2*bx + 1, 2*by + 1, bsi - 1, xdec, ydec,
      hgrad, vgrad);
-    bs = bsi - xdec;
-    bo = (by << (OD_LOG_BSIZE0 + bs))*w + (bx << (OD_LOG_BSIZE0 + bs));
-    od_postfilter_split(ctx->c + bo, w, bs, f);
+    if (!dec->thumb_shift) {
+      bs = bsi - xdec;
+      bo = (by << (OD_LOG_BSIZE0 + bs))*w + (bx << (OD_LOG_BSIZE0 + bs));
+      od_postfilter_split(ctx->c + bo, w, bs, f);
+    }
   }
 }
 
@@ -705,6 +829,7 @@ static void od_dec_mv_unpack(daala_dec_ctx *dec) {
   int level;
   od_mv_grid_pt *mvp;
   od_mv_grid_pt **grid;
+  unsigned char **valid;
   uint16_t *cdf;
   OD_ASSERT(dec->state.ref_imgi[OD_FRAME_PREV] >= 0);
   od_state_mvs_clear(&dec->state);
@@ -716,6 +841,7 @@ static void od_dec_mv_unpack(daala_dec_ctx *dec) {
   width = (img->width + 32) << (3 - mv_res);
   height = (img->height + 32) << (3 - mv_res);
   grid = dec->state.mv_grid;
+  valid = dec->state.mv_valid;
   /*Motion vectors outside the frame are always zero.*/
   /*Level 0.*/
   /*We don't modify the loop indices as in the encoder because we need to
@@ -723,7 +849,7 @@ static void od_dec_mv_unpack(daala_dec_ctx *dec) {
   for (vy = 0; vy <= nvmvbs; vy += OD_MVB_DELTA0) {
     for (vx = 0; vx <= nhmvbs; vx += OD_MVB_DELTA0) {
       mvp = grid[vy] + vx;
-      mvp->valid = 1;
+      valid[vy][vx] = 1;
       od_decode_mv(dec, mvp, vx, vy, 0, mv_res, width, height);
     }
   }
@@ -733,15 +859,15 @@ static void od_dec_mv_unpack(daala_dec_ctx *dec) {
     /*Odd levels.*/
     for (vy = mvb_sz; vy <= nvmvbs; vy += 2*mvb_sz) {
       for (vx = mvb_sz; vx <= nhmvbs; vx += 2*mvb_sz) {
-        if (grid[vy - mvb_sz][vx - mvb_sz].valid
-         && grid[vy - mvb_sz][vx + mvb_sz].valid
-         && grid[vy + mvb_sz][vx + mvb_sz].valid
-         && grid[vy + mvb_sz][vx - mvb_sz].valid) {
+        if (valid[vy - mvb_sz][vx - mvb_sz]
+         && valid[vy - mvb_sz][vx + mvb_sz]
+         && valid[vy + mvb_sz][vx + mvb_sz]
+         && valid[vy + mvb_sz][vx - mvb_sz]) {
           cdf = od_mv_split_flag_cdf(&dec->state, vx, vy, level);
           mvp = grid[vy] + vx;
-          mvp->valid = od_decode_cdf_adapt(&dec->ec,
+          valid[vy][vx] = od_decode_cdf_adapt(&dec->ec,
            cdf, 2, dec->state.adapt.split_flag_increment);
-          if (mvp->valid) {
+          if (valid[vy][vx]) {
             od_decode_mv(dec, mvp, vx, vy, level, mv_res, width, height);
           }
         }
@@ -751,15 +877,15 @@ static void od_dec_mv_unpack(daala_dec_ctx *dec) {
     /*Even Levels.*/
     for (vy = 0; vy <= nvmvbs; vy += mvb_sz) {
       for (vx = mvb_sz*!(vy & mvb_sz); vx <= nhmvbs; vx += 2*mvb_sz) {
-        if ((vy - mvb_sz < 0 || grid[vy - mvb_sz][vx].valid)
-         && (vx - mvb_sz < 0 || grid[vy][vx - mvb_sz].valid)
-         && (vy + mvb_sz > nvmvbs || grid[vy + mvb_sz][vx].valid)
-         && (vx + mvb_sz > nhmvbs || grid[vy][vx + mvb_sz].valid)) {
+        if ((vy - mvb_sz < 0 || valid[vy - mvb_sz][vx])
+         && (vx - mvb_sz < 0 || valid[vy][vx - mvb_sz])
+         && (vy + mvb_sz > nvmvbs || valid[vy + mvb_sz][vx])
+         && (vx + mvb_sz > nhmvbs || valid[vy][vx + mvb_sz])) {
           cdf = od_mv_split_flag_cdf(&dec->state, vx, vy, level);
           mvp = grid[vy] + vx;
-          mvp->valid = od_decode_cdf_adapt(&dec->ec,
+          valid[vy][vx] = od_decode_cdf_adapt(&dec->ec,
            cdf, 2, dec->state.adapt.split_flag_increment);
-          if (mvp->valid) {
+          if (valid[vy][vx]) {
             od_decode_mv(dec, mvp, vx, vy, level, mv_res, width, height);
           }
         }
@@ -767,13 +893,371 @@ static void od_dec_mv_unpack(daala_dec_ctx *dec) {
     }
   }
   if (dec->user_mv_grid != NULL) {
+    /*Points that were not coded were cleared to zero above.*/
     for (vy = 0; vy <= nvmvbs; vy++) {
-      for (vx = 0; vx <= nhmvbs; vx++) {
-        memcpy(&dec->user_mv_grid[vy*(nhmvbs + 1) + vx], &grid[vy][vx],
-         sizeof(od_mv_grid_pt));
+      OD_COPY(dec->user_mv_grid + vy*(nhmvbs + 1), grid[vy], nhmvbs + 1);
+    }
+  }
+}
+
+/*Computes the motion-compensated prediction of one plane of a superblock
+   and stores it in mctmp in the coefficient domain.
+  The 8-bit prediction only passes through a superblock-sized scratch buffer,
+   so it is still in cache when it is converted.*/
+static void od_dec_mc_predict_sb(daala_dec_ctx *dec, int pli, int sbx,
+ int sby) {
+  od_state *state;
+  od_img_plane *mcplane;
+  unsigned char *buf;
+  od_coeff *mc;
+  int xdec;
+  int ydec;
+  int w;
+  int bw;
+  int bh;
+  int coeff_shift;
+  int x;
+  int y;
+  state = &dec->state;
+  xdec = state->io_imgs[OD_FRAME_REC].planes[pli].xdec;
+  ydec = state->io_imgs[OD_FRAME_REC].planes[pli].ydec;
+  w = state->frame_width >> xdec;
+  bw = OD_BSIZE_MAX >> xdec;
+  bh = OD_BSIZE_MAX >> ydec;
+  buf = dec->mc_sb_buf;
+  od_state_pred_block(state, buf, OD_BSIZE_MAX, OD_FRAME_PREV, pli,
+   sbx << OD_LOG_MVB_DELTA0, sby << OD_LOG_MVB_DELTA0, OD_LOG_MVB_DELTA0);
+  coeff_shift = dec->quantizer[pli] == 0 ? 0 : OD_COEFF_SHIFT;
+  mc = state->mctmp[pli] + sby*bh*w + sbx*bw;
+  for (y = 0; y < bh; y++) {
+    for (x = 0; x < bw; x++) {
+      mc[y*w + x] = (buf[OD_BSIZE_MAX*y + x] - 128) << coeff_shift;
+    }
+  }
+  if (dec->user_mc_img != NULL) {
+    mcplane = dec->user_mc_img->planes + pli;
+    for (y = 0; y < bh; y++) {
+      OD_COPY(mcplane->data + (sby*bh + y)*mcplane->ystride + sbx*bw,
+       buf + OD_BSIZE_MAX*y, bw);
+    }
+  }
+}
+
+/*Makes the prefiltered motion-compensated reference of superblock (sbx, sby)
+   available in mctmp.
+  Superblocks are visited in raster order, and the prediction is computed one
+   superblock ahead to the right and below so that the edges of the current
+   superblock can be lapped.
+  Every horizontal edge is filtered before the vertical edges that cross it,
+   which gives the same result as od_apply_prefilter_frame_sbs().*/
+static void od_dec_mc_prefilter_sb(daala_dec_ctx *dec, int pli, int sbx,
+ int sby, int prefilter) {
+  od_state *state;
+  od_coeff *mc;
+  int nhsb;
+  int nvsb;
+  int xdec;
+  int ydec;
+  int w;
+  int bw;
+  int bh;
+  int f;
+  state = &dec->state;
+  nhsb = state->nhsb;
+  nvsb = state->nvsb;
+  if (sbx == 0 && sby == 0) od_dec_mc_predict_sb(dec, pli, 0, 0);
+  if (sby == 0 && sbx + 1 < nhsb) od_dec_mc_predict_sb(dec, pli, sbx + 1, 0);
+  if (sbx == 0 && sby + 1 < nvsb) od_dec_mc_predict_sb(dec, pli, 0, sby + 1);
+  if (sbx + 1 < nhsb && sby + 1 < nvsb) {
+    od_dec_mc_predict_sb(dec, pli, sbx + 1, sby + 1);
+  }
+  if (!prefilter) return;
+  xdec = state->io_imgs[OD_FRAME_REC].planes[pli].xdec;
+  ydec = state->io_imgs[OD_FRAME_REC].planes[pli].ydec;
+  w = state->frame_width >> xdec;
+  bw = OD_BSIZE_MAX >> xdec;
+  bh = OD_BSIZE_MAX >> ydec;
+  f = OD_FILT_SIZE(OD_NBSIZES - 1, xdec);
+  mc = state->mctmp[pli];
+  if (sby + 1 < nvsb) {
+    /*The edge below this superblock row, under the superblocks whose
+       predictions were just completed.*/
+    if (sbx == 0) od_prefilter_hedge(mc + (sby + 1)*bh*w, w, bw, f);
+    if (sbx + 1 < nhsb) {
+      od_prefilter_hedge(mc + (sby + 1)*bh*w + (sbx + 1)*bw, w, bw, f);
+    }
+  }
+  if (sbx + 1 < nhsb) {
+    od_prefilter_vedge(mc + sby*bh*w + (sbx + 1)*bw, w, bh, f);
+  }
+}
+
+/*Builds a reduced-resolution image of plane pli from the dequantized
+   coefficients of a keyframe, without the full-size inverse transforms.
+  Each output pixel is the average of a (1 << shift) by (1 << shift) area.
+  Blocks at least that large only need an inverse transform of their
+   low-order coefficients (or nothing at all beyond their DC), while smaller
+   blocks contribute their DC to the average of the area they fall in.
+  Lapping is ignored, which is invisible at these scales.*/
+static void od_dec_thumbnail_plane(daala_dec_ctx *dec, int pli, int shift,
+ int use_haar_wavelet) {
+  od_state *state;
+  od_coeff *acc;
+  unsigned char *data;
+  int ystride;
+  int coeff_shift;
+  int xdec;
+  int ydec;
+  int w;
+  int h;
+  int tw;
+  int th;
+  int x;
+  int y;
+  state = &dec->state;
+  xdec = state->io_imgs[OD_FRAME_INPUT].planes[pli].xdec;
+  ydec = state->io_imgs[OD_FRAME_INPUT].planes[pli].ydec;
+  /*This code assumes 4:4:4 or 4:2:0 input.*/
+  OD_ASSERT(xdec == ydec);
+  w = state->frame_width >> xdec;
+  h = state->frame_height >> ydec;
+  tw = (w + (1 << shift) - 1) >> shift;
+  th = (h + (1 << shift) - 1) >> shift;
+  /*Keyframes do not use the motion compensation buffers, so we accumulate
+     the sum of the pixels covered by each output pixel there.*/
+  acc = state->mctmp[pli];
+  for (y = 0; y < th*tw; y++) acc[y] = 0;
+  if (use_haar_wavelet) {
+    od_coeff *c;
+    /*The Haar wavelet is only used for lossless coding, which is rare enough
+       that we just reconstruct the full-size plane and average it.*/
+    c = state->ctmp[pli];
+    for (y = 0; y < h; y++) {
+      for (x = 0; x < w; x++) {
+        acc[(y >> shift)*tw + (x >> shift)] += c[y*w + x];
+      }
+    }
+  }
+  else {
+    OD_ALIGN16(od_coeff buf[OD_BSIZE_MAX*OD_BSIZE_MAX]);
+    od_coeff *d;
+    int nhb;
+    int nvb;
+    int bx;
+    int by;
+    d = state->dtmp[pli];
+    nhb = state->nhsb << (OD_NBSIZES - 1);
+    nvb = state->nvsb << (OD_NBSIZES - 1);
+    for (by = 0; by < nvb; by++) {
+      for (bx = 0; bx < nhb; bx++) {
+        od_coeff *blk;
+        int bs;
+        int lb;
+        int ln;
+        int tx;
+        int ty;
+        /*Chroma blocks smaller than 4x4 are merged, exactly as in
+           od_decode_recursive().*/
+        lb = OD_MAXI(OD_BLOCK_SIZE4x4(state->bsize, state->bstride, bx, by),
+         xdec);
+        if ((bx | by) & ((1 << lb) - 1)) continue;
+        bs = lb - xdec;
+        ln = OD_LOG_BSIZE0 + bs;
+        x = (bx << OD_LOG_BSIZE0) >> xdec;
+        y = (by << OD_LOG_BSIZE0) >> ydec;
+        blk = d + y*w + x;
+        tx = x >> shift;
+        ty = y >> shift;
+        if (ln < shift) {
+          /*The sum of the block's pixels is its DC scaled by its size.*/
+          acc[ty*tw + tx] += blk[0]*(1 << ln);
+        }
+        else if (ln == shift) acc[ty*tw + tx] = blk[0]*(1 << shift);
+        else if (ln == shift + 1) {
+          od_coeff s0;
+          od_coeff s1;
+          od_coeff d0;
+          od_coeff d1;
+          /*2x2 orthonormal inverse DCT of the low-order coefficients.*/
+          s0 = blk[0] + blk[w];
+          d0 = blk[0] - blk[w];
+          s1 = blk[1] + blk[w + 1];
+          d1 = blk[1] - blk[w + 1];
+          acc[ty*tw + tx] = (s0 + s1)*(1 << shift >> 1);
+          acc[ty*tw + tx + 1] = (s0 - s1)*(1 << shift >> 1);
+          acc[(ty + 1)*tw + tx] = (d0 + d1)*(1 << shift >> 1);
+          acc[(ty + 1)*tw + tx + 1] = (d0 - d1)*(1 << shift >> 1);
+        }
+        else {
+          int m;
+          int i;
+          int j;
+          /*The top-left m by m coefficients of an orthonormal n by n DCT,
+             scaled by m/n, are the DCT of the n/m decimated block.*/
+          m = 1 << (ln - shift);
+          (*state->opt_vtbl.idct_2d[ln - shift - OD_LOG_BSIZE0])(buf, m,
+           blk, w);
+          for (i = 0; i < m; i++) {
+            for (j = 0; j < m; j++) {
+              acc[(ty + i)*tw + tx + j] = buf[i*m + j]*(1 << shift);
+            }
+          }
+        }
       }
     }
   }
+  coeff_shift = dec->quantizer[pli] == 0 ? 0 : OD_COEFF_SHIFT;
+  data = state->io_imgs[OD_FRAME_REC].planes[pli].data;
+  ystride = state->io_imgs[OD_FRAME_REC].planes[pli].ystride;
+  for (y = 0; y < th; y++) {
+    int ah;
+    ah = OD_MINI(h - (y << shift), 1 << shift);
+    for (x = 0; x < tw; x++) {
+      od_coeff den;
+      od_coeff v;
+      den = ah*OD_MINI(w - (x << shift), 1 << shift) << coeff_shift;
+      v = acc[y*tw + x];
+      v = v < 0 ? -((den/2 - v)/den) : (v + den/2)/den;
+      data[ystride*y + x] = OD_CLAMP255(v + 128);
+    }
+  }
+}
+
+/*Decodes the deringing flags of superblock row sby and applies the filter.
+  The filter reads one pixel past each side of a superblock, so the rows
+   above and below must have been lapped already.*/
+static void od_dec_clpf_sb_row(od_dec_ctx *dec, int sby) {
+  od_state *state;
+  int nplanes;
+  int nhsb;
+  int nvsb;
+  int sbx;
+  state = &dec->state;
+  nplanes = state->info.nplanes;
+  nhsb = state->nhsb;
+  nvsb = state->nvsb;
+  for (sbx = 0; sbx < nhsb; sbx++) {
+    int filtered;
+    int c;
+    int up;
+    int left;
+    int pli;
+    if (state->sb_skip_flags[sby*nhsb + sbx]) {
+      state->clpf_flags[sby*nhsb + sbx] = 0;
+      continue;
+    }
+    up = 0;
+    if (sby > 0) {
+      up = state->clpf_flags[(sby-1)*nhsb + sbx];
+    }
+    left = 0;
+    if (sbx > 0) {
+      left = state->clpf_flags[sby*nhsb + (sbx-1)];
+    }
+    c = (up << 1) + left;
+    OD_DEC_ACCT_SET_SB(dec, sby*nhsb + sbx);
+    filtered = od_decode_cdf_adapt(&dec->ec, state->adapt.clpf_cdf[c], 2,
+     state->adapt.clpf_increment);
+    state->clpf_flags[sby*nhsb + sbx] = filtered;
+    if (filtered) {
+      for (pli = 0; pli < nplanes; pli++) {
+        od_coeff buf[OD_BSIZE_MAX*OD_BSIZE_MAX];
+        od_coeff *output;
+        int xdec;
+        int ydec;
+        int ln;
+        int n;
+        int w;
+        int y;
+        int x;
+        xdec = state->io_imgs[OD_FRAME_INPUT].planes[pli].xdec;
+        ydec = state->io_imgs[OD_FRAME_INPUT].planes[pli].ydec;
+        w = state->frame_width >> xdec;
+        ln = OD_LOG_BSIZE_MAX - xdec;
+        n = 1 << ln;
+        OD_ASSERT(xdec == ydec);
+        /*buf is used for output so that we don't use filtered pixels in
+          the input to the filter, but because we look past block edges,
+          we do this anyway on the edge pixels. Unfortunately, this limits
+          potential parallelism.*/
+        (*state->opt_vtbl.clpf)(buf, OD_BSIZE_MAX,
+         &state->ctmp[pli][(sby << ln)*w + (sbx << ln)], w, ln, sbx, sby,
+         nhsb, nvsb);
+        output = &state->ctmp[pli][(sby << ln)*w + (sbx << ln)];
+        for (y = 0; y < n; y++) {
+          for (x = 0; x < n; x++) {
+            output[y*w + x] = buf[y*OD_BSIZE_MAX + x];
+          }
+        }
+      }
+    }
+  }
+}
+
+/*Smooths the keyframe superblocks of row sby coded as a single block,
+   converts the row to 8-bit output, and reports it to the row callback.
+  The deringing filter of the row below reads the last row of this one, so
+   it must have run already.*/
+static void od_dec_finish_sb_row(od_dec_ctx *dec, od_mb_dec_ctx *mbctx,
+ int sby) {
+  od_state *state;
+  int nplanes;
+  int nhsb;
+  int pli;
+  int y0;
+  int y1;
+  state = &dec->state;
+  nplanes = state->info.nplanes;
+  nhsb = state->nhsb;
+  for (pli = 0; pli < nplanes; pli++) {
+    unsigned char *data;
+    od_coeff *ctmp;
+    int ystride;
+    int coeff_shift;
+    int xdec;
+    int ydec;
+    int ln;
+    int sbx;
+    int w;
+    int y;
+    int x;
+    xdec = state->io_imgs[OD_FRAME_INPUT].planes[pli].xdec;
+    ydec = state->io_imgs[OD_FRAME_INPUT].planes[pli].ydec;
+    w = state->frame_width >> xdec;
+    ln = OD_LOG_BSIZE_MAX - ydec;
+    if (mbctx->is_keyframe) {
+      for (sbx = 0; sbx < nhsb; sbx++) {
+        if (OD_BLOCK_SIZE4x4(state->bsize, state->bstride,
+         sbx << (OD_NBSIZES - 1), sby << (OD_NBSIZES - 1))
+         == OD_NBSIZES - 1) {
+          OD_ASSERT(xdec == ydec);
+          (*state->opt_vtbl.bilinear_smooth)(
+           &state->ctmp[pli][(sby << ln)*w + (sbx << ln)], ln, w,
+           dec->quantizer[pli], pli);
+        }
+      }
+    }
+    coeff_shift = dec->quantizer[pli] == 0 ? 0 : OD_COEFF_SHIFT;
+    ystride = state->io_imgs[OD_FRAME_REC].planes[pli].ystride;
+    data = state->io_imgs[OD_FRAME_REC].planes[pli].data
+     + ystride*(sby << ln);
+    ctmp = state->ctmp[pli] + w*(sby << ln);
+    for (y = 0; y < 1 << ln; y++) {
+      for (x = 0; x < w; x++) {
+        data[ystride*y + x] = OD_CLAMP255(((ctmp[y*w + x]
+         + (1 << coeff_shift >> 1)) >> coeff_shift) + 128);
+      }
+    }
+  }
+  y0 = sby << OD_LOG_BSIZE_MAX;
+  y1 = OD_MINI(y0 + OD_BSIZE_MAX, state->info.pic_height);
+  if (dec->row_cb.func != NULL && y0 < y1) {
+    od_img img;
+    img = state->io_imgs[OD_FRAME_REC];
+    img.width = state->info.pic_width;
+    img.height = state->info.pic_height;
+    (*dec->row_cb.func)(dec->row_cb.ctx, &img, y0, y1);
+  }
 }
 
 static void od_decode_coefficients(od_dec_ctx *dec, od_mb_dec_ctx *mbctx) {
@@ -783,12 +1267,7 @@ static void od_decode_coefficients(od_dec_ctx *dec, od_mb_dec_ctx *mbctx) {
   int ydec;
   int sby;
   int sbx;
-  int h;
-  int w;
-  int y;
-  int x;
   int frame_width;
-  int frame_height;
   int nvsb;
   int nhsb;
   od_state *state;
@@ -798,35 +1277,8 @@ static void od_decode_coefficients(od_dec_ctx *dec, od_mb_dec_ctx *mbctx) {
   nhsb = state->nhsb;
   nvsb = state->nvsb;
   frame_width = state->frame_width;
-  frame_height = state->frame_height;
-  /*Apply the prefilter to the motion-compensated reference.*/
-  if (!mbctx->is_keyframe) {
-    for (pli = 0; pli < nplanes; pli++) {
-      xdec = state->io_imgs[OD_FRAME_REC].planes[pli].xdec;
-      ydec = state->io_imgs[OD_FRAME_REC].planes[pli].ydec;
-      w = frame_width >> xdec;
-      h = frame_height >> ydec;
-      /*Collect the image data needed for this plane.*/
-      {
-        unsigned char *mdata;
-        int ystride;
-        int coeff_shift;
-        coeff_shift = dec->quantizer[pli] == 0 ? 0 : OD_COEFF_SHIFT;
-        mdata = state->io_imgs[OD_FRAME_REC].planes[pli].data;
-        ystride = state->io_imgs[OD_FRAME_REC].planes[pli].ystride;
-        for (y = 0; y < h; y++) {
-          for (x = 0; x < w; x++) {
-            state->mctmp[pli][y*w + x] = (mdata[ystride*y + x] - 128)
-             << coeff_shift;
-          }
-        }
-      }
-      if (!mbctx->is_keyframe && !mbctx->use_haar_wavelet) {
-        od_apply_prefilter_frame_sbs(state->mctmp[pli], w, nhsb, nvsb, xdec,
-         ydec);
-      }
-    }
-  }
+  OD_DEC_ACCT_UPDATE(dec, OD_ACCT_CAT_TECHNIQUE, OD_ACCT_TECH_FRAME);
+  OD_DEC_ACCT_UPDATE(dec, OD_ACCT_CAT_PLANE, OD_ACCT_PLANE_FRAME);
   for (pli = 0; pli < nplanes; pli++) {
     dec->quantizer[pli] =
      od_codedquantizer_to_quantizer(od_ec_dec_uint(&dec->ec,
@@ -834,6 +1286,7 @@ static void od_decode_coefficients(od_dec_ctx *dec, od_mb_dec_ctx *mbctx) {
   }
   for (sby = 0; sby < nvsb; sby++) {
     for (sbx = 0; sbx < nhsb; sbx++) {
+      OD_DEC_ACCT_SET_SB(dec, sby*nhsb + sbx);
       for (pli = 0; pli < nplanes; pli++) {
         od_coeff hgrad;
         od_coeff vgrad;
@@ -845,7 +1298,14 @@ static void od_decode_coefficients(od_dec_ctx *dec, od_mb_dec_ctx *mbctx) {
         mbctx->l = state->lbuf[pli];
         xdec = state->io_imgs[OD_FRAME_INPUT].planes[pli].xdec;
         ydec = state->io_imgs[OD_FRAME_INPUT].planes[pli].ydec;
+        OD_DEC_ACCT_UPDATE(dec, OD_ACCT_CAT_PLANE, OD_ACCT_PLANE_LUMA + pli);
+        if (!mbctx->is_keyframe) {
+          od_dec_mc_prefilter_sb(dec, pli, sbx, sby,
+           !mbctx->use_haar_wavelet);
+        }
         if (mbctx->is_keyframe) {
+          OD_DEC_ACCT_UPDATE(dec, OD_ACCT_CAT_TECHNIQUE,
+           OD_ACCT_TECH_DC_COEFF);
           od_decode_haar_dc_sb(dec, mbctx, pli, sbx, sby, xdec, ydec,
            sby > 0 && sbx < nhsb - 1, &hgrad, &vgrad);
         }
@@ -854,103 +1314,35 @@ static void od_decode_coefficients(od_dec_ctx *dec, od_mb_dec_ctx *mbctx) {
       }
     }
   }
-  for (pli = 0; pli < nplanes; pli++) {
-    xdec = state->io_imgs[OD_FRAME_INPUT].planes[pli].xdec;
-    ydec = state->io_imgs[OD_FRAME_INPUT].planes[pli].ydec;
-    w = frame_width >> xdec;
-    h = frame_height >> ydec;
-    if (!mbctx->use_haar_wavelet) {
-      od_apply_postfilter_frame_sbs(state->ctmp[pli], w, nhsb, nvsb, xdec,
-       ydec);
-    }
-  }
-  if (dec->quantizer[0] > 0) {
-    for (sby = 0; sby < nvsb; sby++) {
-      for (sbx = 0; sbx < nhsb; sbx++) {
-        int filtered;
-        int c;
-        int up;
-        int left;
-        if (state->sb_skip_flags[sby*nhsb + sbx]) {
-          state->clpf_flags[sby*nhsb + sbx] = 0;
-          continue;
-        }
-        up = 0;
-        if (sby > 0) {
-          up = state->clpf_flags[(sby-1)*nhsb + sbx];
-        }
-        left = 0;
-        if (sbx > 0) {
-          left = state->clpf_flags[sby*nhsb + (sbx-1)];
-        }
-        c = (up << 1) + left;
-        filtered = od_decode_cdf_adapt(&dec->ec, state->adapt.clpf_cdf[c], 2,
-         state->adapt.clpf_increment);
-        state->clpf_flags[sby*nhsb + sbx] = filtered;
-        if (filtered) {
-          for (pli = 0; pli < nplanes; pli++) {
-            od_coeff buf[OD_BSIZE_MAX*OD_BSIZE_MAX];
-            od_coeff *output;
-            int ln;
-            int n;
-            xdec = state->io_imgs[OD_FRAME_INPUT].planes[pli].xdec;
-            ydec = state->io_imgs[OD_FRAME_INPUT].planes[pli].ydec;
-            w = frame_width >> xdec;
-            h = frame_height >> ydec;
-            ln = OD_LOG_BSIZE_MAX - xdec;
-            n = 1 << ln;
-            OD_ASSERT(xdec == ydec);
-            /*buf is used for output so that we don't use filtered pixels in
-              the input to the filter, but because we look past block edges,
-              we do this anyway on the edge pixels. Unfortunately, this limits
-              potential parallelism.*/
-            od_clpf(buf, OD_BSIZE_MAX, &state->ctmp[pli][(sby << ln)*w +
-             (sbx << ln)], w, ln, sbx, sby, nhsb, nvsb);
-            output = &state->ctmp[pli][(sby << ln)*w + (sbx << ln)];
-            for (y = 0; y < n; y++) {
-              for (x = 0; x < n; x++) {
-                output[y*w + x] = buf[y*OD_BSIZE_MAX + x];
-              }
-            }
-          }
-        }
-      }
+  OD_DEC_ACCT_SET_SB(dec, -1);
+  if (dec->thumb_shift) {
+    /*The deringing flags are the only thing left in the packet, and they are
+       of no use for a thumbnail, so we stop decoding here.*/
+    for (pli = 0; pli < nplanes; pli++) {
+      od_dec_thumbnail_plane(dec, pli, dec->thumb_shift,
+       mbctx->use_haar_wavelet);
     }
+    return;
   }
-  for (pli = 0; pli < nplanes; pli++) {
-    xdec = state->io_imgs[OD_FRAME_INPUT].planes[pli].xdec;
-    ydec = state->io_imgs[OD_FRAME_INPUT].planes[pli].ydec;
-    w = frame_width >> xdec;
-    h = frame_height >> ydec;
-    for (sby = 0; sby < nvsb; sby++) {
-      for (sbx = 0; sbx < nhsb; sbx++) {
-        if (mbctx->is_keyframe &&
-         OD_BLOCK_SIZE4x4(dec->state.bsize, dec->state.bstride,
-         sbx << (OD_NBSIZES - 1), sby << (OD_NBSIZES - 1)) == OD_NBSIZES - 1) {
-          int ln;
-          OD_ASSERT(xdec == ydec);
-          ln = OD_LOG_BSIZE_MAX - xdec;
-          od_bilinear_smooth(&state->ctmp[pli][(sby << ln)*w + (sbx << ln)],
-           ln, w, dec->quantizer[pli], pli);
-        }
+  if (dec->quantizer[0] == 0) OD_CLEAR(state->clpf_flags, nhsb*nvsb);
+  OD_DEC_ACCT_UPDATE(dec, OD_ACCT_CAT_TECHNIQUE, OD_ACCT_TECH_CLPF);
+  OD_DEC_ACCT_UPDATE(dec, OD_ACCT_CAT_PLANE, OD_ACCT_PLANE_FRAME);
+  /*Each filter reads a little way into the superblock row below, so each
+     stage runs one row behind the one before it, and the output rows are
+     final as soon as the last stage is done with them.*/
+  for (sby = 0; sby < nvsb + 2; sby++) {
+    if (sby < nvsb && !mbctx->use_haar_wavelet) {
+      for (pli = 0; pli < nplanes; pli++) {
+        xdec = state->io_imgs[OD_FRAME_INPUT].planes[pli].xdec;
+        ydec = state->io_imgs[OD_FRAME_INPUT].planes[pli].ydec;
+        od_apply_postfilter_sb_row(state->ctmp[pli], frame_width >> xdec,
+         nhsb, sby, xdec, ydec);
       }
     }
-    {
-      unsigned char *data;
-      od_coeff *ctmp;
-      int ystride;
-      int coeff_shift;
-      coeff_shift = dec->quantizer[pli] == 0 ? 0 : OD_COEFF_SHIFT;
-      data = state->io_imgs[OD_FRAME_REC].planes[pli].data;
-      ctmp = state->ctmp[pli];
-      ystride = state->io_imgs[OD_FRAME_REC].planes[pli].ystride;
-      for (y = 0; y < h; y++) {
-        for (x = 0; x < w; x++) {
-          data[ystride*y + x] = OD_CLAMP255(((ctmp[y*w + x]
-           + (1 << coeff_shift >> 1)) >> coeff_shift) + 128);
-        }
-      }
+    if (sby >= 1 && sby <= nvsb && dec->quantizer[0] > 0) {
+      od_dec_clpf_sb_row(dec, sby - 1);
     }
+    if (sby >= 2) od_dec_finish_sb_row(dec, mbctx, sby - 2);
   }
 }
 
@@ -963,12 +1355,17 @@ int daala_decode_packet_in(daala_dec_ctx *dec, od_img *img,
   if (dec->packet_state != OD_PACKET_DATA) return OD_EINVAL;
   if (op->e_o_s) dec->packet_state = OD_PACKET_DONE;
   od_ec_dec_init(&dec->ec, op->packet, op->bytes);
+  OD_DEC_ACCT_RESET(dec);
+  OD_DEC_ACCT_UPDATE(dec, OD_ACCT_CAT_TECHNIQUE, OD_ACCT_TECH_FRAME);
+  OD_DEC_ACCT_UPDATE(dec, OD_ACCT_CAT_PLANE, OD_ACCT_PLANE_FRAME);
   /*Read the packet type bit.*/
   if (od_ec_decode_bool_q15(&dec->ec, 16384)) return OD_EBADPACKET;
   mbctx.is_keyframe = od_ec_decode_bool_q15(&dec->ec, 16384);
   mbctx.use_activity_masking = od_ec_decode_bool_q15(&dec->ec, 16384);
   mbctx.qm = od_ec_decode_bool_q15(&dec->ec, 16384);
   mbctx.use_haar_wavelet = od_ec_decode_bool_q15(&dec->ec, 16384);
+  /*Thumbnails do not keep any reference frames around to predict from.*/
+  if (dec->thumb_shift && !mbctx.is_keyframe) return OD_EIMPL;
   if (mbctx.is_keyframe) {
     int nplanes;
     int pli;
@@ -1005,14 +1402,26 @@ int daala_decode_packet_in(daala_dec_ctx *dec, od_img *img,
    || refi == dec->state.ref_imgi[OD_FRAME_NEXT]; refi++);
   dec->state.ref_imgi[OD_FRAME_SELF] = refi;
   od_adapt_ctx_reset(&dec->state.adapt, mbctx.is_keyframe);
+  dec->is_keyframe = mbctx.is_keyframe;
+  /*Only the top-left 4x4 entry of each block gets band flags, and none do
+     with the Haar wavelet, so clear the rest rather than leave them over
+     from an earlier frame in OD_DECCTL_GET_SIDE_DATA.
+    The copy in OD_DECCTL_SET_FLAGS_BUFFER has the same layout.*/
+  OD_CLEAR(dec->flags, dec->state.nhsb*8*dec->state.nvsb*8);
+  if (dec->user_flags != NULL) {
+    OD_CLEAR(dec->user_flags, dec->state.nhsb*8*dec->state.nvsb*8);
+  }
+  if (mbctx.use_haar_wavelet) {
+    OD_CLEAR(dec->state.sb_skip_flags, dec->state.nhsb*dec->state.nvsb);
+  }
   if (!mbctx.is_keyframe) {
+    OD_DEC_ACCT_UPDATE(dec, OD_ACCT_CAT_TECHNIQUE,
+     OD_ACCT_TECH_MOTION_VECTORS);
     od_dec_mv_unpack(dec);
-    od_state_mc_predict(&dec->state, OD_FRAME_PREV);
-    if (dec->user_mc_img != NULL) {
-      od_img_copy(dec->user_mc_img, &dec->state.io_imgs[OD_FRAME_REC]);
-    }
   }
   od_decode_coefficients(dec, &mbctx);
+  /*Charge the last symbols of the frame.*/
+  OD_DEC_ACCT_SET_SB(dec, -1);
   if (dec->user_bsize != NULL) {
     int j;
     int nhsb;
@@ -1024,14 +1433,32 @@ int daala_decode_packet_in(daala_dec_ctx *dec, od_img *img,
        &dec->state.bsize[dec->state.bstride*j], nhsb*4);
     }
   }
+  if (dec->thumb_shift) {
+    /*The reference frames were not updated, so make sure an inter frame
+       decoded after thumbnails are disabled does not use stale ones.*/
+    dec->state.ref_imgi[OD_FRAME_GOLD] = -1;
+    dec->state.ref_imgi[OD_FRAME_PREV] = -1;
+    dec->state.ref_imgi[OD_FRAME_SELF] = -1;
+    *img = dec->state.io_imgs[OD_FRAME_REC];
+    img->width = (dec->state.info.pic_width + (1 << dec->thumb_shift) - 1)
+     >> dec->thumb_shift;
+    img->height = (dec->state.info.pic_height + (1 << dec->thumb_shift) - 1)
+     >> dec->thumb_shift;
+    if (dec->row_cb.func != NULL) {
+      (*dec->row_cb.func)(dec->row_cb.ctx, img, 0, img->height);
+    }
+    dec->state.cur_time++;
+    return 0;
+  }
 #if defined(OD_DUMP_IMAGES) || defined(OD_DUMP_RECONS)
   /*Dump YUV*/
   od_state_dump_yuv(&dec->state, dec->state.io_imgs + OD_FRAME_REC, "out");
 #endif
   ref_img = dec->state.ref_imgs + dec->state.ref_imgi[OD_FRAME_SELF];
   OD_ASSERT(ref_img);
+  /*No edge extension is needed: motion compensation clamps its reads to the
+     frame.*/
   od_img_copy(ref_img, dec->state.io_imgs + OD_FRAME_REC);
-  od_img_edge_ext(ref_img);
   /*Return decoded frame.*/
   *img = dec->state.io_imgs[OD_FRAME_REC];
   img->width = dec->state.info.pic_width;
@@ -0,0 +1,201 @@
+/*Daala video codec
+Copyright (c) 2016 Daala project contributors.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+- Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+- Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <limits.h>
+#include <math.h>
+#include "encint.h"
+#include "block_size.h"
+#include "pvq.h"
+
+/*Perceptual distortion used by the block-size RDO.*/
+
+/*Fills in the tables used by od_compute_dist().
+  The HVS weights only depend on the block size, so we compute them once per
+   encoder instead of once per coefficient, in exactly the same order as the
+   direct computation so the results do not change.
+  The activity tables replace a call to pow(x, -1/6) with a lookup on the
+   exponent of x and a linear interpolation on its mantissa.*/
+void od_enc_dist_init(od_enc_ctx *enc) {
+  int bs;
+  int i;
+  int j;
+  for (bs = 1; bs < OD_NBSIZES; bs++) {
+    for (i = 0; i < 8; i++) {
+      for (j = 0; j < 8; j++) {
+        double mag;
+        mag = 16./OD_QM8_Q4_HVS[i*8 + j];
+        /* We attempt to consider the basis magnitudes here, though that's not
+           perfect for block size 16x16 and above since only some edges are
+           filtered then. */
+        mag *= OD_BASIS_MAG[0][bs][i << (bs - 1)]*
+         OD_BASIS_MAG[0][bs][j << (bs - 1)];
+        mag *= mag;
+        enc->dist_weights[bs][i*8 + j] = mag;
+      }
+    }
+  }
+  for (i = 0; i <= OD_ACTIVITY_TABLE_SIZE; i++) {
+    enc->activity_mant[i] = pow(.5 + i*(.5/OD_ACTIVITY_TABLE_SIZE), -1./6);
+  }
+  for (i = 0; i < 6; i++) enc->activity_exp[i] = pow(2, -i/6.);
+}
+
+/*Computes x^(-1/6) for x >= .25 using the tables set up by
+   od_enc_dist_init().
+  With x = m*2^e and .5 <= m < 1, this is m^(-1/6)*2^(-e/6), and 2^(-e/6)
+   splits further into a power of two and one of six fractional powers.
+  The relative error is below 4E-7 (3.7E-7 measured over [.25, 1E6]).*/
+static double od_activity_pow(const od_enc_ctx *enc, double x) {
+  double m;
+  double t;
+  int e;
+  int k;
+  m = frexp(x, &e);
+  t = (m - .5)*(2*OD_ACTIVITY_TABLE_SIZE);
+  k = (int)t;
+  t -= k;
+  m = enc->activity_mant[k] + t*(enc->activity_mant[k + 1]
+   - enc->activity_mant[k]);
+  /*x >= .25 means e >= -1, so offsetting it by 6 keeps the division and
+     remainder below on non-negative values.*/
+  OD_ASSERT(e >= -1);
+  e += 6;
+  return ldexp(m*enc->activity_exp[e%6], 1 - e/6);
+}
+
+static int od_compute_var_4x4(const od_coeff *x, int stride) {
+  int sum;
+  int s2;
+  int i;
+  sum = 0;
+  s2 = 0;
+  for (i = 0; i < 4; i++) {
+    int j;
+    for (j = 0; j < 4; j++) {
+      int t;
+      /* Avoids overflow in the sum^2 below because the pre-filtered input
+         can be much larger than +/-128 << OD_COEFF_SHIFT. Shifting the sum
+         itself is a bad idea because it leads to large error on low
+         variance. */
+      t = x[i*stride + j] >> 2;
+      sum += t;
+      s2 += t*t;
+    }
+  }
+  return (s2 - (sum*sum >> 4));
+}
+
+/*Computes the sum of squared errors over n contiguous coefficients.*/
+double od_compute_sse_c(const od_coeff *x, const od_coeff *y, int n) {
+  double sum;
+  int i;
+  sum = 0;
+  for (i = 0; i < n; i++) {
+    double tmp;
+    tmp = x[i] - y[i];
+    sum += tmp*tmp;
+  }
+  return sum;
+}
+
+/*Computes the sum of the squared 8x8 transform coefficients in et, each
+   scaled by the matching entry of w.*/
+double od_compute_weighted_sse_8x8_c(const od_coeff *et, const double *w) {
+  double sum;
+  int i;
+  sum = 0;
+  for (i = 0; i < 8*8; i++) sum += et[i]*(double)et[i]*w[i];
+  return sum;
+}
+
+static double od_compute_dist_8x8(daala_enc_ctx *enc, const od_coeff *x,
+ const od_coeff *y, int stride, int bs) {
+  od_coeff e[8*8];
+  od_coeff et[8*8];
+  int min_var;
+  double mean_var;
+  double var_stat;
+  double activity;
+  double calibration;
+  int i;
+  int j;
+  OD_ASSERT(enc->qm != OD_FLAT_QM);
+  OD_ASSERT(bs >= 1 && bs < OD_NBSIZES);
+  min_var = INT_MAX;
+  mean_var = 0;
+  for (i = 0; i < 3; i++) {
+    for (j = 0; j < 3; j++) {
+      int var;
+      var = od_compute_var_4x4(x + 2*i*stride + 2*j, stride);
+      min_var = OD_MINI(min_var, var);
+      mean_var += 1./(1+var);
+    }
+  }
+  /* We use a different variance statistic depending on whether activity
+     masking is used, since the harmonic mean appeared slghtly worse with
+     masking off. The calibration constant just ensures that we preserve the
+     rate compared to activity=1. */
+  if (enc->use_activity_masking) {
+    calibration = 1.95;
+    var_stat = 9./mean_var;
+  }
+  else {
+    calibration = 1.62;
+    var_stat = min_var;
+  }
+  /* 1.62 is a calibration constant, 0.25 is a noise floor and 1/6 is the
+     activity masking constant. */
+  activity = calibration*od_activity_pow(enc,
+   .25 + var_stat/(1 << 2*OD_COEFF_SHIFT));
+  for (i = 0; i < 8; i++) {
+    for (j = 0; j < 8; j++) e[8*i + j] = x[i*stride + j] - y[i*stride + j];
+  }
+  (*enc->state.opt_vtbl.fdct_2d[OD_BLOCK_8X8])(&et[0], 8, &e[0], 8);
+  return activity*activity*
+   (*enc->opt_vtbl.compute_weighted_sse_8x8)(et, enc->dist_weights[bs]);
+}
+
+/*Computes the distortion between the n x n blocks x and y (both with a
+   stride of n) used to decide whether to split a block of size bs.*/
+double od_compute_dist(daala_enc_ctx *enc, const od_coeff *x,
+ const od_coeff *y, int n, int bs) {
+  int i;
+  double sum;
+  if (enc->qm == OD_FLAT_QM) {
+    return (*enc->opt_vtbl.compute_sse)(x, y, n*n);
+  }
+  sum = 0;
+  for (i = 0; i < n; i += 8) {
+    int j;
+    for (j = 0; j < n; j += 8) {
+      sum += od_compute_dist_8x8(enc, &x[i*n + j], &y[i*n + j], n, bs);
+    }
+  }
+  return sum;
+}
@@ -30,12 +30,15 @@ typedef struct od_params_ctx od_params_ctx;
 typedef struct od_mv_est_ctx od_mv_est_ctx;
 typedef struct od_enc_opt_vtbl od_enc_opt_vtbl;
 typedef struct od_rollback_buffer od_rollback_buffer;
+typedef struct od_complexity_ctl od_complexity_ctl;
+typedef struct od_queued_img od_queued_img;
 
 # include "../include/daala/daaladec.h"
 # include "../include/daala/daalaenc.h"
 # include "state.h"
 # include "entenc.h"
 # include "block_size_enc.h"
+# include "accounting.h"
 
 /*Constants for the packet state machine specific to the encoder.*/
 /*No packet currently ready to output.*/
@@ -48,6 +51,22 @@ typedef struct od_rollback_buffer od_rollback_buffer;
    \lambda*R.*/
 # define OD_ERROR_SCALE        (OD_LAMBDA_SCALE + OD_BITRES)
 
+/*Charges the bits coded since the last accounting update to the current
+   categories before switching category cat to value.*/
+# define OD_ENC_ACCT_UPDATE(enc, cat, value) \
+  OD_ACCT_UPDATE(&(enc)->acct, od_ec_enc_tell_frac(&(enc)->ec), cat, value)
+/*Charges the bits coded from here on to superblock sbi (-1 for none).*/
+# define OD_ENC_ACCT_SET_SB(enc, sbi) \
+  OD_ACCT_SET_SB(&(enc)->acct, od_ec_enc_tell_frac(&(enc)->ec), sbi)
+# define OD_ENC_ACCT_RESET(enc) \
+  OD_ACCT_RESET(&(enc)->acct, od_ec_enc_tell_frac(&(enc)->ec))
+# define OD_ENC_ACCT_PAUSE(enc) \
+  OD_ACCT_PAUSE(&(enc)->acct, od_ec_enc_tell_frac(&(enc)->ec))
+# define OD_ENC_ACCT_RESUME(enc) \
+  OD_ACCT_RESUME(&(enc)->acct, od_ec_enc_tell_frac(&(enc)->ec))
+
+/*The complexity setting where we enable block size RDO.*/
+# define OD_BSIZE_RDO_COMPLEXITY (2)
 /*The complexity setting where we enable a square pattern in basic (fullpel)
    MV refinement.*/
 # define OD_MC_SQUARE_REFINEMENT_COMPLEXITY (8)
@@ -58,6 +77,10 @@ typedef struct od_rollback_buffer od_rollback_buffer;
    refinement.*/
 # define OD_MC_SQUARE_SUBPEL_REFINEMENT_COMPLEXITY (10)
 
+/*The number of intervals in the mantissa table used to compute the activity
+   masking term of the block-size RDO distortion.*/
+# define OD_ACTIVITY_TABLE_SIZE (256)
+
 struct od_enc_opt_vtbl {
   int (*mc_compute_sad_4x4_xstride_1)(const unsigned char *src,
    int systride, const unsigned char *ref, int dystride);
@@ -65,6 +88,13 @@ struct od_enc_opt_vtbl {
    int systride, const unsigned char *ref, int dystride);
   int (*mc_compute_sad_16x16_xstride_1)(const unsigned char *src,
    int systride, const unsigned char *ref, int dystride);
+  int (*mc_compute_sad_32x32_xstride_1)(const unsigned char *src,
+   int systride, const unsigned char *ref, int dystride);
+  int (*mc_compute_sad_xstride_1)(const unsigned char *src,
+   int systride, const unsigned char *ref, int dystride, int w, int h);
+  void (*mc_compute_sad4_xstride_1)(int32_t sad[4], const unsigned char *src,
+   int systride, const unsigned char *const ref[4], int dystride,
+   int w, int h);
   int (*mc_compute_satd_4x4)(const unsigned char *src,
    int systride, const unsigned char *ref, int dystride);
   int (*mc_compute_satd_8x8)(const unsigned char *src,
@@ -73,6 +103,46 @@ struct od_enc_opt_vtbl {
    int systride, const unsigned char *ref, int dystride);
   int (*mc_compute_satd_32x32)(const unsigned char *src,
    int systride, const unsigned char *ref, int dystride);
+  double (*compute_sse)(const od_coeff *x, const od_coeff *y, int n);
+  double (*compute_weighted_sse_8x8)(const od_coeff *et, const double *w);
+  void (*bs_sums_2x2)(int32_t *sx2, int32_t *sxx2, const unsigned char *img,
+   int istride, const unsigned char *pred, int pstride, int n);
+};
+
+/*The lowest complexity the real-time controller uses.
+  Each level below 0 also stops the sub-pel motion search one step earlier,
+   down to 1/2 pel, since that is most of the work left at complexity 0.*/
+# define OD_RT_COMPLEXITY_MIN (-2)
+/*The number of consecutive frames that must finish with time to spare
+   before the real-time controller tries a higher complexity.*/
+# define OD_RT_RAISE_FRAMES (4)
+/*The most frames the controller waits before raising the complexity again
+   after a raise immediately missed the deadline.*/
+# define OD_RT_RAISE_FRAMES_MAX (64)
+
+/*Real-time complexity control state (see OD_SET_FRAME_DEADLINE).*/
+struct od_complexity_ctl {
+  /*The time budget of each frame in microseconds, or 0 if disabled.*/
+  int deadline;
+  /*The complexity to use for the next frame, from OD_RT_COMPLEXITY_MIN up
+     to the configured complexity.*/
+  int complexity;
+  /*The number of consecutive frames that finished with time to spare.*/
+  int nfast;
+  /*The number of such frames needed before raising the complexity.*/
+  int raise_frames;
+  /*Whether the last frame was the first one after a raise.*/
+  int raised;
+};
+
+/*A frame submitted with daala_encode_img_submit() that has not been encoded
+   yet.*/
+struct od_queued_img {
+  od_img img;
+  int duration;
+  /*Whether the frame was submitted with OD_SUBMIT_PADDED.*/
+  int padded;
+  daala_img_release release;
 };
 
 /*Unsanitized user parameters*/
@@ -88,11 +158,30 @@ struct daala_enc_ctx{
   od_enc_opt_vtbl opt_vtbl;
   oggbyte_buffer obb;
   od_ec_enc ec;
+  /* Scratch entropy coder used to measure the rate of PVQ codewords, kept
+     here so that RDO does not allocate buffers for every candidate. */
+  od_ec_enc pvq_rate_ec;
   int packet_state;
   int quality[OD_NPLANES_MAX];
   int quantizer[OD_NPLANES_MAX];
   int coded_quantizer[OD_NPLANES_MAX];
   int complexity;
+  /*The complexity actually used for the current frame.
+    This is below complexity while the real-time controller is shedding
+     work.*/
+  int frame_complexity;
+  /*The coarsest sub-pel motion vector resolution used for the current frame
+     (see od_mv_est_ctx.mv_res_min).*/
+  int frame_mv_res_min;
+  od_complexity_ctl rt;
+  /*The frames waiting to be encoded by daala_encode_packet_out(), in a ring
+     starting at queue_head.*/
+  od_queued_img queue[OD_SUBMIT_QUEUE_MAX];
+  int queue_head;
+  int nqueued;
+  /*Whether daala_encode_img_in() reads the caller's buffers in place (see
+     OD_SET_INPUT_PADDED).*/
+  int input_padded;
   int use_activity_masking;
   int use_satd;
   int qm;
@@ -101,13 +190,26 @@ struct daala_enc_ctx{
   od_params_ctx params;
 #if defined(OD_ENCODER_CHECK)
   struct daala_dec_ctx *dec;
+#endif
+#if defined(OD_ACCOUNTING)
+  /*Where the bits of the last frame went, for OD_GET_ACCOUNTING.*/
+  od_acct acct;
 #endif
   od_block_size_comp *bs;
+  /* Block-size statistics of the current input computed by another encoder,
+     set by daala_encode_img_in_multi() for the duration of one frame. */
+  const od_frame_stats *shared_psy;
   /* These buffers are for saving pixel data during block size RDO. */
   od_coeff mc_orig[OD_NBSIZES-1][OD_BSIZE_MAX*OD_BSIZE_MAX];
   od_coeff c_orig[OD_NBSIZES-1][OD_BSIZE_MAX*OD_BSIZE_MAX];
   od_coeff nosplit[OD_NBSIZES-1][OD_BSIZE_MAX*OD_BSIZE_MAX];
   od_coeff split[OD_NBSIZES-1][OD_BSIZE_MAX*OD_BSIZE_MAX];
+  /* Per-block-size HVS weights of the 8x8 transform coefficients used by
+     od_compute_dist(), indexed by bs (0 is unused). */
+  double dist_weights[OD_NBSIZES][8*8];
+  /* Tables replacing pow(x, -1/6) in the activity masking term. */
+  double activity_mant[OD_ACTIVITY_TABLE_SIZE + 1];
+  double activity_exp[6];
 };
 
 /** Holds important encoder information so we can roll back decisions */
@@ -121,6 +223,9 @@ void od_encode_rollback(daala_enc_ctx *enc, const od_rollback_buffer *rbuf);
 
 od_mv_est_ctx *od_mv_est_alloc(od_enc_ctx *enc);
 void od_mv_est_free(od_mv_est_ctx *est);
+void od_mv_est_reset(od_mv_est_ctx *est);
+int od_mv_est_subpel_cache_alloc(od_mv_est_ctx *est);
+void od_mv_est_subpel_cache_free(od_mv_est_ctx *est);
 void od_mv_est(od_mv_est_ctx *est, int ref, int lambda);
 
 int od_mc_compute_sad_4x4_xstride_1_c(const unsigned char *src, int systride,
@@ -129,6 +234,12 @@ int od_mc_compute_sad_8x8_xstride_1_c(const unsigned char *src, int systride,
  const unsigned char *ref, int dystride);
 int od_mc_compute_sad_16x16_xstride_1_c(const unsigned char *src, int systride,
  const unsigned char *ref, int dystride);
+int od_mc_compute_sad_32x32_xstride_1_c(const unsigned char *src, int systride,
+ const unsigned char *ref, int dystride);
+int od_mc_compute_sad_xstride_1_c(const unsigned char *src, int systride,
+ const unsigned char *ref, int dystride, int w, int h);
+void od_mc_compute_sad4_xstride_1_c(int32_t sad[4], const unsigned char *src,
+ int systride, const unsigned char *const ref[4], int dystride, int w, int h);
 int od_mc_compute_sad_c(const unsigned char *_src, int _systride,
  const unsigned char *_ref, int _dystride, int _dxstride, int _w, int _h);
 int od_mc_compute_satd_4x4_c(const unsigned char *src, int systride,
@@ -139,6 +250,11 @@ int od_mc_compute_satd_16x16_c(const unsigned char *src, int systride,
  const unsigned char *ref, int dystride);
 int od_mc_compute_satd_32x32_c(const unsigned char *src, int systride,
  const unsigned char *ref, int dystride);
+double od_compute_sse_c(const od_coeff *x, const od_coeff *y, int n);
+double od_compute_weighted_sse_8x8_c(const od_coeff *et, const double *w);
+void od_enc_dist_init(od_enc_ctx *enc);
+double od_compute_dist(daala_enc_ctx *enc, const od_coeff *x,
+ const od_coeff *y, int n, int bs);
 void od_enc_opt_vtbl_init_c(od_enc_ctx *enc);
 
 # if defined(OD_X86ASM)
@@ -52,6 +52,13 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
 #if defined(OD_X86ASM)
 # include "x86/x86int.h"
 #endif
+#if defined(HAVE_GETTIMEOFDAY)
+# include <sys/time.h>
+#elif defined(HAVE_FTIME) || defined(_WIN32)
+# include <sys/timeb.h>
+#else
+# include <time.h>
+#endif
 
 /* These are the PVQ equivalent of quantization matrices, except that
    the values are per-band. */
@@ -144,6 +151,10 @@ void od_enc_opt_vtbl_init_c(od_enc_ctx *enc) {
    od_mc_compute_sad_8x8_xstride_1_c;
   enc->opt_vtbl.mc_compute_sad_16x16_xstride_1 =
    od_mc_compute_sad_16x16_xstride_1_c;
+  enc->opt_vtbl.mc_compute_sad_32x32_xstride_1 =
+   od_mc_compute_sad_32x32_xstride_1_c;
+  enc->opt_vtbl.mc_compute_sad_xstride_1 = od_mc_compute_sad_xstride_1_c;
+  enc->opt_vtbl.mc_compute_sad4_xstride_1 = od_mc_compute_sad4_xstride_1_c;
   enc->opt_vtbl.mc_compute_satd_4x4 =
    od_mc_compute_satd_4x4_c;
   enc->opt_vtbl.mc_compute_satd_8x8 =
@@ -152,6 +163,9 @@ void od_enc_opt_vtbl_init_c(od_enc_ctx *enc) {
    od_mc_compute_satd_16x16_c;
   enc->opt_vtbl.mc_compute_satd_32x32 =
    od_mc_compute_satd_32x32_c;
+  enc->opt_vtbl.compute_sse = od_compute_sse_c;
+  enc->opt_vtbl.compute_weighted_sse_8x8 = od_compute_weighted_sse_8x8_c;
+  enc->opt_vtbl.bs_sums_2x2 = od_bs_sums_2x2_c;
 }
 
 static void od_enc_opt_vtbl_init(od_enc_ctx *enc) {
@@ -162,20 +176,33 @@ static void od_enc_opt_vtbl_init(od_enc_ctx *enc) {
 #endif
 }
 
-static int od_enc_init(od_enc_ctx *enc, const daala_info *info) {
+static int od_enc_init(od_enc_ctx *enc, const daala_info *info,
+ const daala_allocator *alloc) {
   int i;
   int ret;
-  ret = od_state_init(&enc->state, info);
+  /*The motion search reads the reference frames past their edges.*/
+  ret = od_state_init(&enc->state, info, alloc, OD_UMV_PADDING);
   if (ret < 0) return ret;
   enc->use_satd = 0;
   od_enc_opt_vtbl_init(enc);
-  oggbyte_writeinit(&enc->obb);
-  od_ec_enc_init(&enc->ec, 65025);
+  od_enc_dist_init(enc);
+  oggbyte_writeinit(&enc->obb, &enc->state.alloc);
+  /*Start with room for about one bit per pixel, so that all but the largest
+     frames are coded without growing the entropy coder buffers mid-frame.*/
+  od_ec_enc_init(&enc->ec, OD_MAXI(65025,
+   enc->state.frame_width*enc->state.frame_height >> 3), &enc->state.alloc);
+  od_ec_enc_init(&enc->pvq_rate_ec, 1000, &enc->state.alloc);
   enc->packet_state = OD_PACKET_INFO_HDR;
   for (i = 0; i < OD_NPLANES_MAX; i++){
     enc->quality[i] = 10;
   }
   enc->complexity = 7;
+  enc->frame_complexity = enc->complexity;
+  enc->frame_mv_res_min = 0;
+  enc->rt.deadline = 0;
+  enc->queue_head = 0;
+  enc->nqueued = 0;
+  enc->input_padded = 0;
   enc->use_activity_masking = 1;
   enc->qm = OD_HVS_QM;
   enc->use_haar_wavelet = OD_USE_HAAR_WAVELET;
@@ -185,41 +212,132 @@ static int od_enc_init(od_enc_ctx *enc, const daala_info *info) {
   }
   enc->params.mv_level_min = 0;
   enc->params.mv_level_max = 4;
-  enc->bs = (od_block_size_comp *)malloc(sizeof(*enc->bs));
+  enc->bs = (od_block_size_comp *)od_malloc(&enc->state.alloc,
+   sizeof(*enc->bs));
+  if (OD_UNLIKELY(!enc->bs)) {
+    return OD_EFAULT;
+  }
+  if (OD_UNLIKELY(od_block_size_comp_init(enc->bs, enc->state.nhsb,
+   enc->state.nvsb, &enc->state.alloc) < 0)) {
+    od_free(&enc->state.alloc, enc->bs);
+    enc->bs = NULL;
+    return OD_EFAULT;
+  }
+#if defined(OD_ACCOUNTING)
+  if (OD_UNLIKELY(od_acct_init(&enc->acct, enc->state.nhsb, enc->state.nvsb,
+   &enc->state.alloc) < 0)) {
+    return OD_EFAULT;
+  }
+#endif
 #if defined(OD_ENCODER_CHECK)
-  enc->dec = daala_decode_alloc(info, NULL);
+  enc->dec = daala_decode_alloc_with_allocator(info, NULL, alloc);
 #endif
   return 0;
 }
 
 static void od_enc_clear(od_enc_ctx *enc) {
+#if defined(OD_ACCOUNTING)
+  od_acct_clear(&enc->acct);
+#endif
   od_mv_est_free(enc->mvest);
+  od_ec_enc_clear(&enc->pvq_rate_ec);
   od_ec_enc_clear(&enc->ec);
   oggbyte_writeclear(&enc->obb);
   od_state_clear(&enc->state);
 }
 
 daala_enc_ctx *daala_encode_create(const daala_info *info) {
+  return daala_encode_create_with_allocator(info, NULL);
+}
+
+daala_enc_ctx *daala_encode_create_with_allocator(const daala_info *info,
+ const daala_allocator *alloc) {
   od_enc_ctx *enc;
   if (info == NULL) return NULL;
-  enc = (od_enc_ctx *)malloc(sizeof(*enc));
-  if (od_enc_init(enc, info) < 0) {
-    free(enc);
+  enc = (od_enc_ctx *)od_malloc(alloc, sizeof(*enc));
+  if (enc == NULL) return NULL;
+  if (od_enc_init(enc, info, alloc) < 0) {
+    od_free(alloc, enc);
     return NULL;
   }
   return enc;
 }
 
+/*Takes the oldest frame out of the queue of daala_encode_img_submit().*/
+static void od_enc_dequeue_img(daala_enc_ctx *enc, od_queued_img *q) {
+  OD_ASSERT(enc->nqueued > 0);
+  *q = enc->queue[enc->queue_head];
+  enc->queue_head = (enc->queue_head + 1) % OD_SUBMIT_QUEUE_MAX;
+  enc->nqueued--;
+}
+
+static void od_queued_img_release(od_queued_img *q) {
+  if (q->release.func != NULL) (*q->release.func)(q->release.ctx, &q->img);
+}
+
+/*Drops all the queued frames, handing them back to the caller.*/
+static void od_enc_flush_queue(daala_enc_ctx *enc) {
+  while (enc->nqueued > 0) {
+    od_queued_img q;
+    od_enc_dequeue_img(enc, &q);
+    od_queued_img_release(&q);
+  }
+  enc->queue_head = 0;
+}
+
+/*Restarts the real-time complexity controller from the configured
+   complexity, keeping its deadline.*/
+static void od_enc_rt_reset(daala_enc_ctx *enc) {
+  enc->rt.complexity = enc->complexity;
+  enc->rt.nfast = 0;
+  enc->rt.raise_frames = OD_RT_RAISE_FRAMES;
+  enc->rt.raised = 0;
+}
+
+int daala_encode_reset(daala_enc_ctx *enc, const daala_info *info) {
+  int ret;
+  if (enc == NULL) return OD_EFAULT;
+  ret = od_state_reset(&enc->state, info);
+  if (ret < 0) return ret;
+  od_enc_flush_queue(enc);
+#if defined(OD_ENCODER_CHECK)
+  if (enc->dec != NULL) daala_decode_reset(enc->dec, info);
+#endif
+  oggbyte_reset(&enc->obb);
+  od_ec_enc_reset(&enc->ec);
+  od_mv_est_reset(enc->mvest);
+  /*Give back the memory of the sub-pel cache, keeping only what the current
+     settings need.*/
+  if (enc->mvest->flags & OD_MC_USE_SUBPEL_CACHE) {
+    if (od_mv_est_subpel_cache_alloc(enc->mvest) < 0) {
+      enc->mvest->flags &= ~OD_MC_USE_SUBPEL_CACHE;
+      return OD_EFAULT;
+    }
+  }
+  else od_mv_est_subpel_cache_free(enc->mvest);
+  /*Timings measured on the old stream say nothing about the new one.*/
+  od_enc_rt_reset(enc);
+  enc->frame_complexity = enc->complexity;
+  /*The next packets out are the headers of the new stream.*/
+  enc->packet_state = OD_PACKET_INFO_HDR;
+  return 0;
+}
+
 void daala_encode_free(daala_enc_ctx *enc) {
   if (enc != NULL) {
+    daala_allocator alloc;
+    /*The allocator lives in the context we are about to free.*/
+    alloc = enc->state.alloc;
+    od_enc_flush_queue(enc);
 #if defined(OD_ENCODER_CHECK)
     if (enc->dec != NULL) {
       daala_decode_free(enc->dec);
     }
 #endif
-    free(enc->bs);
+    if (enc->bs != NULL) od_block_size_comp_clear(enc->bs);
+    od_free(&alloc, enc->bs);
     od_enc_clear(enc);
-    free(enc);
+    od_free(&alloc, enc);
   }
 }
 
@@ -256,6 +374,49 @@ int daala_encode_ctl(daala_enc_ctx *enc, int req, void *buf, size_t buf_sz) {
       *(int *)buf = enc->complexity;
       return OD_SUCCESS;
     }
+    case OD_SET_FRAME_DEADLINE: {
+      int deadline;
+      OD_ASSERT(enc);
+      OD_ASSERT(buf);
+      OD_ASSERT(buf_sz == sizeof(deadline));
+      deadline = *(const int *)buf;
+      if (deadline < 0) return OD_EINVAL;
+      enc->rt.deadline = deadline;
+      od_enc_rt_reset(enc);
+      return OD_SUCCESS;
+    }
+    case OD_GET_FRAME_COMPLEXITY: {
+      OD_ASSERT(enc);
+      OD_ASSERT(buf);
+      OD_ASSERT(buf_sz == sizeof(enc->frame_complexity));
+      *(int *)buf = enc->frame_complexity;
+      return OD_SUCCESS;
+    }
+    case OD_GET_ACCOUNTING: {
+      OD_ASSERT(enc);
+      OD_ASSERT(buf);
+      OD_ASSERT(buf_sz == sizeof(daala_accounting));
+#if defined(OD_ACCOUNTING)
+      od_acct_export(&enc->acct, (daala_accounting *)buf);
+      return OD_SUCCESS;
+#else
+      return OD_EIMPL;
+#endif
+    }
+    case OD_SET_INPUT_PADDED: {
+      OD_ASSERT(enc);
+      OD_ASSERT(buf);
+      OD_ASSERT(buf_sz == sizeof(enc->input_padded));
+      enc->input_padded = !!*(const int *)buf;
+      return OD_SUCCESS;
+    }
+    case OD_GET_INPUT_PADDING: {
+      OD_ASSERT(enc);
+      OD_ASSERT(buf);
+      OD_ASSERT(buf_sz == sizeof(int));
+      *(int *)buf = OD_UMV_PADDING;
+      return OD_SUCCESS;
+    }
     case OD_SET_MC_USE_CHROMA:
     {
       int mc_use_chroma;
@@ -278,6 +439,23 @@ int daala_encode_ctl(daala_enc_ctx *enc, int req, void *buf, size_t buf_sz) {
       enc->use_satd = !!*(const int *)buf;
       return OD_SUCCESS;
     }
+    case OD_SET_MC_SUBPEL_CACHE:
+    {
+      int mc_subpel_cache;
+      OD_ASSERT(enc);
+      OD_ASSERT(buf);
+      OD_ASSERT(buf_sz == sizeof(mc_subpel_cache));
+      mc_subpel_cache = *(int *)buf;
+      /*The cache is allocated here rather than when a frame first needs it,
+         so that only the calls documented for the allocator allocate.*/
+      enc->mvest->flags &= ~OD_MC_USE_SUBPEL_CACHE;
+      if (mc_subpel_cache) {
+        if (od_mv_est_subpel_cache_alloc(enc->mvest) < 0) return OD_EFAULT;
+        enc->mvest->flags |= OD_MC_USE_SUBPEL_CACHE;
+      }
+      else od_mv_est_subpel_cache_free(enc->mvest);
+      return OD_SUCCESS;
+    }
     case OD_SET_USE_ACTIVITY_MASKING: {
       OD_ASSERT(enc);
       OD_ASSERT(buf);
@@ -297,6 +475,21 @@ int daala_encode_ctl(daala_enc_ctx *enc, int req, void *buf, size_t buf_sz) {
       enc->qm = qm;
       return OD_SUCCESS;
     }
+    case OD_SET_START_TIME: {
+      int64_t start_time;
+      OD_ASSERT(enc);
+      OD_ASSERT(buf);
+      OD_ASSERT(buf_sz == sizeof(start_time));
+      start_time = *(const int64_t *)buf;
+      /*Chunks must start with a keyframe, and we must not have a reference
+         frame yet.*/
+      if (start_time < 0 || start_time % enc->state.info.keyframe_rate != 0
+       || enc->state.ref_imgi[OD_FRAME_SELF] >= 0) {
+        return OD_EINVAL;
+      }
+      enc->state.cur_time = start_time;
+      return OD_SUCCESS;
+    }
     case OD_SET_MV_RES_MIN:
     {
       int mv_res_min;
@@ -308,6 +501,12 @@ int daala_encode_ctl(daala_enc_ctx *enc, int req, void *buf, size_t buf_sz) {
         return OD_EINVAL;
       }
       enc->mvest->mv_res_min = mv_res_min;
+      /*Resize the sub-pel cache for the phases now allowed.*/
+      if (enc->mvest->flags & OD_MC_USE_SUBPEL_CACHE
+       && od_mv_est_subpel_cache_alloc(enc->mvest) < 0) {
+        enc->mvest->flags &= ~OD_MC_USE_SUBPEL_CACHE;
+        return OD_EFAULT;
+      }
       return OD_SUCCESS;
     }
     case OD_SET_MV_LEVEL_MIN:
@@ -350,62 +549,70 @@ void od_encode_rollback(daala_enc_ctx *enc, const od_rollback_buffer *rbuf) {
   OD_COPY(&enc->state.adapt, &rbuf->adapt, 1);
 }
 
-static void od_img_plane_copy_pad8(od_img_plane *dst_p,
- int plane_width, int plane_height, od_img_plane *src_p,
- int pic_width, int pic_height) {
+/*Fills in the padding of a plane that already holds the picture, out to the
+   full plane size, with a low-pass extension of the picture.*/
+static void od_img_plane_pad8(od_img_plane *dst_p,
+ int plane_width, int plane_height, int pic_width, int pic_height) {
   unsigned char *dst_data;
+  unsigned char *dst;
   ptrdiff_t dstride;
+  int x;
   int y;
   dstride = dst_p->ystride;
+  dst_data = dst_p->data;
   /*If we have _no_ data, just encode a dull green.*/
   if (pic_width == 0 || pic_height == 0) {
-    dst_data = dst_p->data;
     for (y = 0; y < plane_height; y++) {
       OD_CLEAR(dst_data, plane_width);
       dst_data += dstride;
     }
+    return;
   }
-  /*Otherwise, copy what we do have, and add our own padding.*/
-  else {
-    unsigned char *src_data;
-    unsigned char *dst;
-    ptrdiff_t sxstride;
-    ptrdiff_t systride;
-    int x;
-    /*Step 1: Copy the data we do have.*/
-    sxstride = src_p->xstride;
-    systride = src_p->ystride;
-    dst_data = dst_p->data;
-    src_data = src_p->data;
-    dst = dst_data;
+  /*Right side.*/
+  for (x = pic_width; x < plane_width; x++) {
+    dst = dst_data + x - 1;
     for (y = 0; y < pic_height; y++) {
-      if (sxstride == 1) OD_COPY(dst, src_data, pic_width);
-      else for (x = 0; x < pic_width; x++) dst[x] = *(src_data + sxstride*x);
+      dst[1] = (2*dst[0] + (dst - (dstride & -(y > 0)))[0]
+       + (dst + (dstride & -(y + 1 < pic_height)))[0] + 2) >> 2;
       dst += dstride;
-      src_data += systride;
-    }
-    /*Step 2: Perform a low-pass extension into the padding region.*/
-    /*Right side.*/
-    for (x = pic_width; x < plane_width; x++) {
-      dst = dst_data + x - 1;
-      for (y = 0; y < pic_height; y++) {
-        dst[1] = (2*dst[0] + (dst - (dstride & -(y > 0)))[0]
-         + (dst + (dstride & -(y + 1 < pic_height)))[0] + 2) >> 2;
-        dst += dstride;
-      }
     }
-    /*Bottom.*/
-    dst = dst_data + dstride*pic_height;
-    for (y = pic_height; y < plane_height; y++) {
-      for (x = 0; x < plane_width; x++) {
-        dst[x] = (2*(dst - dstride)[x] + (dst - dstride)[x - (x > 0)]
-         + (dst - dstride)[x + (x + 1 < plane_width)] + 2) >> 2;
-      }
-      dst += dstride;
+  }
+  /*Bottom.*/
+  dst = dst_data + dstride*pic_height;
+  for (y = pic_height; y < plane_height; y++) {
+    for (x = 0; x < plane_width; x++) {
+      dst[x] = (2*(dst - dstride)[x] + (dst - dstride)[x - (x > 0)]
+       + (dst - dstride)[x + (x + 1 < plane_width)] + 2) >> 2;
     }
+    dst += dstride;
   }
 }
 
+static void od_img_plane_copy_pad8(od_img_plane *dst_p,
+ int plane_width, int plane_height, od_img_plane *src_p,
+ int pic_width, int pic_height) {
+  unsigned char *src_data;
+  unsigned char *dst;
+  ptrdiff_t dstride;
+  ptrdiff_t sxstride;
+  ptrdiff_t systride;
+  int x;
+  int y;
+  /*Copy the data we do have, and add our own padding.*/
+  dstride = dst_p->ystride;
+  sxstride = src_p->xstride;
+  systride = src_p->ystride;
+  src_data = src_p->data;
+  dst = dst_p->data;
+  for (y = 0; y < pic_height && pic_width > 0; y++) {
+    if (sxstride == 1) OD_COPY(dst, src_data, pic_width);
+    else for (x = 0; x < pic_width; x++) dst[x] = *(src_data + sxstride*x);
+    dst += dstride;
+    src_data += systride;
+  }
+  od_img_plane_pad8(dst_p, plane_width, plane_height, pic_width, pic_height);
+}
+
 struct od_mb_enc_ctx {
   od_coeff *c;
   od_coeff **d;
@@ -455,27 +662,34 @@ static void od_encode_compute_pred(daala_enc_ctx *enc, od_mb_enc_ctx *ctx,
   }
 }
 
-/* Compute the sum of the tree (parent and descendents) at each level. */
-static int od_compute_max_tree(od_coeff tree_sum[OD_BSIZE_MAX][OD_BSIZE_MAX],
- int x, int y, const od_coeff *c, int ln) {
+/* Compute the sum of the tree (parent and descendents) at each level for the
+   three trees rooted at (1, 0), (0, 1) and (1, 1).
+   This works bottom-up, one level at a time: the children of (x, y) are at
+   (2x, 2y) to (2x + 1, 2y + 1), so all of the sums they need are already
+   known when we reach it. */
+static void od_compute_tree_sums(od_coeff tree_sum[OD_BSIZE_MAX][OD_BSIZE_MAX],
+ const od_coeff *c, int ln) {
   int n;
-  int maxval;
+  int s;
+  int x;
+  int y;
   n = 1 << ln;
-  maxval = 0;
-  if (2*x < n && 2*y < n) {
-    int tmp;
-    tmp = od_compute_max_tree(tree_sum, 2*x, 2*y, c, ln);
-    maxval = maxval + tmp;
-    tmp = od_compute_max_tree(tree_sum, 2*x + 1, 2*y, c, ln);
-    maxval = maxval + tmp;
-    tmp = od_compute_max_tree(tree_sum, 2*x, 2*y + 1, c, ln);
-    maxval = maxval + tmp;
-    tmp = od_compute_max_tree(tree_sum, 2*x + 1, 2*y + 1, c, ln);
-    maxval = maxval + tmp;
-  }
-  maxval = maxval + abs(c[y*n + x]);
-  tree_sum[y][x] = maxval;
-  return maxval;
+  /* The finest level has no children. */
+  for (y = 0; y < n; y++) {
+    for (x = y < n >> 1 ? n >> 1 : 0; x < n; x++) {
+      tree_sum[y][x] = abs(c[y*n + x]);
+    }
+  }
+  /* Level s covers the coefficients with max(x, y) in [s, 2s). */
+  for (s = n >> 2; s >= 1; s >>= 1) {
+    for (y = 0; y < 2*s; y++) {
+      for (x = y < s ? s : 0; x < 2*s; x++) {
+        tree_sum[y][x] = abs(c[y*n + x])
+         + tree_sum[2*y][2*x] + tree_sum[2*y][2*x + 1]
+         + tree_sum[2*y + 1][2*x] + tree_sum[2*y + 1][2*x + 1];
+      }
+    }
+  }
 }
 
 /* Encode with unary (Rice) code.
@@ -586,9 +800,7 @@ static int od_wavelet_quantize(daala_enc_ctx *enc, int ln,
     }
   }
   /* Compute magnitude at each level of each tree. */
-  od_compute_max_tree(tree_sum, 1, 0, out, ln);
-  od_compute_max_tree(tree_sum, 0, 1, out, ln);
-  od_compute_max_tree(tree_sum, 1, 1, out, ln);
+  od_compute_tree_sums(tree_sum, out, ln);
   /* Encode magnitude for the top of each tree */
   tree_sum[0][0] = tree_sum[0][1] + tree_sum[1][0] + tree_sum[1][1];
   {
@@ -639,6 +851,81 @@ static int od_wavelet_quantize(daala_enc_ctx *enc, int ln,
   return 0;
 }
 
+/* Returns 1 if the motion-compensated residual of an inter block is so small
+   compared to the quantizer that PVQ would skip it anyway.
+   The residual norm of a band bounds both the change in its gain and the
+   gain times its angle to the prediction, so we require the norm of the whole
+   block to stay under half the finest step of any of its bands (or the DC).
+   With the gain companding of activity masking, PVQ can still code such a
+   block now and then, but what it codes is worth less than half a step. */
+static int od_block_predict_skip(daala_enc_ctx *enc, od_mb_enc_ctx *ctx,
+ int bs, int pli, int bo, int w) {
+  const unsigned char *qm;
+  const od_coeff *c;
+  const od_coeff *mc;
+  int64_t thresh;
+  int64_t sse;
+  int nb_bands;
+  int quant;
+  int q;
+  int n;
+  int i;
+  int j;
+  qm = enc->state.pvq_qm_q4[pli];
+  quant = OD_MAXI(1, enc->quantizer[pli]);
+  nb_bands = OD_BAND_OFFSETS[bs][0];
+  /* Band 0 is the DC. */
+  q = OD_MAXI(1, quant*qm[od_qm_get_index(bs, 0)] >> 4);
+  for (i = 1; i <= nb_bands; i++) {
+    q = OD_MINI(q, OD_MAXI(1, quant*qm[od_qm_get_index(bs, i)] >> 4));
+  }
+  thresh = (int64_t)q*q;
+  n = 1 << (bs + 2);
+  c = ctx->c + bo;
+  mc = ctx->mc + bo;
+  sse = 0;
+  for (i = 0; i < n; i++) {
+    for (j = 0; j < n; j++) {
+      int64_t r;
+      r = c[i*w + j] - mc[i*w + j];
+      sse += r*r;
+    }
+    if (4*sse >= thresh) return 0;
+  }
+  return 1;
+}
+
+/* Codes an inter block that od_block_predict_skip() marked as skipped.
+   This produces the same symbols and reconstruction as od_block_encode() does
+   when PVQ skips the block with a zero DC, without transforming the input or
+   searching any band. */
+static void od_block_encode_skip(daala_enc_ctx *enc, od_mb_enc_ctx *ctx,
+ int bs, int pli, int bo, int w) {
+  od_coeff *c;
+  od_coeff *d;
+  od_coeff *md;
+  const int *qm;
+  int xdec;
+  int n;
+  int y;
+  qm = ctx->qm == OD_HVS_QM ? OD_QM8_Q4_HVS : OD_QM8_Q4_FLAT;
+  xdec = enc->state.io_imgs[OD_FRAME_INPUT].planes[pli].xdec;
+  n = 1 << (bs + 2);
+  c = ctx->c;
+  d = ctx->d[pli];
+  md = ctx->md;
+  (*enc->state.opt_vtbl.fdct_2d[bs])(md + bo, w, ctx->mc + bo, w);
+  od_apply_qm(md + bo, w, md + bo, w, bs, xdec, 0, qm);
+  OD_ENC_ACCT_UPDATE(enc, OD_ACCT_CAT_TECHNIQUE, OD_ACCT_TECH_AC_COEFFS);
+  od_encode_cdf_adapt(&enc->ec, 2,
+   enc->state.adapt.skip_cdf[2*bs + (pli != 0)], 4 + (pli == 0 && bs > 0),
+   enc->state.adapt.skip_increment);
+  /* The reconstruction is the prediction itself. */
+  for (y = 0; y < n; y++) OD_COPY(d + bo + y*w, md + bo + y*w, n);
+  od_apply_qm(d + bo, w, d + bo, w, bs, xdec, 1, qm);
+  (*enc->state.opt_vtbl.idct_2d[bs])(c + bo, w, d + bo, w);
+}
+
 /* Returns 1 if the block is skipped, zero otherwise. */
 static int od_block_encode(daala_enc_ctx *enc, od_mb_enc_ctx *ctx, int bs,
  int pli, int bx, int by, int rdo_only) {
@@ -680,13 +967,20 @@ static int od_block_encode(daala_enc_ctx *enc, od_mb_enc_ctx *ctx, int bs,
   md = ctx->md;
   mc = ctx->mc;
   lossless = (enc->quantizer[pli] == 0);
+#if !defined(OD_OUTPUT_PRED)
+  if (!ctx->is_keyframe && !ctx->use_haar_wavelet && !lossless
+   && od_block_predict_skip(enc, ctx, bs, pli, bo, w)) {
+    od_block_encode_skip(enc, ctx, bs, pli, bo, w);
+    return 1;
+  }
+#endif
   /* Apply forward transform. */
   if (ctx->use_haar_wavelet) {
     if (rdo_only || !ctx->is_keyframe) {
-      od_haar(d + bo, w, c + bo, w, bs + 2);
+      (*enc->state.opt_vtbl.haar)(d + bo, w, c + bo, w, bs + 2);
     }
     if (!ctx->is_keyframe) {
-      od_haar(md + bo, w, mc + bo, w, bs + 2);
+      (*enc->state.opt_vtbl.haar)(md + bo, w, mc + bo, w, bs + 2);
     }
   }
   else {
@@ -722,8 +1016,8 @@ static int od_block_encode(daala_enc_ctx *enc, od_mb_enc_ctx *ctx, int bs,
   }
   else {
     /* Change ordering for encoding. */
-    od_raster_to_coding_order(dblock,  n, &d[bo], w);
-    od_raster_to_coding_order(predt,  n, &pred[0], n);
+    (*OD_RASTER_TO_CODING_ORDER[bs])(dblock, &d[bo], w);
+    (*OD_RASTER_TO_CODING_ORDER[bs])(predt, &pred[0], n);
   }
   /* Lossless encoding uses an actual quantizer of 1, but is signalled
      with a 'quantizer' of 0. */
@@ -742,6 +1036,7 @@ static int od_block_encode(daala_enc_ctx *enc, od_mb_enc_ctx *ctx, int bs,
       scalar_out[0] = OD_DIV_R0(dblock[0] - predt[0], dc_quant);
     }
   }
+  OD_ENC_ACCT_UPDATE(enc, OD_ACCT_CAT_TECHNIQUE, OD_ACCT_TECH_AC_COEFFS);
   if (ctx->use_haar_wavelet) {
     skip = od_wavelet_quantize(enc, bs + 2, scalar_out, dblock, predt,
      enc->quantizer[pli], pli);
@@ -750,6 +1045,7 @@ static int od_block_encode(daala_enc_ctx *enc, od_mb_enc_ctx *ctx, int bs,
     skip = od_pvq_encode(enc, predt, dblock, scalar_out, quant, pli, bs,
      OD_PVQ_BETA[use_masking][pli][bs], OD_ROBUST_STREAM, ctx->is_keyframe);
   }
+  OD_ENC_ACCT_UPDATE(enc, OD_ACCT_CAT_TECHNIQUE, OD_ACCT_TECH_DC_COEFF);
   if (!ctx->is_keyframe) {
     int has_dc_skip;
     has_dc_skip = !ctx->is_keyframe && !ctx->use_haar_wavelet;
@@ -778,12 +1074,12 @@ static int od_block_encode(daala_enc_ctx *enc, od_mb_enc_ctx *ctx, int bs,
     }
   }
   else {
-    od_coding_order_to_raster(&d[bo], w, scalar_out, n);
+    (*OD_CODING_ORDER_TO_RASTER[bs])(&d[bo], w, scalar_out);
   }
   /*Apply the inverse transform.*/
 #if !defined(OD_OUTPUT_PRED)
   if (ctx->use_haar_wavelet) {
-    od_haar_inv(c + bo, w, d + bo, w, bs + 2);
+    (*enc->state.opt_vtbl.haar_inv)(c + bo, w, d + bo, w, bs + 2);
   }
   else {
     od_apply_qm(d + bo, w, d + bo, w, bs, xdec, 1, qm);
@@ -828,7 +1124,7 @@ static void od_compute_dcts(daala_enc_ctx *enc, od_mb_enc_ctx *ctx, int pli,
     bs -= xdec;
     bo = (by << (OD_LOG_BSIZE0 + bs))*w + (bx << (OD_LOG_BSIZE0 + bs));
     if (use_haar) {
-      od_haar(d + bo, w, ctx->c + bo, w, bs + 2);
+      (*enc->state.opt_vtbl.haar)(d + bo, w, ctx->c + bo, w, bs + 2);
     }
     else {
       (*enc->state.opt_vtbl.fdct_2d[bs])(d + bo, w, ctx->c + bo, w);
@@ -1009,114 +1305,6 @@ static void od_quantize_haar_dc_level(daala_enc_ctx *enc, od_mb_enc_ctx *ctx,
   ctx->d[pli][((by + 1) << ln)*w + ((bx + 1) << ln)] = x[3];
 }
 
-static int od_compute_var_4x4(od_coeff *x, int stride) {
-  int sum;
-  int s2;
-  int i;
-  sum = 0;
-  s2 = 0;
-  for (i = 0; i < 4; i++) {
-    int j;
-    for (j = 0; j < 4; j++) {
-      int t;
-      /* Avoids overflow in the sum^2 below because the pre-filtered input
-         can be much larger than +/-128 << OD_COEFF_SHIFT. Shifting the sum
-         itself is a bad idea because it leads to large error on low
-         variance. */
-      t = x[i*stride + j] >> 2;
-      sum += t;
-      s2 += t*t;
-    }
-  }
-  return (s2 - (sum*sum >> 4));
-}
-
-static double od_compute_dist_8x8(daala_enc_ctx *enc, od_coeff *x, od_coeff *y,
- int stride, int bs) {
-  od_coeff e[8*8];
-  od_coeff et[8*8];
-  double sum;
-  int min_var;
-  double mean_var;
-  double var_stat;
-  double activity;
-  double calibration;
-  int i;
-  int j;
-  OD_ASSERT(enc->qm != OD_FLAT_QM);
-#if 1
-  min_var = INT_MAX;
-  mean_var = 0;
-  for (i = 0; i < 3; i++) {
-    for (j = 0; j < 3; j++) {
-      int var;
-      var = od_compute_var_4x4(x + 2*i*stride + 2*j, stride);
-      min_var = OD_MINI(min_var, var);
-      mean_var += 1./(1+var);
-    }
-  }
-  /* We use a different variance statistic depending on whether activity
-     masking is used, since the harmonic mean appeared slghtly worse with
-     masking off. The calibration constant just ensures that we preserve the
-     rate compared to activity=1. */
-  if (enc->use_activity_masking) {
-    calibration = 1.95;
-    var_stat = 9./mean_var;
-  }
-  else {
-    calibration = 1.62;
-    var_stat = min_var;
-  }
-  /* 1.62 is a calibration constant, 0.25 is a noise floor and 1/6 is the
-     activity masking constant. */
-  activity = calibration*pow(.25 + var_stat/(1 << 2*OD_COEFF_SHIFT), -1./6);
-#else
-  activity = 1;
-#endif
-  for (i = 0; i < 8; i++) {
-    for (j = 0; j < 8; j++) e[8*i + j] = x[i*stride + j] - y[i*stride + j];
-  }
-  (*enc->state.opt_vtbl.fdct_2d[OD_BLOCK_8X8])(&et[0], 8, &e[0], 8);
-  sum = 0;
-  for (i = 0; i < 8; i++) {
-    for (j = 0; j < 8; j++) {
-      double mag;
-      mag = 16./OD_QM8_Q4_HVS[i*8 + j];
-      /* We attempt to consider the basis magnitudes here, though that's not
-         perfect for block size 16x16 and above since only some edges are
-         filtered then. */
-      mag *= OD_BASIS_MAG[0][bs][i << (bs - 1)]*
-       OD_BASIS_MAG[0][bs][j << (bs - 1)];
-      mag *= mag;
-      sum += et[8*i + j]*(double)et[8*i + j]*mag;
-    }
-  }
-  return activity*activity*sum;
-}
-
-static double od_compute_dist(daala_enc_ctx *enc, od_coeff *x, od_coeff *y,
- int n, int bs) {
-  int i;
-  double sum;
-  sum = 0;
-  if (enc->qm == OD_FLAT_QM) {
-    for (i = 0; i < n*n; i++) {
-      double tmp;
-      tmp = x[i] - y[i];
-      sum += tmp*tmp;
-    }
-  }
-  else {
-    for (i = 0; i < n; i += 8) {
-      int j;
-      for (j = 0; j < n; j += 8) {
-        sum += od_compute_dist_8x8(enc, &x[i*n + j], &y[i*n + j], n, bs);
-      }
-    }
-  }
-  return sum;
-}
-
 /* Returns 1 if the block is skipped, zero otherwise. */
 static int od_encode_recursive(daala_enc_ctx *enc, od_mb_enc_ctx *ctx,
  int pli, int bx, int by, int bsi, int xdec, int ydec, int rdo_only,
@@ -1209,11 +1397,13 @@ static int od_encode_recursive(daala_enc_ctx *enc, od_mb_enc_ctx *ctx,
     skip_split = 1;
     if (pli == 0) {
       /* Code the "split this block" symbol (4). */
+      OD_ENC_ACCT_UPDATE(enc, OD_ACCT_CAT_TECHNIQUE, OD_ACCT_TECH_BLOCK_SIZE);
       od_encode_cdf_adapt(&enc->ec, 4,
        enc->state.adapt.skip_cdf[2*bs + (pli != 0)], 5,
        enc->state.adapt.skip_increment);
     }
     if (ctx->is_keyframe) {
+      OD_ENC_ACCT_UPDATE(enc, OD_ACCT_CAT_TECHNIQUE, OD_ACCT_TECH_DC_COEFF);
       od_quantize_haar_dc_level(enc, ctx, pli, 2*bx, 2*by, bsi - 1, xdec,
        &hgrad, &vgrad);
     }
@@ -1318,6 +1508,23 @@ static void od_img_copy_pad(od_state *state, od_img *img) {
   od_img_edge_ext(state->io_imgs + OD_FRAME_INPUT);
 }
 
+/*Pads an image submitted with OD_SUBMIT_PADDED in place, exactly as
+   od_img_copy_pad() pads its copy.*/
+static void od_img_pad(od_state *state, od_img *img) {
+  int pli;
+  for (pli = 0; pli < img->nplanes; pli++) {
+    int xdec;
+    int ydec;
+    xdec = img->planes[pli].xdec;
+    ydec = img->planes[pli].ydec;
+    od_img_plane_pad8(img->planes + pli,
+     state->frame_width >> xdec, state->frame_height >> ydec,
+     (state->info.pic_width + (1 << xdec) - 1) >> xdec,
+     (state->info.pic_height + (1 << ydec) - 1) >> ydec);
+  }
+  od_img_edge_ext(img);
+}
+
 #if defined(OD_DUMP_IMAGES)
 static void od_img_dump_padded(od_state *state) {
   daala_info *info;
@@ -1372,6 +1579,8 @@ static void od_split_superblocks(daala_enc_ctx *enc, int is_keyframe) {
   int k;
   int m;
   od_state *state;
+  od_img_plane *bimg;
+  od_img_plane *rimg;
   state = &enc->state;
   nhsb = state->nhsb;
   nvsb = state->nvsb;
@@ -1382,27 +1591,21 @@ static void od_split_superblocks(daala_enc_ctx *enc, int is_keyframe) {
    state->io_imgs[OD_FRAME_INPUT].planes[0].data -
    16*state->io_imgs[OD_FRAME_INPUT].planes[0].ystride - 16,
    state->io_imgs[OD_FRAME_INPUT].planes[0].ystride, (nvsb + 1)*32);
+  /* Compute the statistics for the whole frame at once, so that the margins
+     shared by neighboring superblocks are only processed once. */
+  bimg = &state->io_imgs[OD_FRAME_INPUT].planes[0];
+  rimg = &state->io_imgs[OD_FRAME_REC].planes[0];
+  od_compute_frame_stats(enc->bs, bimg->data, bimg->ystride,
+   is_keyframe ? NULL : rimg->data, rimg->ystride, enc->shared_psy,
+   enc->opt_vtbl.bs_sums_2x2);
   for (i = 0; i < nvsb; i++) {
-    unsigned char *bimg;
-    unsigned char *rimg;
-    int istride;
-    int rstride;
     int bstride;
     bstride = state->bstride;
-    istride = state->io_imgs[OD_FRAME_INPUT].planes[0].ystride;
-    rstride = is_keyframe ? 0 :
-     state->io_imgs[OD_FRAME_REC].planes[0].ystride;
-    bimg = state->io_imgs[OD_FRAME_INPUT].planes[0].data
-     + i*istride*OD_BSIZE_MAX;
-    rimg = state->io_imgs[OD_FRAME_REC].planes[0].data
-     + i*rstride*OD_BSIZE_MAX;
     for (j = 0; j < nhsb; j++) {
       int bsize[4][4];
       unsigned char *state_bsize;
       state_bsize = &state->bsize[i*4*state->bstride + j*4];
-      od_split_superblock(enc->bs, bimg + j*OD_BSIZE_MAX, istride,
-       is_keyframe ? NULL : rimg + j*OD_BSIZE_MAX, rstride, bsize,
-       enc->quantizer[0]);
+      od_split_superblock(enc->bs, j, i, bsize, enc->quantizer[0]);
       /* Grab the 4x4 information returned from `od_split_superblock` in bsize
          and store it in the od_state bsize. */
       for (k = 0; k < 4; k++) {
@@ -1434,6 +1637,7 @@ static void od_encode_mvs(daala_enc_ctx *enc) {
   int level;
   od_mv_grid_pt *mvp;
   od_mv_grid_pt **grid;
+  unsigned char **valid;
   uint16_t *cdf;
   nhmvbs = enc->state.nhmvbs;
   nvmvbs = enc->state.nvmvbs;
@@ -1444,6 +1648,7 @@ static void od_encode_mvs(daala_enc_ctx *enc) {
   width = (mvimg->width + 32) << (3 - mv_res) + 1; /* delta mvx range */
   height = (mvimg->height + 32) << (3 - mv_res) + 1;/* delta mvy range */
   grid = enc->state.mv_grid;
+  valid = enc->state.mv_valid;
   /*Code the motion vectors and flags. At each level, the MVs are zero
     outside of the frame, so don't code them.*/
   /*Level 0.*/
@@ -1464,19 +1669,19 @@ static void od_encode_mvs(daala_enc_ctx *enc) {
     for (vy = mvb_sz; vy <= nvmvbs; vy += 2*mvb_sz) {
       for (vx = mvb_sz; vx <= nhmvbs; vx += 2*mvb_sz) {
         mvp = grid[vy] + vx;
-        if (grid[vy - mvb_sz][vx - mvb_sz].valid
-         && grid[vy - mvb_sz][vx + mvb_sz].valid
-         && grid[vy + mvb_sz][vx + mvb_sz].valid
-         && grid[vy + mvb_sz][vx - mvb_sz].valid) {
+        if (valid[vy - mvb_sz][vx - mvb_sz]
+         && valid[vy - mvb_sz][vx + mvb_sz]
+         && valid[vy + mvb_sz][vx + mvb_sz]
+         && valid[vy + mvb_sz][vx - mvb_sz]) {
           cdf = od_mv_split_flag_cdf(&enc->state, vx, vy, level);
-          od_encode_cdf_adapt(&enc->ec, mvp->valid,
+          od_encode_cdf_adapt(&enc->ec, valid[vy][vx],
            cdf, 2, enc->state.adapt.split_flag_increment);
-          if (mvp->valid) {
+          if (valid[vy][vx]) {
             od_encode_mv(enc, mvp, vx, vy, level, mv_res, width, height);
           }
         }
         else {
-          OD_ASSERT(!mvp->valid);
+          OD_ASSERT(!valid[vy][vx]);
         }
       }
     }
@@ -1485,19 +1690,19 @@ static void od_encode_mvs(daala_enc_ctx *enc) {
     for (vy = 0; vy <= nvmvbs; vy += mvb_sz) {
       for (vx = mvb_sz*!(vy & mvb_sz); vx <= nhmvbs; vx += 2*mvb_sz) {
         mvp = grid[vy] + vx;
-        if ((vy - mvb_sz < 0 || grid[vy - mvb_sz][vx].valid)
-         && (vx - mvb_sz < 0 || grid[vy][vx - mvb_sz].valid)
-         && (vy + mvb_sz > nvmvbs || grid[vy + mvb_sz][vx].valid)
-         && (vx + mvb_sz > nhmvbs || grid[vy][vx + mvb_sz].valid)) {
+        if ((vy - mvb_sz < 0 || valid[vy - mvb_sz][vx])
+         && (vx - mvb_sz < 0 || valid[vy][vx - mvb_sz])
+         && (vy + mvb_sz > nvmvbs || valid[vy + mvb_sz][vx])
+         && (vx + mvb_sz > nhmvbs || valid[vy][vx + mvb_sz])) {
           cdf = od_mv_split_flag_cdf(&enc->state, vx, vy, level);
-          od_encode_cdf_adapt(&enc->ec, mvp->valid,
+          od_encode_cdf_adapt(&enc->ec, valid[vy][vx],
            cdf, 2, enc->state.adapt.split_flag_increment);
-          if (mvp->valid) {
+          if (valid[vy][vx]) {
             od_encode_mv(enc, mvp, vx, vy, level, mv_res, width, height);
           }
         }
         else {
-          OD_ASSERT(!mvp->valid);
+          OD_ASSERT(!valid[vy][vx]);
         }
       }
     }
@@ -1530,6 +1735,8 @@ static void od_encode_coefficients(daala_enc_ctx *enc, od_mb_enc_ctx *mbctx,
   frame_height = state->frame_height;
   nhsb = state->nhsb;
   nvsb = state->nvsb;
+  OD_ENC_ACCT_UPDATE(enc, OD_ACCT_CAT_TECHNIQUE, OD_ACCT_TECH_FRAME);
+  OD_ENC_ACCT_UPDATE(enc, OD_ACCT_CAT_PLANE, OD_ACCT_PLANE_FRAME);
   for (pli = 0; pli < nplanes; pli++) {
     od_ec_enc_uint(&enc->ec, enc->coded_quantizer[pli], OD_N_CODED_QUANTIZERS);
   }
@@ -1570,6 +1777,7 @@ static void od_encode_coefficients(daala_enc_ctx *enc, od_mb_enc_ctx *mbctx,
   }
   for (sby = 0; sby < nvsb; sby++) {
     for (sbx = 0; sbx < nhsb; sbx++) {
+      OD_ENC_ACCT_SET_SB(enc, sby*nhsb + sbx);
       for (pli = 0; pli < nplanes; pli++) {
         od_coeff *c_orig;
         int i;
@@ -1586,6 +1794,7 @@ static void od_encode_coefficients(daala_enc_ctx *enc, od_mb_enc_ctx *mbctx,
         mbctx->l = state->lbuf[pli];
         xdec = state->io_imgs[OD_FRAME_INPUT].planes[pli].xdec;
         ydec = state->io_imgs[OD_FRAME_INPUT].planes[pli].ydec;
+        OD_ENC_ACCT_UPDATE(enc, OD_ACCT_CAT_PLANE, OD_ACCT_PLANE_LUMA + pli);
         if (mbctx->is_keyframe) {
           int width;
           width = enc->state.frame_width;
@@ -1600,6 +1809,8 @@ static void od_encode_coefficients(daala_enc_ctx *enc, od_mb_enc_ctx *mbctx,
           }
           od_compute_dcts(enc, mbctx, pli, sbx, sby, OD_NBSIZES - 1, xdec,
            ydec, mbctx->use_haar_wavelet && !rdo_only);
+          OD_ENC_ACCT_UPDATE(enc, OD_ACCT_CAT_TECHNIQUE,
+           OD_ACCT_TECH_DC_COEFF);
           od_quantize_haar_dc_sb(enc, mbctx, pli, sbx, sby, xdec, ydec,
            sby > 0 && sbx < nhsb - 1, &hgrad, &vgrad);
           if (rdo_only) {
@@ -1621,6 +1832,7 @@ static void od_encode_coefficients(daala_enc_ctx *enc, od_mb_enc_ctx *mbctx,
       }
     }
   }
+  OD_ENC_ACCT_SET_SB(enc, -1);
 #if defined(OD_DUMP_IMAGES)
   if (!rdo_only) {
     /*Dump the lapped frame (before the postfilter has been applied)*/
@@ -1657,6 +1869,8 @@ static void od_encode_coefficients(daala_enc_ctx *enc, od_mb_enc_ctx *mbctx,
     }
   }
   if (!rdo_only && enc->quantizer[0] > 0) {
+    OD_ENC_ACCT_UPDATE(enc, OD_ACCT_CAT_TECHNIQUE, OD_ACCT_TECH_CLPF);
+    OD_ENC_ACCT_UPDATE(enc, OD_ACCT_CAT_PLANE, OD_ACCT_PLANE_FRAME);
     for (sby = 0; sby < nvsb; sby++) {
       for (sbx = 0; sbx < nhsb; sbx++) {
         int ln;
@@ -1684,8 +1898,9 @@ static void od_encode_coefficients(daala_enc_ctx *enc, od_mb_enc_ctx *mbctx,
         OD_ASSERT(xdec == state->io_imgs[OD_FRAME_INPUT].planes[pli].ydec);
         ln = OD_LOG_BSIZE_MAX - xdec;
         n = 1 << ln;
-        od_clpf(buf, OD_BSIZE_MAX, &state->ctmp[pli][(sby << ln)*w +
-         (sbx << ln)], w, ln, sbx, sby, nhsb, nvsb);
+        (*state->opt_vtbl.clpf)(buf, OD_BSIZE_MAX,
+         &state->ctmp[pli][(sby << ln)*w + (sbx << ln)], w, ln, sbx, sby,
+         nhsb, nvsb);
         ystride = state->io_imgs[OD_FRAME_INPUT].planes[pli].ystride;
         input = (unsigned char *)&state->io_imgs[OD_FRAME_INPUT].planes[pli].
          data[(sby << ln)*ystride + (sbx << ln)];
@@ -1719,6 +1934,7 @@ static void od_encode_coefficients(daala_enc_ctx *enc, od_mb_enc_ctx *mbctx,
         filtered = (filtered_error + 0.1*q2*filtered_rate) <
          (unfiltered_error + 0.1*q2*unfiltered_rate);
         state->clpf_flags[sby*nhsb + sbx] = filtered;
+        OD_ENC_ACCT_SET_SB(enc, sby*nhsb + sbx);
         od_encode_cdf_adapt(&enc->ec, filtered, state->adapt.clpf_cdf[c], 2,
          state->adapt.clpf_increment);
         if (filtered) {
@@ -1736,8 +1952,9 @@ static void od_encode_coefficients(daala_enc_ctx *enc, od_mb_enc_ctx *mbctx,
               the input to the filter, but because we look past block edges,
               we do this anyway on the edge pixels. Unfortunately, this limits
               potential parallelism.*/
-            od_clpf(buf, OD_BSIZE_MAX, &state->ctmp[pli][(sby << ln)*w +
-             (sbx << ln)], w, ln, sbx, sby, nhsb, nvsb);
+            (*state->opt_vtbl.clpf)(buf, OD_BSIZE_MAX,
+             &state->ctmp[pli][(sby << ln)*w + (sbx << ln)], w, ln, sbx, sby,
+             nhsb, nvsb);
             output = &state->ctmp[pli][(sby << ln)*w + (sbx << ln)];
             for (y = 0; y < n; y++) {
               for (x = 0; x < n; x++) {
@@ -1763,8 +1980,9 @@ static void od_encode_coefficients(daala_enc_ctx *enc, od_mb_enc_ctx *mbctx,
             int ln;
             OD_ASSERT(xdec == ydec);
             ln = OD_LOG_BSIZE_MAX - xdec;
-            od_bilinear_smooth(&state->ctmp[pli][(sby << ln)*w + (sbx << ln)],
-             ln, w, enc->quantizer[pli], pli);
+            (*state->opt_vtbl.bilinear_smooth)(
+             &state->ctmp[pli][(sby << ln)*w + (sbx << ln)], ln, w,
+             enc->quantizer[pli], pli);
           }
         }
       }
@@ -1875,40 +2093,35 @@ static void od_interp_qm(unsigned char *out, int q, const od_qm_entry *entry1,
   }
 }
 
-static void od_split_superblocks_rdo(daala_enc_ctx *enc,
- od_mb_enc_ctx *mbctx) {
-  int nhsb;
-  int nvsb;
+/*Sets every block of the frame to the same size.*/
+static void od_set_frame_bsize(od_state *state, int bsize) {
   int i;
   int j;
-  od_state *state;
-  od_rollback_buffer rbuf;
-  state = &enc->state;
-  nhsb = state->nhsb;
-  nvsb = state->nvsb;
-  od_encode_checkpoint(enc, &rbuf);
-  for (i = 0; i < 4*nvsb; i++) {
-    for (j = 0; j < 4*nhsb; j++) {
-      state->bsize[i*state->bstride + j] = mbctx->use_haar_wavelet ?
-       OD_BLOCK_32X32 :  OD_LIMIT_BSIZE_MIN;
+  for (i = 0; i < 4*state->nvsb; i++) {
+    for (j = 0; j < 4*state->nhsb; j++) {
+      state->bsize[i*state->bstride + j] = bsize;
     }
   }
+}
+
+static void od_split_superblocks_rdo(daala_enc_ctx *enc,
+ od_mb_enc_ctx *mbctx) {
+  od_rollback_buffer rbuf;
+  OD_ASSERT(!mbctx->use_haar_wavelet);
+  od_encode_checkpoint(enc, &rbuf);
+  /*None of the symbols coded here end up in the packet.*/
+  OD_ENC_ACCT_PAUSE(enc);
+  od_set_frame_bsize(&enc->state, OD_LIMIT_BSIZE_MIN);
   od_encode_coefficients(enc, mbctx, OD_ENCODE_RDO);
   od_encode_rollback(enc, &rbuf);
+  OD_ENC_ACCT_RESUME(enc);
 }
 
-int daala_encode_img_in(daala_enc_ctx *enc, od_img *img, int duration) {
-  int refi;
+/*Checks that an input image is compatible with the declared video size and
+   that the encoder can still accept frames.*/
+static int od_enc_check_img(daala_enc_ctx *enc, const od_img *img) {
   int nplanes;
   int pli;
-  int frame_width;
-  int frame_height;
-  int pic_width;
-  int pic_height;
-  int use_masking;
-  od_mb_enc_ctx mbctx;
-  od_img *ref_img;
-  if (enc == NULL || img == NULL) return OD_EFAULT;
   if (enc->packet_state == OD_PACKET_DONE) return OD_EINVAL;
   /*Check the input image dimensions to make sure they're compatible with the
      declared video size.*/
@@ -1920,21 +2133,134 @@ int daala_encode_img_in(daala_enc_ctx *enc, od_img *img, int duration) {
       return OD_EINVAL;
     }
   }
-  use_masking = enc->use_activity_masking;
-  frame_width = enc->state.frame_width;
-  frame_height = enc->state.frame_height;
-  pic_width = enc->state.info.pic_width;
-  pic_height = enc->state.info.pic_height;
-  if (img->width != frame_width || img->height != frame_height) {
+  if (img->width != enc->state.frame_width
+   || img->height != enc->state.frame_height) {
     /*The buffer does not match the frame size.
       Check to see if it matches the picture size.*/
-    if (img->width != pic_width || img->height != pic_height) {
+    if (img->width != enc->state.info.pic_width
+     || img->height != enc->state.info.pic_height) {
       /*It doesn't; we don't know how to handle it yet.*/
       return OD_EINVAL;
     }
   }
-  od_img_copy_pad(&enc->state, img);
+  return 0;
+}
 
+/*Returns a wall-clock time stamp in microseconds.*/
+static int64_t od_enc_time_us(void) {
+#if defined(HAVE_GETTIMEOFDAY)
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (int64_t)tv.tv_sec*1000000 + tv.tv_usec;
+#elif defined(HAVE_FTIME) || defined(_WIN32)
+  struct timeb tb;
+  ftime(&tb);
+  return (int64_t)tb.time*1000000 + tb.millitm*1000;
+#else
+  /*Without either, processor time is the best we can do.*/
+  return (int64_t)((double)clock()*1000000/CLOCKS_PER_SEC);
+#endif
+}
+
+/*The complexity settings where the encoder starts doing more work.
+  The real-time controller only moves between these, since every level in
+   between behaves the same, and then below 0 (see OD_RT_COMPLEXITY_MIN).*/
+static const int OD_COMPLEXITY_STEPS[] = {
+  OD_BSIZE_RDO_COMPLEXITY,
+  OD_MC_SQUARE_REFINEMENT_COMPLEXITY,
+  OD_MC_LOGARITHMIC_REFINEMENT_COMPLEXITY,
+  OD_MC_SQUARE_SUBPEL_REFINEMENT_COMPLEXITY
+};
+
+#define OD_NCOMPLEXITY_STEPS \
+ ((int)(sizeof(OD_COMPLEXITY_STEPS)/sizeof(*OD_COMPLEXITY_STEPS)))
+
+/*Returns the highest complexity that does less work than complexity.*/
+static int od_complexity_lower(int complexity) {
+  int i;
+  for (i = OD_NCOMPLEXITY_STEPS; i-- > 0;) {
+    if (OD_COMPLEXITY_STEPS[i] <= complexity) {
+      return OD_COMPLEXITY_STEPS[i] - 1;
+    }
+  }
+  return OD_MAXI(OD_MINI(complexity, 0) - 1, OD_RT_COMPLEXITY_MIN);
+}
+
+/*Returns the lowest complexity that does more work than complexity.*/
+static int od_complexity_raise(int complexity) {
+  int i;
+  if (complexity < 0) return complexity + 1;
+  for (i = 0; i < OD_NCOMPLEXITY_STEPS; i++) {
+    if (OD_COMPLEXITY_STEPS[i] > complexity) return OD_COMPLEXITY_STEPS[i];
+  }
+  return complexity;
+}
+
+/*Picks the complexity of the next frame from the time spent on the last
+   one.
+  A frame over budget drops one step (two if it took more than twice the
+   budget) right away, while raising the complexity waits for a run of frames
+   that left at least a quarter of the budget unused.
+  When a raise immediately overruns, that wait doubles, so that a setting
+   that barely fits does not make every few frames miss the deadline.*/
+static void od_complexity_ctl_update(daala_enc_ctx *enc, int64_t elapsed) {
+  od_complexity_ctl *rt;
+  int64_t deadline;
+  int complexity;
+  rt = &enc->rt;
+  deadline = rt->deadline;
+  complexity = OD_MINI(rt->complexity, enc->complexity);
+  if (elapsed > deadline) {
+    if (rt->raised) {
+      rt->raise_frames = OD_MINI(rt->raise_frames << 1,
+       OD_RT_RAISE_FRAMES_MAX);
+    }
+    rt->complexity = od_complexity_lower(complexity);
+    if (elapsed > deadline << 1) {
+      rt->complexity = od_complexity_lower(rt->complexity);
+    }
+    rt->nfast = 0;
+    rt->raised = 0;
+    return;
+  }
+  if (rt->raised) {
+    rt->raise_frames = OD_MAXI(rt->raise_frames >> 1, OD_RT_RAISE_FRAMES);
+    rt->raised = 0;
+  }
+  if (elapsed*4 > deadline*3) {
+    rt->nfast = 0;
+    return;
+  }
+  if (++rt->nfast >= rt->raise_frames && complexity < enc->complexity) {
+    rt->complexity = OD_MINI(od_complexity_raise(complexity),
+     enc->complexity);
+    rt->nfast = 0;
+    rt->raised = 1;
+  }
+}
+
+/*Encodes the frame currently held in io_imgs[OD_FRAME_INPUT], which must
+   already have been copied and padded.*/
+static void od_encode_frame(daala_enc_ctx *enc, int duration) {
+  int64_t start;
+  int refi;
+  int nplanes;
+  int pli;
+  int use_masking;
+  od_mb_enc_ctx mbctx;
+  od_img *ref_img;
+  nplanes = enc->state.info.nplanes;
+  use_masking = enc->use_activity_masking;
+  start = 0;
+  enc->frame_complexity = enc->complexity;
+  enc->frame_mv_res_min = enc->mvest->mv_res_min;
+  if (enc->rt.deadline > 0) {
+    int complexity;
+    start = od_enc_time_us();
+    complexity = OD_MINI(enc->rt.complexity, enc->complexity);
+    enc->frame_complexity = OD_MAXI(complexity, 0);
+    enc->frame_mv_res_min = OD_MAXI(enc->frame_mv_res_min, -complexity);
+  }
 #if defined(OD_DUMP_IMAGES)
   if (od_logging_active(OD_LOG_GENERIC, OD_LOG_DEBUG)) {
     od_img_dump_padded(&enc->state);
@@ -1970,6 +2296,9 @@ int daala_encode_img_in(daala_enc_ctx *enc, od_img *img, int duration) {
   mbctx.use_haar_wavelet = enc->use_haar_wavelet || enc->quality[0] == 0;
   /*Initialize the entropy coder.*/
   od_ec_enc_reset(&enc->ec);
+  OD_ENC_ACCT_RESET(enc);
+  OD_ENC_ACCT_UPDATE(enc, OD_ACCT_CAT_TECHNIQUE, OD_ACCT_TECH_FRAME);
+  OD_ENC_ACCT_UPDATE(enc, OD_ACCT_CAT_PLANE, OD_ACCT_PLANE_FRAME);
   /*Write a bit to mark this as a data packet.*/
   od_ec_encode_bool_q15(&enc->ec, 0, 16384);
   /*Code the keyframe bit.*/
@@ -2029,13 +2358,24 @@ int daala_encode_img_in(daala_enc_ctx *enc, od_img *img, int duration) {
   od_adapt_ctx_reset(&enc->state.adapt, mbctx.is_keyframe);
   if (!mbctx.is_keyframe) {
     od_predict_frame(enc);
+    OD_ENC_ACCT_UPDATE(enc, OD_ACCT_CAT_TECHNIQUE,
+     OD_ACCT_TECH_MOTION_VECTORS);
     od_encode_mvs(enc);
   }
+  else od_mv_est_reset(enc->mvest);
   /* Enable block size RDO for all but complexity 0 and 1. We might want to
      revise that choice if we get a better open-loop block size algorithm. */
-  if (enc->complexity >= 2) od_split_superblocks_rdo(enc, &mbctx);
+  /* The Haar wavelet is always applied to whole superblocks (and the decoder
+     assumes so), so lossless coding skips both the block size decision and
+     the RDO pass, which would only encode every superblock a second time. */
+  if (mbctx.use_haar_wavelet) od_set_frame_bsize(&enc->state, OD_BLOCK_32X32);
+  else if (enc->frame_complexity >= OD_BSIZE_RDO_COMPLEXITY) {
+    od_split_superblocks_rdo(enc, &mbctx);
+  }
   else od_split_superblocks(enc, mbctx.is_keyframe);
   od_encode_coefficients(enc, &mbctx, OD_ENCODE_REAL);
+  /*Charge the last symbols of the frame.*/
+  OD_ENC_ACCT_SET_SB(enc, -1);
 #if defined(OD_DUMP_IMAGES) || defined(OD_DUMP_RECONS)
   /*Dump YUV*/
   od_state_dump_yuv(&enc->state, enc->state.io_imgs + OD_FRAME_REC, "out");
@@ -2057,9 +2397,169 @@ int daala_encode_img_in(daala_enc_ctx *enc, od_img *img, int duration) {
 #endif
   if (enc->state.info.frame_duration == 0) enc->state.cur_time += duration;
   else enc->state.cur_time += enc->state.info.frame_duration;
+  if (enc->rt.deadline > 0) {
+    od_complexity_ctl_update(enc, od_enc_time_us() - start);
+  }
+}
+
+/*Checks that an image already compatible with the encoder is also laid out
+   like its input buffer, so that it can be padded and encoded in place.*/
+static int od_enc_check_padded_img(daala_enc_ctx *enc, const od_img *img) {
+  int pli;
+  /*The encoder uses the strides of its input buffer for the reconstruction
+     as well, so they must match exactly.*/
+  if (img->width != enc->state.frame_width
+   || img->height != enc->state.frame_height) {
+    return OD_EINVAL;
+  }
+  for (pli = 0; pli < img->nplanes; pli++) {
+    if (img->planes[pli].xstride != 1
+     || img->planes[pli].ystride != (enc->state.frame_width
+     + (OD_UMV_PADDING << 1)) >> img->planes[pli].xdec) {
+      return OD_EINVAL;
+    }
+  }
   return 0;
 }
 
+/*Encodes a frame straight from the caller's buffers, which must have passed
+   od_enc_check_padded_img().*/
+static void od_encode_padded_img(daala_enc_ctx *enc, od_img *img,
+ int duration) {
+  od_state *state;
+  od_img input;
+  state = &enc->state;
+  od_img_pad(state, img);
+  *&input = *(state->io_imgs + OD_FRAME_INPUT);
+  *(state->io_imgs + OD_FRAME_INPUT) = *img;
+  od_encode_frame(enc, duration);
+  *(state->io_imgs + OD_FRAME_INPUT) = *&input;
+}
+
+int daala_encode_img_in(daala_enc_ctx *enc, od_img *img, int duration) {
+  int ret;
+  if (enc == NULL || img == NULL) return OD_EFAULT;
+  /*Frames must be encoded in the order they were submitted.*/
+  if (enc->nqueued > 0) return OD_EINVAL;
+  ret = od_enc_check_img(enc, img);
+  if (ret < 0) return ret;
+  if (enc->input_padded) {
+    ret = od_enc_check_padded_img(enc, img);
+    if (ret < 0) return ret;
+    od_encode_padded_img(enc, img, duration);
+  }
+  else {
+    od_img_copy_pad(&enc->state, img);
+    od_encode_frame(enc, duration);
+  }
+  return 0;
+}
+
+int daala_encode_img_in_multi(daala_enc_ctx **encs, int nencs, od_img *img,
+ int duration) {
+  od_img *shared;
+  const od_frame_stats *psy;
+  int ei;
+  int ret;
+  if (encs == NULL || nencs <= 0 || img == NULL) return OD_EFAULT;
+  for (ei = 0; ei < nencs; ei++) {
+    if (encs[ei] == NULL) return OD_EFAULT;
+  }
+  for (ei = 0; ei < nencs; ei++) {
+    if (encs[ei]->nqueued > 0) return OD_EINVAL;
+    ret = od_enc_check_img(encs[ei], img);
+    if (ret < 0) return ret;
+    /*The padded input is shared, so every encoder must use the same frame
+       geometry.
+      The plane decimations were already checked against img above.*/
+    if (encs[ei]->state.frame_width != encs[0]->state.frame_width
+     || encs[ei]->state.frame_height != encs[0]->state.frame_height
+     || encs[ei]->state.info.pic_width != encs[0]->state.info.pic_width
+     || encs[ei]->state.info.pic_height != encs[0]->state.info.pic_height) {
+      return OD_EINVAL;
+    }
+  }
+  /*Copy and pad the input a single time into the first encoder, and let the
+     others read it from there.
+    Nothing downstream of od_img_copy_pad() writes to the input frame, so
+     it is safe to alias it for the duration of each encode.
+    The source variance statistics of the open-loop block-size decision are
+     also computed once, by the first encoder that needs them.
+    Motion estimation, the block-size decisions themselves and the inter
+     statistics depend on each rendition's own reconstruction, so they
+     cannot be shared without changing the output.*/
+  if (encs[0]->input_padded) {
+    /*The first encoder decides whether the caller's buffers are used in
+       place; the others share them either way.*/
+    ret = od_enc_check_padded_img(encs[0], img);
+    if (ret < 0) return ret;
+    od_img_pad(&encs[0]->state, img);
+    shared = img;
+  }
+  else {
+    od_img_copy_pad(&encs[0]->state, img);
+    shared = encs[0]->state.io_imgs + OD_FRAME_INPUT;
+  }
+  psy = NULL;
+  for (ei = 0; ei < nencs; ei++) {
+    od_img input;
+    od_state *state;
+    state = &encs[ei]->state;
+    *&input = *(state->io_imgs + OD_FRAME_INPUT);
+    *(state->io_imgs + OD_FRAME_INPUT) = *shared;
+    encs[ei]->bs->psy = NULL;
+    encs[ei]->shared_psy = psy;
+    od_encode_frame(encs[ei], duration);
+    encs[ei]->shared_psy = NULL;
+    *(state->io_imgs + OD_FRAME_INPUT) = *&input;
+    if (psy == NULL) psy = encs[ei]->bs->psy;
+  }
+  return 0;
+}
+
+int daala_encode_img_submit(daala_enc_ctx *enc, od_img *img, int duration,
+ int flags, const daala_img_release *release) {
+  od_queued_img *q;
+  int ret;
+  if (enc == NULL || img == NULL) return OD_EFAULT;
+  if (enc->nqueued >= OD_SUBMIT_QUEUE_MAX) return OD_EINVAL;
+  ret = od_enc_check_img(enc, img);
+  if (ret < 0) return ret;
+  if (flags & OD_SUBMIT_PADDED) {
+    ret = od_enc_check_padded_img(enc, img);
+    if (ret < 0) return ret;
+  }
+  q = enc->queue + (enc->queue_head + enc->nqueued) % OD_SUBMIT_QUEUE_MAX;
+  q->img = *img;
+  q->duration = duration;
+  q->padded = !!(flags & OD_SUBMIT_PADDED);
+  if (release != NULL) q->release = *release;
+  else {
+    q->release.func = NULL;
+    q->release.ctx = NULL;
+  }
+  enc->nqueued++;
+  return 0;
+}
+
+/*Encodes the oldest queued frame.*/
+static void od_encode_queued_img(daala_enc_ctx *enc) {
+  od_queued_img q;
+  od_state *state;
+  state = &enc->state;
+  od_enc_dequeue_img(enc, &q);
+  if (q.padded) {
+    od_encode_padded_img(enc, &q.img, q.duration);
+    od_queued_img_release(&q);
+  }
+  else {
+    /*Hand the frame back as soon as it has been copied.*/
+    od_img_copy_pad(state, &q.img);
+    od_queued_img_release(&q);
+    od_encode_frame(enc, q.duration);
+  }
+}
+
 #if defined(OD_ENCODER_CHECK)
 static void daala_encoder_check(daala_enc_ctx *ctx, od_img *img,
  ogg_packet *op) {
@@ -2101,7 +2601,11 @@ static void daala_encoder_check(daala_enc_ctx *ctx, od_img *img,
 int daala_encode_packet_out(daala_enc_ctx *enc, int last, ogg_packet *op) {
   uint32_t nbytes;
   if (enc == NULL || op == NULL) return OD_EFAULT;
-  else if (enc->packet_state <= 0 || enc->packet_state == OD_PACKET_DONE) {
+  /*Once the last packet has been taken, move on to the next queued frame.*/
+  if (enc->packet_state == OD_PACKET_EMPTY && enc->nqueued > 0) {
+    od_encode_queued_img(enc);
+  }
+  if (enc->packet_state <= 0 || enc->packet_state == OD_PACKET_DONE) {
     return 0;
   }
   op->packet = od_ec_enc_done(&enc->ec, &nbytes);
@@ -2109,6 +2613,8 @@ int daala_encode_packet_out(daala_enc_ctx *enc, int last, ogg_packet *op) {
   OD_LOG((OD_LOG_ENCODER, OD_LOG_INFO, "Output Bytes: %ld (%ld Kbits)",
    op->bytes, op->bytes*8/1024));
   op->b_o_s = 0;
+  /*The end of the stream comes after all the queued frames.*/
+  last = last && enc->nqueued == 0;
   op->e_o_s = last;
   op->packetno = 0;
   op->granulepos = enc->state.cur_time;
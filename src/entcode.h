@@ -29,8 +29,15 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
 # include "internal.h"
 
 /*OPT: od_ec_window must be at least 32 bits, but if you have fast arithmetic
-   on a larger type, you can speed up the decoder by using it here.*/
+   on a larger type, you can speed up the decoder by using it here.
+  A 64-bit window also lets the encoder hold several output bytes in low and
+   flush them all at once.*/
+# if defined(__amd64__) || defined(__x86_64__) || defined(_M_X64) \
+ || defined(__aarch64__) || defined(_M_ARM64)
+typedef uint64_t od_ec_window;
+# else
 typedef uint32_t od_ec_window;
+# endif
 
 # define OD_EC_WINDOW_SIZE ((int)sizeof(od_ec_window)*CHAR_BIT)
 
@@ -88,8 +88,12 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
   Even relatively modest values like 100 would work fine.*/
 #define OD_EC_LOTS_OF_BITS (0x4000)
 
+/*Fills dif with as many whole bytes as fit in the window.
+  With a 64-bit window this is usually six or seven bytes at a time, so it only
+   runs once every few symbols.*/
 static void od_ec_dec_refill(od_ec_dec *dec) {
   int s;
+  int n;
   od_ec_window dif;
   int16_t cnt;
   const unsigned char *bptr;
@@ -99,11 +103,13 @@ static void od_ec_dec_refill(od_ec_dec *dec) {
   bptr = dec->bptr;
   end = dec->end;
   s = OD_EC_WINDOW_SIZE - 9 - (cnt + 15);
-  for (; s >= 0 && bptr < end; s -= 8, bptr++) {
-    OD_ASSERT(s <= OD_EC_WINDOW_SIZE - 8);
-    dif |= (od_ec_window)bptr[0] << s;
-    cnt += 8;
-  }
+  OD_ASSERT(s >= 0);
+  OD_ASSERT(s <= OD_EC_WINDOW_SIZE - 8);
+  /*Check the end of the buffer once, instead of once per byte.*/
+  n = (s >> 3) + 1;
+  if (end - bptr < n) n = (int)(end - bptr);
+  cnt += 8*n;
+  for (; n-- > 0; s -= 8) dif |= (od_ec_window)*bptr++ << s;
   if (bptr >= end) {
     dec->tell_offs += OD_EC_LOTS_OF_BITS - cnt;
     cnt = OD_EC_LOTS_OF_BITS;
@@ -142,7 +148,10 @@ void od_ec_dec_init(od_ec_dec *dec,
   dec->eptr = buf + storage;
   dec->end_window = 0;
   dec->nend_bits = 0;
-  dec->tell_offs = 10 - (OD_EC_WINDOW_SIZE - 8);
+  /*Every byte read adds 8 to both cnt and the bytes consumed, so this does
+     not depend on how many bytes the first refill reads, and makes
+     od_ec_dec_tell() start at 1, like the encoder.*/
+  dec->tell_offs = 10 - 24;
   dec->end = buf + storage;
   dec->bptr = buf;
   dec->dif = 0;
@@ -55,6 +55,12 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
    URL="http://researchcommons.waikato.ac.nz/bitstream/handle/10289/78/content.pdf"
   }*/
 
+/*The encoder only flushes bytes from low once cnt reaches this value.
+  low holds at most cnt + 26 bits between calls, so waiting any longer could
+   shift bits off the top of the window.
+  With a 32-bit window this flushes every time a whole byte is available.*/
+#define OD_EC_FLUSH_CNT (OD_EC_WINDOW_SIZE - 32)
+
 /*Takes updated low and range values, renormalizes them so that
    32768 <= rng < 65536 (flushing bytes from low to the pre-carry buffer if
    necessary), and stores them back in the encoder context.
@@ -69,22 +75,18 @@ static void od_ec_enc_normalize(od_ec_enc *enc,
   OD_ASSERT(rng <= 65535U);
   d = 16 - OD_ILOG_NZ(rng);
   s = c + d;
-  /*TODO: Right now we flush every time we have at least one byte available.
-    Instead we should use an od_ec_window and flush right before we're about to
-     shift bits off the end of the window.
-    For a 32-bit window this is about the same amount of work, but for a 64-bit
-     window it should be a fair win.*/
-  if (s >= 0) {
+  if (s >= OD_EC_FLUSH_CNT) {
     uint16_t *buf;
     uint32_t storage;
     uint32_t offs;
-    unsigned m;
+    od_ec_window m;
     buf = enc->precarry_buf;
     storage = enc->precarry_storage;
     offs = enc->offs;
-    if (offs + 2 > storage) {
-      storage = 2*storage + 2;
-      buf = (uint16_t *)realloc(buf, sizeof(*buf)*storage);
+    if (offs + (s >> 3) + 1 > storage) {
+      storage = 2*storage + (s >> 3) + 1;
+      buf = (uint16_t *)od_realloc(enc->alloc, buf,
+       sizeof(*buf)*enc->precarry_storage, sizeof(*buf)*storage);
       if (buf == NULL) {
         enc->error = -1;
         enc->offs = 0;
@@ -93,19 +95,19 @@ static void od_ec_enc_normalize(od_ec_enc *enc,
       enc->precarry_buf = buf;
       enc->precarry_storage = storage;
     }
+    /*Flush every byte that can no longer change, except for a carry, in one
+       go.*/
     c += 16;
-    m = (1 << c) - 1;
-    if (s >= 8) {
+    m = ((od_ec_window)1 << c) - 1;
+    do {
       OD_ASSERT(offs < storage);
       buf[offs++] = (uint16_t)(low >> c);
       low &= m;
       c -= 8;
       m >>= 8;
+      s -= 8;
     }
-    OD_ASSERT(offs < storage);
-    buf[offs++] = (uint16_t)(low >> c);
-    s = c + d - 24;
-    low &= m;
+    while (s >= 0);
     enc->offs = offs;
   }
   enc->low = low << d;
@@ -114,17 +116,22 @@ static void od_ec_enc_normalize(od_ec_enc *enc,
 }
 
 /*Initializes the encoder.
-  size: The initial size of the buffer, in bytes.*/
-void od_ec_enc_init(od_ec_enc *enc, uint32_t size) {
+  size: The initial size of the buffer, in bytes.
+  alloc: The allocator to take the buffers from, or NULL to use the C
+          library.
+         It must outlive the encoder.*/
+void od_ec_enc_init(od_ec_enc *enc, uint32_t size,
+ const daala_allocator *alloc) {
   od_ec_enc_reset(enc);
-  enc->buf = (unsigned char *)malloc(sizeof(*enc->buf)*size);
+  enc->alloc = alloc;
+  enc->buf = (unsigned char *)od_malloc(alloc, sizeof(*enc->buf)*size);
   enc->storage = size;
   if (size > 0 && enc->buf == NULL) {
     enc->storage = 0;
     enc->error = -1;
   }
   enc->precarry_buf =
-   (uint16_t *)malloc(sizeof(*enc->precarry_buf)*size);
+   (uint16_t *)od_malloc(alloc, sizeof(*enc->precarry_buf)*size);
   enc->precarry_storage = size;
   if (size > 0 && enc->precarry_buf == NULL) {
     enc->precarry_storage = 0;
@@ -152,8 +159,8 @@ void od_ec_enc_reset(od_ec_enc *enc) {
 
 /*Frees the buffers used by the encoder.*/
 void od_ec_enc_clear(od_ec_enc *enc) {
-  free(enc->precarry_buf);
-  free(enc->buf);
+  od_free(enc->alloc, enc->precarry_buf);
+  od_free(enc->alloc, enc->buf);
 }
 
 /*Encodes a symbol given its scaled frequency information.
@@ -417,7 +424,8 @@ void od_ec_enc_bits(od_ec_enc *enc, uint32_t fl, unsigned ftb) {
       unsigned char *new_buf;
       uint32_t new_storage;
       new_storage = 2*storage + (OD_EC_WINDOW_SIZE >> 3);
-      new_buf = (unsigned char *)malloc(sizeof(*new_buf)*new_storage);
+      new_buf = (unsigned char *)od_malloc(enc->alloc,
+       sizeof(*new_buf)*new_storage);
       if (new_buf == NULL) {
         enc->error = -1;
         enc->end_offs = 0;
@@ -426,7 +434,7 @@ void od_ec_enc_bits(od_ec_enc *enc, uint32_t fl, unsigned ftb) {
       OD_COPY(new_buf + new_storage - end_offs,
        buf + storage - end_offs, end_offs);
       storage = new_storage;
-      free(buf);
+      od_free(enc->alloc, buf);
       enc->buf = buf = new_buf;
       enc->storage = storage;
     }
@@ -529,11 +537,12 @@ unsigned char *od_ec_enc_done(od_ec_enc *enc, uint32_t *nbytes) {
   offs = enc->offs;
   buf = enc->precarry_buf;
   if (s > 0) {
-    unsigned n;
+    od_ec_window n;
     storage = enc->precarry_storage;
     if (offs + ((s + 7) >> 3) > storage) {
       storage = storage*2 + ((s + 7) >> 3);
-      buf = (uint16_t *)realloc(buf, sizeof(*buf)*storage);
+      buf = (uint16_t *)od_realloc(enc->alloc, buf,
+       sizeof(*buf)*enc->precarry_storage, sizeof(*buf)*storage);
       if (buf == NULL) {
         enc->error = -1;
         return NULL;
@@ -541,7 +550,7 @@ unsigned char *od_ec_enc_done(od_ec_enc *enc, uint32_t *nbytes) {
       enc->precarry_buf = buf;
       enc->precarry_storage = storage;
     }
-    n = (1 << (c + 16)) - 1;
+    n = ((od_ec_window)1 << (c + 16)) - 1;
     do {
       OD_ASSERT(offs < storage);
       buf[offs++] = (uint16_t)(e >> (c + 16));
@@ -563,7 +572,8 @@ unsigned char *od_ec_enc_done(od_ec_enc *enc, uint32_t *nbytes) {
   c = OD_MAXI((nend_bits - s + 7) >> 3, 0);
   if (offs + end_offs + c > storage) {
     storage = offs + end_offs + c;
-    out = (unsigned char *)realloc(out, sizeof(*out)*storage);
+    out = (unsigned char *)od_realloc(enc->alloc, out,
+     sizeof(*out)*enc->storage, sizeof(*out)*storage);
     if (out == NULL) {
       enc->error = -1;
       return NULL;
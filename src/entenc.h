@@ -58,6 +58,8 @@ struct od_ec_enc {
   int16_t cnt;
   /*Nonzero if an error occurred.*/
   int error;
+  /*The allocator the buffers come from, or NULL for the C library.*/
+  const daala_allocator *alloc;
 #if OD_MEASURE_EC_OVERHEAD
   double entropy;
   int nb_symbols;
@@ -66,7 +68,8 @@ struct od_ec_enc {
 
 /*See entenc.c for further documentation.*/
 
-void od_ec_enc_init(od_ec_enc *enc, uint32_t size) OD_ARG_NONNULL(1);
+void od_ec_enc_init(od_ec_enc *enc, uint32_t size,
+ const daala_allocator *alloc) OD_ARG_NONNULL(1);
 void od_ec_enc_reset(od_ec_enc *enc) OD_ARG_NONNULL(1);
 void od_ec_enc_clear(od_ec_enc *enc) OD_ARG_NONNULL(1);
 
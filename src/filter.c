@@ -1384,53 +1384,74 @@ void od_postfilter_split(od_coeff *c0, int stride, int bs, int f) {
   }
 }
 
+/*Applies the pre-filter across a horizontal block edge.
+  c points to the first row below the edge and n is the number of columns to
+   filter.*/
+void od_prefilter_hedge(od_coeff *c, int stride, int n, int f) {
+  int j;
+  c -= (2 << f)*stride;
+  for (j = 0; j < n; j++) {
+    int k;
+    od_coeff t[4 << OD_NBSIZES];
+    for (k = 0; k < 4 << f; k++) t[k] = c[stride*k + j];
+    (*OD_PRE_FILTER[f])(t, t);
+    for (k = 0; k < 4 << f; k++) c[stride*k + j] = t[k];
+  }
+}
+
+/*Applies the pre-filter across a vertical block edge.
+  c points to the first column right of the edge and n is the number of rows
+   to filter.*/
+void od_prefilter_vedge(od_coeff *c, int stride, int n, int f) {
+  int i;
+  c -= 2 << f;
+  for (i = 0; i < n; i++) {
+    (*OD_PRE_FILTER[f])(c + i*stride, c + i*stride);
+  }
+}
+
 void od_apply_prefilter_frame_sbs(od_coeff *c0, int stride, int nhsb, int nvsb,
  int xdec, int ydec) {
   int sbx;
   int sby;
-  int i;
-  int j;
   int f;
-  od_coeff *c;
   f = OD_FILT_SIZE(OD_NBSIZES - 1, xdec);
-  c = c0 + ((OD_BSIZE_MAX >> ydec) - (2 << f))*stride;
   for (sby = 1; sby < nvsb; sby++) {
-    for (j = 0; j < nhsb << OD_LOG_BSIZE_MAX >> xdec; j++) {
-      int k;
-      od_coeff t[4 << OD_NBSIZES];
-      for (k = 0; k < 4 << f; k++) t[k] = c[stride*k + j];
-      (*OD_PRE_FILTER[f])(t, t);
-      for (k = 0; k < 4 << f; k++) c[stride*k + j] = t[k];
-    }
-    c += OD_BSIZE_MAX*stride >> ydec;
+    od_prefilter_hedge(c0 + (sby*OD_BSIZE_MAX >> ydec)*stride, stride,
+     nhsb << OD_LOG_BSIZE_MAX >> xdec, f);
   }
-  c = c0 + (OD_BSIZE_MAX >> ydec) - (2 << f);
   for (sbx = 1; sbx < nhsb; sbx++) {
-    for (i = 0; i < nvsb << OD_LOG_BSIZE_MAX >> ydec; i++) {
-      (*OD_PRE_FILTER[f])(c + i*stride, c + i*stride);
-    }
-    c += OD_BSIZE_MAX >> xdec;
+    od_prefilter_vedge(c0 + (sbx*OD_BSIZE_MAX >> xdec), stride,
+     nvsb << OD_LOG_BSIZE_MAX >> ydec, f);
   }
 }
 
-void od_apply_postfilter_frame_sbs(od_coeff *c0, int stride, int nhsb,
- int nvsb, int xdec, int ydec) {
+/*Applies the postfilter across the superblock edges within superblock row
+   sby, and across the edge above it.
+  Each horizontal edge only touches the rows next to it, so filtering the
+   rows in order from the top gives the same result as filtering all the
+   vertical edges of the frame first, but lets the decoder finish the top of
+   the frame before the bottom is filtered.*/
+void od_apply_postfilter_sb_row(od_coeff *c0, int stride, int nhsb, int sby,
+ int xdec, int ydec) {
   int sbx;
-  int sby;
   int i;
   int j;
   int f;
+  int n;
   od_coeff *c;
   f = OD_FILT_SIZE(OD_NBSIZES - 1, xdec);
-  c = c0 + (OD_BSIZE_MAX >> ydec) - (2 << f);
+  n = OD_BSIZE_MAX >> ydec;
+  c0 += sby*n*stride;
+  c = c0 + (OD_BSIZE_MAX >> xdec) - (2 << f);
   for (sbx = 1; sbx < nhsb; sbx++) {
-    for (i = 0; i < nvsb << OD_LOG_BSIZE_MAX >> ydec; i++) {
+    for (i = 0; i < n; i++) {
       (*OD_POST_FILTER[f])(c + i*stride, c + i*stride);
     }
     c += OD_BSIZE_MAX >> xdec;
   }
-  c = c0 + ((OD_BSIZE_MAX >> ydec) - (2 << f))*stride;
-  for (sby = 1; sby < nvsb; sby++) {
+  if (sby > 0) {
+    c = c0 - (2 << f)*stride;
     for (j = 0; j < nhsb << OD_LOG_BSIZE_MAX >> xdec; j++) {
       int k;
       od_coeff t[4 << OD_NBSIZES];
@@ -1438,14 +1459,21 @@ void od_apply_postfilter_frame_sbs(od_coeff *c0, int stride, int nhsb,
       (*OD_POST_FILTER[f])(t, t);
       for (k = 0; k < 4 << f; k++) c[stride*k + j] = t[k];
     }
-    c += OD_BSIZE_MAX*stride >> ydec;
+  }
+}
+
+void od_apply_postfilter_frame_sbs(od_coeff *c0, int stride, int nhsb,
+ int nvsb, int xdec, int ydec) {
+  int sby;
+  for (sby = 0; sby < nvsb; sby++) {
+    od_apply_postfilter_sb_row(c0, stride, nhsb, sby, xdec, ydec);
   }
 }
 
 /*Smooths a block using the constrained lowpass filter from Thor
   (https://tools.ietf.org/html/draft-fuldseth-netvc-thor-00#section-8.2).*/
-void od_clpf(od_coeff *y, int ystride, od_coeff *x, int xstride, int ln,
- int sbx, int sby, int nhsb, int nvsb) {
+void od_clpf_c(od_coeff *y, int ystride, const od_coeff *x, int xstride,
+ int ln, int sbx, int sby, int nhsb, int nvsb) {
   int i;
   int j;
   int n;
@@ -1485,6 +1513,45 @@ void od_clpf(od_coeff *y, int ystride, od_coeff *x, int xstride, int ln,
   }
 }
 
+/*Computes the coefficients of the bilinear surface through the four corners
+   of a block.
+  a[0] is the constant term, a[1] and a[2] the horizontal and vertical slopes,
+   and a[3] the x*y term, all pre-scaled so that the interpolation can divide
+   by n instead of n - 1.*/
+void od_bilinear_smooth_coeffs(od_coeff a[4], const od_coeff *x, int ln,
+ int stride) {
+  od_coeff x00;
+  od_coeff x01;
+  od_coeff x10;
+  od_coeff x11;
+  int n;
+  n = 1 << ln;
+  x00 = x[0];
+  x01 = x[n - 1];
+  x10 = x[(n - 1)*stride];
+  x11 = x[(n - 1)*stride + (n - 1)];
+  a[0] = x00;
+  a[1] = x01 - x00;
+  a[2] = x10 - x00;
+  a[3] = x11 + x00 - x10 - x01;
+  /* Multiply by 1+1/n (approximation of n/(n-1)) here so that we can divide
+     by n in the loop instead of dividing by n-1. */
+  a[1] += (a[1] + n/2) >> ln;
+  a[2] += (a[2] + n/2) >> ln;
+  a[3] += (2*a[2] + n/2) >> ln;
+}
+
+/*Computes the smoothing weight (in Q8) from the mean squared distance between
+   a block and its bilinear approximation.*/
+int od_bilinear_smooth_weight(od_coeff dist, int q, int pli) {
+  int w;
+  /* Compute 1 - Wiener filter gain = strength * (q^2/12) / dist. */
+  w = OD_MINI(1024, OD_BILINEAR_STRENGTH[pli]*q*q/(1 + 12*dist));
+  /* Square the theoretical gain to attenuate the effect when we're unsure
+     whether it's useful. */
+  return w*w >> 12;
+}
+
 /** Smoothes a block using bilinear interpolation from its four corners.
  *  The interpolation is applied using a weight that depends on the amount
  *  amount of distortion it causes to the signal compared to the quantization
@@ -1495,15 +1562,8 @@ void od_clpf(od_coeff *y, int ystride, od_coeff *x, int xstride, int ln,
  * @param [in]     q      quantizer
  * @param [in]     pli    plane index
  */
-void od_bilinear_smooth(od_coeff *x, int ln, int stride, int q, int pli) {
-  od_coeff x00;
-  od_coeff x01;
-  od_coeff x10;
-  od_coeff x11;
-  od_coeff a00;
-  od_coeff a01;
-  od_coeff a10;
-  od_coeff a11;
+void od_bilinear_smooth_c(od_coeff *x, int ln, int stride, int q, int pli) {
+  od_coeff a[4];
   od_coeff y[OD_BSIZE_MAX][OD_BSIZE_MAX];
   od_coeff dist;
   int w;
@@ -1511,33 +1571,16 @@ void od_bilinear_smooth(od_coeff *x, int ln, int stride, int q, int pli) {
   int j;
   int n;
   n = 1 << ln;
-  x00 = x[0];
-  x01 = x[n - 1];
-  x10 = x[(n - 1)*stride];
-  x11 = x[(n - 1)*stride + (n - 1)];
-  a00 = x00;
-  a01 = x01 - x00;
-  a10 = x10 - x00;
-  a11 = x11 + x00 - x10 - x01;
-  /* Multiply by 1+1/n (approximation of n/(n-1)) here so that we can divide
-     by n in the loop instead of dividing by n-1. */
-  a01 += (a01 + n/2) >> ln;
-  a10 += (a10 + n/2) >> ln;
-  a11 += (2*a10 + n/2) >> ln;
+  od_bilinear_smooth_coeffs(a, x, ln, stride);
   dist = 0;
   /* Bilinear interpolation with non-linear x*y term. */
   for (i = 0; i < n; i++) {
     for (j = 0; j < n; j++) {
-      y[i][j] = a00 + ((j*a01 + i*a10 + (j*i*a11 >> ln) + n/2) >> ln);
+      y[i][j] = a[0] + ((j*a[1] + i*a[2] + (j*i*a[3] >> ln) + n/2) >> ln);
       dist += (y[i][j] - x[i*stride + j])*(y[i][j] - x[i*stride + j]);
     }
   }
-  dist >>= 2*ln;
-  /* Compute 1 - Wiener filter gain = strength * (q^2/12) / dist. */
-  w = OD_MINI(1024, OD_BILINEAR_STRENGTH[pli]*q*q/(1 + 12*dist));
-  /* Square the theoretical gain to attenuate the effect when we're unsure
-     whether it's useful. */
-  w = w*w >> 12;
+  w = od_bilinear_smooth_weight(dist >> 2*ln, q, pli);
   for (i = 0; i < n; i++) {
     for (j = 0; j < n; j++) {
       x[i*stride + j] -= (w*(x[i*stride + j]-y[i][j]) + 128) >> 8;
@@ -1621,3 +1664,25 @@ int main(void) {
   return err;
 }
 #endif
+
+#if defined(OD_CHECKASM)
+# include <stdio.h>
+
+void od_filter_check(const char *name, const od_coeff *ref, int ref_stride,
+ const od_coeff *x, int xstride, int n) {
+  int failed;
+  int i;
+  int j;
+  failed = 0;
+  for (i = 0; i < n; i++) {
+    for (j = 0; j < n; j++) {
+      if (ref[i*ref_stride + j] != x[i*xstride + j]) {
+        fprintf(stderr, "%s ASM mismatch: %i!=%i @ (%2i,%2i)\n", name,
+         ref[i*ref_stride + j], x[i*xstride + j], j, i);
+        failed = 1;
+      }
+    }
+  }
+  OD_ASSERT(!failed);
+}
+#endif
@@ -77,15 +77,22 @@ void od_apply_postfilter_frame(od_coeff *c, int w, int nhsb, int nvsb,
 #define OD_FILT_SIZE(ln, xdec) (0)
 
 extern const int OD_FILT_SIZE[OD_NBSIZES];
-void od_clpf(od_coeff *y, int ystride, od_coeff *x, int xstride, int ln,
- int sbx, int sby, int nhsb, int nvsb);
-void od_bilinear_smooth(od_coeff *x, int ln, int stride, int q, int pli);
+void od_clpf_c(od_coeff *y, int ystride, const od_coeff *x, int xstride,
+ int ln, int sbx, int sby, int nhsb, int nvsb);
+void od_bilinear_smooth_coeffs(od_coeff a[4], const od_coeff *x, int ln,
+ int stride);
+int od_bilinear_smooth_weight(od_coeff dist, int q, int pli);
+void od_bilinear_smooth_c(od_coeff *x, int ln, int stride, int q, int pli);
 void od_prefilter_split(od_coeff *c0, int stride, int bs, int f);
 void od_postfilter_split(od_coeff *c0, int stride, int bs, int f);
+void od_prefilter_hedge(od_coeff *c, int stride, int n, int f);
+void od_prefilter_vedge(od_coeff *c, int stride, int n, int f);
 void od_apply_prefilter_frame_sbs(od_coeff *c, int stride, int nhsb, int nvsb,
  int xdec, int ydec);
 void od_apply_postfilter_frame_sbs(od_coeff *c, int stride, int nhsb, int nvsb,
  int xdec, int ydec);
+void od_apply_postfilter_sb_row(od_coeff *c, int stride, int nhsb, int sby,
+ int xdec, int ydec);
 void od_apply_filter_sb_rows(od_coeff *c, int stride, int nhsb, int nvsb,
  int xdec, int ydec, int inv, int bs);
 void od_apply_filter_sb_cols(od_coeff *c, int stride, int nhsb, int nvsb,
@@ -93,6 +100,11 @@ void od_apply_filter_sb_cols(od_coeff *c, int stride, int nhsb, int nvsb,
 void od_apply_filter_hsplit(od_coeff *c0, int stride, int inv, int bs, int f);
 void od_apply_filter_vsplit(od_coeff *c0, int stride, int inv, int bs, int f);
 
+# if defined(OD_CHECKASM)
+void od_filter_check(const char *name, const od_coeff *ref, int ref_stride,
+ const od_coeff *x, int xstride, int n);
+# endif
+
 # if defined(OD_DCT_TEST) && defined(OD_DCT_CHECK_OVERFLOW)
 #  include <stdio.h>
 
@@ -145,61 +145,95 @@ int od_ilog(uint32_t _v) {
 #endif
 }
 
-void **od_malloc_2d(size_t _height, size_t _width, size_t _sz) {
-  size_t  rowsz;
-  size_t  colsz;
-  size_t  datsz;
-  char *ret;
-  colsz = _height*sizeof(void *);
-  rowsz = _sz*_width;
-  datsz = rowsz*_height;
-  /*Alloc array and row pointers.*/
-  ret = (char *)malloc(datsz+colsz);
+static int od_use_libc_heap(const daala_allocator *_alloc) {
+  return _alloc == NULL || _alloc->alloc == NULL;
+}
+
+void *od_malloc(const daala_allocator *_alloc, size_t _sz) {
+  if (od_use_libc_heap(_alloc)) return malloc(_sz);
+  return (*_alloc->alloc)(_alloc->ctx, _sz);
+}
+
+void *od_calloc(const daala_allocator *_alloc, size_t _n, size_t _sz) {
+  void *ret;
+  if (od_use_libc_heap(_alloc)) return calloc(_n, _sz);
+  if (_sz != 0 && _n > ~(size_t)0/_sz) return NULL;
+  ret = (*_alloc->alloc)(_alloc->ctx, _n*_sz);
+  if (ret != NULL) memset(ret, 0, _n*_sz);
+  return ret;
+}
+
+/*Unlike realloc(), this needs the old size of the block, since a custom
+   allocator has no way to resize one in place.
+  As with realloc(), the old block is left untouched on failure.*/
+void *od_realloc(const daala_allocator *_alloc, void *_ptr, size_t _old_sz,
+ size_t _sz) {
+  void *ret;
+  if (od_use_libc_heap(_alloc)) return realloc(_ptr, _sz);
+  ret = (*_alloc->alloc)(_alloc->ctx, _sz);
+  if (ret != NULL && _ptr != NULL) {
+    memcpy(ret, _ptr, OD_MINI(_old_sz, _sz));
+    (*_alloc->release)(_alloc->ctx, _ptr);
+  }
+  return ret;
+}
+
+void od_free(const daala_allocator *_alloc, void *_ptr) {
+  if (od_use_libc_heap(_alloc)) free(_ptr);
+  else if (_ptr != NULL) (*_alloc->release)(_alloc->ctx, _ptr);
+}
+
+static void **od_init_2d(char *_ret, size_t _height, size_t _colsz,
+ size_t _rowsz) {
   /*Initialize the array.*/
-  if (ret != NULL) {
+  if (_ret != NULL) {
     size_t   i;
     void **p;
     char *datptr;
-    p = (void **)ret;
+    p = (void **)_ret;
     i = _height;
-    for (datptr = ret + colsz; i-- > 0; p++, datptr += rowsz)
+    for (datptr = _ret + _colsz; i-- > 0; p++, datptr += _rowsz)
       *p = (void *)datptr;
   }
-  return (void **)ret;
+  return (void **)_ret;
+}
+
+void **od_malloc_2d(const daala_allocator *_alloc, size_t _height,
+ size_t _width, size_t _sz) {
+  size_t  rowsz;
+  size_t  colsz;
+  size_t  datsz;
+  colsz = _height*sizeof(void *);
+  rowsz = _sz*_width;
+  datsz = rowsz*_height;
+  /*Alloc array and row pointers.*/
+  return od_init_2d((char *)od_malloc(_alloc, datsz + colsz), _height, colsz,
+   rowsz);
 }
 
-void **od_calloc_2d(size_t _height, size_t _width, size_t _sz) {
+void **od_calloc_2d(const daala_allocator *_alloc, size_t _height,
+ size_t _width, size_t _sz) {
   size_t  colsz;
   size_t  rowsz;
   size_t  datsz;
-  char *ret;
   colsz = _height*sizeof(void *);
   rowsz = _sz*_width;
   datsz = rowsz*_height;
   /*Alloc array and row pointers.*/
-  ret = (char *)calloc(datsz + colsz, 1);
-  /*Initialize the array.*/
-  if (ret != NULL) {
-    size_t   i;
-    void **p;
-    char *datptr;
-    p = (void **)ret;
-    i = _height;
-    for (datptr = ret + colsz; i-- > 0; p++, datptr += rowsz)
-      *p = (void *)datptr;
-  }
-  return (void **)ret;
+  return od_init_2d((char *)od_calloc(_alloc, datsz + colsz, 1), _height,
+   colsz, rowsz);
 }
 
-void od_free_2d(void *_ptr) {
-  free(_ptr);
+void od_free_2d(const daala_allocator *_alloc, void *_ptr) {
+  od_free(_alloc, _ptr);
 }
 
 #define BUFFER_INCREMENT (256)
 
-void oggbyte_writeinit(oggbyte_buffer *_b) {
+void oggbyte_writeinit(oggbyte_buffer *_b, const daala_allocator *_alloc) {
   OD_CLEAR(_b, 1);
-  _b->ptr = _b->buf = (unsigned char *)malloc(BUFFER_INCREMENT);
+  _b->alloc = _alloc;
+  _b->ptr = _b->buf = (unsigned char *)od_malloc(_alloc, BUFFER_INCREMENT);
   _b->storage = BUFFER_INCREMENT;
 }
 
@@ -212,7 +246,7 @@ void oggbyte_write1(oggbyte_buffer *_b, unsigned _value) {
   ptrdiff_t endbyte;
   endbyte = _b->ptr-_b->buf;
   if (endbyte >= _b->storage) {
-    _b->buf = (unsigned char *)realloc(_b->buf,
+    _b->buf = (unsigned char *)od_realloc(_b->alloc, _b->buf, _b->storage,
             _b->storage + BUFFER_INCREMENT);
     _b->storage += BUFFER_INCREMENT;
     _b->ptr = _b->buf+endbyte;
@@ -224,7 +258,7 @@ void oggbyte_write4(oggbyte_buffer *_b, uint32_t _value) {
   ptrdiff_t endbyte;
   endbyte = _b->ptr - _b->buf;
   if (endbyte+4 > _b->storage) {
-    _b->buf = (unsigned char *)realloc(_b->buf,
+    _b->buf = (unsigned char *)od_realloc(_b->alloc, _b->buf, _b->storage,
             _b->storage + BUFFER_INCREMENT);
     _b->storage += BUFFER_INCREMENT;
     _b->ptr = _b->buf + endbyte;
@@ -243,8 +277,11 @@ void oggbyte_writecopy(oggbyte_buffer *_b, const void *_source,
   ptrdiff_t endbyte;
   endbyte = _b->ptr-_b->buf;
   if (endbyte+_bytes > _b->storage) {
-    _b->storage = endbyte+_bytes+BUFFER_INCREMENT;
-    _b->buf = (unsigned char *)realloc((void *)_b->buf, _b->storage);
+    ptrdiff_t storage;
+    storage = endbyte+_bytes+BUFFER_INCREMENT;
+    _b->buf = (unsigned char *)od_realloc(_b->alloc, (void *)_b->buf,
+     _b->storage, storage);
+    _b->storage = storage;
     _b->ptr = _b->buf+endbyte;
   }
   memmove(_b->ptr, _source, _bytes);
@@ -256,7 +293,7 @@ void oggbyte_reset(oggbyte_buffer *_b) {
 }
 
 void oggbyte_writeclear(oggbyte_buffer *_b) {
-  free(_b->buf);
+  od_free(_b->alloc, _b->buf);
   OD_CLEAR(_b, 1);
 }
 
@@ -155,10 +155,12 @@ struct oggbyte_buffer{
   unsigned char *buf;
   unsigned char *ptr;
   ptrdiff_t      storage;
+  /*The allocator the write buffer comes from, or NULL for the C library.*/
+  const daala_allocator *alloc;
 };
 
 /*Encoding functions.*/
-void oggbyte_writeinit(oggbyte_buffer *_b);
+void oggbyte_writeinit(oggbyte_buffer *_b, const daala_allocator *_alloc);
 void oggbyte_writetrunc(oggbyte_buffer *_b, ptrdiff_t _bytes);
 void oggbyte_write1(oggbyte_buffer *_b, unsigned _value);
 void oggbyte_write4(oggbyte_buffer *_b, uint32_t _value);
@@ -183,9 +185,19 @@ unsigned char *oggbyte_get_buffer(oggbyte_buffer *_b);
 ptrdiff_t oggbyte_bytes_left(oggbyte_buffer *_b);
 
 int od_ilog(uint32_t _v);
-void **od_malloc_2d(size_t _height, size_t _width, size_t _sz);
-void **od_calloc_2d(size_t _height, size_t _width, size_t _sz);
-void od_free_2d(void *_ptr);
+
+/*Allocation through an instance's allocator.
+  A NULL allocator (or one without callbacks) uses the C library heap.*/
+void *od_malloc(const daala_allocator *_alloc, size_t _sz);
+void *od_calloc(const daala_allocator *_alloc, size_t _n, size_t _sz);
+void *od_realloc(const daala_allocator *_alloc, void *_ptr, size_t _old_sz,
+ size_t _sz);
+void od_free(const daala_allocator *_alloc, void *_ptr);
+void **od_malloc_2d(const daala_allocator *_alloc, size_t _height,
+ size_t _width, size_t _sz);
+void **od_calloc_2d(const daala_allocator *_alloc, size_t _height,
+ size_t _width, size_t _sz);
+void od_free_2d(const daala_allocator *_alloc, void *_ptr);
 
 # define OD_DIVU_DMAX (64)
 
@@ -196,11 +196,62 @@ void od_mc_predict1fmv8_c(unsigned char *dst, const unsigned char *src,
   }
 }
 
+/*Predicts the block at (x, y) of a reference plane from a single motion
+   vector.
+  If the pixels the filters read around the displaced block reach past the
+   padding of the reference, they are first copied into state->mc_patch with
+   their coordinates clamped to the frame, which gives exactly what edge
+   extension would have stored there.
+  The filters then read the patch, with just the fractional part of the
+   vector.*/
 static void od_mc_predict1fmv8(od_state *state, unsigned char *dst,
- const unsigned char *src, int systride, int32_t mvx, int32_t mvy,
- int log_xblk_sz, int log_yblk_sz, int subsampled_plane) {
+ const od_img_plane *iplane, int x, int y, int32_t mvx, int32_t mvy,
+ int log_xblk_sz, int log_yblk_sz) {
+  const unsigned char *src;
+  int systride;
+  int xpad;
+  int ypad;
+  int x0;
+  int y0;
+  int w;
+  int h;
+  src = iplane->data + y*iplane->ystride + x;
+  systride = iplane->ystride;
+  w = state->frame_width >> iplane->xdec;
+  h = state->frame_height >> iplane->ydec;
+  xpad = state->ref_padding >> iplane->xdec;
+  ypad = state->ref_padding >> iplane->ydec;
+  x0 = x + (mvx >> 3) - OD_MC_PATCH_APRON;
+  y0 = y + (mvy >> 3) - OD_MC_PATCH_APRON;
+  if (x0 < -xpad || y0 < -ypad
+   || x0 + (1 << log_xblk_sz) + 2*OD_MC_PATCH_APRON > w + xpad
+   || y0 + (1 << log_yblk_sz) + 2*OD_MC_PATCH_APRON > h + ypad) {
+    unsigned char *patch;
+    int pw;
+    int ph;
+    int i;
+    int j;
+    patch = state->mc_patch;
+    pw = (1 << log_xblk_sz) + 2*OD_MC_PATCH_APRON;
+    ph = (1 << log_yblk_sz) + 2*OD_MC_PATCH_APRON;
+    for (j = 0; j < ph; j++) {
+      const unsigned char *row;
+      row = iplane->data + OD_CLAMPI(0, y0 + j, h - 1)*systride;
+      /*Only the pixels left and right of the frame need clamping.*/
+      if (x0 >= 0 && x0 + pw <= w) OD_COPY(patch + j*pw, row + x0, pw);
+      else {
+        for (i = 0; i < pw; i++) {
+          patch[j*pw + i] = row[OD_CLAMPI(0, x0 + i, w - 1)];
+        }
+      }
+    }
+    src = patch + OD_MC_PATCH_APRON*pw + OD_MC_PATCH_APRON;
+    systride = pw;
+    mvx &= 7;
+    mvy &= 7;
+  }
 #if OD_THOR_SUBPEL_SIMD && OD_X86ASM
-  if (subsampled_plane)
+  if (iplane->xdec != 0 || iplane->ydec != 0)
      /*(*state->opt_vtbl.mc_predict1fmv8)(dst, src, systride, mvx, mvy,
      log_xblk_sz, log_yblk_sz);*/
     thor_mc_predict1fmv8_chroma_sse2(dst, src, systride, mvx, mvy,
@@ -259,10 +310,10 @@ void od_state_mvs_clear(od_state *state) {
     od_mv_grid_pt *grid;
     grid = state->mv_grid[vy];
     for (vx = 0; vx <= nhmvbs; vx++) {
-      grid[vx].valid = 0;
       grid[vx].mv[0] = 0;
       grid[vx].mv[1] = 0;
     }
+    OD_CLEAR(state->mv_valid[vy], nhmvbs + 1);
   }
 }
 #if 0
@@ -2387,7 +2438,7 @@ static void od_mc_blend_multi_split8(unsigned char *dst, int dystride,
 }
 #endif
 
-static void od_mc_blend8(od_state *state, unsigned char *dst, int dystride,
+void od_mc_blend8(od_state *state, unsigned char *dst, int dystride,
  const unsigned char *src[4], int oc, int s,
  int log_xblk_sz, int log_yblk_sz) {
   if (0 && log_xblk_sz > 1 && log_yblk_sz > 1) {
@@ -2414,7 +2465,9 @@ static void od_mc_blend8(od_state *state, unsigned char *dst, int dystride,
 }
 
 void od_mc_predict8(od_state *state, unsigned char *dst, int dystride,
- const unsigned char *src, int systride,
+ const od_img_plane *iplane, /* The reference plane. */
+ int x, /* The position of the block in the reference plane. */
+ int y,
  const int32_t mvx[4], /* This is x coord for the four
                             motion vectors of the four corners
                             (in rotation not raster order). */
@@ -2422,32 +2475,31 @@ void od_mc_predict8(od_state *state, unsigned char *dst, int dystride,
  int oc, /* Index of outside corner. */
  int s, /* Two split flags that indicate if the corners are split. */
  int log_xblk_sz,   /* Log 2 of block size. */
- int log_yblk_sz,
- int subsampled_plane /*Either xdec or ydec is not zero, then 1.*/
+ int log_yblk_sz
 ) {
   const unsigned char *pred[4];
-  od_mc_predict1fmv8(state, state->mc_buf[0], src, systride,
-   mvx[0], mvy[0], log_xblk_sz, log_yblk_sz, subsampled_plane);
+  od_mc_predict1fmv8(state, state->mc_buf[0], iplane, x, y,
+   mvx[0], mvy[0], log_xblk_sz, log_yblk_sz);
   pred[0] = state->mc_buf[0];
   if (mvx[1] == mvx[0] && mvy[1] == mvy[0]) pred[1] = pred[0];
   else {
-    od_mc_predict1fmv8(state, state->mc_buf[1], src, systride,
-     mvx[1], mvy[1], log_xblk_sz, log_yblk_sz, subsampled_plane);
+    od_mc_predict1fmv8(state, state->mc_buf[1], iplane, x, y,
+     mvx[1], mvy[1], log_xblk_sz, log_yblk_sz);
     pred[1] = state->mc_buf[1];
   }
   if (mvx[2] == mvx[0] && mvy[2] == mvy[0]) pred[2] = pred[0];
   else if (mvx[2] == mvx[1] && mvy[2] == mvy[1]) pred[2] = pred[1];
   else {
-    od_mc_predict1fmv8(state, state->mc_buf[2], src, systride,
-     mvx[2], mvy[2], log_xblk_sz, log_yblk_sz, subsampled_plane);
+    od_mc_predict1fmv8(state, state->mc_buf[2], iplane, x, y,
+     mvx[2], mvy[2], log_xblk_sz, log_yblk_sz);
     pred[2] = state->mc_buf[2];
   }
   if (mvx[3] == mvx[0] && mvy[3] == mvy[0]) pred[3] = pred[0];
   else if (mvx[3] == mvx[1] && mvy[3] == mvy[1]) pred[3] = pred[1];
   else if (mvx[3] == mvx[2] && mvy[3] == mvy[2]) pred[3] = pred[2];
   else {
-    od_mc_predict1fmv8(state, state->mc_buf[3], src, systride,
-     mvx[3], mvy[3], log_xblk_sz, log_yblk_sz, subsampled_plane);
+    od_mc_predict1fmv8(state, state->mc_buf[3], iplane, x, y,
+     mvx[3], mvy[3], log_xblk_sz, log_yblk_sz);
     pred[3] = state->mc_buf[3];
   }
   od_mc_blend8(state, dst, dystride, pred,
@@ -2457,58 +2509,86 @@ void od_mc_predict8(od_state *state, unsigned char *dst, int dystride,
 /*Gets the predictor for a given MV node at the given MV resolution.*/
 int od_state_get_predictor(od_state *state,
  int pred[2], int vx, int vy, int level, int mv_res) {
-  static const od_mv_grid_pt ZERO_GRID_PT = { {0, 0}, 1};
+  static const od_mv_grid_pt ZERO_GRID_PT = { {0, 0} };
+  static const unsigned char ZERO_GRID_PT_VALID = 1;
   const od_mv_grid_pt *cneighbors[4];
+  const unsigned char *cvalid[4];
+  od_mv_grid_pt **grid;
+  unsigned char **valid;
   int a[4][2];
   int equal_mvs;
   int mvb_sz;
   int ncns;
   int ci;
   ncns = 4;
+  grid = state->mv_grid;
+  valid = state->mv_valid;
   mvb_sz = 1 << ((OD_MC_LEVEL_MAX - level) >> 1);
+  /*We track the validity flag of each predictor alongside it so that we can
+     check it without storing it in the grid itself.*/
+#define OD_SET_CNEIGHBOR(ci, cvx, cvy) \
+  do { \
+    cneighbors[ci] = grid[cvy] + (cvx); \
+    cvalid[ci] = valid[cvy] + (cvx); \
+  } \
+  while (0)
+#define OD_SET_CNEIGHBOR_ZERO(ci) \
+  do { \
+    cneighbors[ci] = &ZERO_GRID_PT; \
+    cvalid[ci] = &ZERO_GRID_PT_VALID; \
+  } \
+  while (0)
   if (level == 0) {
     if (vy >= mvb_sz) {
-      cneighbors[0] = vx >= mvb_sz ?
-       state->mv_grid[vy - mvb_sz] + vx - mvb_sz : &ZERO_GRID_PT;
-      cneighbors[1] = state->mv_grid[vy - mvb_sz] + vx;
-      cneighbors[2] = vx + mvb_sz <= state->nhmvbs ?
-       state->mv_grid[vy - mvb_sz] + vx + mvb_sz : &ZERO_GRID_PT;
-    }
-    else cneighbors[2] = cneighbors[1] = cneighbors[0] = &ZERO_GRID_PT;
-    cneighbors[3] = vx >= mvb_sz ?
-     state->mv_grid[vy] + vx - mvb_sz : &ZERO_GRID_PT;
+      if (vx >= mvb_sz) OD_SET_CNEIGHBOR(0, vx - mvb_sz, vy - mvb_sz);
+      else OD_SET_CNEIGHBOR_ZERO(0);
+      OD_SET_CNEIGHBOR(1, vx, vy - mvb_sz);
+      if (vx + mvb_sz <= state->nhmvbs) {
+        OD_SET_CNEIGHBOR(2, vx + mvb_sz, vy - mvb_sz);
+      }
+      else OD_SET_CNEIGHBOR_ZERO(2);
+    }
+    else {
+      OD_SET_CNEIGHBOR_ZERO(0);
+      OD_SET_CNEIGHBOR_ZERO(1);
+      OD_SET_CNEIGHBOR_ZERO(2);
+    }
+    if (vx >= mvb_sz) OD_SET_CNEIGHBOR(3, vx - mvb_sz, vy);
+    else OD_SET_CNEIGHBOR_ZERO(3);
   }
   else {
     if (level & 1) {
-      cneighbors[0] = state->mv_grid[vy - mvb_sz] + vx - mvb_sz;
-      cneighbors[1] = state->mv_grid[vy - mvb_sz] + vx + mvb_sz;
-      cneighbors[2] = state->mv_grid[vy + mvb_sz] + vx - mvb_sz;
-      cneighbors[3] = state->mv_grid[vy + mvb_sz] + vx + mvb_sz;
+      OD_SET_CNEIGHBOR(0, vx - mvb_sz, vy - mvb_sz);
+      OD_SET_CNEIGHBOR(1, vx + mvb_sz, vy - mvb_sz);
+      OD_SET_CNEIGHBOR(2, vx - mvb_sz, vy + mvb_sz);
+      OD_SET_CNEIGHBOR(3, vx + mvb_sz, vy + mvb_sz);
     }
     else {
-      cneighbors[0] = vy >= mvb_sz ?
-       state->mv_grid[vy - mvb_sz] + vx : &ZERO_GRID_PT;
-      cneighbors[1] = vx >= mvb_sz ?
-       state->mv_grid[vy] + vx - mvb_sz : &ZERO_GRID_PT;
+      if (vy >= mvb_sz) OD_SET_CNEIGHBOR(0, vx, vy - mvb_sz);
+      else OD_SET_CNEIGHBOR_ZERO(0);
+      if (vx >= mvb_sz) OD_SET_CNEIGHBOR(1, vx - mvb_sz, vy);
+      else OD_SET_CNEIGHBOR_ZERO(1);
       /*NOTE: Only one of these candidates can be excluded at a time, so
          there will always be at least 3.*/
       if (vx > 0 && vx + mvb_sz > ((vx + OD_MVB_MASK) & ~OD_MVB_MASK)) ncns--;
-      else cneighbors[2] = state->mv_grid[vy] + vx + mvb_sz;
+      else OD_SET_CNEIGHBOR(2, vx + mvb_sz, vy);
       if (vy > 0 && vy + mvb_sz > ((vy + OD_MVB_MASK) & ~OD_MVB_MASK)) ncns--;
-      else cneighbors[ncns - 1] = state->mv_grid[vy + mvb_sz] + vx;
+      else OD_SET_CNEIGHBOR(ncns - 1, vx, vy + mvb_sz);
     }
   }
+#undef OD_SET_CNEIGHBOR_ZERO
+#undef OD_SET_CNEIGHBOR
   for (ci = 0; ci < ncns; ci++) {
     a[ci][0] = cneighbors[ci]->mv[0];
     a[ci][1] = cneighbors[ci]->mv[1];
 #if defined(OD_ENABLE_LOGGING)
-    if (!cneighbors[ci]->valid) {
+    if (!*cvalid[ci]) {
       OD_LOG((OD_LOG_MOTION_ESTIMATION, OD_LOG_ERR,
        "Failure in MV pred: predictor (%i, %i) for (%i, %i) is not valid",
 	     a[ci][0], a[ci][1], vx, vy));
     }
 #endif
-    OD_ASSERT(cneighbors[ci]->valid);
+    OD_ASSERT(*cvalid[ci]);
   }
   /*Median-of-4.*/
   if (ncns > 3) {
@@ -2577,7 +2657,8 @@ This last compare is unneeded for a median:
   return equal_mvs;
 }
 
-int od_mv_split_flag_ctx(od_mv_grid_pt **grid, int vx, int vy,int level) {
+int od_mv_split_flag_ctx(od_mv_grid_pt **grid, unsigned char **valid,
+ int vx, int vy, int level) {
   od_mv_grid_pt *v1;
   od_mv_grid_pt *v2;
   od_mv_grid_pt *v3;
@@ -2597,8 +2678,8 @@ int od_mv_split_flag_ctx(od_mv_grid_pt **grid, int vx, int vy,int level) {
     v2 = vx >= mvb_sz ? grid[vy] + vx - mvb_sz : NULL;
     v3 = vx & mvb_sz ? grid[vy] + vx + mvb_sz : grid[vy + mvb_sz] + vx;
   }
-  split1 = vx >= 2*mvb_sz ? grid[vy][vx - 2*mvb_sz].valid : 0;
-  split2 = vy >= 2*mvb_sz ? grid[vy - 2*mvb_sz][vx].valid : 0;
+  split1 = vx >= 2*mvb_sz ? valid[vy][vx - 2*mvb_sz] : 0;
+  split2 = vy >= 2*mvb_sz ? valid[vy - 2*mvb_sz][vx] : 0;
   same1 = v1 != NULL && v2 != NULL
    && (v1->mv[0] == v2->mv[0]) && (v1->mv[1] == v2->mv[1]);
   same2 = v2 != NULL
@@ -2609,7 +2690,8 @@ int od_mv_split_flag_ctx(od_mv_grid_pt **grid, int vx, int vy,int level) {
 uint16_t *od_mv_split_flag_cdf(od_state *state,
  int vx, int vy, int level) {
   int ctx;
-  ctx = od_mv_split_flag_ctx(state->mv_grid, vx, vy, level);
+  ctx = od_mv_split_flag_ctx(state->mv_grid, state->mv_valid,
+   vx, vy, level);
   OD_ASSERT(0 < level && level <= OD_MC_LEVEL_MAX);
   return state->adapt.split_flag_cdf[level - 1][ctx];
 }
@@ -70,13 +70,24 @@ typedef struct od_mv_grid_pt od_mv_grid_pt;
    Balmelli, as it is encumbered by patents.
   Fortunately, our relatively limited levels of subdivision makes it mostly
    unnecessary.*/
+/*Grid points are kept small so that whole rows fit in a few cache lines and
+   snapshots of the grid are cheap to take.
+  Whether or not a point actually has a valid value is stored separately, in
+   the mv_valid map of the od_state.*/
 struct od_mv_grid_pt {
-  /*The x, y offsets of the motion vector in units of 1/8th pixels.*/
-  int mv[2];
-  /*Whether or not this MV actually has a valid value.*/
-  unsigned valid:1;
+  /*The x, y offsets of the motion vector in units of 1/8th pixels.
+    This limits vectors to [OD_MV_MIN, OD_MV_MAX], or just under 4096 pixels
+     in each direction.
+    The encoder never searches more than OD_MC_SEARCH_RANGE pixels away, but
+     a stream for a large enough frame can code longer vectors, so the
+     decoder clamps them to this range.*/
+  int16_t mv[2];
 };
 
+/*The range of each motion vector component, in units of 1/8th pixels.*/
+#define OD_MV_MIN (-32768)
+#define OD_MV_MAX (32767)
+
 extern const int16_t OD_SUBPEL_FILTER_SET[8][8];
 
 #define OD_SUBPEL_FILTER_TAP_SIZE (6)
@@ -92,15 +103,18 @@ extern const int16_t OD_SUBPEL_FILTER_SET[8][8];
 #define OD_SUBPEL_BUFF_APRON_SZ (OD_SUBPEL_TOP_APRON_SZ \
  + OD_SUBPEL_BOTTOM_APRON_SZ)
 
+void od_mc_blend8(od_state *state, unsigned char *dst, int dystride,
+ const unsigned char *src[4], int oc, int s,
+ int log_xblk_sz, int log_yblk_sz);
 void od_mc_predict8(od_state *state, unsigned char *dst, int dystride,
- const unsigned char *src, int systride, const int32_t mvx[4],
- const int32_t mvy[4], int oc, int s, int log_xblk_sz, int log_yblk_sz,
- int subsampled_plane);
+ const od_img_plane *iplane, int x, int y, const int32_t mvx[4],
+ const int32_t mvy[4], int oc, int s, int log_xblk_sz, int log_yblk_sz);
 void od_state_mvs_clear(od_state *state);
 int od_state_get_predictor(od_state *state, int pred[2],
  int vx, int vy, int level, int mv_res);
 
-int od_mv_split_flag_ctx(od_mv_grid_pt **grid, int vx, int vy,int level);
+int od_mv_split_flag_ctx(od_mv_grid_pt **grid, unsigned char **valid,
+ int vx, int vy, int level);
 uint16_t *od_mv_split_flag_cdf(od_state *state, int vx, int vy, int level);
 
 #endif
@@ -1365,6 +1365,27 @@ int od_mc_compute_sad_16x16_xstride_1_c(const unsigned char *src, int systride,
   return od_mc_compute_sad_c(src, systride, ref, dystride, 1, 16, 16);
 }
 
+int od_mc_compute_sad_32x32_xstride_1_c(const unsigned char *src, int systride,
+ const unsigned char *ref, int dystride) {
+  return od_mc_compute_sad_c(src, systride, ref, dystride, 1, 32, 32);
+}
+
+/*Handles blocks of any size, e.g., those clipped against the picture edge.*/
+int od_mc_compute_sad_xstride_1_c(const unsigned char *src, int systride,
+ const unsigned char *ref, int dystride, int w, int h) {
+  return od_mc_compute_sad_c(src, systride, ref, dystride, 1, w, h);
+}
+
+/*Computes the SADs of one source block against four predictors that share
+   the same stride.*/
+void od_mc_compute_sad4_xstride_1_c(int32_t sad[4], const unsigned char *src,
+ int systride, const unsigned char *const ref[4], int dystride, int w, int h) {
+  int k;
+  for (k = 0; k < 4; k++) {
+    sad[k] = od_mc_compute_sad_c(src, systride, ref[k], dystride, 1, w, h);
+  }
+}
+
 static const od_coeff OD_HADAMARD_4X4[] = {
   1, 1, 1, 1,
   1,-1, 1,-1,
@@ -1583,49 +1604,63 @@ int od_mc_compute_satd_32x32_c(const unsigned char *src, int systride,
   return satd;
 }
 
-/*Computes the SAD of the input image against the given predictor.*/
-static int32_t od_enc_sad8(od_enc_ctx *enc, const unsigned char *p,
- int pystride, int pxstride, int pli, int x, int y, int log_blk_sz) {
-  od_state *state;
+/*Clips a block of the input image against the active picture region.
+  x, y and log_blk_sz give the block in luma pixels.
+  On return, *w and *h hold the size of the clipped block in the plane, and
+   *offs the offset to add to a predictor with the given strides to match it.
+  Returns a pointer to the top-left pixel of the clipped block.*/
+static unsigned char *od_enc_clip_block(od_state *state, int *w, int *h,
+ int *offs, int pystride, int pxstride, int pli, int x, int y,
+ int log_blk_sz) {
   od_img_plane *iplane;
-  unsigned char *src;
   int clipx;
   int clipy;
   int clipw;
   int cliph;
-  int w;
-  int h;
-  int32_t ret;
-  state = &enc->state;
   iplane = state->io_imgs[OD_FRAME_INPUT].planes + pli;
   /*Compute the block dimensions in the target image plane.*/
   x >>= iplane->xdec;
   y >>= iplane->ydec;
-  w = 1 << (log_blk_sz - iplane->xdec);
-  h = 1 << (log_blk_sz - iplane->ydec);
-  /*Clip the block against the active picture region.*/
+  *w = 1 << (log_blk_sz - iplane->xdec);
+  *h = 1 << (log_blk_sz - iplane->ydec);
+  *offs = 0;
   clipx = -x;
   if (clipx > 0) {
-    w -= clipx;
-    p += clipx*pxstride;
+    *w -= clipx;
+    *offs += clipx*pxstride;
     x += clipx;
   }
   clipy = -y;
   if (clipy > 0) {
-    h -= clipy;
-    p += clipy*pystride;
+    *h -= clipy;
+    *offs += clipy*pystride;
     y += clipy;
   }
   clipw = ((state->info.pic_width + (1 << iplane->xdec) - 1) >> iplane->xdec)
    - x;
-  w = OD_MINI(w, clipw);
+  *w = OD_MINI(*w, clipw);
   cliph = ((state->info.pic_height + (1 << iplane->ydec) - 1) >> iplane->ydec)
    - y;
-  h = OD_MINI(h, cliph);
+  *h = OD_MINI(*h, cliph);
   /*OD_LOG((OD_LOG_MOTION_ESTIMATION, OD_LOG_DEBUG,
-   "[%i, %i]x[%i, %i]", x, y, w, h));*/
+   "[%i, %i]x[%i, %i]", x, y, *w, *h));*/
+  return iplane->data + y*iplane->ystride + x*iplane->xstride;
+}
+
+/*Computes the SAD of the input image against the given predictor.*/
+static int32_t od_enc_sad8(od_enc_ctx *enc, const unsigned char *p,
+ int pystride, int pxstride, int pli, int x, int y, int log_blk_sz) {
+  od_img_plane *iplane;
+  unsigned char *src;
+  int offs;
+  int w;
+  int h;
+  int32_t ret;
+  iplane = enc->state.io_imgs[OD_FRAME_INPUT].planes + pli;
+  src = od_enc_clip_block(&enc->state, &w, &h, &offs, pystride, pxstride,
+   pli, x, y, log_blk_sz);
+  p += offs;
   /*Compute the SAD.*/
-  src = iplane->data + y*iplane->ystride + x*iplane->xstride;
   if (pxstride != 1) {
     /*Default C implementation.*/
     ret = od_mc_compute_sad_c(src, iplane->ystride,
@@ -1643,14 +1678,37 @@ static int32_t od_enc_sad8(od_enc_ctx *enc, const unsigned char *p,
     ret = (*enc->opt_vtbl.mc_compute_sad_16x16_xstride_1)(src, iplane->ystride,
      p, pystride);
   }
+  else if (w == 32 && h == 32) {
+    ret = (*enc->opt_vtbl.mc_compute_sad_32x32_xstride_1)(src, iplane->ystride,
+     p, pystride);
+  }
   else {
-    /*Default C implementation.*/
-    ret = od_mc_compute_sad_c(src, iplane->ystride,
-     p, pystride, pxstride, w, h);
+    /*Blocks clipped against the picture edge.*/
+    ret = (*enc->opt_vtbl.mc_compute_sad_xstride_1)(src, iplane->ystride,
+     p, pystride, w, h);
   }
   return ret;
 }
 
+/*Computes the SADs of the input image block against four predictors that
+   share the same stride, with the same clipping as od_enc_sad8().*/
+static void od_enc_sad8_x4(od_enc_ctx *enc, int32_t ret[4],
+ const unsigned char *const p[4], int pystride, int pli, int x, int y,
+ int log_blk_sz) {
+  const unsigned char *q[4];
+  unsigned char *src;
+  int offs;
+  int w;
+  int h;
+  int k;
+  src = od_enc_clip_block(&enc->state, &w, &h, &offs, pystride, 1,
+   pli, x, y, log_blk_sz);
+  for (k = 0; k < 4; k++) q[k] = p[k] + offs;
+  (*enc->opt_vtbl.mc_compute_sad4_xstride_1)(ret, src,
+   enc->state.io_imgs[OD_FRAME_INPUT].planes[pli].ystride,
+   q, pystride, w, h);
+}
+
 /*Computes the SATD of the input image block against the given predictor.*/
 static int32_t od_enc_satd8(od_enc_ctx *enc, const unsigned char *p,
  int pystride, int pxstride, int pli, int x, int y, int log_blk_sz) {
@@ -1736,32 +1794,40 @@ static int od_mv_est_init_impl(od_mv_est_ctx *est, od_enc_ctx *enc) {
   nhmvbs = enc->state.nhmvbs;
   nvmvbs = enc->state.nvmvbs;
   for (log_mvb_sz = 0; log_mvb_sz < OD_LOG_MVB_DELTA0 ; log_mvb_sz++) {
-    est->sad_cache[log_mvb_sz] = (od_sad4 **)od_malloc_2d(nvmvbs >> log_mvb_sz,
-     nhmvbs >> log_mvb_sz, sizeof(est->sad_cache[log_mvb_sz][0][0]));
+    est->sad_cache[log_mvb_sz] = (od_sad4 **)od_malloc_2d(&enc->state.alloc,
+     nvmvbs >> log_mvb_sz, nhmvbs >> log_mvb_sz,
+     sizeof(est->sad_cache[log_mvb_sz][0][0]));
     if (OD_UNLIKELY(!est->sad_cache[log_mvb_sz])) return OD_EFAULT;
   }
-  est->mvs = (od_mv_node **)od_calloc_2d(nvmvbs + 1, nhmvbs + 1,
-   sizeof(est->mvs[0][0]));
+  est->mvs = (od_mv_node **)od_calloc_2d(&enc->state.alloc, nvmvbs + 1,
+   nhmvbs + 1, sizeof(est->mvs[0][0]));
   if (OD_UNLIKELY(!est->mvs)) {
     return OD_EFAULT;
   }
-  est->refine_grid = (od_mv_grid_pt **)od_malloc_2d(nvmvbs + 1, nhmvbs + 1,
-   sizeof(est->refine_grid[0][0]));
+  est->bma = (od_mv_bma_node **)od_calloc_2d(&enc->state.alloc, nvmvbs + 1,
+   nhmvbs + 1, sizeof(est->bma[0][0]));
+  if (OD_UNLIKELY(!est->bma)) {
+    return OD_EFAULT;
+  }
+  est->refine_grid = (od_mv_grid_pt **)od_malloc_2d(&enc->state.alloc,
+   nvmvbs + 1, nhmvbs + 1, sizeof(est->refine_grid[0][0]));
   if (OD_UNLIKELY(!est->refine_grid)) {
     return OD_EFAULT;
   }
-  est->dp_nodes = (od_mv_dp_node *)malloc(
+  est->dp_nodes = (od_mv_dp_node *)od_malloc(&enc->state.alloc,
    sizeof(od_mv_dp_node)*(OD_MAXI(nhmvbs, nvmvbs) + 1));
   if (OD_UNLIKELY(!est->dp_nodes)) {
     return OD_EFAULT;
   }
   est->row_counts =
-   (unsigned *)malloc(sizeof(*est->row_counts)*(nvmvbs + 1));
+   (unsigned *)od_malloc(&enc->state.alloc,
+   sizeof(*est->row_counts)*(nvmvbs + 1));
   if (OD_UNLIKELY(!est->row_counts)) {
     return OD_EFAULT;
   }
   est->col_counts =
-   (unsigned *)malloc(sizeof(*est->col_counts)*(nhmvbs + 1));
+   (unsigned *)od_malloc(&enc->state.alloc,
+   sizeof(*est->col_counts)*(nhmvbs + 1));
   if (OD_UNLIKELY(!est->col_counts)) {
     return OD_EFAULT;
   }
@@ -1770,10 +1836,12 @@ static int od_mv_est_init_impl(od_mv_est_ctx *est, od_enc_ctx *enc) {
       est->mvs[vy][vx].vx = vx;
       est->mvs[vy][vx].vy = vy;
       est->mvs[vy][vx].heapi = -1;
-      enc->state.mv_grid[vy][vx].valid = 1;
+      est->bma[vy][vx].vx = vx;
+      est->bma[vy][vx].vy = vy;
+      enc->state.mv_valid[vy][vx] = 1;
     }
   }
-  est->dec_heap = (od_mv_node **)malloc(
+  est->dec_heap = (od_mv_node **)od_malloc(&enc->state.alloc,
    sizeof(*est->dec_heap)*(nvmvbs + 1)*(nhmvbs + 1));
   if (OD_UNLIKELY(!est->dec_heap)) {
     return OD_EFAULT;
@@ -1782,19 +1850,24 @@ static int od_mv_est_init_impl(od_mv_est_ctx *est, od_enc_ctx *enc) {
   est->hit_bit = UCHAR_MAX;
   est->mv_res_min = 0;
   est->flags = OD_MC_USE_CHROMA;
+  est->subpel_refi = -1;
   return OD_SUCCESS;
 }
 
 static void od_mv_est_clear(od_mv_est_ctx *est) {
+  const daala_allocator *alloc;
   int log_mvb_sz;
-  free(est->dec_heap);
-  free(est->col_counts);
-  free(est->row_counts);
-  free(est->dp_nodes);
-  od_free_2d(est->refine_grid);
-  od_free_2d(est->mvs);
+  alloc = &est->enc->state.alloc;
+  od_mv_est_subpel_cache_free(est);
+  od_free(alloc, est->dec_heap);
+  od_free(alloc, est->col_counts);
+  od_free(alloc, est->row_counts);
+  od_free(alloc, est->dp_nodes);
+  od_free_2d(alloc, est->refine_grid);
+  od_free_2d(alloc, est->bma);
+  od_free_2d(alloc, est->mvs);
   for (log_mvb_sz = OD_LOG_MVB_DELTA0; log_mvb_sz-- > 0; ) {
-    od_free_2d(est->sad_cache[log_mvb_sz]);
+    od_free_2d(alloc, est->sad_cache[log_mvb_sz]);
   }
 }
 
@@ -2183,14 +2256,278 @@ static int32_t od_mv_est_bma_sad8(od_mv_est_ctx *est,
   return ret;
 }
 
+/*Computes the SADs of up to four whole-pel BMA candidates for the same block
+   in a single pass over the input image.
+  Unused entries of sad are left unspecified.*/
+static void od_mv_est_bma_sad8_x4(od_mv_est_ctx *est, int32_t sad[4],
+ int ref, int bx, int by, int (*cands)[2], int ncands, int log_mvb_sz) {
+  od_state *state;
+  od_img_plane *iplane;
+  const unsigned char *p[4];
+  int refi;
+  int k;
+  OD_ASSERT(ncands > 0 && ncands <= 4);
+  state = &est->enc->state;
+  refi = state->ref_imgi[ref];
+  iplane = state->ref_imgs[refi].planes + 0;
+  OD_ASSERT(iplane->xdec == 0 && iplane->ydec == 0);
+  for (k = 0; k < 4; k++) {
+    int ck;
+    ck = k < ncands ? k : 0;
+    p[k] = iplane->data + (by + cands[ck][1])*iplane->ystride
+     + bx + cands[ck][0];
+  }
+  od_enc_sad8_x4(est->enc, sad, p, iplane->ystride, 0, bx, by,
+   log_mvb_sz + OD_LOG_MVBSIZE_MIN);
+  if (est->flags & OD_MC_USE_CHROMA) {
+    int32_t csad[4];
+    int pli;
+    for (pli = 1; pli < state->io_imgs[OD_FRAME_INPUT].nplanes; pli++) {
+      unsigned char *ref_img;
+      iplane = state->ref_imgs[refi].planes + pli;
+      ref_img = iplane->data + (by >> iplane->ydec)*iplane->ystride
+       + (bx >> iplane->xdec);
+      for (k = 0; k < 4; k++) {
+        if (k < ncands) {
+          od_mc_predict1fmv8_c(state->mc_buf[k], ref_img, iplane->ystride,
+           cands[k][0] << (3 - iplane->xdec), cands[k][1] << (3 - iplane->ydec),
+           log_mvb_sz + OD_LOG_MVBSIZE_MIN - iplane->xdec,
+           log_mvb_sz + OD_LOG_MVBSIZE_MIN - iplane->ydec);
+          p[k] = state->mc_buf[k];
+        }
+        else p[k] = state->mc_buf[0];
+      }
+      od_enc_sad8_x4(est->enc, csad, p,
+       1 << (log_mvb_sz + OD_LOG_MVBSIZE_MIN - iplane->xdec), pli, bx, by,
+       log_mvb_sz + OD_LOG_MVBSIZE_MIN);
+      for (k = 0; k < ncands; k++) sad[k] += csad[k] >> OD_MC_CHROMA_SCALE;
+    }
+  }
+}
+
+/*Frees the sub-pel cache.*/
+void od_mv_est_subpel_cache_free(od_mv_est_ctx *est) {
+  const daala_allocator *alloc;
+  int phase;
+  alloc = &est->enc->state.alloc;
+  od_free(alloc, est->subpel_valid);
+  est->subpel_valid = NULL;
+  for (phase = 1; phase < 64; phase++) {
+    od_free(alloc, est->subpel_planes[phase]);
+    est->subpel_planes[phase] = NULL;
+  }
+  est->subpel_refi = -1;
+}
+
+/*Allocates the sub-pel cache, with a plane for every phase the search can
+   reach at the current mv_res_min, replacing any cache allocated before.
+  This is done up front, so that encoding a frame never allocates memory.
+  Return: 0 on success, or OD_EFAULT if an allocation failed, in which case
+   the cache is left freed.*/
+int od_mv_est_subpel_cache_alloc(od_mv_est_ctx *est) {
+  od_state *state;
+  size_t plane_sz;
+  int mask;
+  int phase;
+  state = &est->enc->state;
+  od_mv_est_subpel_cache_free(est);
+  est->subpel_ntx = (state->frame_width + (OD_MC_SUBPEL_CACHE_PAD << 1))
+   >> OD_MC_SUBPEL_CACHE_LOG_TILE;
+  est->subpel_nty = (state->frame_height + (OD_MC_SUBPEL_CACHE_PAD << 1))
+   >> OD_MC_SUBPEL_CACHE_LOG_TILE;
+  est->subpel_valid = (unsigned char *)od_malloc(&state->alloc,
+   64*est->subpel_ntx*est->subpel_nty);
+  if (OD_UNLIKELY(!est->subpel_valid)) return OD_EFAULT;
+  plane_sz = (size_t)(est->subpel_ntx*est->subpel_nty)
+   << 2*OD_MC_SUBPEL_CACHE_LOG_TILE;
+  /*Only phases on the 1 << mv_res_min eighth-pel grid are ever searched.*/
+  mask = (1 << est->mv_res_min) - 1;
+  for (phase = 1; phase < 64; phase++) {
+    if ((phase & 7 & mask) || (phase >> 3 & mask)) continue;
+    est->subpel_planes[phase] = (unsigned char *)od_malloc(&state->alloc,
+     plane_sz);
+    if (OD_UNLIKELY(!est->subpel_planes[phase])) {
+      od_mv_est_subpel_cache_free(est);
+      return OD_EFAULT;
+    }
+  }
+  return OD_SUCCESS;
+}
+
+/*Empties the sub-pel cache and points it at the given reference.
+  The tiles are filled lazily the first time a candidate touches them, since
+   the search rarely visits every phase of every part of the frame.*/
+static void od_mv_est_subpel_cache_reset(od_mv_est_ctx *est, int ref) {
+  od_state *state;
+  od_img_plane *iplane;
+  state = &est->enc->state;
+  est->subpel_refi = -1;
+  iplane = state->ref_imgs[state->ref_imgi[ref]].planes + 0;
+  /*The cache only handles an undecimated luma plane.*/
+  if (iplane->xdec != 0 || iplane->ydec != 0) return;
+  if (est->subpel_valid == NULL) return;
+  OD_CLEAR(est->subpel_valid, 64*est->subpel_ntx*est->subpel_nty);
+  est->subpel_refi = state->ref_imgi[ref];
+}
+
+/*Returns the given tile of a sub-pel phase plane, interpolating it first if
+   this is the first time it was needed this frame.
+  Return: The upper-left pixel of the tile, or NULL if no plane was allocated
+   for this phase.*/
+static const unsigned char *od_mv_est_subpel_tile(od_mv_est_ctx *est,
+ int phase, int tx, int ty) {
+  od_state *state;
+  od_img_plane *iplane;
+  unsigned char *valid;
+  unsigned char *plane;
+  unsigned char *dst;
+  int ystride;
+  int tile_sz;
+  int j;
+  state = &est->enc->state;
+  ystride = est->subpel_ntx << OD_MC_SUBPEL_CACHE_LOG_TILE;
+  tile_sz = 1 << OD_MC_SUBPEL_CACHE_LOG_TILE;
+  plane = est->subpel_planes[phase];
+  if (plane == NULL) return NULL;
+  dst = plane + ((ty*ystride + tx) << OD_MC_SUBPEL_CACHE_LOG_TILE);
+  valid = est->subpel_valid + (phase*est->subpel_nty + ty)*est->subpel_ntx
+   + tx;
+  if (!*valid) {
+    unsigned char buf[1 << 2*OD_MC_SUBPEL_CACHE_LOG_TILE];
+    int x;
+    int y;
+    iplane = state->ref_imgs[est->subpel_refi].planes + 0;
+    x = (tx << OD_MC_SUBPEL_CACHE_LOG_TILE) - OD_MC_SUBPEL_CACHE_PAD;
+    y = (ty << OD_MC_SUBPEL_CACHE_LOG_TILE) - OD_MC_SUBPEL_CACHE_PAD;
+    /*Each output pixel depends only on its position and phase, so filtering
+       the tile with the same function as od_mc_predict8() gives exactly the
+       pixels it would produce for any block overlapping it.*/
+    (*state->opt_vtbl.mc_predict1fmv8)(buf,
+     iplane->data + y*iplane->ystride + x, iplane->ystride,
+     phase & 7, phase >> 3,
+     OD_MC_SUBPEL_CACHE_LOG_TILE, OD_MC_SUBPEL_CACHE_LOG_TILE);
+    for (j = 0; j < tile_sz; j++) {
+      OD_COPY(dst + j*ystride, buf + (j << OD_MC_SUBPEL_CACHE_LOG_TILE),
+       tile_sz);
+    }
+    *valid = 1;
+  }
+  return dst;
+}
+
+/*Copies the prediction of a block for a single MV out of the sub-pel cache.
+  x, y: The upper-left corner of the block in the luma plane.
+  Return: 0 on success, or a negative value if the block is not covered by the
+   cache, in which case the caller must interpolate it itself.*/
+static int od_mv_est_subpel_fetch(od_mv_est_ctx *est, unsigned char *dst,
+ int x, int y, int32_t mvx, int32_t mvy, int log_blk_sz) {
+  od_state *state;
+  const unsigned char *src;
+  int blk_sz;
+  int phase;
+  int ystride;
+  int j;
+  state = &est->enc->state;
+  blk_sz = 1 << log_blk_sz;
+  phase = (mvy & 7) << 3 | (mvx & 7);
+  x += mvx >> 3;
+  y += mvy >> 3;
+  if (phase == 0) {
+    od_img_plane *iplane;
+    iplane = state->ref_imgs[est->subpel_refi].planes + 0;
+    src = iplane->data + y*iplane->ystride + x;
+    ystride = iplane->ystride;
+  }
+  else {
+    int tx0;
+    int ty0;
+    int tx1;
+    int ty1;
+    int tx;
+    int ty;
+    x += OD_MC_SUBPEL_CACHE_PAD;
+    y += OD_MC_SUBPEL_CACHE_PAD;
+    ystride = est->subpel_ntx << OD_MC_SUBPEL_CACHE_LOG_TILE;
+    if (x < 0 || y < 0 || x + blk_sz > ystride
+     || y + blk_sz > est->subpel_nty << OD_MC_SUBPEL_CACHE_LOG_TILE) {
+      return -1;
+    }
+    tx0 = x >> OD_MC_SUBPEL_CACHE_LOG_TILE;
+    ty0 = y >> OD_MC_SUBPEL_CACHE_LOG_TILE;
+    tx1 = (x + blk_sz - 1) >> OD_MC_SUBPEL_CACHE_LOG_TILE;
+    ty1 = (y + blk_sz - 1) >> OD_MC_SUBPEL_CACHE_LOG_TILE;
+    for (ty = ty0; ty <= ty1; ty++) {
+      for (tx = tx0; tx <= tx1; tx++) {
+        if (od_mv_est_subpel_tile(est, phase, tx, ty) == NULL) return -1;
+      }
+    }
+    src = est->subpel_planes[phase] + y*ystride + x;
+  }
+  for (j = 0; j < blk_sz; j++) {
+    OD_COPY(dst + (j << log_blk_sz), src + j*ystride, blk_sz);
+  }
+  return 0;
+}
+
+/*Equivalent to od_state_pred_block_from_setup() for the luma plane, but
+   reading the four corner predictions out of the sub-pel cache.
+  Return: 0 on success, or a negative value if the cache does not cover the
+   block.*/
+static int od_mv_est_pred_block_cached(od_mv_est_ctx *est, unsigned char *buf,
+ int ystride, int ref, int vx, int vy, int oc, int s, int log_mvb_sz) {
+  od_state *state;
+  const unsigned char *pred[4];
+  int32_t mvx[4];
+  int32_t mvy[4];
+  const int *dxp;
+  const int *dyp;
+  int log_blk_sz;
+  int x;
+  int y;
+  int k;
+  int l;
+  state = &est->enc->state;
+  if (est->subpel_refi < 0 || est->subpel_refi != state->ref_imgi[ref]) {
+    return -1;
+  }
+  dxp = OD_VERT_SETUP_DX[oc][s];
+  dyp = OD_VERT_SETUP_DY[oc][s];
+  log_blk_sz = log_mvb_sz + OD_LOG_MVBSIZE_MIN;
+  x = vx << OD_LOG_MVBSIZE_MIN;
+  y = vy << OD_LOG_MVBSIZE_MIN;
+  for (k = 0; k < 4; k++) {
+    od_mv_grid_pt *grid;
+    grid = state->mv_grid[vy + (dyp[k] << log_mvb_sz)]
+     + vx + (dxp[k] << log_mvb_sz);
+    mvx[k] = grid->mv[0];
+    mvy[k] = grid->mv[1];
+    /*Reuse the prediction of an earlier corner with the same MV.*/
+    for (l = 0; l < k && (mvx[l] != mvx[k] || mvy[l] != mvy[k]); l++);
+    if (l < k) pred[k] = pred[l];
+    else {
+      if (od_mv_est_subpel_fetch(est, state->mc_buf[k], x, y,
+       mvx[k], mvy[k], log_blk_sz) < 0) {
+        return -1;
+      }
+      pred[k] = state->mc_buf[k];
+    }
+  }
+  od_mc_blend8(state, buf, ystride, pred, oc, s, log_blk_sz, log_blk_sz);
+  return 0;
+}
+
 /*Computes the SAD of a block with the given parameters.*/
 static int32_t od_mv_est_sad8(od_mv_est_ctx *est,
  int ref, int vx, int vy, int oc, int s, int log_mvb_sz) {
   od_state *state;
   int32_t ret;
   state = &est->enc->state;
-  od_state_pred_block_from_setup(state, state->mc_buf[4], OD_MVBSIZE_MAX,
-   ref, 0, vx, vy, oc, s, log_mvb_sz);
+  if (!(est->flags & OD_MC_USE_SUBPEL_CACHE)
+   || od_mv_est_pred_block_cached(est, state->mc_buf[4], OD_MVBSIZE_MAX,
+   ref, vx, vy, oc, s, log_mvb_sz) < 0) {
+    od_state_pred_block_from_setup(state, state->mc_buf[4], OD_MVBSIZE_MAX,
+     ref, 0, vx, vy, oc, s, log_mvb_sz);
+  }
   ret = est->compute_distortion(est->enc, state->mc_buf[4], OD_MVBSIZE_MAX,
    1, 0, vx << OD_LOG_MVBSIZE_MIN, vy << OD_LOG_MVBSIZE_MIN,
    log_mvb_sz + OD_LOG_MVBSIZE_MIN);
@@ -2218,7 +2555,7 @@ void od_mv_est_check_rd_block_state(od_mv_est_ctx *est,
   state = &est->enc->state;
   half_mvb_sz = 1 << log_mvb_sz >> 1;
   if (log_mvb_sz > 0
-   && state->mv_grid[vy + half_mvb_sz][vx + half_mvb_sz].valid) {
+   && state->mv_valid[vy + half_mvb_sz][vx + half_mvb_sz]) {
     od_mv_est_check_rd_block_state(est, ref, vx, vy, log_mvb_sz - 1);
     od_mv_est_check_rd_block_state(est, ref,
      vx + half_mvb_sz, vy, log_mvb_sz - 1);
@@ -2258,8 +2595,8 @@ void od_mv_est_check_rd_block_state(od_mv_est_ctx *est,
       s1vy = vy + (OD_VERT_DY[(oc + 1) & 3] << log_mvb_sz);
       s3vx = vx + (OD_VERT_DX[(oc + 3) & 3] << log_mvb_sz);
       s3vy = vy + (OD_VERT_DY[(oc + 3) & 3] << log_mvb_sz);
-      s = state->mv_grid[s1vy][s1vx].valid |
-       state->mv_grid[s3vy][s3vx].valid << 1;
+      s = state->mv_valid[s1vy][s1vx] |
+       state->mv_valid[s3vy][s3vx] << 1;
     }
     else {
       oc = 0;
@@ -2309,21 +2646,21 @@ void od_mv_est_check_rd_state(od_mv_est_ctx *est, int ref, int mv_res) {
       int equal_mvs;
       int level;
       int mvb_sz;
+      if (!state->mv_valid[vy][vx]) continue;
       mvg = state->mv_grid[vy] + vx;
-      if (!mvg->valid) continue;
       level = OD_MC_LEVEL[vy & OD_MVB_MASK][vx & OD_MVB_MASK];
       mvb_sz = 1 << ((OD_MC_LEVEL_MAX - level) >> 1);
       if (level & 1) {
-        OD_ASSERT(state->mv_grid[vy - mvb_sz][vx - mvb_sz].valid
-         && state->mv_grid[vy - mvb_sz][vx + mvb_sz].valid
-         && state->mv_grid[vy + mvb_sz][vx - mvb_sz].valid
-         && state->mv_grid[vy + mvb_sz][vx + mvb_sz].valid);
+        OD_ASSERT(state->mv_valid[vy - mvb_sz][vx - mvb_sz]
+         && state->mv_valid[vy - mvb_sz][vx + mvb_sz]
+         && state->mv_valid[vy + mvb_sz][vx - mvb_sz]
+         && state->mv_valid[vy + mvb_sz][vx + mvb_sz]);
       }
       else {
-        OD_ASSERT((vy - mvb_sz < 0 || state->mv_grid[vy - mvb_sz][vx].valid)
-         && (vx - mvb_sz < 0 || state->mv_grid[vy][vx - mvb_sz].valid)
-         && (vy + mvb_sz > nvmvbs || state->mv_grid[vy + mvb_sz][vx].valid)
-         && (vx + mvb_sz > nhmvbs || state->mv_grid[vy][vx + mvb_sz].valid));
+        OD_ASSERT((vy - mvb_sz < 0 || state->mv_valid[vy - mvb_sz][vx])
+         && (vx - mvb_sz < 0 || state->mv_valid[vy][vx - mvb_sz])
+         && (vy + mvb_sz > nvmvbs || state->mv_valid[vy + mvb_sz][vx])
+         && (vx + mvb_sz > nhmvbs || state->mv_valid[vy][vx + mvb_sz]));
       }
       mv = est->mvs[vy] + vx;
       equal_mvs = od_state_get_predictor(state, pred, vx, vy,
@@ -2348,13 +2685,52 @@ void od_mv_est_check_rd_state(od_mv_est_ctx *est, int ref, int mv_res) {
 static const unsigned char OD_YCbCr_MVCAND[3] = { 210, 16, 214 };
 #endif
 
+/*Scores a list of whole-pel candidates for the initial EPZS^2 search, four
+   at a time, and keeps the best one.
+  Candidates are compared in list order, so the result is the same as
+   scoring them one at a time.
+  Return: The index of the best candidate, or -1 if none was better than the
+   current best.*/
+static int od_mv_est_init_cands(od_mv_est_ctx *est, int ref, int bx, int by,
+ int log_mvb_sz, int equal_mvs, const int pred[2], int (*cands)[2],
+ int ncands, int32_t *best_sad, int *best_rate, int32_t *best_cost) {
+  int32_t sad[4];
+  int best_ci;
+  int ci;
+  int k;
+  best_ci = -1;
+  for (ci = 0; ci < ncands; ci += 4) {
+    int n;
+    n = OD_MINI(ncands - ci, 4);
+    od_mv_est_bma_sad8_x4(est, sad, ref, bx, by, cands + ci, n, log_mvb_sz);
+    for (k = 0; k < n; k++) {
+      int32_t cost;
+      int rate;
+      rate = od_mv_est_bits(est, equal_mvs,
+       cands[ci + k][0] << 1, cands[ci + k][1] << 1, pred[0], pred[1]);
+      cost = (sad[k] << OD_ERROR_SCALE) + rate*est->lambda;
+      OD_LOG((OD_LOG_MOTION_ESTIMATION, OD_LOG_DEBUG,
+       "Candidate %i: (%i, %i)    Cost: %i",
+       ci + k, cands[ci + k][0], cands[ci + k][1], cost));
+      if (cost < *best_cost) {
+        *best_sad = sad[k];
+        *best_rate = rate;
+        *best_cost = cost;
+        best_ci = ci + k;
+      }
+    }
+  }
+  return best_ci;
+}
+
 static void od_mv_est_init_mv(od_mv_est_ctx *est, int ref, int vx, int vy) {
-  static const od_mv_node ZERO_NODE;
+  static const od_mv_bma_node ZERO_NODE;
   od_state *state;
   od_mv_grid_pt *mvg;
   od_mv_node *mv;
-  const od_mv_node *cneighbors[4];
-  const od_mv_node *pneighbors[4];
+  od_mv_bma_node *bma;
+  const od_mv_bma_node *cneighbors[4];
+  const od_mv_bma_node *pneighbors[4];
   int32_t t2;
   int32_t best_sad;
   int32_t best_cost;
@@ -2391,6 +2767,7 @@ static void od_mv_est_init_mv(od_mv_est_ctx *est, int ref, int vx, int vy) {
    "Initial search for MV (%i, %i):", vx, vy));
   state = &est->enc->state;
   mv = est->mvs[vy] + vx;
+  bma = est->bma[vy] + vx;
   level = OD_MC_LEVEL[vy & OD_MVB_MASK][vx & OD_MVB_MASK];
   log_mvb_sz = (OD_MC_LEVEL_MAX - level) >> 1;
   mvb_sz = 1 << log_mvb_sz;
@@ -2442,38 +2819,38 @@ static void od_mv_est_init_mv(od_mv_est_ctx *est, int ref, int vx, int vy) {
   if (level == 0) {
     if (vy >= mvb_sz) {
       cneighbors[0] = vx >= mvb_sz ?
-       est->mvs[vy - mvb_sz] + vx - mvb_sz : &ZERO_NODE;
-      cneighbors[1] = est->mvs[vy - mvb_sz] + vx;
+       est->bma[vy - mvb_sz] + vx - mvb_sz : &ZERO_NODE;
+      cneighbors[1] = est->bma[vy - mvb_sz] + vx;
       cneighbors[2] = vx + mvb_sz <= nhmvbs ?
-       est->mvs[vy - mvb_sz] + vx + mvb_sz : &ZERO_NODE;
-      pneighbors[0] = est->mvs[vy - mvb_sz] + vx;
+       est->bma[vy - mvb_sz] + vx + mvb_sz : &ZERO_NODE;
+      pneighbors[0] = est->bma[vy - mvb_sz] + vx;
     }
     else {
       cneighbors[2] = cneighbors[1] = cneighbors[0] = &ZERO_NODE;
       pneighbors[0] = &ZERO_NODE;
     }
-    cneighbors[3] = vx >= mvb_sz ? est->mvs[vy] + vx - mvb_sz : &ZERO_NODE;
-    pneighbors[1] = vx >= mvb_sz ? est->mvs[vy] + vx - mvb_sz : &ZERO_NODE;
+    cneighbors[3] = vx >= mvb_sz ? est->bma[vy] + vx - mvb_sz : &ZERO_NODE;
+    pneighbors[1] = vx >= mvb_sz ? est->bma[vy] + vx - mvb_sz : &ZERO_NODE;
     pneighbors[2] = vx + mvb_sz <= nhmvbs ?
-     est->mvs[vy] + vx + mvb_sz : &ZERO_NODE;
+     est->bma[vy] + vx + mvb_sz : &ZERO_NODE;
     pneighbors[3] = vy + mvb_sz <= nvmvbs ?
-     est->mvs[vy + OD_MVB_DELTA0] + vx : &ZERO_NODE;
+     est->bma[vy + OD_MVB_DELTA0] + vx : &ZERO_NODE;
   }
   else {
     if (level & 1) {
-      pneighbors[0] = est->mvs[vy - mvb_sz] + vx - mvb_sz;
-      pneighbors[1] = est->mvs[vy - mvb_sz] + vx + mvb_sz;
-      pneighbors[2] = est->mvs[vy + mvb_sz] + vx - mvb_sz;
-      pneighbors[3] = est->mvs[vy + mvb_sz] + vx + mvb_sz;
+      pneighbors[0] = est->bma[vy - mvb_sz] + vx - mvb_sz;
+      pneighbors[1] = est->bma[vy - mvb_sz] + vx + mvb_sz;
+      pneighbors[2] = est->bma[vy + mvb_sz] + vx - mvb_sz;
+      pneighbors[3] = est->bma[vy + mvb_sz] + vx + mvb_sz;
       memcpy(cneighbors, pneighbors, sizeof(cneighbors));
     }
     else {
-      pneighbors[0] = vy >= mvb_sz ? est->mvs[vy - mvb_sz] + vx : &ZERO_NODE;
-      pneighbors[1] = vx >= mvb_sz ? est->mvs[vy] + vx - mvb_sz : &ZERO_NODE;
+      pneighbors[0] = vy >= mvb_sz ? est->bma[vy - mvb_sz] + vx : &ZERO_NODE;
+      pneighbors[1] = vx >= mvb_sz ? est->bma[vy] + vx - mvb_sz : &ZERO_NODE;
       pneighbors[2] = vx + mvb_sz <= nhmvbs ?
-       est->mvs[vy] + vx + mvb_sz : &ZERO_NODE;
+       est->bma[vy] + vx + mvb_sz : &ZERO_NODE;
       pneighbors[3] = vy + mvb_sz <= nvmvbs ?
-       est->mvs[vy + mvb_sz] + vx : &ZERO_NODE;
+       est->bma[vy + mvb_sz] + vx : &ZERO_NODE;
       cneighbors[0] = pneighbors[0];
       cneighbors[1] = pneighbors[1];
       /*NOTE: Only one of these candidates can be excluded at a time, so
@@ -2510,11 +2887,10 @@ static void od_mv_est_init_mv(od_mv_est_ctx *est, int ref, int vx, int vy) {
   OD_LOG((OD_LOG_MOTION_ESTIMATION, OD_LOG_DEBUG,
    "Threshold: %i", est->thresh1[log_mvb_sz]));
   if (best_sad > est->thresh1[log_mvb_sz]) {
-    int32_t sad;
-    int32_t cost;
-    int rate;
+    int batch[8][2];
+    int nhits;
     /*Compute the early termination threshold for set B.*/
-    t2 = mv->bma_sad;
+    t2 = bma->bma_sad;
     for (ci = 0; ci < ncns; ci++) {
       int log_cnb_sz;
       int clevel;
@@ -2530,15 +2906,16 @@ static void od_mv_est_init_mv(od_mv_est_ctx *est, int ref, int vx, int vy) {
     t2 = t2 + (t2 >> OD_MC_THRESH2_SCALE_BITS) + est->thresh2_offs[log_mvb_sz];
     /*Constant velocity predictor:*/
     cands[ncns][0] =
-     OD_CLAMPI(mvxmin, mv->bma_mvs[1][ref][0], mvxmax);
+     OD_CLAMPI(mvxmin, bma->bma_mvs[1][ref][0], mvxmax);
     cands[ncns][1] =
-     OD_CLAMPI(mvymin, mv->bma_mvs[1][ref][1], mvymax);
+     OD_CLAMPI(mvymin, bma->bma_mvs[1][ref][1], mvymax);
     ncns++;
     /*Zero predictor.*/
     cands[ncns][0] = 0;
     cands[ncns][1] = 0;
     ncns++;
     /*Examine the candidates in Set B.*/
+    nhits = 0;
     for (ci = 0; ci < ncns; ci++) {
       candx = cands[ci][0];
       candy = cands[ci][1];
@@ -2554,19 +2931,15 @@ static void od_mv_est_init_mv(od_mv_est_ctx *est, int ref, int vx, int vy) {
          x0 + (candx << 1), y0 + (candy << 1), OD_YCbCr_MVCAND);
       }
 #endif
-      sad = od_mv_est_bma_sad8(est, ref, bx, by, candx, candy, log_mvb_sz);
-      rate = od_mv_est_bits(est, equal_mvs,
-       candx << 1, candy << 1, pred[0], pred[1]);
-      cost = (sad << OD_ERROR_SCALE) + rate*est->lambda;
-      OD_LOG((OD_LOG_MOTION_ESTIMATION, OD_LOG_DEBUG,
-       "Set B predictor %i: (%i, %i)    Cost: %i", ci, candx, candy, cost));
-      if (cost < best_cost) {
-        best_sad = sad;
-        best_rate = rate;
-        best_cost = cost;
-        best_vec[0] = candx;
-        best_vec[1] = candy;
-      }
+      batch[nhits][0] = candx;
+      batch[nhits][1] = candy;
+      nhits++;
+    }
+    ci = od_mv_est_init_cands(est, ref, bx, by, log_mvb_sz, equal_mvs, pred,
+     batch, nhits, &best_sad, &best_rate, &best_cost);
+    if (ci >= 0) {
+      best_vec[0] = batch[ci][0];
+      best_vec[1] = batch[ci][1];
     }
     OD_LOG((OD_LOG_MOTION_ESTIMATION, OD_LOG_DEBUG, "Threshold: %i", t2));
     if (best_sad > t2) {
@@ -2579,12 +2952,13 @@ static void od_mv_est_init_mv(od_mv_est_ctx *est, int ref, int vx, int vy) {
       }
       /*The constant acceleration predictor:*/
       cands[4][0] = OD_CLAMPI(mvxmin,
-       OD_DIV_ROUND_POW2(mv->bma_mvs[1][ref][0]*est->mvapw[ref][0]
-       - mv->bma_mvs[2][ref][0]*est->mvapw[ref][1], 16, 0x8000), mvxmax);
+       OD_DIV_ROUND_POW2(bma->bma_mvs[1][ref][0]*est->mvapw[ref][0]
+       - bma->bma_mvs[2][ref][0]*est->mvapw[ref][1], 16, 0x8000), mvxmax);
       cands[4][1] = OD_CLAMPI(mvymin,
-       OD_DIV_ROUND_POW2(mv->bma_mvs[1][ref][1]*est->mvapw[ref][0]
-       - mv->bma_mvs[2][ref][1]*est->mvapw[ref][1], 16, 0x8000), mvymax);
+       OD_DIV_ROUND_POW2(bma->bma_mvs[1][ref][1]*est->mvapw[ref][0]
+       - bma->bma_mvs[2][ref][1]*est->mvapw[ref][1], 16, 0x8000), mvymax);
       /*Examine the candidates in Set C.*/
+      nhits = 0;
       for (ci = 0; ci < 5; ci++) {
         candx = cands[ci][0];
         candy = cands[ci][1];
@@ -2593,7 +2967,6 @@ static void od_mv_est_init_mv(od_mv_est_ctx *est, int ref, int vx, int vy) {
            "Set C predictor %i: (%i, %i) ...Skipping.", ci, candx, candy));
           continue;
         }
-        /*if (od_mv_est_is_hit(est, candx, candy)) continue;*/
         od_mv_est_set_hit(est, candx, candy);
 #if defined(OD_DUMP_IMAGES) && defined(OD_ANIMATE)
         if (animating) {
@@ -2601,24 +2974,21 @@ static void od_mv_est_init_mv(od_mv_est_ctx *est, int ref, int vx, int vy) {
            x0 + (candx << 1), y0 + (candy << 1), OD_YCbCr_MVCAND);
         }
 #endif
-        sad = od_mv_est_bma_sad8(est, ref, bx, by, candx, candy, log_mvb_sz);
-        rate = od_mv_est_bits(est, equal_mvs,
-         candx << 1, candy << 1, pred[0], pred[1]);
-        cost = (sad << OD_ERROR_SCALE) + rate*est->lambda;
-        OD_LOG((OD_LOG_MOTION_ESTIMATION, OD_LOG_DEBUG,
-         "Set C predictor %i: (%i, %i)    Cost: %i", ci, candx, candy, cost));
-        if (cost < best_cost) {
-          best_sad = sad;
-          best_rate = rate;
-          best_cost = cost;
-          best_vec[0] = candx;
-          best_vec[1] = candy;
-        }
+        batch[nhits][0] = candx;
+        batch[nhits][1] = candy;
+        nhits++;
+      }
+      ci = od_mv_est_init_cands(est, ref, bx, by, log_mvb_sz, equal_mvs, pred,
+       batch, nhits, &best_sad, &best_rate, &best_cost);
+      if (ci >= 0) {
+        best_vec[0] = batch[ci][0];
+        best_vec[1] = batch[ci][1];
       }
       /*Use the same threshold for Set C as in Set B.*/
       OD_LOG((OD_LOG_MOTION_ESTIMATION, OD_LOG_DEBUG, "Threshold: %i", t2));
       if (best_sad > t2) {
         const int *pattern;
+        int sites[8];
         int mvstate;
         int best_site;
         int nsites;
@@ -2633,6 +3003,7 @@ static void od_mv_est_init_mv(od_mv_est_ctx *est, int ref, int vx, int vy) {
            (best_vec[1] <= mvymin) << 2 | (best_vec[1] >= mvymax) << 3;
           pattern = OD_SEARCH_SITES[mvstate][b];
           nsites = OD_SEARCH_NSITES[mvstate][b];
+          nhits = 0;
           for (sitei = 0; sitei < nsites; sitei++) {
             site = pattern[sitei];
             candx = best_vec[0] + OD_SITE_DX[site];
@@ -2660,21 +3031,14 @@ static void od_mv_est_init_mv(od_mv_est_ctx *est, int ref, int vx, int vy) {
                x0 + (candx << 1), y0 + (candy << 1), OD_YCbCr_MVCAND);
             }
 #endif
-            sad = od_mv_est_bma_sad8(est,
-             ref, bx, by, candx, candy, log_mvb_sz);
-            rate = od_mv_est_bits(est, equal_mvs,
-             candx << 1, candy << 1, pred[0], pred[1]);
-            cost = (sad << OD_ERROR_SCALE) + rate*est->lambda;
-            OD_LOG((OD_LOG_MOTION_ESTIMATION, OD_LOG_DEBUG,
-             "Pattern search %i: (%i, %i)    Cost: %i",
-             site, candx, candy, cost));
-            if (cost < best_cost) {
-              best_sad = sad;
-              best_rate = rate;
-              best_cost = cost;
-              best_site = site;
-            }
+            batch[nhits][0] = candx;
+            batch[nhits][1] = candy;
+            sites[nhits] = site;
+            nhits++;
           }
+          sitei = od_mv_est_init_cands(est, ref, bx, by, log_mvb_sz,
+           equal_mvs, pred, batch, nhits, &best_sad, &best_rate, &best_cost);
+          if (sitei >= 0) best_site = sites[sitei];
           mvstate = OD_SEARCH_STATES[mvstate][best_site];
           best_vec[0] += OD_SITE_DX[best_site];
           best_vec[1] += OD_SITE_DY[best_site];
@@ -2686,21 +3050,23 @@ static void od_mv_est_init_mv(od_mv_est_ctx *est, int ref, int vx, int vy) {
   OD_LOG((OD_LOG_MOTION_ESTIMATION, OD_LOG_DEBUG,
    "Finished. Best vector: (%i, %i)  Best cost %i",
    best_vec[0], best_vec[1], best_cost));
-  mv->bma_mvs[0][ref][0] = best_vec[0];
-  mv->bma_mvs[0][ref][1] = best_vec[1];
+  bma->bma_mvs[0][ref][0] = best_vec[0];
+  bma->bma_mvs[0][ref][1] = best_vec[1];
+  /*The search range keeps every vector well inside what an od_mv_grid_pt can
+     hold, whatever the size of the frame.*/
+  OD_ASSERT(abs(best_vec[0]) <= OD_MC_SEARCH_RANGE
+   && abs(best_vec[1]) <= OD_MC_SEARCH_RANGE);
   mvg->mv[0] = best_vec[0] << 3;
   mvg->mv[1] = best_vec[1] << 3;
-  mvg->valid = 1;
+  state->mv_valid[vy][vx] = 1;
 #if defined(OD_DUMP_IMAGES) && defined(OD_ANIMATE)
   if (animating) {
     char iter_label[16];
     const od_offset *anc;
-    od_mv_grid_pt *amvg;
     int nanc;
     int ai;
     int ax;
     int ay;
-    mvg->valid = 1;
     nanc = OD_NANCESTORS[vy & OD_MVB_MASK][vx & OD_MVB_MASK];
     anc = OD_ANCESTORS[vy & OD_MVB_MASK][vx & OD_MVB_MASK];
     for (ai = 0; ai < nanc; ai++) {
@@ -2708,14 +3074,13 @@ static void od_mv_est_init_mv(od_mv_est_ctx *est, int ref, int vx, int vy) {
       if (ax < 0 || ax > ((vx + OD_MVB_MASK) & ~OD_MVB_MASK)) continue;
       ay = vy + anc[ai][1];
       if (ay < 0 || ay > ((vy + OD_MVB_MASK) & ~OD_MVB_MASK)) continue;
-      amvg = state->mv_grid[ay] + ax;
-      amvg->valid = 1;
+      state->mv_valid[ay][ax] = 1;
     }
     sprintf(iter_label, "ani%08i", state->ani_iter++);
     od_state_dump_img(state, &state->vis_img, iter_label);
   }
 #endif
-  mv->bma_sad = best_sad;
+  bma->bma_sad = best_sad;
   mv->mv_rate = best_rate;
   OD_LOG((OD_LOG_MOTION_ESTIMATION, OD_LOG_DEBUG,
    "Initialized MV (%2i, %2i): (%3i, %3i), SAD: %i",
@@ -2745,9 +3110,9 @@ static void od_mv_est_init_mvs(od_mv_est_ctx *est, int ref) {
   /*Move the motion vector predictors back a frame.*/
   for (vy = 0; vy <= nvmvbs; vy++) {
     for (vx = 0; vx <= nhmvbs; vx++) {
-      od_mv_node *mv;
-      mv = est->mvs[vy] + vx;
-      OD_MOVE(mv->bma_mvs + 1, mv->bma_mvs + 0, 2);
+      od_mv_bma_node *bma;
+      bma = est->bma[vy] + vx;
+      OD_MOVE(bma->bma_mvs + 1, bma->bma_mvs + 0, 2);
     }
   }
   /*We initialize MVs a MVB at a time for cache coherency.
@@ -3403,7 +3768,7 @@ static void od_mv_dec_update(od_mv_est_ctx *est, od_mv_node *node,
 static void od_mv_est_init_nodes(od_mv_est_ctx *est) {
   od_state *state;
   od_mv_node *mv_row;
-  od_mv_grid_pt *grid;
+  unsigned char *valid;
   int nhmvbs;
   int nvmvbs;
   int vx;
@@ -3413,14 +3778,14 @@ static void od_mv_est_init_nodes(od_mv_est_ctx *est) {
   nvmvbs = state->nvmvbs;
   for (vy = 0; vy <= nvmvbs; vy++) {
     mv_row = est->mvs[vy];
-    grid = state->mv_grid[vy];
+    valid = state->mv_valid[vy];
     for (vx = 0; vx <= nhmvbs; vx++) {
       int level;
       level = OD_MC_LEVEL[vy & OD_MVB_MASK][vx & OD_MVB_MASK];
       if (level <= est->level_max) {
         int flag_rate;
         /*While we're here, reset the MV state.*/
-        OD_ASSERT(grid[vx].valid == 1);
+        OD_ASSERT(valid[vx] == 1);
         est->row_counts[vy]++;
         est->col_counts[vx]++;
         /*Inbetween the level limits, vertices require on average 2 bits to
@@ -3431,7 +3796,7 @@ static void od_mv_est_init_nodes(od_mv_est_ctx *est) {
          (1 + OD_BITRES);
         mv_row[vx].dr = -mv_row[vx].mv_rate - flag_rate;
       }
-      else grid[vx].valid = 0;
+      else valid[vx] = 0;
     }
   }
 }
@@ -3573,7 +3938,7 @@ static void od_mv_est_init_du(od_mv_est_ctx *est, int ref, int vx, int vy) {
     if (OD_MC_LEVEL[dvy & OD_MVB_MASK][dvx & OD_MVB_MASK] > est->level_max) {
       continue;
     }
-    state->mv_grid[dvy][dvx].valid = 0;
+    state->mv_valid[dvy][dvx] = 0;
     merge = est->mvs[dvy] + dvx;
     if (merge == dec) break;
     dec->dr += merge->dr;
@@ -3606,8 +3971,8 @@ static void od_mv_est_init_du(od_mv_est_ctx *est, int ref, int vx, int vy) {
         s1vy = dvy + (OD_VERT_DY[(oc + 1) & 3] << log_mvb_sz);
         s3vx = dvx + (OD_VERT_DX[(oc + 3) & 3] << log_mvb_sz);
         s3vy = dvy + (OD_VERT_DY[(oc + 3) & 3] << log_mvb_sz);
-        s = state->mv_grid[s1vy][s1vx].valid |
-         state->mv_grid[s3vy][s3vx].valid << 1;
+        s = state->mv_valid[s1vy][s1vx] |
+         state->mv_valid[s3vy][s3vx] << 1;
         dec->dd +=
          est->sad_cache[log_mvb_sz][dvy >> log_mvb_sz][dvx >> log_mvb_sz][s];
         OD_LOG((OD_LOG_MOTION_ESTIMATION, OD_LOG_DEBUG,
@@ -3638,7 +4003,7 @@ static void od_mv_est_init_du(od_mv_est_ctx *est, int ref, int vx, int vy) {
     if (OD_MC_LEVEL[dvy & OD_MVB_MASK][dvx & OD_MVB_MASK] > est->level_max) {
       continue;
     }
-    state->mv_grid[dvy][dvx].valid = 1;
+    state->mv_valid[dvy][dvx] = 1;
     if (dvx == vx && dvy == vy) break;
   }
   OD_LOG((OD_LOG_MOTION_ESTIMATION, OD_LOG_DEBUG,
@@ -3764,7 +4129,7 @@ static void od_mv_est_decimate(od_mv_est_ctx *est, int ref) {
       if (vy < 0 || vy > nvmvbs) continue;
       merge = est->mvs[vy] + vx;
       /*Don't decimate vertices that have already been decimated.*/
-      if (!state->mv_grid[vy][vx].valid) {
+      if (!state->mv_valid[vy][vx]) {
         OD_LOG((OD_LOG_MOTION_ESTIMATION, OD_LOG_DEBUG,
          "Skipping node (%i, %i) (already merged).", vx, vy));
         continue;
@@ -3790,7 +4155,7 @@ static void od_mv_est_decimate(od_mv_est_ctx *est, int ref) {
          "Updated ancestor (%2i, %2i) of (%2i, %2i): dd %5i, dr %5i",
          ax, ay, vx, vy, ancestor->dd, ancestor->dr));
       }
-      state->mv_grid[vy][vx].valid = 0;
+      state->mv_valid[vy][vx] = 0;
       od_mv_dec_heap_del(est, merge);
       est->row_counts[vy]--;
       est->col_counts[vx]--;
@@ -3818,7 +4183,7 @@ static void od_mv_est_decimate(od_mv_est_ctx *est, int ref) {
           block = est->mvs[by] + bx;
           by >>= log_mvb_sz;
           bx >>= log_mvb_sz;
-          if (!state->mv_grid[cy][cx].valid) {
+          if (!state->mv_valid[cy][cx]) {
             block->s = 0;
             block->sad = est->sad_cache[log_mvb_sz][by][bx][0];
             /*If the opposing corner has already been decimated, the remaining
@@ -3925,7 +4290,7 @@ static void od_mv_est_decimate(od_mv_est_ctx *est, int ref) {
      "Node (%i, %i) dd %i, dr %i, dopt %i: not enough.", dec->vx, dec->vy,
      dec->dd, dec->dr, dec->dr*est->lambda + (dec->dd << OD_ERROR_SCALE)));
   }*/
-  /*if (state->mv_grid[31][1].valid) {
+  /*if (state->mv_valid[31][1]) {
     dec = est->mvs[31] + 1;
     OD_LOG((OD_LOG_MOTION_ESTIMATION, OD_LOG_DEBUG,
      "(%i, %i) remains. dd: %5i, dr: %2i, dopt: %6i.", dec->vx, dec->vy,
@@ -4394,16 +4759,16 @@ static void od_mv_dp_animate_state(od_state *state,
         if (d1vx - d0vx > 1) {
           mvb_sz = d1vx - d0vx;
           if (!has_gap || dp + 1 != dp0) mvb_sz >>= 1;
-          if (!state->mv_grid[d0vy][d0vx + mvb_sz].valid) {
+          if (!state->mv_valid[d0vy][d0vx + mvb_sz]) {
             if (d0vy >= mvb_sz
-             && state->mv_grid[d0vy - mvb_sz][d0vx + mvb_sz].valid) {
+             && state->mv_valid[d0vy - mvb_sz][d0vx + mvb_sz]) {
               od_img_draw_line(&state->vis_img,
                x0 + (mvb_sz << (OD_LOG_MVBSIZE_MIN + 1)),
                y0 - (mvb_sz << (OD_LOG_MVBSIZE_MIN + 1)),
                x0 + (mvb_sz << (OD_LOG_MVBSIZE_MIN + 1)), y1, OD_YCbCr_EDGE);
             }
             if (dp[0].mv->vy <= state->nvmvbs - mvb_sz
-             && state->mv_grid[d0vy + mvb_sz][d0vx + mvb_sz].valid) {
+             && state->mv_valid[d0vy + mvb_sz][d0vx + mvb_sz]) {
               od_img_draw_line(&state->vis_img,
                x0 + (mvb_sz << (OD_LOG_MVBSIZE_MIN + 1)),
                y0 + (mvb_sz << (OD_LOG_MVBSIZE_MIN + 1)),
@@ -4414,16 +4779,16 @@ static void od_mv_dp_animate_state(od_state *state,
         else if (d1vy - d0vy > 1) {
           mvb_sz = d1vy - d0vy;
           if (!has_gap || dp + 1 != dp0) mvb_sz >>= 1;
-          if (!state->mv_grid[d0vy + mvb_sz][d0vx].valid) {
+          if (!state->mv_valid[d0vy + mvb_sz][d0vx]) {
             if (d0vx >= mvb_sz
-             && state->mv_grid[d0vy + mvb_sz][d0vx - mvb_sz].valid) {
+             && state->mv_valid[d0vy + mvb_sz][d0vx - mvb_sz]) {
               od_img_draw_line(&state->vis_img,
                x0 - (mvb_sz << (OD_LOG_MVBSIZE_MIN + 1)),
                y0 + (mvb_sz << (OD_LOG_MVBSIZE_MIN + 1)),
                x1, y0 + (mvb_sz << (OD_LOG_MVBSIZE_MIN + 1)), OD_YCbCr_EDGE);
             }
             if (d0vx <= state->nhmvbs - mvb_sz
-             && state->mv_grid[d0vy + mvb_sz][d0vx + mvb_sz].valid) {
+             && state->mv_valid[d0vy + mvb_sz][d0vx + mvb_sz]) {
               od_img_draw_line(&state->vis_img,
                x0 + (mvb_sz << (OD_LOG_MVBSIZE_MIN + 1)),
                y0 + (mvb_sz << (OD_LOG_MVBSIZE_MIN + 1)),
@@ -4542,7 +4907,7 @@ static void od_mv_dp_row_init(od_mv_est_ctx *est,
     if (px < 0 || px > nhmvbs) continue;
     py = vy + OD_ROW_PREDICTED[level][pi][1];
     if (py < 0 || py > nvmvbs) continue;
-    if (state->mv_grid[py][px].valid) {
+    if (state->mv_valid[py][px]) {
       OD_LOG((OD_LOG_MOTION_ESTIMATION, OD_LOG_DEBUG,
        "Adding (%i, %i) as a PREDICTED MV.", px, py));
       dp->predicted_mvgs[npred] = state->mv_grid[py] + px;
@@ -4647,13 +5012,13 @@ static void od_mv_dp_first_row_block_setup(od_mv_est_ctx *est,
        of the frame.)*/
     if (vy >= mvb_sz) {
       OD_ASSERT(mvb_sz == 1
-       || !state->mv_grid[vy - (mvb_sz >> 1)][vx - (mvb_sz >> 1)].valid);
+       || !state->mv_valid[vy - (mvb_sz >> 1)][vx - (mvb_sz >> 1)]);
       dp->blocks[nblocks++] = est->mvs[vy - mvb_sz] + vx - mvb_sz;
       OD_ASSERT(1 << dp->blocks[nblocks - 1]->log_mvb_sz == mvb_sz);
     }
     if (vy <= nvmvbs - mvb_sz) {
       OD_ASSERT(mvb_sz == 1
-       || !state->mv_grid[vy + (mvb_sz >> 1)][vx - (mvb_sz >> 1)].valid);
+       || !state->mv_valid[vy + (mvb_sz >> 1)][vx - (mvb_sz >> 1)]);
       dp->blocks[nblocks++] = est->mvs[vy] + vx - mvb_sz;
       OD_ASSERT(1 << dp->blocks[nblocks - 1]->log_mvb_sz == mvb_sz);
     }
@@ -4691,7 +5056,7 @@ static void od_mv_dp_prev_row_block_setup(od_mv_est_ctx *est,
          a) level must be OD_MC_LEVEL_MAX, and
          b) If the MV up-left from us is not present, then the previous MV also
           affects one more block above us.*/
-      if (prev_log_mvb_sz > 0 && !state->mv_grid[vy - 1][vx - 1].valid) {
+      if (prev_log_mvb_sz > 0 && !state->mv_valid[vy - 1][vx - 1]) {
         OD_ASSERT(level == OD_MC_LEVEL_MAX);
         dp->blocks[nblocks++] = est->mvs[vy - 2] + vx - 1;
         OD_ASSERT(dp->blocks[nblocks - 1]->log_mvb_sz == 0);
@@ -4701,7 +5066,7 @@ static void od_mv_dp_prev_row_block_setup(od_mv_est_ctx *est,
       dp->blocks[nblocks++] = est->mvs[vy] + vx - 1;
       OD_ASSERT(dp->blocks[nblocks - 1]->log_mvb_sz == 0);
       /*The same case for a missing down-left MV.*/
-      if (prev_log_mvb_sz > 0 && !state->mv_grid[vy + 1][vx - 1].valid) {
+      if (prev_log_mvb_sz > 0 && !state->mv_valid[vy + 1][vx - 1]) {
         OD_ASSERT(level == OD_MC_LEVEL_MAX);
         dp->blocks[nblocks++] = est->mvs[vy + 1] + vx - 1;
         OD_ASSERT(dp->blocks[nblocks - 1]->log_mvb_sz == 0);
@@ -4714,28 +5079,28 @@ static void od_mv_dp_prev_row_block_setup(od_mv_est_ctx *est,
     half_mvb_sz = mvb_sz >> 1;
     if (vy >= mvb_sz) {
       /*Figure out if the up-left block has been split at all.*/
-      if (state->mv_grid[vy - half_mvb_sz][vx - half_mvb_sz].valid) {
+      if (state->mv_valid[vy - half_mvb_sz][vx - half_mvb_sz]) {
         /*It has, now figure out how far down.*/
         mvb_off = half_mvb_sz;
         while (mvb_off > 1
-         && state->mv_grid[vy - (mvb_off >> 1)][vx - (mvb_off >> 1)].valid) {
+         && state->mv_valid[vy - (mvb_off >> 1)][vx - (mvb_off >> 1)]) {
           mvb_off >>= 1;
         }
         dp->blocks[nblocks++] = est->mvs[vy - mvb_off] + vx - mvb_off;
         OD_ASSERT(1 << dp->blocks[nblocks - 1]->log_mvb_sz == mvb_off);
         /*If we were only partially split at this level, then this MV might
            be used for an extra block above.*/
-        if (!state->mv_grid[vy - mvb_off][vx].valid) {
+        if (!state->mv_valid[vy - mvb_off][vx]) {
           dp->blocks[nblocks++] = est->mvs[vy - (mvb_off << 1)] + vx - mvb_off;
           OD_ASSERT(1 << dp->blocks[nblocks - 1]->log_mvb_sz == mvb_off);
         }
         /*Or for an extra block to the left.*/
-        if (!state->mv_grid[vy][vx - mvb_off].valid) {
+        if (!state->mv_valid[vy][vx - mvb_off]) {
           dp->blocks[nblocks++] = est->mvs[vy - mvb_off] + vx - (mvb_off << 1);
           OD_ASSERT(1 << dp->blocks[nblocks - 1]->log_mvb_sz == mvb_off);
           /*And if so, if the _previous_ MV might have affected an extra block
              above it.*/
-          if (!state->mv_grid[vy - mvb_off][vx - (mvb_off << 1)].valid) {
+          if (!state->mv_valid[vy - mvb_off][vx - (mvb_off << 1)]) {
             dp->blocks[nblocks++] =
              est->mvs[vy - (mvb_off << 1)] + vx - (mvb_off << 1);
             OD_ASSERT(1 << dp->blocks[nblocks - 1]->log_mvb_sz == mvb_off);
@@ -4752,7 +5117,7 @@ static void od_mv_dp_prev_row_block_setup(od_mv_est_ctx *est,
            b) If the MV up-left from us is not present, then the previous MV
             also affects one more block above us.*/
         if (prev_log_mvb_sz > log_mvb_sz
-         && !state->mv_grid[vy - mvb_sz][vx - mvb_sz].valid) {
+         && !state->mv_valid[vy - mvb_sz][vx - mvb_sz]) {
           OD_ASSERT(!(level & 1));
           dp->blocks[nblocks++] = est->mvs[vy - (mvb_sz << 1)] + vx - mvb_sz;
           OD_ASSERT(1 << dp->blocks[nblocks - 1]->log_mvb_sz == mvb_sz);
@@ -4761,28 +5126,28 @@ static void od_mv_dp_prev_row_block_setup(od_mv_est_ctx *est,
     }
     if (vy <= nvmvbs - mvb_sz) {
       /*Figure out if the down-left block has been split at all.*/
-      if (state->mv_grid[vy + half_mvb_sz][vx - half_mvb_sz].valid) {
+      if (state->mv_valid[vy + half_mvb_sz][vx - half_mvb_sz]) {
         /*It has, now figure out how far down.*/
         mvb_off = half_mvb_sz;
         while (mvb_off > 1
-         && state->mv_grid[vy + (mvb_off >> 1)][vx - (mvb_off >> 1)].valid) {
+         && state->mv_valid[vy + (mvb_off >> 1)][vx - (mvb_off >> 1)]) {
           mvb_off >>= 1;
         }
         dp->blocks[nblocks++] = est->mvs[vy] + vx - mvb_off;
         OD_ASSERT(1 << dp->blocks[nblocks - 1]->log_mvb_sz == mvb_off);
         /*If we were only partially split at this level, then this MV might
            be used for an extra block below.*/
-        if (!state->mv_grid[vy + mvb_off][vx].valid) {
+        if (!state->mv_valid[vy + mvb_off][vx]) {
           dp->blocks[nblocks++] = est->mvs[vy + mvb_off] + vx - mvb_off;
           OD_ASSERT(1 << dp->blocks[nblocks - 1]->log_mvb_sz == mvb_off);
         }
         /*Or for an extra block to the left.*/
-        if (!state->mv_grid[vy][vx - mvb_off].valid) {
+        if (!state->mv_valid[vy][vx - mvb_off]) {
           dp->blocks[nblocks++] = est->mvs[vy] + vx - (mvb_off << 1);
           OD_ASSERT(1 << dp->blocks[nblocks - 1]->log_mvb_sz == mvb_off);
           /*And if so, if the _previous_ MV might have affected an extra block
              below it.*/
-          if (!state->mv_grid[vy + mvb_off][vx - (mvb_off << 1)].valid) {
+          if (!state->mv_valid[vy + mvb_off][vx - (mvb_off << 1)]) {
             dp->blocks[nblocks++] =
              est->mvs[vy + mvb_off] + vx - (mvb_off << 1);
             OD_ASSERT(1 << dp->blocks[nblocks - 1]->log_mvb_sz == mvb_off);
@@ -4799,7 +5164,7 @@ static void od_mv_dp_prev_row_block_setup(od_mv_est_ctx *est,
            b) If the MV down-left from us is not present, then the previous MV
             also affects one more block below us.*/
         if (prev_log_mvb_sz > log_mvb_sz
-         && !state->mv_grid[vy + mvb_sz][vx - mvb_sz].valid) {
+         && !state->mv_valid[vy + mvb_sz][vx - mvb_sz]) {
           OD_ASSERT(!(level & 1));
           dp->blocks[nblocks++] = est->mvs[vy + mvb_sz] + vx - mvb_sz;
           OD_ASSERT(1 << dp->blocks[nblocks - 1]->log_mvb_sz == mvb_sz);
@@ -4835,14 +5200,14 @@ static void od_mv_dp_last_row_block_setup(od_mv_est_ctx *est,
      to the right cannot be split.*/
   if (vy >= mvb_sz) {
     OD_ASSERT(mvb_sz == 1
-     || !state->mv_grid[vy - (mvb_sz >> 1)][vx + (mvb_sz >> 1)].valid);
+     || !state->mv_valid[vy - (mvb_sz >> 1)][vx + (mvb_sz >> 1)]);
     dp->blocks[nblocks++] = est->mvs[vy - mvb_sz] + vx;
     OD_ASSERT(1 << dp->blocks[nblocks - 1]->log_mvb_sz == mvb_sz);
   }
 
   if (vy <= nvmvbs - mvb_sz) {
     OD_ASSERT(mvb_sz == 1
-     || !state->mv_grid[vy + (mvb_sz >> 1)][vx + (mvb_sz >> 1)].valid);
+     || !state->mv_valid[vy + (mvb_sz >> 1)][vx + (mvb_sz >> 1)]);
     dp->blocks[nblocks++] = est->mvs[vy] + vx;
     OD_ASSERT(1 << dp->blocks[nblocks - 1]->log_mvb_sz == mvb_sz);
   }
@@ -4920,6 +5285,7 @@ static int32_t od_mv_est_refine_row(od_mv_est_ctx *est,
  const od_pattern *pattern) {
   od_state *state;
   od_mv_grid_pt *grid;
+  unsigned char *valid;
   od_mv_grid_pt *pmvg;
   od_mv_grid_pt *mvg;
   od_mv_dp_node *dp_node;
@@ -4940,6 +5306,7 @@ static int32_t od_mv_est_refine_row(od_mv_est_ctx *est,
   state = &est->enc->state;
   nhmvbs = state->nhmvbs;
   grid = state->mv_grid[vy];
+  valid = state->mv_valid[vy];
   dcost = 0;
   OD_LOG((OD_LOG_MOTION_ESTIMATION, OD_LOG_DEBUG,
    "Refining row %i (%i)...", vy, vy << OD_LOG_MVBSIZE_MIN));
@@ -4955,7 +5322,7 @@ static int32_t od_mv_est_refine_row(od_mv_est_ctx *est,
     int dr;
     int best_si;
     int si;
-    for (; vx <= nhmvbs && !grid[vx].valid; vx++);
+    for (; vx <= nhmvbs && !valid[vx]; vx++);
     if (vx > nhmvbs) break;
     level = OD_MC_LEVEL[vy & OD_MVB_MASK][vx & OD_MVB_MASK];
     OD_LOG((OD_LOG_MOTION_ESTIMATION, OD_LOG_DEBUG,
@@ -4997,12 +5364,12 @@ static int32_t od_mv_est_refine_row(od_mv_est_ctx *est,
     pmvg = mvg;
     while (vx < nhmvbs) {
       /*Find the next available MV to advance to.*/
-      if ((level & 1) && !grid[vx + mvb_sz].valid) {
+      if ((level & 1) && !valid[vx + mvb_sz]) {
         OD_LOG((OD_LOG_MOTION_ESTIMATION, OD_LOG_DEBUG,
          "Gap found at %i (%i), stopping", vx, vx << OD_LOG_MVBSIZE_MIN));
         break;
       }
-      while (mvb_sz > 1 && grid[vx + (mvb_sz >> 1)].valid) mvb_sz >>= 1;
+      while (mvb_sz > 1 && valid[vx + (mvb_sz >> 1)]) mvb_sz >>= 1;
       vx += mvb_sz;
 #if defined(OD_DUMP_IMAGES) && defined(OD_ANIMATE)
       if (daala_granule_basetime(state, state->cur_time) == ANI_FRAME) {
@@ -5198,7 +5565,7 @@ static void od_mv_dp_col_init(od_mv_est_ctx *est,
     if (px < 0 || px > nhmvbs) continue;
     py = vy + OD_COL_PREDICTED[level][pi][1];
     if (py < 0 || py > nvmvbs) continue;
-    if (state->mv_grid[py][px].valid) {
+    if (state->mv_valid[py][px]) {
       OD_LOG((OD_LOG_MOTION_ESTIMATION, OD_LOG_DEBUG,
        "Adding (%i, %i) as a PREDICTED MV.", px, py));
       dp->predicted_mvgs[npred] = state->mv_grid[py] + px;
@@ -5262,13 +5629,13 @@ static void od_mv_dp_first_col_block_setup(od_mv_est_ctx *est,
        of the frame.)*/
     if (vx >= mvb_sz) {
       OD_ASSERT(mvb_sz == 1
-       || !state->mv_grid[vy - (mvb_sz >> 1)][vx - (mvb_sz >> 1)].valid);
+       || !state->mv_valid[vy - (mvb_sz >> 1)][vx - (mvb_sz >> 1)]);
       dp->blocks[nblocks++] = est->mvs[vy - mvb_sz] + vx - mvb_sz;
       OD_ASSERT(1 << dp->blocks[nblocks - 1]->log_mvb_sz == mvb_sz);
     }
     if (vx <= nhmvbs - mvb_sz) {
       OD_ASSERT(mvb_sz == 1
-       || !state->mv_grid[vy - (mvb_sz >> 1)][vx + (mvb_sz >> 1)].valid);
+       || !state->mv_valid[vy - (mvb_sz >> 1)][vx + (mvb_sz >> 1)]);
       dp->blocks[nblocks++] = est->mvs[vy - mvb_sz] + vx;
       OD_ASSERT(1 << dp->blocks[nblocks - 1]->log_mvb_sz == mvb_sz);
     }
@@ -5306,7 +5673,7 @@ static void od_mv_dp_prev_col_block_setup(od_mv_est_ctx *est,
          a) level must be OD_MC_LEVEL_MAX, and
          b) If the MV up-left from us is not present, then the previous MV also
           affects one more block to the left of us.*/
-      if (prev_log_mvb_sz > 0 && !state->mv_grid[vy - 1][vx - 1].valid) {
+      if (prev_log_mvb_sz > 0 && !state->mv_valid[vy - 1][vx - 1]) {
         dp->blocks[nblocks++] = est->mvs[vy - 1] + vx - 2;
         OD_ASSERT(dp->blocks[nblocks - 1]->log_mvb_sz == 0);
       }
@@ -5315,7 +5682,7 @@ static void od_mv_dp_prev_col_block_setup(od_mv_est_ctx *est,
       dp->blocks[nblocks++] = est->mvs[vy - 1] + vx;
       OD_ASSERT(dp->blocks[nblocks - 1]->log_mvb_sz == 0);
       /*The same case for a missing up-right MV.*/
-      if (prev_log_mvb_sz > 0 && !state->mv_grid[vy - 1][vx + 1].valid) {
+      if (prev_log_mvb_sz > 0 && !state->mv_valid[vy - 1][vx + 1]) {
         dp->blocks[nblocks++] = est->mvs[vy - 1] + vx + 1;
         OD_ASSERT(dp->blocks[nblocks - 1]->log_mvb_sz == 0);
       }
@@ -5327,28 +5694,28 @@ static void od_mv_dp_prev_col_block_setup(od_mv_est_ctx *est,
     half_mvb_sz = mvb_sz >> 1;
     if (vx >= mvb_sz) {
       /*Figure out if the up-left block has been split at all.*/
-      if (state->mv_grid[vy - half_mvb_sz][vx - half_mvb_sz].valid) {
+      if (state->mv_valid[vy - half_mvb_sz][vx - half_mvb_sz]) {
         /*It has, now figure out how far down.*/
         mvb_off = half_mvb_sz;
         while (mvb_off > 1
-         && state->mv_grid[vy - (mvb_off >> 1)][vx - (mvb_off >> 1)].valid) {
+         && state->mv_valid[vy - (mvb_off >> 1)][vx - (mvb_off >> 1)]) {
           mvb_off >>= 1;
         }
         dp->blocks[nblocks++] = est->mvs[vy - mvb_off] + vx - mvb_off;
         OD_ASSERT(1 << dp->blocks[nblocks - 1]->log_mvb_sz == mvb_off);
         /*If we were only partially split at this level, then this MV might
            be used for an extra block to the left.*/
-        if (!state->mv_grid[vy][vx - mvb_off].valid) {
+        if (!state->mv_valid[vy][vx - mvb_off]) {
           dp->blocks[nblocks++] = est->mvs[vy - mvb_off] + vx - (mvb_off << 1);
           OD_ASSERT(1 << dp->blocks[nblocks - 1]->log_mvb_sz == mvb_off);
         }
         /*Or for an extra block above.*/
-        if (!state->mv_grid[vy - mvb_off][vx].valid) {
+        if (!state->mv_valid[vy - mvb_off][vx]) {
           dp->blocks[nblocks++] = est->mvs[vy - (mvb_off << 1)] + vx - mvb_off;
           OD_ASSERT(1 << dp->blocks[nblocks - 1]->log_mvb_sz == mvb_off);
           /*And if so, if the _previous_ MV might have affected an extra block
              to the left of it.*/
-          if (!state->mv_grid[vy - (mvb_off << 1)][vx - mvb_off].valid) {
+          if (!state->mv_valid[vy - (mvb_off << 1)][vx - mvb_off]) {
             dp->blocks[nblocks++] =
              est->mvs[vy - (mvb_off << 1)] + vx - (mvb_off << 1);
             OD_ASSERT(1 << dp->blocks[nblocks - 1]->log_mvb_sz == mvb_off);
@@ -5365,7 +5732,7 @@ static void od_mv_dp_prev_col_block_setup(od_mv_est_ctx *est,
            b) If the MV up-left from us is not present, then the previous MV
             also affects one more block to the left of us.*/
         if (prev_log_mvb_sz > log_mvb_sz
-         && !state->mv_grid[vy - mvb_sz][vx - mvb_sz].valid) {
+         && !state->mv_valid[vy - mvb_sz][vx - mvb_sz]) {
           dp->blocks[nblocks++] = est->mvs[vy - mvb_sz] + vx - (mvb_sz << 1);
           OD_ASSERT(1 << dp->blocks[nblocks - 1]->log_mvb_sz == mvb_sz);
         }
@@ -5373,28 +5740,28 @@ static void od_mv_dp_prev_col_block_setup(od_mv_est_ctx *est,
     }
     if (vx <= nhmvbs - mvb_sz) {
       /*Figure out if the up-right block has been split at all.*/
-      if (state->mv_grid[vy - half_mvb_sz][vx + half_mvb_sz].valid) {
+      if (state->mv_valid[vy - half_mvb_sz][vx + half_mvb_sz]) {
         /*It has, now figure out how far down.*/
         mvb_off = half_mvb_sz;
         while (mvb_off > 1
-         && state->mv_grid[vy - (mvb_off >> 1)][vx + (mvb_off >> 1)].valid) {
+         && state->mv_valid[vy - (mvb_off >> 1)][vx + (mvb_off >> 1)]) {
           mvb_off >>= 1;
         }
         dp->blocks[nblocks++] = est->mvs[vy - mvb_off] + vx;
         OD_ASSERT(1 << dp->blocks[nblocks - 1]->log_mvb_sz == mvb_off);
         /*If we were only partially split at this level, then this MV might
            be used for an extra block to the right.*/
-        if (!state->mv_grid[vy][vx + mvb_off].valid) {
+        if (!state->mv_valid[vy][vx + mvb_off]) {
           dp->blocks[nblocks++] = est->mvs[vy - mvb_off] + vx + mvb_off;
           OD_ASSERT(1 << dp->blocks[nblocks - 1]->log_mvb_sz == mvb_off);
         }
         /*Or for an extra block above.*/
-        if (!state->mv_grid[vy - mvb_off][vx].valid) {
+        if (!state->mv_valid[vy - mvb_off][vx]) {
           dp->blocks[nblocks++] = est->mvs[vy - (mvb_off << 1)] + vx;
           OD_ASSERT(1 << dp->blocks[nblocks - 1]->log_mvb_sz == mvb_off);
           /*And if so, if the _previous_ MV might have affected an extra block
              to the right of it.*/
-          if (!state->mv_grid[vy - (mvb_off << 1)][vx + mvb_off].valid) {
+          if (!state->mv_valid[vy - (mvb_off << 1)][vx + mvb_off]) {
             dp->blocks[nblocks++] =
              est->mvs[vy - (mvb_off << 1)] + vx + mvb_off;
             OD_ASSERT(1 << dp->blocks[nblocks - 1]->log_mvb_sz == mvb_off);
@@ -5411,7 +5778,7 @@ static void od_mv_dp_prev_col_block_setup(od_mv_est_ctx *est,
            b) If the MV up-right from us is not present, then the previous MV
             also affects one more block to the right of us.*/
         if (prev_log_mvb_sz > log_mvb_sz
-         && !state->mv_grid[vy - mvb_sz][vx + mvb_sz].valid) {
+         && !state->mv_valid[vy - mvb_sz][vx + mvb_sz]) {
           dp->blocks[nblocks++] = est->mvs[vy - mvb_sz] + vx + mvb_sz;
           OD_ASSERT(1 << dp->blocks[nblocks - 1]->log_mvb_sz == mvb_sz);
         }
@@ -5446,13 +5813,13 @@ static void od_mv_dp_last_col_block_setup(od_mv_est_ctx *est,
      below cannot be split.*/
   if (vx >= mvb_sz) {
     OD_ASSERT(mvb_sz == 1
-     || !state->mv_grid[vy + (mvb_sz >> 1)][vx - (mvb_sz >> 1)].valid);
+     || !state->mv_valid[vy + (mvb_sz >> 1)][vx - (mvb_sz >> 1)]);
     dp->blocks[nblocks++] = est->mvs[vy] + vx - mvb_sz;
     OD_ASSERT(1 << dp->blocks[nblocks - 1]->log_mvb_sz == mvb_sz);
   }
   if (vx <= nhmvbs - mvb_sz) {
     OD_ASSERT(mvb_sz == 1
-     || !state->mv_grid[vy + (mvb_sz >> 1)][vx + (mvb_sz >> 1)].valid);
+     || !state->mv_valid[vy + (mvb_sz >> 1)][vx + (mvb_sz >> 1)]);
     dp->blocks[nblocks++] = est->mvs[vy] + vx;
     OD_ASSERT(1 << dp->blocks[nblocks - 1]->log_mvb_sz == mvb_sz);
   }
@@ -5521,6 +5888,7 @@ static int32_t od_mv_est_refine_col(od_mv_est_ctx *est,
  const od_pattern *pattern) {
   od_state *state;
   od_mv_grid_pt **grid;
+  unsigned char **valid;
   od_mv_grid_pt *pmvg;
   od_mv_grid_pt *mvg;
   od_mv_dp_node *dp_node;
@@ -5541,6 +5909,7 @@ static int32_t od_mv_est_refine_col(od_mv_est_ctx *est,
   state = &est->enc->state;
   nvmvbs = state->nvmvbs;
   grid = state->mv_grid;
+  valid = state->mv_valid;
   dcost = 0;
   OD_LOG((OD_LOG_MOTION_ESTIMATION, OD_LOG_DEBUG,
    "Refining column %i (%i)...", vx, vx << OD_LOG_MVBSIZE_MIN));
@@ -5556,7 +5925,7 @@ static int32_t od_mv_est_refine_col(od_mv_est_ctx *est,
     int dr;
     int best_si;
     int si;
-    for (; vy <= nvmvbs && !grid[vy][vx].valid; vy++);
+    for (; vy <= nvmvbs && !valid[vy][vx]; vy++);
     if (vy > nvmvbs) break;
     level = OD_MC_LEVEL[vy & OD_MVB_MASK][vx & OD_MVB_MASK];
     OD_LOG((OD_LOG_MOTION_ESTIMATION, OD_LOG_DEBUG,
@@ -5599,12 +5968,12 @@ static int32_t od_mv_est_refine_col(od_mv_est_ctx *est,
     pmvg = mvg;
     while (vy < nvmvbs) {
       /*Find the next available MV to advance to.*/
-      if ((level & 1) && !grid[vy + mvb_sz][vx].valid) {
+      if ((level & 1) && !valid[vy + mvb_sz][vx]) {
         OD_LOG((OD_LOG_MOTION_ESTIMATION, OD_LOG_DEBUG,
          "Gap found at %i (%i), stopping", vy, vy << OD_LOG_MVBSIZE_MIN));
         break;
       }
-      while (mvb_sz > 1 && grid[vy + (mvb_sz >> 1)][vx].valid) mvb_sz >>= 1;
+      while (mvb_sz > 1 && valid[vy + (mvb_sz >> 1)][vx]) mvb_sz >>= 1;
       vy += mvb_sz;
 #if defined(OD_DUMP_IMAGES) && defined(OD_ANIMATE)
       if (daala_granule_basetime(state, state->cur_time) == ANI_FRAME) {
@@ -5814,12 +6183,12 @@ void od_mv_est_update_fullpel_mvs(od_mv_est_ctx *est, int ref) {
   for (vy = 0; vy <= nvmvbs; vy++) {
     for (vx = 0; vx <= nhmvbs; vx++) {
       od_mv_grid_pt *mvg;
-      od_mv_node *mv;
+      od_mv_bma_node *bma;
+      if (!state->mv_valid[vy][vx]) continue;
       mvg = state->mv_grid[vy] + vx;
-      if (!mvg->valid) continue;
-      mv = est->mvs[vy] + vx;
-      mv->bma_mvs[0][ref][0] = mvg->mv[0] >> 3;
-      mv->bma_mvs[0][ref][1] = mvg->mv[1] >> 3;
+      bma = est->bma[vy] + vx;
+      bma->bma_mvs[0][ref][0] = mvg->mv[0] >> 3;
+      bma->bma_mvs[0][ref][1] = mvg->mv[1] >> 3;
     }
   }
 }
@@ -5843,8 +6212,8 @@ int od_mv_est_update_mv_rates(od_mv_est_ctx *est, int mv_res) {
       od_mv_node *mv;
       int pred[2];
       int equal_mvs;
+      if (!state->mv_valid[vy][vx]) continue;
       mvg = state->mv_grid[vy] + vx;
-      if (!mvg->valid) continue;
       mv = est->mvs[vy] + vx;
       equal_mvs = od_state_get_predictor(state, pred,
        vx, vy, OD_MC_LEVEL[vy & OD_MVB_MASK][vx & OD_MVB_MASK], mv_res);
@@ -5859,9 +6228,10 @@ int od_mv_est_update_mv_rates(od_mv_est_ctx *est, int mv_res) {
 
 od_mv_est_ctx *od_mv_est_alloc(od_enc_ctx *enc) {
   od_mv_est_ctx *ret;
-  ret = (od_mv_est_ctx *)malloc(sizeof(*ret));
+  ret = (od_mv_est_ctx *)od_malloc(&enc->state.alloc, sizeof(*ret));
+  if (OD_UNLIKELY(!ret)) return NULL;
   if (od_mv_est_init(ret, enc) < 0) {
-    free(ret);
+    od_free(&enc->state.alloc, ret);
     return NULL;
   }
   return ret;
@@ -5869,8 +6239,28 @@ od_mv_est_ctx *od_mv_est_alloc(od_enc_ctx *enc) {
 
 void od_mv_est_free(od_mv_est_ctx *est) {
   if (est != NULL) {
+    od_enc_ctx *enc;
+    enc = est->enc;
     od_mv_est_clear(est);
-    free(est);
+    od_free(&enc->state.alloc, est);
+  }
+}
+
+/*Forgets the motion vectors and SADs of previous frames, which seed the
+   EPZS^2 predictors and thresholds.
+  This is called on keyframes, so that motion estimation after a keyframe
+   does not depend on anything before it, and independently encoded chunks
+   produce the same packets as a single encoder would.*/
+void od_mv_est_reset(od_mv_est_ctx *est) {
+  od_state *state;
+  int vx;
+  int vy;
+  state = &est->enc->state;
+  for (vy = 0; vy <= state->nvmvbs; vy++) {
+    for (vx = 0; vx <= state->nhmvbs; vx++) {
+      OD_CLEAR(est->bma[vy][vx].bma_mvs, 3);
+      est->bma[vy][vx].bma_sad = 0;
+    }
   }
 }
 
@@ -5881,7 +6271,7 @@ void od_mv_est_reset_rd_block_state(od_mv_est_ctx *est,
   state = &est->enc->state;
   half_mvb_sz = 1 << log_mvb_sz >> 1;
   if (log_mvb_sz > 0
-   && state->mv_grid[vy + half_mvb_sz][vx + half_mvb_sz].valid) {
+   && state->mv_valid[vy + half_mvb_sz][vx + half_mvb_sz]) {
     od_mv_est_reset_rd_block_state(est, ref, vx, vy, log_mvb_sz - 1);
     od_mv_est_reset_rd_block_state(est, ref,
      vx + half_mvb_sz, vy, log_mvb_sz - 1);
@@ -5909,8 +6299,8 @@ void od_mv_est_reset_rd_block_state(od_mv_est_ctx *est,
       s1vy = vy + (OD_VERT_DY[(oc + 1) & 3] << log_mvb_sz);
       s3vx = vx + (OD_VERT_DX[(oc + 3) & 3] << log_mvb_sz);
       s3vy = vy + (OD_VERT_DY[(oc + 3) & 3] << log_mvb_sz);
-      s = state->mv_grid[s1vy][s1vx].valid |
-       state->mv_grid[s3vy][s3vx].valid << 1;
+      s = state->mv_valid[s1vy][s1vx] |
+       state->mv_valid[s3vy][s3vx] << 1;
     }
     else {
       oc = 0;
@@ -5940,7 +6330,7 @@ void od_mv_subpel_refine(od_mv_est_ctx *est, int ref, int cost_thresh) {
     We could also try rounding the results after refinement, I guess.
     I'm not sure it makes much difference*/
   od_mv_est_update_fullpel_mvs(est, ref);
-  complexity = est->enc->complexity;
+  complexity = est->enc->frame_complexity;
   if (complexity >= OD_MC_SQUARE_SUBPEL_REFINEMENT_COMPLEXITY) {
     pattern_nsites = OD_SQUARE_NSITES;
     pattern = OD_SQUARE_SITES;
@@ -5954,7 +6344,7 @@ void od_mv_subpel_refine(od_mv_est_ctx *est, int ref, int cost_thresh) {
     dcost = od_mv_est_refine(est, ref, 2, 2, pattern_nsites, pattern);
   }
   while (dcost < cost_thresh);
-  for (best_mv_res = mv_res = 2; mv_res-- > est->mv_res_min;) {
+  for (best_mv_res = mv_res = 2; mv_res-- > est->enc->frame_mv_res_min;) {
     subpel_cost = od_mv_est_update_mv_rates(est, mv_res)*est->lambda;
     /*If the rate penalty for refining is small, bump the termination threshold
        down to make sure we actually get a decent improvement.
@@ -6024,6 +6414,10 @@ void od_mv_est(od_mv_est_ctx *est, int ref, int lambda) {
   /*If the luma plane is decimated for some reason, then our distortions will
      be smaller, so scale lambda appropriately.*/
   est->lambda = lambda >> (iplane->xdec + iplane->ydec);
+  if (est->flags & OD_MC_USE_SUBPEL_CACHE) {
+    od_mv_est_subpel_cache_reset(est, ref);
+  }
+  else est->subpel_refi = -1;
   /*Compute termination thresholds for EPZS^2.*/
   for (log_mvb_sz = 0; log_mvb_sz < OD_NMVBSIZES; log_mvb_sz++) {
     est->thresh1[log_mvb_sz] =
@@ -6072,7 +6466,7 @@ void od_mv_est(od_mv_est_ctx *est, int ref, int lambda) {
      more appropriate value, however that gives a PSNR improvement of less than
      0.01 dB, and requires almost twice as many iterations to achieve.*/
   cost_thresh = -nhmvbs*nvmvbs << OD_ERROR_SCALE;
-  complexity = est->enc->complexity;
+  complexity = est->enc->frame_complexity;
   if (complexity >= OD_MC_SQUARE_REFINEMENT_COMPLEXITY) {
     pattern_nsites = OD_SQUARE_NSITES;
     pattern = OD_SQUARE_SITES;
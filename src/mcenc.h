@@ -27,11 +27,21 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
 
 /*Flag indicating we include the chroma planes in our SAD calculations.*/
 # define OD_MC_USE_CHROMA (1 << 0)
+/*Flag indicating we cache the sub-pel interpolated luma reference planes.*/
+# define OD_MC_USE_SUBPEL_CACHE (1 << 1)
+
+/*The log of the size of the tiles the sub-pel cache is filled in.*/
+# define OD_MC_SUBPEL_CACHE_LOG_TILE (4)
+/*The number of pixels outside the frame covered by the sub-pel cache.
+  This must be a multiple of the tile size, and leave room for the filter
+   apron inside OD_UMV_PADDING.*/
+# define OD_MC_SUBPEL_CACHE_PAD (16)
 
 /* The maximum search range for BMA. Also controls hit cache size. */
 #define OD_MC_SEARCH_RANGE (64)
 
 typedef struct od_mv_node od_mv_node;
+typedef struct od_mv_bma_node od_mv_bma_node;
 typedef struct od_mv_dp_state od_mv_dp_state;
 typedef struct od_mv_dp_node od_mv_dp_node;
 
@@ -44,11 +54,10 @@ typedef uint16_t od_sad4[4];
    required by the decoder.
   Some of this information corresponds to a vertex in the MV mesh.
   Other pieces correspond to a block whose upper-left corner is located at that
-   vertex.*/
+   vertex.
+  Only the fields used by DP refinement and decimation live here; the EPZS^2
+   history, which is only touched once per frame, is kept in od_mv_bma_node.*/
 struct od_mv_node {
-  /*The historical motion vectors for EPZS^2, stored at full-pel resolution.
-    Indexed by [time][reference_type][component].*/
-  int bma_mvs[3][2][2];
   /*The current estimated rate of this MV.*/
   unsigned mv_rate:16;
   /*The current size of the block with this MV at its upper-left.*/
@@ -59,9 +68,6 @@ struct od_mv_node {
   unsigned s:2;
   /*The current distortion of that block.*/
   int32_t sad;
-  /*The SAD for BMA predictor centered on this node.
-    Used for the dynamic thresholds of the initial EPZS^2 pass.*/
-  int32_t bma_sad;
   /*The location of this node in the grid.*/
   int vx;
   int vy;
@@ -73,6 +79,19 @@ struct od_mv_node {
   int heapi;
 };
 
+/*The state used by the initial EPZS^2 search for a vertex in the MV mesh.*/
+struct od_mv_bma_node {
+  /*The historical motion vectors for EPZS^2, stored at full-pel resolution.
+    Indexed by [time][reference_type][component].*/
+  int16_t bma_mvs[3][2][2];
+  /*The SAD for BMA predictor centered on this node.
+    Used for the dynamic thresholds of the initial EPZS^2 pass.*/
+  int32_t bma_sad;
+  /*The location of this node in the grid.*/
+  int16_t vx;
+  int16_t vy;
+};
+
 /*The square pattern, the largest we use, has 9 states.*/
 # define OD_DP_NSTATES_MAX (9)
 /*Up to 8 blocks can be influenced by this MV and the previous MV.*/
@@ -147,6 +166,8 @@ struct od_mv_est_ctx {
   od_sad4 **sad_cache[OD_LOG_MVB_DELTA0];
   /*The state of the MV mesh specific to the encoder.*/
   od_mv_node **mvs;
+  /*The EPZS^2 state of the MV mesh, indexed the same way as mvs.*/
+  od_mv_bma_node **bma;
   /*A temporary copy of the decoder-side MV grid used to save-and-restore the
      MVs when attempting sub-pel refinement.*/
   od_mv_grid_pt **refine_grid;
@@ -189,6 +210,20 @@ struct od_mv_est_ctx {
      and SATD functions are called for stage 4 (i.e. sub-pel refine).*/
   int (*compute_distortion)(od_enc_ctx *enc, const unsigned char *p,
    int pystride, int pxstride, int pli, int x, int y, int log_blk_sz);
+  /*The sub-pel interpolated luma reference planes, indexed by the fractional
+     MV (mvy & 7) << 3 | (mvx & 7).
+    They are allocated when the cache is turned on, for only the phases
+     allowed by mv_res_min, and the other entries are NULL.
+    Entry 0 is unused, since whole-pel candidates read the reference plane.*/
+  unsigned char *subpel_planes[64];
+  /*Flags indicating which tiles of each phase plane are filled for the
+     current frame, indexed by [phase][ty][tx].*/
+  unsigned char *subpel_valid;
+  /*The number of tiles in each row and column of a phase plane.*/
+  int subpel_ntx;
+  int subpel_nty;
+  /*The reference image the cache was filled from, or -1 if it is empty.*/
+  int subpel_refi;
 };
 
 #endif
@@ -30,48 +30,6 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
 #include "partition.h"
 #include "zigzag.h"
 
-/* The tables below specify how coefficient blocks are translated to
-   and from PVQ partition coding scan order for 4x4, 8x8 and 16x16 */
-static const int OD_LAYOUT64_OFFSETS[4] = { 0, 512, 1024, 3072 };
-const band_layout OD_LAYOUT64 = {
-  OD_ZIGZAG64,
-  64,
-  3,
-  OD_LAYOUT64_OFFSETS
-};
-
-static const int OD_LAYOUT32_OFFSETS[4] = { 0, 128, 256, 768};
-const band_layout OD_LAYOUT32 = {
-  OD_ZIGZAG32,
-  32,
-  3,
-  OD_LAYOUT32_OFFSETS
-};
-
-static const int OD_LAYOUT16_OFFSETS[4] = { 0, 32, 64, 192 };
-const band_layout OD_LAYOUT16 = {
-  OD_ZIGZAG16,
-  16,
-  3,
-  OD_LAYOUT16_OFFSETS
-};
-
-const int OD_LAYOUT8_OFFSETS[4] = { 0, 8, 16, 48 };
-const band_layout OD_LAYOUT8 = {
-  OD_ZIGZAG8,
-  8,
-  3,
-  OD_LAYOUT8_OFFSETS
-};
-
-static const int OD_LAYOUT4_OFFSETS[2] = { 0, 15 };
-const band_layout OD_LAYOUT4 = {
-  OD_ZIGZAG4,
-  4,
-  1,
-  OD_LAYOUT4_OFFSETS
-};
-
 /* First element is the number of bands, followed by the list all the band
   boundaries. */
 static const int OD_BAND_OFFSETS4[] = {1, 1, 16};
@@ -90,104 +48,120 @@ const int *const OD_BAND_OFFSETS[OD_NBSIZES + 1] = {
   OD_BAND_OFFSETS64
 };
 
-/** Perform a single stage of conversion from a coefficient block in
- * raster order into coding scan order
- *
- * @param [in]     layout  scan order specification
- * @param [out]    dst     destination vector
- * @param [in]     src     source coefficient block
- * @param [int]    int     source vector row stride
- */
-static void od_band_from_raster(const band_layout *layout, od_coeff *dst,
- od_coeff *src, int stride) {
-  int i;
-  int len;
-  len = layout->band_offsets[layout->nb_bands];
-  for (i = 0; i < len; i++) {
-    dst[i] = src[layout->dst_table[i][1]*stride + layout->dst_table[i][0]];
+/*Defines the conversions between raster order and coding scan order for
+   the coefficients that a block of size n adds to the one of half its size.
+  Each stage walks the zig-zag table of its size, whose length is a
+   compile-time constant, so the loops can be fully unrolled and no layout
+   table is consulted at run time.*/
+#define OD_CODING_ORDER_STAGE(n) \
+  static void od_band_from_raster##n(od_coeff *dst, const od_coeff *src, \
+   int stride) { \
+    int i; \
+    for (i = 0; i < (int)(sizeof(OD_ZIGZAG##n)/sizeof(*OD_ZIGZAG##n)); \
+     i++) { \
+      dst[i] = src[OD_ZIGZAG##n[i][1]*stride + OD_ZIGZAG##n[i][0]]; \
+    } \
+  } \
+  \
+  static void od_raster_from_band##n(od_coeff *dst, int stride, \
+   const od_coeff *src) { \
+    int i; \
+    for (i = 0; i < (int)(sizeof(OD_ZIGZAG##n)/sizeof(*OD_ZIGZAG##n)); \
+     i++) { \
+      dst[OD_ZIGZAG##n[i][1]*stride + OD_ZIGZAG##n[i][0]] = src[i]; \
+    } \
   }
-}
 
-/** Perform a single stage of conversion from a vector in coding scan
-    order back into a coefficient block in raster order
- *
- * @param [in]     layout  scan order specification
- * @param [out]    dst     destination coefficient block
- * @param [in]     src     source vector
- * @param [int]    stride  destination vector row stride
- */
-static void od_raster_from_band(const band_layout *layout, od_coeff *dst,
- int stride, od_coeff *src) {
-  int i;
-  int len;
-  len = layout->band_offsets[layout->nb_bands];
-  for (i = 0; i < len; i++) {
-    dst[layout->dst_table[i][1]*stride + layout->dst_table[i][0]] = src[i];
-  }
+OD_CODING_ORDER_STAGE(4)
+OD_CODING_ORDER_STAGE(8)
+OD_CODING_ORDER_STAGE(16)
+OD_CODING_ORDER_STAGE(32)
+OD_CODING_ORDER_STAGE(64)
+
+/*Converts an nxn coefficient block in raster order into a vector in coding
+   scan order with the PVQ partitions laid out one after another.
+  This works in stages; the 4x4 conversion is applied to the coefficients
+   nearest DC, then the 8x8 applied to the 8x8 block nearest DC that was not
+   already coded by 4x4, then 16x16 following the same pattern.*/
+static void od_raster_to_coding_order_4x4(od_coeff *dst, const od_coeff *src,
+ int stride) {
+  od_band_from_raster4(dst + 1, src, stride);
+  dst[0] = src[0];
 }
 
-/** Converts a coefficient block in raster order into a vector in
- * coding scan order with the PVQ partitions laid out one after
- * another.  This works in stages; the 4x4 conversion is applied to
- * the coefficients nearest DC, then the 8x8 applied to the 8x8 block
- * nearest DC that was not already coded by 4x4, then 16x16 following
- * the same pattern.
- *
- * @param [out]    dst        destination vector
- * @param [in]     n          block size (along one side)
- * @param [in]     src        source coefficient block
- * @param [in]     stride     source vector row stride
- * @param [in]     interleave interleaves entries for the scalar
-                              (non-pvq) case
- */
-void od_raster_to_coding_order(od_coeff *dst,  int n, od_coeff *src,
+static void od_raster_to_coding_order_8x8(od_coeff *dst, const od_coeff *src,
  int stride) {
-  /* TODO - Rewrite these as a loop. */
-  od_band_from_raster(&OD_LAYOUT4, dst + 1, src, stride);
-  if (n >= 8) {
-    od_band_from_raster(&OD_LAYOUT8, dst + 16, src, stride);
-  }
-  if (n >= 16) {
-    od_band_from_raster(&OD_LAYOUT16, dst + 64, src, stride);
-  }
-  if (n >= 32) {
-    od_band_from_raster(&OD_LAYOUT32, dst + 256, src, stride);
-  }
-  if (n >= 64) {
-    od_band_from_raster(&OD_LAYOUT64, dst + 1024, src, stride);
-  }
-  dst[0] = src[0];
+  od_raster_to_coding_order_4x4(dst, src, stride);
+  od_band_from_raster8(dst + 16, src, stride);
 }
 
-/** Converts a vector in coding scan order witht he PVQ partitions
- * laid out one after another into a coefficient block in raster
- * order. This works in stages in the reverse order of raster->scan
- * order; the 16x16 conversion is applied to the coefficients that
- * don't appear in an 8x8 block, then the 8x8 applied to the 8x8 block
- * sans the 4x4 block it contains, then 4x4 is converted sans DC.
- *
- * @param [out]    dst        destination coefficient block
- * @param [in]     stride     destination vector row stride
- * @param [in]     src        source vector
- * @param [in]     n          block size (along one side)
- * @param [in]     interleave de-interleaves entries for
-                              the scalar (non-pvq) case
- */
-void od_coding_order_to_raster(od_coeff *dst,  int stride, od_coeff *src,
- int n) {
-  /* TODO - Rewrite these as a loop. */
-  od_raster_from_band(&OD_LAYOUT4, dst, stride, src + 1);
-  if (n >= 8) {
-    od_raster_from_band(&OD_LAYOUT8, dst, stride, src + 16);
-  }
-  if (n >= 16) {
-    od_raster_from_band(&OD_LAYOUT16, dst, stride, src + 64);
-  }
-  if (n >= 32) {
-    od_raster_from_band(&OD_LAYOUT32, dst, stride, src + 256);
-  }
-  if (n >= 64) {
-    od_raster_from_band(&OD_LAYOUT64, dst, stride, src + 1024);
-  }
+static void od_raster_to_coding_order_16x16(od_coeff *dst,
+ const od_coeff *src, int stride) {
+  od_raster_to_coding_order_8x8(dst, src, stride);
+  od_band_from_raster16(dst + 64, src, stride);
+}
+
+static void od_raster_to_coding_order_32x32(od_coeff *dst,
+ const od_coeff *src, int stride) {
+  od_raster_to_coding_order_16x16(dst, src, stride);
+  od_band_from_raster32(dst + 256, src, stride);
+}
+
+static void od_raster_to_coding_order_64x64(od_coeff *dst,
+ const od_coeff *src, int stride) {
+  od_raster_to_coding_order_32x32(dst, src, stride);
+  od_band_from_raster64(dst + 1024, src, stride);
+}
+
+/*Converts a vector in coding scan order with the PVQ partitions laid out one
+   after another back into an nxn coefficient block in raster order.
+  The stages are the inverse of the ones above; they touch disjoint
+   coefficients, so their order does not matter.*/
+static void od_coding_order_to_raster_4x4(od_coeff *dst, int stride,
+ const od_coeff *src) {
+  od_raster_from_band4(dst, stride, src + 1);
   dst[0] = src[0];
 }
+
+static void od_coding_order_to_raster_8x8(od_coeff *dst, int stride,
+ const od_coeff *src) {
+  od_coding_order_to_raster_4x4(dst, stride, src);
+  od_raster_from_band8(dst, stride, src + 16);
+}
+
+static void od_coding_order_to_raster_16x16(od_coeff *dst, int stride,
+ const od_coeff *src) {
+  od_coding_order_to_raster_8x8(dst, stride, src);
+  od_raster_from_band16(dst, stride, src + 64);
+}
+
+static void od_coding_order_to_raster_32x32(od_coeff *dst, int stride,
+ const od_coeff *src) {
+  od_coding_order_to_raster_16x16(dst, stride, src);
+  od_raster_from_band32(dst, stride, src + 256);
+}
+
+static void od_coding_order_to_raster_64x64(od_coeff *dst, int stride,
+ const od_coeff *src) {
+  od_coding_order_to_raster_32x32(dst, stride, src);
+  od_raster_from_band64(dst, stride, src + 1024);
+}
+
+/*Indexed by the log of the block size minus two.*/
+const od_raster_to_coding_order_func
+ OD_RASTER_TO_CODING_ORDER[OD_NBSIZES + 1] = {
+  od_raster_to_coding_order_4x4,
+  od_raster_to_coding_order_8x8,
+  od_raster_to_coding_order_16x16,
+  od_raster_to_coding_order_32x32,
+  od_raster_to_coding_order_64x64
+};
+
+const od_coding_order_to_raster_func
+ OD_CODING_ORDER_TO_RASTER[OD_NBSIZES + 1] = {
+  od_coding_order_to_raster_4x4,
+  od_coding_order_to_raster_8x8,
+  od_coding_order_to_raster_16x16,
+  od_coding_order_to_raster_32x32,
+  od_coding_order_to_raster_64x64
+};
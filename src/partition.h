@@ -25,21 +25,21 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
 #if !defined(_partition_H)
 # define _partition_H
 
-typedef unsigned char index_pair[2];
-
-typedef struct {
-  const index_pair *const dst_table;
-  int size;
-  int nb_bands;
-  const int *const band_offsets;
-} band_layout;
-
 extern const int *const OD_BAND_OFFSETS[OD_NBSIZES + 1];
 
-void od_raster_to_coding_order(od_coeff *dst, int n, od_coeff *src,
- int stride);
-
-void od_coding_order_to_raster(od_coeff *dst, int stride, od_coeff *src,
- int n);
+/*Converts a block in raster order with the given row stride into a vector
+   in coding scan order.*/
+typedef void (*od_raster_to_coding_order_func)(od_coeff *dst,
+ const od_coeff *src, int stride);
+/*Converts a vector in coding scan order back into a block in raster order
+   with the given row stride.*/
+typedef void (*od_coding_order_to_raster_func)(od_coeff *dst, int stride,
+ const od_coeff *src);
+
+/*Specialized conversions, indexed by the log of the block size minus two.*/
+extern const od_raster_to_coding_order_func
+ OD_RASTER_TO_CODING_ORDER[OD_NBSIZES + 1];
+extern const od_coding_order_to_raster_func
+ OD_CODING_ORDER_TO_RASTER[OD_NBSIZES + 1];
 
 #endif
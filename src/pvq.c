@@ -260,28 +260,83 @@ const double *const OD_PVQ_BETA[2][OD_NPLANES_MAX][OD_NBSIZES + 1] = {
    be smaller, so they would end up being quantized too finely (the same
    error in the quantized domain would result in a smaller pixel domain
    error). */
+/*Defines the forward and inverse quantization matrix application for one
+   block size, so that the loop bounds and the matrix indexing are
+   compile-time constants and the direction is not tested per coefficient.
+  The magnitudes are computed with exactly the same operations as before, so
+   the results are bit-exact.
+  DC is never scaled: floor(.5 + x) is x for any od_coeff x.*/
+#define OD_APPLY_QM_BS(bs) \
+  static void od_apply_qm_fwd##bs(od_coeff *out, int out_stride, \
+   const od_coeff *in, int in_stride, int dec, const int *qm) { \
+    const double *basis; \
+    od_coeff dc; \
+    int i; \
+    int j; \
+    basis = OD_BASIS_MAG[dec][bs]; \
+    dc = in[0]; \
+    for (i = 0; i < 4 << bs; i++) { \
+      for (j = 0; j < 4 << bs; j++) { \
+        double mag; \
+        mag = basis[i]*basis[j]; \
+        mag /= 0.0625*qm[(i << 1 >> bs)*8 + (j << 1 >> bs)]; \
+        out[i*out_stride + j] = \
+         (od_coeff)floor(.5 + in[i*in_stride + j]*mag); \
+      } \
+    } \
+    out[0] = dc; \
+  } \
+  \
+  static void od_apply_qm_inv##bs(od_coeff *out, int out_stride, \
+   const od_coeff *in, int in_stride, int dec, const int *qm) { \
+    const double *basis; \
+    od_coeff dc; \
+    int i; \
+    int j; \
+    basis = OD_BASIS_MAG[dec][bs]; \
+    dc = in[0]; \
+    for (i = 0; i < 4 << bs; i++) { \
+      for (j = 0; j < 4 << bs; j++) { \
+        double mag; \
+        mag = basis[i]*basis[j]; \
+        mag /= 0.0625*qm[(i << 1 >> bs)*8 + (j << 1 >> bs)]; \
+        out[i*out_stride + j] = \
+         (od_coeff)floor(.5 + in[i*in_stride + j]/mag); \
+      } \
+    } \
+    out[0] = dc; \
+  }
+
+OD_APPLY_QM_BS(0)
+OD_APPLY_QM_BS(1)
+OD_APPLY_QM_BS(2)
+OD_APPLY_QM_BS(3)
+OD_APPLY_QM_BS(4)
+
+typedef void (*od_apply_qm_func)(od_coeff *out, int out_stride,
+ const od_coeff *in, int in_stride, int dec, const int *qm);
+
+static const od_apply_qm_func OD_APPLY_QM[2][OD_NBSIZES + 1] = {
+  {
+    od_apply_qm_fwd0,
+    od_apply_qm_fwd1,
+    od_apply_qm_fwd2,
+    od_apply_qm_fwd3,
+    od_apply_qm_fwd4
+  },
+  {
+    od_apply_qm_inv0,
+    od_apply_qm_inv1,
+    od_apply_qm_inv2,
+    od_apply_qm_inv3,
+    od_apply_qm_inv4
+  }
+};
+
 void od_apply_qm(od_coeff *out, int out_stride, od_coeff *in, int in_stride,
  int bs, int dec, int inverse, const int *qm) {
-  int i;
-  int j;
-  for (i = 0; i < 4 << bs; i++) {
-    for (j = 0; j < 4 << bs; j++) {
-      double mag;
-      mag = OD_BASIS_MAG[dec][bs][i]*OD_BASIS_MAG[dec][bs][j];
-      if (i == 0 && j == 0) {
-        mag = 1;
-      }
-      else {
-        mag /= 0.0625*qm[(i << 1 >> bs)*8 + (j << 1 >> bs)];
-      }
-      if (inverse) {
-        out[i*out_stride + j] = (od_coeff)floor(.5 + in[i*in_stride + j]/mag);
-      }
-      else {
-        out[i*out_stride + j] = (od_coeff)floor(.5 + in[i*in_stride + j]*mag);
-      }
-    }
-  }
+  OD_ASSERT(bs >= 0 && bs <= OD_NBSIZES);
+  (*OD_APPLY_QM[!!inverse][bs])(out, out_stride, in, in_stride, dec, qm);
 }
 
 /* Indexing for the packed quantization matrices. */
@@ -222,28 +222,30 @@ int od_vector_is_null(const od_coeff *x, int len) {
   return 1;
 }
 
+/*Estimates the rate of a PVQ codeword by actually coding it.
+  ec: Scratch encoder owned by the caller, so that no buffers are allocated
+       per call.*/
 static double od_pvq_rate(int qg, int icgr, int theta, int ts,
- const od_adapt_ctx *adapt, const od_coeff *y0, int k, int n,
+ od_ec_enc *ec, const od_adapt_ctx *adapt, const od_coeff *y0, int k, int n,
  int is_keyframe, int pli, int bs) {
   double rate;
 #if OD_PVQ_RATE_APPROX
   /* Estimates the number of bits it will cost to encode K pulses in
      N dimensions based on experimental data for bitrate vs K. */
   rate = n*OD_LOG2(1+log(n*2)*k/n);
+  (void)ec;
   (void)adapt;
   (void)m;
   (void)y0;
 #else
   if (k > 0){
-    od_ec_enc ec;
     od_adapt_ctx ad;
     int tell;
-    od_ec_enc_init(&ec, 1000);
+    od_ec_enc_reset(ec);
     OD_COPY(&ad, adapt, 1);
-    tell = od_ec_enc_tell_frac(&ec);
-    od_encode_pvq_codeword(&ec, &ad, y0, n, k, theta == -1, bs);
-    rate = (od_ec_enc_tell_frac(&ec)-tell)/8.;
-    od_ec_enc_clear(&ec);
+    tell = od_ec_enc_tell_frac(ec);
+    od_encode_pvq_codeword(ec, &ad, y0, n, k, theta == -1, bs);
+    rate = (od_ec_enc_tell_frac(ec)-tell)/8.;
   }
   else rate = 0;
 #endif
@@ -279,6 +281,7 @@ static double od_pvq_rate(int qg, int icgr, int theta, int ts,
  * @param [in]     robust    make stream robust to error in the reference
  * @param [in]     is_keyframe whether we're encoding a keyframe
  * @param [in]     pli       plane index
+ * @param [in,out] ec        scratch entropy coder for rate estimation
  * @param [in]     adapt     probability adaptation context
  * @param [in]     bs        log of the block size minus two
  * @return         gain      index of the quatized gain
@@ -286,7 +289,7 @@ static double od_pvq_rate(int qg, int icgr, int theta, int ts,
 static int pvq_theta(od_coeff *out, od_coeff *x0, od_coeff *r0, int n, int q0,
  od_coeff *y, int *itheta, int *max_theta, int *vk,
  double beta, double *skip_diff, int robust, int is_keyframe, int pli,
- const od_adapt_ctx *adapt, int bs) {
+ od_ec_enc *ec, const od_adapt_ctx *adapt, int bs) {
   double g;
   double gr;
   double x[MAXN];
@@ -342,7 +345,7 @@ static int pvq_theta(od_coeff *out, od_coeff *x0, od_coeff *r0, int n, int q0,
   qg = 0;
   dist = gain_weight*cg*cg;
   best_dist = dist;
-  best_cost = dist + lambda*od_pvq_rate(0, 0, -1, 0, adapt, NULL, 0, n,
+  best_cost = dist + lambda*od_pvq_rate(0, 0, -1, 0, ec, adapt, NULL, 0, n,
    is_keyframe, pli, bs);
   noref = 1;
   best_k = 0;
@@ -363,7 +366,7 @@ static int pvq_theta(od_coeff *out, od_coeff *x0, od_coeff *r0, int n, int q0,
     if (icgr == 0) {
       best_dist = gain_weight*(cg - scgr)*(cg - scgr) + scgr*cg*(2 - 2*corr);
     }
-    best_cost = best_dist + lambda*od_pvq_rate(0, icgr, 0, 0, adapt, NULL,
+    best_cost = best_dist + lambda*od_pvq_rate(0, icgr, 0, 0, ec, adapt, NULL,
      0, n, is_keyframe, pli, bs);
     best_qtheta = 0;
     *itheta = 0;
@@ -404,8 +407,8 @@ static int pvq_theta(od_coeff *out, od_coeff *x0, od_coeff *r0, int n, int q0,
          + sin(theta)*sin(qtheta)*(2 - 2*cos_dist);
         dist = gain_weight*(qcg - cg)*(qcg - cg) + qcg*cg*dist_theta;
         /* Do approximate RDO. */
-        cost = dist + lambda*od_pvq_rate(i, icgr, j, ts, adapt, y_tmp, k, n,
-         is_keyframe, pli, bs);
+        cost = dist + lambda*od_pvq_rate(i, icgr, j, ts, ec, adapt, y_tmp, k,
+         n, is_keyframe, pli, bs);
         if (cost < best_cost) {
           best_cost = cost;
           best_dist = dist;
@@ -437,8 +440,8 @@ static int pvq_theta(od_coeff *out, od_coeff *x0, od_coeff *r0, int n, int q0,
       /* See Jmspeex' Journal of Dubious Theoretical Results. */
       dist = gain_weight*(qcg - cg)*(qcg - cg) + qcg*cg*(2 - 2*cos_dist);
       /* Do approximate RDO. */
-      cost = dist + lambda*od_pvq_rate(i, 0, -1, 0, adapt, y_tmp, k, n,
-       is_keyframe, pli, bs);
+      cost = dist + lambda*od_pvq_rate(i, 0, -1, 0, ec, adapt, y_tmp, k,
+       n, is_keyframe, pli, bs);
       if (cost <= best_cost) {
         best_cost = cost;
         best_dist = dist;
@@ -644,8 +647,8 @@ int od_pvq_encode(daala_enc_ctx *enc,
     q = OD_MAXI(1, q0*qm[od_qm_get_index(bs, i + 1)] >> 4);
     qg[i] = pvq_theta(out + off[i], in + off[i], ref + off[i], size[i],
      q, y + off[i], &theta[i], &max_theta[i],
-     &k[i], beta[i], &skip_diff, robust, is_keyframe, pli, &enc->state.adapt,
-     bs);
+     &k[i], beta[i], &skip_diff, robust, is_keyframe, pli, &enc->pvq_rate_ec,
+     &enc->state.adapt, bs);
   }
   od_encode_checkpoint(enc, &buf);
   if (is_keyframe) out[0] = 0;
@@ -0,0 +1,287 @@
+/*Daala video codec
+Copyright (c) 2016 Daala project contributors.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+- Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+- Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS”
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/daala/daaladec.h"
+#include "internal.h"
+
+/*The serialized index starts with this magic and a version byte.*/
+static const unsigned char OD_SEEK_INDEX_MAGIC[4] = { 'D', 'S', 'I', 'X' };
+#define OD_SEEK_INDEX_VERSION (0)
+
+typedef struct od_seek_entry od_seek_entry;
+
+struct od_seek_entry {
+  /*The number of the keyframe, counting from the first video packet.*/
+  int64_t frame;
+  /*The byte offset of the Ogg page the keyframe packet starts on.*/
+  int64_t offset;
+  /*The number of packets that start on the same page before the keyframe.*/
+  int skip;
+};
+
+struct daala_seek_index {
+  /*Reassembles the packets of the indexed stream while building.*/
+  ogg_stream_state os;
+  /*The byte offset of the page the next unfinished packet started on.*/
+  int64_t packet_offset;
+  /*The page the last completed packet started on, and the number of
+     packets completed so far that started on it.*/
+  int64_t last_start;
+  int nlast_start;
+  /*The number of video packets seen so far.*/
+  int64_t nframes;
+  /*Whether the index was restored by daala_seek_index_load().
+    The stream state it was built with is not saved, so it cannot be
+     extended.*/
+  int loaded;
+  od_seek_entry *entries;
+  int nentries;
+  int centries;
+  /*Holds the serialized index.*/
+  oggbyte_buffer obb;
+};
+
+static daala_seek_index *od_seek_index_create(int serialno) {
+  daala_seek_index *idx;
+  idx = (daala_seek_index *)malloc(sizeof(*idx));
+  if (idx == NULL) return NULL;
+  if (ogg_stream_init(&idx->os, serialno) != 0) {
+    free(idx);
+    return NULL;
+  }
+  idx->packet_offset = 0;
+  idx->last_start = -1;
+  idx->nlast_start = 0;
+  idx->nframes = 0;
+  idx->loaded = 0;
+  idx->entries = NULL;
+  idx->nentries = 0;
+  idx->centries = 0;
+  oggbyte_writeinit(&idx->obb, NULL);
+  return idx;
+}
+
+static int od_seek_index_append(daala_seek_index *idx, int64_t frame,
+ int64_t offset, int skip) {
+  if (idx->nentries >= idx->centries) {
+    od_seek_entry *entries;
+    int centries;
+    centries = idx->centries ? idx->centries << 1 : 64;
+    entries = (od_seek_entry *)realloc(idx->entries,
+     centries*sizeof(*entries));
+    if (entries == NULL) return OD_EFAULT;
+    idx->entries = entries;
+    idx->centries = centries;
+  }
+  idx->entries[idx->nentries].frame = frame;
+  idx->entries[idx->nentries].offset = offset;
+  idx->entries[idx->nentries].skip = skip;
+  idx->nentries++;
+  return 0;
+}
+
+daala_seek_index *daala_seek_index_alloc(int serialno) {
+  return od_seek_index_create(serialno);
+}
+
+int daala_seek_index_add_page(daala_seek_index *idx, ogg_page *og,
+ int64_t offset) {
+  ogg_packet op;
+  int first;
+  int ret;
+  if (idx == NULL || og == NULL) return OD_EFAULT;
+  if (idx->loaded || offset < idx->packet_offset) return OD_EINVAL;
+  /*Pages from other logical streams are silently ignored.*/
+  if (ogg_page_serialno(og) != idx->os.serialno) return 0;
+  if (ogg_stream_pagein(&idx->os, og) != 0) return OD_EINVAL;
+  first = 1;
+  while ((ret = ogg_stream_packetout(&idx->os, &op)) != 0) {
+    int64_t start;
+    /*A hole in the data: the next packet cannot start before this page.*/
+    if (ret < 0) {
+      idx->packet_offset = offset;
+      first = 0;
+      continue;
+    }
+    /*Only the first packet completed on a page can have started on an
+       earlier one.*/
+    start = first && ogg_page_continued(og) ? idx->packet_offset : offset;
+    first = 0;
+    /*A reader that starts at the page this packet started on gets every
+       other packet that started there first.*/
+    if (start != idx->last_start) {
+      idx->last_start = start;
+      idx->nlast_start = 0;
+    }
+    if (daala_packet_isheader(op.packet, op.bytes) <= 0) {
+      if (daala_packet_iskeyframe(op.packet, op.bytes) > 0) {
+        ret = od_seek_index_append(idx, idx->nframes, start,
+         idx->nlast_start);
+        if (ret < 0) return ret;
+      }
+      idx->nframes++;
+    }
+    idx->nlast_start++;
+  }
+  /*Any packet left unfinished on this page started on it, unless the page
+     did not complete a single packet.*/
+  if (!first || !ogg_page_continued(og)) idx->packet_offset = offset;
+  return 0;
+}
+
+int daala_seek_index_lookup(const daala_seek_index *idx, int64_t frame,
+ int64_t *keyframe, int64_t *offset, int *skip) {
+  int lo;
+  int hi;
+  if (idx == NULL || keyframe == NULL || offset == NULL || skip == NULL) {
+    return OD_EFAULT;
+  }
+  if (idx->nentries <= 0 || frame < idx->entries[0].frame) return OD_EINVAL;
+  /*Find the last entry at or before the requested frame.*/
+  lo = 0;
+  hi = idx->nentries;
+  while (hi - lo > 1) {
+    int mid;
+    mid = lo + ((hi - lo) >> 1);
+    if (idx->entries[mid].frame <= frame) lo = mid;
+    else hi = mid;
+  }
+  *keyframe = idx->entries[lo].frame;
+  *offset = idx->entries[lo].offset;
+  *skip = idx->entries[lo].skip;
+  return 0;
+}
+
+static void od_seek_index_write_uint(oggbyte_buffer *obb, uint64_t v) {
+  while (v >= 0x80) {
+    oggbyte_write1(obb, (unsigned)(v & 0x7F) | 0x80);
+    v >>= 7;
+  }
+  oggbyte_write1(obb, (unsigned)v);
+}
+
+static int od_seek_index_read_uint(oggbyte_buffer *obb, int64_t *v) {
+  uint64_t ret;
+  int shift;
+  ret = 0;
+  for (shift = 0; shift < 63; shift += 7) {
+    int c;
+    c = oggbyte_read1(obb);
+    if (c < 0) return OD_EBADHEADER;
+    ret |= (uint64_t)(c & 0x7F) << shift;
+    if (!(c & 0x80)) {
+      if (ret > (uint64_t)0x7FFFFFFFFFFFFFFFLL) return OD_EBADHEADER;
+      *v = (int64_t)ret;
+      return 0;
+    }
+  }
+  return OD_EBADHEADER;
+}
+
+int daala_seek_index_save(daala_seek_index *idx, const unsigned char **buf) {
+  int64_t frame;
+  int64_t offset;
+  int i;
+  if (idx == NULL || buf == NULL) return OD_EFAULT;
+  oggbyte_reset(&idx->obb);
+  oggbyte_writecopy(&idx->obb, OD_SEEK_INDEX_MAGIC,
+   sizeof(OD_SEEK_INDEX_MAGIC));
+  oggbyte_write1(&idx->obb, OD_SEEK_INDEX_VERSION);
+  oggbyte_write4(&idx->obb, (uint32_t)idx->os.serialno);
+  od_seek_index_write_uint(&idx->obb, idx->nframes);
+  od_seek_index_write_uint(&idx->obb, idx->nentries);
+  /*Both fields only ever increase, so we store the deltas.*/
+  frame = offset = 0;
+  for (i = 0; i < idx->nentries; i++) {
+    od_seek_index_write_uint(&idx->obb, idx->entries[i].frame - frame);
+    od_seek_index_write_uint(&idx->obb, idx->entries[i].offset - offset);
+    od_seek_index_write_uint(&idx->obb, idx->entries[i].skip);
+    frame = idx->entries[i].frame;
+    offset = idx->entries[i].offset;
+  }
+  *buf = oggbyte_get_buffer(&idx->obb);
+  return (int)oggbyte_bytes(&idx->obb);
+}
+
+daala_seek_index *daala_seek_index_load(const unsigned char *buf,
+ size_t buf_sz) {
+  oggbyte_buffer obb;
+  daala_seek_index *idx;
+  unsigned char magic[sizeof(OD_SEEK_INDEX_MAGIC)];
+  uint32_t serialno;
+  int64_t nentries;
+  int64_t frame;
+  int64_t offset;
+  int64_t i;
+  if (buf == NULL) return NULL;
+  /*The buffer is only read from.*/
+  oggbyte_readinit(&obb, (unsigned char *)buf, buf_sz);
+  if (oggbyte_readcopy(&obb, magic, sizeof(magic))
+   || memcmp(magic, OD_SEEK_INDEX_MAGIC, sizeof(magic)) != 0
+   || oggbyte_read1(&obb) != OD_SEEK_INDEX_VERSION
+   || oggbyte_read4(&obb, &serialno)) {
+    return NULL;
+  }
+  idx = od_seek_index_create((int)serialno);
+  if (idx == NULL) return NULL;
+  if (od_seek_index_read_uint(&obb, &idx->nframes)
+   || od_seek_index_read_uint(&obb, &nentries)
+   /*Each entry takes at least three bytes.*/
+   || nentries > oggbyte_bytes_left(&obb)/3) {
+    daala_seek_index_free(idx);
+    return NULL;
+  }
+  frame = offset = 0;
+  for (i = 0; i < nentries; i++) {
+    int64_t dframe;
+    int64_t doffset;
+    int64_t skip;
+    if (od_seek_index_read_uint(&obb, &dframe)
+     || od_seek_index_read_uint(&obb, &doffset)
+     || od_seek_index_read_uint(&obb, &skip) || skip > INT_MAX
+     || od_seek_index_append(idx, frame += dframe, offset += doffset,
+     (int)skip)) {
+      daala_seek_index_free(idx);
+      return NULL;
+    }
+  }
+  idx->loaded = 1;
+  return idx;
+}
+
+void daala_seek_index_free(daala_seek_index *idx) {
+  if (idx != NULL) {
+    ogg_stream_clear(&idx->os);
+    oggbyte_writeclear(&idx->obb);
+    free(idx->entries);
+    free(idx);
+  }
+}
@@ -66,11 +66,12 @@ const int OD_HAAR_QM[2][OD_LOG_BSIZE_MAX] = {
   {16, 16, 24, 32, 48},
 };
 
-static void *od_aligned_malloc(size_t _sz,size_t _align) {
+static void *od_aligned_malloc(const daala_allocator *_alloc, size_t _sz,
+ size_t _align) {
   unsigned char *p;
   if (_align - 1 > UCHAR_MAX || (_align&_align-1) || _sz > ~(size_t)0-_align)
     return NULL;
-  p = (unsigned char *)malloc(_sz + _align);
+  p = (unsigned char *)od_malloc(_alloc, _sz + _align);
   if (p != NULL) {
     int offs;
     offs = ((p-(unsigned char *)0) - 1 & _align - 1);
@@ -80,13 +81,13 @@ static void *od_aligned_malloc(size_t _sz,size_t _align) {
   return p;
 }
 
-static void od_aligned_free(void *_ptr) {
+static void od_aligned_free(const daala_allocator *_alloc, void *_ptr) {
   unsigned char *p;
   p = (unsigned char *)_ptr;
   if (p != NULL) {
     int offs;
     offs = *--p;
-    free(p - offs);
+    od_free(_alloc, p - offs);
   }
 }
 
@@ -109,9 +110,11 @@ void od_img_copy(od_img* dest, od_img* src) {
 }
 
 /*Initializes the buffers used for reference frames.
-  These buffers are padded with 16 extra pixels on each side, to allow
-   (relatively) unrestricted motion vectors without special casing reading
-   outside the image boundary.
+  The reference frames are padded with state->ref_padding extra pixels on
+   each side, and the input/output images with OD_UMV_PADDING.
+  Motion compensation clamps any read past the padding of a reference frame
+   to its edge, so the padding is only needed by code that reads reference
+   frames directly.
   If chroma is decimated in either direction, the padding is reduced by an
    appropriate factor on the appropriate sides.*/
 static int od_state_ref_imgs_init(od_state *state, int nrefs, int nio) {
@@ -122,6 +125,8 @@ static int od_state_ref_imgs_init(od_state *state, int nrefs, int nio) {
   size_t data_sz;
   int frame_buf_width;
   int frame_buf_height;
+  int ref_buf_width;
+  int ref_buf_height;
   int plane_buf_width;
   int plane_buf_height;
   int imgi;
@@ -135,11 +140,15 @@ static int od_state_ref_imgs_init(od_state *state, int nrefs, int nio) {
   /*TODO: Check for overflow before allocating.*/
   frame_buf_width = state->frame_width + (OD_UMV_PADDING << 1);
   frame_buf_height = state->frame_height + (OD_UMV_PADDING << 1);
+  ref_buf_width = state->frame_width + (state->ref_padding << 1);
+  ref_buf_height = state->frame_height + (state->ref_padding << 1);
   for (pli = 0; pli < info->nplanes; pli++) {
     /*Reserve space for this plane in nrefs reference images.*/
+    plane_buf_width = ref_buf_width >> info->plane_info[pli].xdec;
+    plane_buf_height = ref_buf_height >> info->plane_info[pli].ydec;
+    data_sz += plane_buf_width*plane_buf_height*nrefs;
     plane_buf_width = frame_buf_width >> info->plane_info[pli].xdec;
     plane_buf_height = frame_buf_height >> info->plane_info[pli].ydec;
-    data_sz += plane_buf_width*plane_buf_height*nrefs;
 #if defined(OD_DUMP_IMAGES)
     /*Reserve space for this plane in 1 visualization image.*/
     data_sz += plane_buf_width*plane_buf_height << 2;
@@ -153,7 +162,7 @@ static int od_state_ref_imgs_init(od_state *state, int nrefs, int nio) {
   /*Reserve space for the line buffer in the up-sampler.*/
   data_sz += (frame_buf_width << 1)*8;
   state->ref_img_data = ref_img_data =
-    (unsigned char *)od_aligned_malloc(data_sz, 32);
+    (unsigned char *)od_aligned_malloc(&state->alloc, data_sz, 32);
   if (OD_UNLIKELY(!ref_img_data)) {
     return OD_EFAULT;
   }
@@ -164,12 +173,12 @@ static int od_state_ref_imgs_init(od_state *state, int nrefs, int nio) {
     img->width = state->frame_width;
     img->height = state->frame_height;
     for (pli = 0; pli < img->nplanes; pli++) {
-      plane_buf_width = frame_buf_width >> info->plane_info[pli].xdec;
-      plane_buf_height = frame_buf_height >> info->plane_info[pli].ydec;
+      plane_buf_width = ref_buf_width >> info->plane_info[pli].xdec;
+      plane_buf_height = ref_buf_height >> info->plane_info[pli].ydec;
       iplane = img->planes + pli;
       iplane->data = ref_img_data
-       + (OD_UMV_PADDING >> info->plane_info[pli].xdec)
-       + plane_buf_width*(OD_UMV_PADDING >> info->plane_info[pli].ydec);
+       + (state->ref_padding >> info->plane_info[pli].xdec)
+       + plane_buf_width*(state->ref_padding >> info->plane_info[pli].ydec);
       ref_img_data += plane_buf_width*plane_buf_height;
       iplane->xdec = info->plane_info[pli].xdec;
       iplane->ydec = info->plane_info[pli].ydec;
@@ -242,11 +251,18 @@ static int od_state_ref_imgs_init(od_state *state, int nrefs, int nio) {
 }
 
 static int od_state_mvs_init(od_state *state) {
-  state->mv_grid = (od_mv_grid_pt **)od_calloc_2d(state->nvmvbs + 1,
+  state->mv_grid = (od_mv_grid_pt **)od_calloc_2d(&state->alloc,
+   state->nvmvbs + 1,
    state->nhmvbs + 1, sizeof(**state->mv_grid));
   if (OD_UNLIKELY(!state->mv_grid)) {
     return OD_EFAULT;
   }
+  state->mv_valid = (unsigned char **)od_calloc_2d(&state->alloc,
+   state->nvmvbs + 1,
+   state->nhmvbs + 1, sizeof(**state->mv_valid));
+  if (OD_UNLIKELY(!state->mv_valid)) {
+    return OD_EFAULT;
+  }
   return OD_SUCCESS;
 }
 
@@ -263,6 +279,10 @@ void od_state_opt_vtbl_init_c(od_state *state) {
   state->opt_vtbl.restore_fpu = od_restore_fpu_c;
   OD_COPY(state->opt_vtbl.fdct_2d, OD_FDCT_2D_C, OD_NBSIZES + 1);
   OD_COPY(state->opt_vtbl.idct_2d, OD_IDCT_2D_C, OD_NBSIZES + 1);
+  state->opt_vtbl.clpf = od_clpf_c;
+  state->opt_vtbl.bilinear_smooth = od_bilinear_smooth_c;
+  state->opt_vtbl.haar = od_haar;
+  state->opt_vtbl.haar_inv = od_haar_inv;
 }
 
 static void od_state_opt_vtbl_init(od_state *state) {
@@ -273,16 +293,23 @@ static void od_state_opt_vtbl_init(od_state *state) {
 #endif
 }
 
-static int od_state_init_impl(od_state *state, const daala_info *info) {
+static int od_state_init_impl(od_state *state, const daala_info *info,
+ const daala_allocator *alloc, int ref_padding) {
   int nplanes;
   int pli;
+  /*Clear the state first so that od_state_clear() is safe on any failure.*/
+  OD_CLEAR(state, 1);
+  if (alloc != NULL) {
+    /*Custom allocators must supply both callbacks.*/
+    if (alloc->alloc == NULL || alloc->release == NULL) return OD_EINVAL;
+    state->alloc = *alloc;
+  }
   /*First validate the parameters.*/
   if (info == NULL) return OD_EFAULT;
   nplanes = info->nplanes;
   if (nplanes <= 0 || nplanes > OD_NPLANES_MAX) return OD_EINVAL;
   /*The first plane (the luma plane) must not be subsampled.*/
   if (info->plane_info[0].xdec || info->plane_info[0].ydec) return OD_EINVAL;
-  OD_CLEAR(state, 1);
   OD_COPY(&state->info, info, 1);
   /*Frame size is a multiple of a super block.*/
   state->frame_width = (info->pic_width + (OD_BSIZE_MAX - 1)) &
@@ -291,6 +318,7 @@ static int od_state_init_impl(od_state *state, const daala_info *info) {
    ~(OD_BSIZE_MAX - 1);
   state->nhmvbs = state->frame_width >> OD_LOG_MVBSIZE_MIN;
   state->nvmvbs = state->frame_height >> OD_LOG_MVBSIZE_MIN;
+  state->ref_padding = ref_padding;
   od_state_opt_vtbl_init(state);
   if (OD_UNLIKELY(od_state_ref_imgs_init(state, 4, 2))) {
     return OD_EFAULT;
@@ -305,7 +333,7 @@ static int od_state_init_impl(od_state *state, const daala_info *info) {
     int ydec;
     int w;
     int h;
-    state->sb_dc_mem[pli] = (od_coeff*)malloc(
+    state->sb_dc_mem[pli] = (od_coeff*)od_malloc(&state->alloc,
      sizeof(state->sb_dc_mem[pli][0])*state->nhsb*state->nvsb);
     if (OD_UNLIKELY(!state->sb_dc_mem[pli])) {
       return OD_EFAULT;
@@ -314,19 +342,23 @@ static int od_state_init_impl(od_state *state, const daala_info *info) {
     ydec = info->plane_info[pli].ydec;
     w = state->frame_width >> xdec;
     h = state->frame_height >> ydec;
-    state->ctmp[pli] = (od_coeff *)malloc(w*h*sizeof(*state->ctmp[pli]));
+    state->ctmp[pli] = (od_coeff *)od_malloc(&state->alloc,
+     w*h*sizeof(*state->ctmp[pli]));
     if (OD_UNLIKELY(!state->ctmp[pli])) {
       return OD_EFAULT;
     }
-    state->dtmp[pli] = (od_coeff *)malloc(w*h*sizeof(*state->dtmp[pli]));
+    state->dtmp[pli] = (od_coeff *)od_malloc(&state->alloc,
+     w*h*sizeof(*state->dtmp[pli]));
     if (OD_UNLIKELY(!state->dtmp[pli])) {
       return OD_EFAULT;
     }
-    state->mctmp[pli] = (od_coeff *)malloc(w*h*sizeof(*state->mctmp[pli]));
+    state->mctmp[pli] = (od_coeff *)od_malloc(&state->alloc,
+     w*h*sizeof(*state->mctmp[pli]));
     if (OD_UNLIKELY(!state->mctmp[pli])) {
       return OD_EFAULT;
     }
-    state->mdtmp[pli] = (od_coeff *)malloc(w*h*sizeof(*state->mdtmp[pli]));
+    state->mdtmp[pli] = (od_coeff *)od_malloc(&state->alloc,
+     w*h*sizeof(*state->mdtmp[pli]));
     if (OD_UNLIKELY(!state->mdtmp[pli])) {
       return OD_EFAULT;
     }
@@ -343,8 +375,8 @@ static int od_state_init_impl(od_state *state, const daala_info *info) {
         }
       }
       if (plj >= pli) {
-        state->lbuf[pli] = state->ltmp[pli] = (od_coeff *)malloc(OD_BSIZE_MAX*
-         OD_BSIZE_MAX*sizeof(*state->ltmp[pli]));
+        state->lbuf[pli] = state->ltmp[pli] = (od_coeff *)od_malloc(
+         &state->alloc, OD_BSIZE_MAX*OD_BSIZE_MAX*sizeof(*state->ltmp[pli]));
         if (OD_UNLIKELY(!state->lbuf[pli])) {
           return OD_EFAULT;
         }
@@ -352,7 +384,7 @@ static int od_state_init_impl(od_state *state, const daala_info *info) {
     }
     else state->lbuf[pli] = state->ltmp[pli] = NULL;
   }
-  state->bsize = (unsigned char *)malloc(
+  state->bsize = (unsigned char *)od_malloc(&state->alloc,
    sizeof(*state->bsize)*(state->nhsb + 2)*4*(state->nvsb + 2)*4);
   if (OD_UNLIKELY(!state->bsize)) {
     return OD_EFAULT;
@@ -363,20 +395,58 @@ static int od_state_init_impl(od_state *state, const daala_info *info) {
   state->dump_tags = 0;
   state->dump_files = 0;
 #endif
-  state->clpf_flags = (unsigned char *)malloc(state->nhsb * state->nvsb);
-  state->sb_skip_flags = (unsigned char *)malloc(state->nhsb * state->nvsb);
+  state->clpf_flags = (unsigned char *)od_malloc(&state->alloc,
+   state->nhsb * state->nvsb);
+  state->sb_skip_flags = (unsigned char *)od_malloc(&state->alloc,
+   state->nhsb * state->nvsb);
   return OD_SUCCESS;
 }
 
-int od_state_init(od_state *state, const daala_info *info) {
+/*Initializes a state.
+  ref_padding: The padding to keep around the reference frames, in luma
+                pixels: OD_UMV_PADDING if anything other than motion
+                compensation reads them past their edges, or 0.*/
+int od_state_init(od_state *state, const daala_info *info,
+ const daala_allocator *alloc, int ref_padding) {
   int ret;
-  ret = od_state_init_impl(state, info);
+  ret = od_state_init_impl(state, info, alloc, ref_padding);
   if (OD_UNLIKELY(ret < 0)) {
     od_state_clear(state);
   }
   return ret;
 }
 
+/*Prepares a state for a new stream without reallocating anything.
+  info: The parameters of the new stream, or NULL to keep the current ones.
+        Only parameters that do not change the size of any buffer may
+         differ.
+  Return: 0 on success, or OD_EINVAL if the new parameters would need
+           different buffers.*/
+int od_state_reset(od_state *state, const daala_info *info) {
+  int imgi;
+  if (info != NULL) {
+    int pli;
+    if (info->nplanes != state->info.nplanes) return OD_EINVAL;
+    /*Pictures only need to round up to the same frame size.*/
+    if (((info->pic_width + (OD_BSIZE_MAX - 1)) & ~(OD_BSIZE_MAX - 1))
+     != state->frame_width
+     || ((info->pic_height + (OD_BSIZE_MAX - 1)) & ~(OD_BSIZE_MAX - 1))
+     != state->frame_height) {
+      return OD_EINVAL;
+    }
+    for (pli = 0; pli < info->nplanes; pli++) {
+      if (info->plane_info[pli].xdec != state->info.plane_info[pli].xdec
+       || info->plane_info[pli].ydec != state->info.plane_info[pli].ydec) {
+        return OD_EINVAL;
+      }
+    }
+    OD_COPY(&state->info, info, 1);
+  }
+  for (imgi = 0; imgi < 4; imgi++) state->ref_imgi[imgi] = -1;
+  state->cur_time = 0;
+  return OD_SUCCESS;
+}
+
 void od_state_clear(od_state *state) {
   int pli;
 #if defined(OD_DUMP_IMAGES) || defined(OD_DUMP_RECONS)
@@ -388,20 +458,21 @@ void od_state_clear(od_state *state) {
     state->dump_tags = 0;
   }
 #endif
-  od_free_2d(state->mv_grid);
-  od_aligned_free(state->ref_img_data);
-  state->bsize -= 4*state->bstride + 4;
+  od_free_2d(&state->alloc, state->mv_valid);
+  od_free_2d(&state->alloc, state->mv_grid);
+  od_aligned_free(&state->alloc, state->ref_img_data);
+  if (state->bsize != NULL) state->bsize -= 4*state->bstride + 4;
   for (pli = 0; pli < state->info.nplanes; pli++) {
-    free(state->sb_dc_mem[pli]);
-    free(state->ltmp[pli]);
-    free(state->dtmp[pli]);
-    free(state->ctmp[pli]);
-    free(state->mctmp[pli]);
-    free(state->mdtmp[pli]);
-  }
-  free(state->bsize);
-  free(state->clpf_flags);
-  free(state->sb_skip_flags);
+    od_free(&state->alloc, state->sb_dc_mem[pli]);
+    od_free(&state->alloc, state->ltmp[pli]);
+    od_free(&state->alloc, state->dtmp[pli]);
+    od_free(&state->alloc, state->ctmp[pli]);
+    od_free(&state->alloc, state->mctmp[pli]);
+    od_free(&state->alloc, state->mdtmp[pli]);
+  }
+  od_free(&state->alloc, state->bsize);
+  od_free(&state->alloc, state->clpf_flags);
+  od_free(&state->alloc, state->sb_skip_flags);
 }
 
 /*Probabilities that a motion vector is not coded given two neighbors and the
@@ -843,11 +914,9 @@ void od_state_pred_block_from_setup(od_state *state,
   }
   x = vx << (OD_LOG_MVBSIZE_MIN - iplane->xdec);
   y = vy << (OD_LOG_MVBSIZE_MIN - iplane->ydec);
-  od_mc_predict8(state, buf, ystride, iplane->data + y*iplane->ystride + x,
-   iplane->ystride, mvx, mvy, oc, s,
+  od_mc_predict8(state, buf, ystride, iplane, x, y, mvx, mvy, oc, s,
    log_mvb_sz + OD_LOG_MVBSIZE_MIN - iplane->xdec,
-   log_mvb_sz + OD_LOG_MVBSIZE_MIN - iplane->ydec,
-   (iplane->xdec != 0) || (iplane->ydec != 0));
+   log_mvb_sz + OD_LOG_MVBSIZE_MIN - iplane->ydec);
 }
 
 void od_state_pred_block(od_state *state, unsigned char *buf, int ystride,
@@ -855,7 +924,7 @@ void od_state_pred_block(od_state *state, unsigned char *buf, int ystride,
   int half_mvb_sz;
   half_mvb_sz = 1 << log_mvb_sz >> 1;
   if (log_mvb_sz > 0
-   && state->mv_grid[vy + half_mvb_sz][vx + half_mvb_sz].valid) {
+   && state->mv_valid[vy + half_mvb_sz][vx + half_mvb_sz]) {
     od_img_plane *iplane;
     int half_xblk_sz;
     int half_yblk_sz;
@@ -887,8 +956,8 @@ void od_state_pred_block(od_state *state, unsigned char *buf, int ystride,
       s1vy = vy + (OD_VERT_DY[(oc + 1) & 3] << log_mvb_sz);
       s3vx = vx + (OD_VERT_DX[(oc + 3) & 3] << log_mvb_sz);
       s3vy = vy + (OD_VERT_DY[(oc + 3) & 3] << log_mvb_sz);
-      s = state->mv_grid[s1vy][s1vx].valid |
-       state->mv_grid[s3vy][s3vx].valid << 1;
+      s = state->mv_valid[s1vy][s1vx] |
+       state->mv_valid[s3vy][s3vx] << 1;
     }
     else {
       oc = 0;
@@ -1039,7 +1108,7 @@ static void od_state_draw_mv_grid_block(od_state *state,
   int half_mvb_sz;
   half_mvb_sz = 1 << log_mvb_sz >> 1;
   if (log_mvb_sz > 0
-   && state->mv_grid[vy + half_mvb_sz][vx + half_mvb_sz].valid) {
+   && state->mv_valid[vy + half_mvb_sz][vx + half_mvb_sz]) {
     od_state_draw_mv_grid_block(state, vx, vy, log_mvb_sz - 1);
     od_state_draw_mv_grid_block(state, vx + half_mvb_sz, vy, log_mvb_sz - 1);
     od_state_draw_mv_grid_block(state, vx, vy + half_mvb_sz, log_mvb_sz - 1);
@@ -1087,7 +1156,7 @@ static void od_state_draw_mvs_block(od_state *state,
   int half_mvb_sz;
   half_mvb_sz = 1 << log_mvb_sz >> 1;
   if (log_mvb_sz > 0
-   && state->mv_grid[vy + half_mvb_sz][vx + half_mvb_sz].valid) {
+   && state->mv_valid[vy + half_mvb_sz][vx + half_mvb_sz]) {
     od_state_draw_mvs_block(state, vx, vy, log_mvb_sz - 1);
     od_state_draw_mvs_block(state, vx + half_mvb_sz, vy, log_mvb_sz - 1);
     od_state_draw_mvs_block(state, vx, vy + half_mvb_sz, log_mvb_sz - 1);
@@ -1116,8 +1185,8 @@ static void od_state_draw_mvs_block(od_state *state,
       s1vy = vy + (OD_VERT_DY[(oc + 1) & 3] << log_mvb_sz);
       s3vx = vx + (OD_VERT_DX[(oc + 3) & 3] << log_mvb_sz);
       s3vy = vy + (OD_VERT_DY[(oc + 3) & 3] << log_mvb_sz);
-      s = state->mv_grid[s1vy][s1vx].valid |
-       state->mv_grid[s3vy][s3vx].valid << 1;
+      s = state->mv_valid[s1vy][s1vx] |
+       state->mv_valid[s3vy][s3vx] << 1;
     }
     else {
       oc = 0;
@@ -1277,7 +1346,8 @@ int od_state_dump_img(od_state *state, od_img *img, const char *tag) {
     fclose(fp);
     return OD_EFAULT;
   }
-  data = (png_bytep *)od_malloc_2d(img->height, 6*img->width, sizeof(**data));
+  data = (png_bytep *)od_malloc_2d(NULL, img->height, 6*img->width,
+   sizeof(**data));
   if (img->nplanes < 3) nplanes = 1;
   else nplanes = 3;
   for (pli = 0; pli < nplanes; pli++) p_rows[pli] = img->planes[pli].data;
@@ -1338,7 +1408,7 @@ int od_state_dump_img(od_state *state, od_img *img, const char *tag) {
   png_write_png(png, info, PNG_TRANSFORM_IDENTITY, NULL);
   png_write_end(png, info);
   png_destroy_write_struct(&png, &info);
-  od_free_2d(data);
+  od_free_2d(NULL, data);
   fclose(fp);
   return 0;
 }
@@ -91,6 +91,12 @@ extern const int *const OD_VERT_SETUP_DY[4][4];
 
 /*This should be a power of 2, and at least 8.*/
 # define OD_UMV_PADDING (32)
+/*The margin around a motion-compensated block that is copied, clamped to
+   the frame, when the block reads past the padding of its reference.
+  This covers the support of the sub-pel filters, and the bytes past it that
+   the SIMD versions load but ignore.*/
+# define OD_MC_PATCH_APRON (8)
+# define OD_MC_PATCH_STRIDE (OD_MVBSIZE_MAX + 2*OD_MC_PATCH_APRON)
 
 /*The shared (encoder and decoder) functions that have accelerated variants.*/
 struct od_state_opt_vtbl{
@@ -105,6 +111,14 @@ struct od_state_opt_vtbl{
   void (*restore_fpu)(void);
   od_dct_func_2d fdct_2d[OD_NBSIZES + 1];
   od_dct_func_2d idct_2d[OD_NBSIZES + 1];
+  void (*clpf)(od_coeff *_y, int _ystride, const od_coeff *_x, int _xstride,
+   int _ln, int _sbx, int _sby, int _nhsb, int _nvsb);
+  void (*bilinear_smooth)(od_coeff *_x, int _ln, int _stride, int _q,
+   int _pli);
+  void (*haar)(od_coeff *_y, int _ystride, const od_coeff *_x, int _xstride,
+   int _ln);
+  void (*haar_inv)(od_coeff *_x, int _xstride, const od_coeff *_y,
+   int _ystride, int _ln);
 };
 
 # if defined(OD_DUMP_IMAGES) || defined(OD_DUMP_RECONS)
@@ -159,13 +173,26 @@ struct od_adapt_ctx {
 struct od_state{
   od_adapt_ctx        adapt;
   daala_info          info;
+  /** Where all of the instance's memory comes from.
+      The callbacks are NULL to use the C library heap. */
+  daala_allocator     alloc;
   OD_ALIGN16(unsigned char mc_buf[5][OD_MVBSIZE_MAX*OD_MVBSIZE_MAX]);
+  /** Edge-clamped copy of the reference pixels around a block whose motion
+      vector reaches past the padding of the reference image.
+      The extra 16 bytes are for SIMD loads past its last row. */
+  OD_ALIGN16(unsigned char mc_patch[OD_MC_PATCH_STRIDE*OD_MC_PATCH_STRIDE
+   + 16]);
   od_state_opt_vtbl   opt_vtbl;
   uint32_t        cpu_flags;
   int32_t         frame_width;
   int32_t         frame_height;
   /** Buffer for the 4 ref images. */
   int                 ref_imgi[4];
+  /** The padding kept around the ref images, in luma pixels.
+      This is OD_UMV_PADDING where something other than motion
+       compensation reads them past their edges (the encoder's motion
+       search), and 0 otherwise. */
+  int                 ref_padding;
   /** Pointers to the ref images so one can move them around without coping
       them. */
   od_img              ref_imgs[4];
@@ -176,6 +203,9 @@ struct od_state{
   /** Increments by 1 for each frame. */
   int64_t         cur_time;
   od_mv_grid_pt **mv_grid;
+  /** Whether or not each point of mv_grid has a valid value (1 byte per
+       point, indexed the same way as mv_grid). */
+  unsigned char **mv_valid;
 
   /** Number of horizontal motion-vector blocks. */
   int                 nhmvbs;
@@ -226,7 +256,9 @@ struct od_state{
   unsigned char *sb_skip_flags;
 };
 
-int od_state_init(od_state *_state, const daala_info *_info);
+int od_state_init(od_state *_state, const daala_info *_info,
+ const daala_allocator *_alloc, int _ref_padding);
+int od_state_reset(od_state *_state, const daala_info *_info);
 void od_state_clear(od_state *_state);
 
 void od_img_copy(od_img* dest, od_img* src);
@@ -46,7 +46,7 @@ int main(int _argc,char **_argv){
   /*Trigger resize during termination.*/
   for(ft=2;ft<1024;ft++){
     for(i=0;i<ft;i++){
-      od_ec_enc_init(&enc,ft+i&1);
+      od_ec_enc_init(&enc,ft+i&1,NULL);
       od_ec_enc_uint(&enc,i,ft);
       nbits=od_ec_enc_tell_frac(&enc);
       ptr=od_ec_enc_done(&enc,&ptr_sz);
@@ -72,7 +72,7 @@ int main(int _argc,char **_argv){
   /*Raw bits only w/ resize*/
   for(ftb=1;ftb<17;ftb++){
     for(i=0;i<(1<<ftb);i++){
-      od_ec_enc_init(&enc,ftb+i&1);
+      od_ec_enc_init(&enc,ftb+i&1,NULL);
       od_ec_enc_checkpoint(&enc_bak,&enc);
       od_ec_enc_bits(&enc,i,ftb);
       od_ec_enc_rollback(&enc,&enc_bak);
@@ -93,7 +93,7 @@ int main(int _argc,char **_argv){
     }
   }
   /*Testing unsigned integer corruption*/
-  od_ec_enc_init(&enc,2);
+  od_ec_enc_init(&enc,2,NULL);
   od_ec_enc_uint(&enc,128,129);
   od_ec_enc_checkpoint(&enc_bak,&enc);
   od_ec_enc_uint(&enc,128,129);
@@ -120,7 +120,7 @@ int main(int _argc,char **_argv){
   }
   od_ec_enc_clear(&enc);
   /*Testing encoding of unsigned integers.*/
-  od_ec_enc_init(&enc,1);
+  od_ec_enc_init(&enc,1,NULL);
   for(ft=2;ft<1024;ft++){
     for(i=0;i<ft;i++){
       entropy+=log(ft)*M_LOG2E;
@@ -163,7 +163,7 @@ int run_pvq(od_coeff *X,int len,int N,int fuzz){
   pvq_adapt.mean_sum_ex_q8=64;
   pvq_adapt.mean_count_q8=100*4;
   pvq_adapt.mean_count_ex_q8=256*4;
-  od_ec_enc_init(&enc, EC_BUF_SIZE);
+  od_ec_enc_init(&enc, EC_BUF_SIZE, NULL);
   generic_model_init(&model);
   for(i=0;i<len;i++){
     int K=0;
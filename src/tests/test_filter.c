@@ -0,0 +1,198 @@
+/*Daala video codec
+Copyright (c) 2016 Daala project contributors.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+- Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+- Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../filter.h"
+#if defined(OD_X86ASM)
+# include "../x86/cpu.h"
+# include "../x86/x86int.h"
+#endif
+#if defined(OD_ARMASM)
+# include "../arm/cpu.h"
+# include "../arm/armint.h"
+#endif
+
+typedef void (*od_clpf_func)(od_coeff *y, int ystride, const od_coeff *x,
+ int xstride, int ln, int sbx, int sby, int nhsb, int nvsb);
+typedef void (*od_bilinear_smooth_func)(od_coeff *x, int ln, int stride,
+ int q, int pli);
+
+/*A 3x3 superblock frame, so that every combination of frame edges can be
+   tested.*/
+#define NSB (3)
+#define FRAME_STRIDE (NSB*OD_BSIZE_MAX)
+
+static od_coeff frame[FRAME_STRIDE*FRAME_STRIDE];
+
+static int test_failed;
+
+/*Fills the frame with values that exercise both sides of the CLPF threshold.*/
+static void fill_frame(int range) {
+  int i;
+  for (i = 0; i < FRAME_STRIDE*FRAME_STRIDE; i++) {
+    frame[i] = (rand() % (2*range + 1)) - range;
+  }
+}
+
+static void test_clpf(const char *name, od_clpf_func clpf) {
+  int iter;
+  int ln;
+  int sbx;
+  int sby;
+  for (iter = 0; iter < 64; iter++) {
+    fill_frame(iter & 1 ? 24 << OD_COEFF_SHIFT : 4 << OD_COEFF_SHIFT);
+    for (ln = 2; ln <= OD_LOG_BSIZE_MAX; ln++) {
+      for (sby = 0; sby < NSB; sby++) {
+        for (sbx = 0; sbx < NSB; sbx++) {
+          od_coeff ref[OD_BSIZE_MAX*OD_BSIZE_MAX];
+          od_coeff out[OD_BSIZE_MAX*OD_BSIZE_MAX];
+          const od_coeff *x;
+          int n;
+          int i;
+          int j;
+          n = 1 << ln;
+          x = frame + (sby << ln)*FRAME_STRIDE + (sbx << ln);
+          od_clpf_c(ref, OD_BSIZE_MAX, x, FRAME_STRIDE, ln, sbx, sby, NSB,
+           NSB);
+          (*clpf)(out, OD_BSIZE_MAX, x, FRAME_STRIDE, ln, sbx, sby, NSB, NSB);
+          for (i = 0; i < n; i++) {
+            for (j = 0; j < n; j++) {
+              if (ref[i*OD_BSIZE_MAX + j] != out[i*OD_BSIZE_MAX + j]) {
+                fprintf(stderr, "%s mismatch: ln=%i sb=(%i,%i) "
+                 "(%i,%i): %i!=%i\n", name, ln, sbx, sby, j, i,
+                 out[i*OD_BSIZE_MAX + j], ref[i*OD_BSIZE_MAX + j]);
+                test_failed = 1;
+                return;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+static void test_bilinear_smooth(const char *name,
+ od_bilinear_smooth_func bilinear_smooth) {
+  int iter;
+  int ln;
+  for (iter = 0; iter < 256; iter++) {
+    for (ln = 2; ln <= OD_LOG_BSIZE_MAX; ln++) {
+      od_coeff ref[OD_BSIZE_MAX*OD_BSIZE_MAX];
+      od_coeff *x;
+      int q;
+      int pli;
+      int n;
+      int i;
+      int j;
+      n = 1 << ln;
+      /*Smooth gradients with a little noise make the filter kick in, while
+         noisier blocks test the cases where it is turned off.*/
+      for (i = 0; i < n; i++) {
+        for (j = 0; j < n; j++) {
+          frame[i*FRAME_STRIDE + j] = ((i*(iter - 128) + j*(iter % 37 - 18))
+           << OD_COEFF_SHIFT >> ln) + (rand() % (2*(iter & 63) + 1))
+           - (iter & 63);
+        }
+      }
+      x = frame + FRAME_STRIDE + 1;
+      q = (rand() % 512) << OD_COEFF_SHIFT;
+      pli = rand() % 3;
+      for (i = 0; i < n; i++) {
+        OD_COPY(ref + i*OD_BSIZE_MAX, x + i*FRAME_STRIDE, n);
+      }
+      od_bilinear_smooth_c(ref, ln, OD_BSIZE_MAX, q, pli);
+      (*bilinear_smooth)(x, ln, FRAME_STRIDE, q, pli);
+      for (i = 0; i < n; i++) {
+        for (j = 0; j < n; j++) {
+          if (ref[i*OD_BSIZE_MAX + j] != x[i*FRAME_STRIDE + j]) {
+            fprintf(stderr, "%s mismatch: ln=%i q=%i (%i,%i): %i!=%i\n",
+             name, ln, q, j, i, x[i*FRAME_STRIDE + j],
+             ref[i*OD_BSIZE_MAX + j]);
+            test_failed = 1;
+            return;
+          }
+        }
+      }
+    }
+  }
+}
+
+static void run_test(const char *name, od_clpf_func clpf,
+ od_bilinear_smooth_func bilinear_smooth) {
+  fprintf(stderr, "Testing %s filters...\n", name);
+  test_clpf(name, clpf);
+  test_bilinear_smooth(name, bilinear_smooth);
+}
+
+int main(int argc, char *argv[]) {
+  unsigned int seed;
+  if (argc > 2) {
+    fprintf(stderr, "Usage: %s [<seed>]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (argc > 1) {
+    seed = atoi(argv[1]);
+  }
+  else {
+    const char *env_seed;
+    env_seed = getenv("SEED");
+    if (env_seed) {
+      seed = atoi(env_seed);
+    }
+    else {
+      seed = time(NULL);
+    }
+  }
+  srand(seed);
+  fprintf(stderr, "Random seed: %u (%.4X).\n", seed, rand() & 65535);
+#if defined(OD_X86ASM)
+# if defined(OD_SSE41_INTRINSICS)
+  if (od_cpu_flags_get() & OD_CPU_X86_SSE4_1) {
+    run_test("SSE4.1", od_clpf_sse41, od_bilinear_smooth_sse41);
+  }
+# endif
+# if defined(OD_AVX2_INTRINSICS)
+  if (od_cpu_flags_get() & OD_CPU_X86_AVX2) {
+    run_test("AVX2", od_clpf_avx2, od_bilinear_smooth_avx2);
+  }
+# endif
+#endif
+#if defined(OD_ARMASM)
+  if (od_cpu_flags_get() & OD_CPU_ARM_NEON) {
+    run_test("NEON", od_clpf_neon, od_bilinear_smooth_neon);
+  }
+#endif
+  if (test_failed) return EXIT_FAILURE;
+  fprintf(stderr, "Passed!\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,186 @@
+/*Daala video codec
+Copyright (c) 2016 Daala project contributors.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+- Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+- Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS”
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/*Checks daala_encode_reset() and daala_decode_reset() with a counting
+   allocator.
+  A stream is encoded and decoded, both instances are reset, and the same
+   stream is coded again.
+  The second pass must produce the same packets and frames without
+   allocating anything, and freeing the instances must release every block
+   they got from the allocator.*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "daala/daalaenc.h"
+#include "daala/daaladec.h"
+#include "test_util.h"
+
+#define NFRAMES (6)
+
+/*Encodes and decodes NFRAMES frames, and computes a hash of the packets and
+   the decoded frames.
+  If *dec is NULL, the header packets are decoded into *dsi, and the decoder
+   is allocated from them.
+  Returns 0 on success.*/
+static int code_stream(unsigned long *hash, daala_enc_ctx *enc,
+ daala_dec_ctx **dec, daala_setup_info **dsi, const daala_allocator *alloc,
+ od_img *img) {
+  daala_comment dc;
+  daala_info ddi;
+  daala_comment ddc;
+  ogg_packet op;
+  unsigned long h;
+  int f;
+  h = OD_TEST_HASH_INIT;
+  daala_comment_init(&dc);
+  daala_info_init(&ddi);
+  daala_comment_init(&ddc);
+  while (daala_encode_flush_header(enc, &dc, &op) > 0) {
+    h = od_test_hash(h, op.packet, op.bytes);
+    if (*dec == NULL) daala_decode_header_in(&ddi, &ddc, dsi, &op);
+  }
+  daala_comment_clear(&ddc);
+  if (*dec == NULL) {
+    *dec = daala_decode_alloc_with_allocator(&ddi, *dsi, alloc);
+    if (*dec == NULL) return 1;
+  }
+  for (f = 0; f < NFRAMES; f++) {
+    od_test_fill_frame(img, img->width, img->height, f);
+    daala_encode_img_in(enc, img, 0);
+    while (daala_encode_packet_out(enc, f == NFRAMES - 1, &op) > 0) {
+      od_img out;
+      int pli;
+      h = od_test_hash(h, op.packet, op.bytes);
+      if (daala_decode_packet_in(*dec, &out, &op) != 0) {
+        fprintf(stderr, "Failed to decode frame %i.\n", f);
+        return 1;
+      }
+      for (pli = 0; pli < out.nplanes; pli++) {
+        int y;
+        for (y = 0; y < out.height >> out.planes[pli].ydec; y++) {
+          h = od_test_hash(h,
+           out.planes[pli].data + y*out.planes[pli].ystride,
+           out.width >> out.planes[pli].xdec);
+        }
+      }
+    }
+  }
+  *hash = h;
+  return 0;
+}
+
+int main(void) {
+  od_test_alloc_counter ac;
+  daala_allocator alloc;
+  daala_info di;
+  daala_enc_ctx *enc;
+  daala_dec_ctx *dec;
+  daala_setup_info *dsi;
+  od_img img;
+  unsigned long h1;
+  unsigned long h2;
+  long nallocs;
+  int failed;
+  int quant;
+  int pli;
+  failed = 0;
+  fprintf(stderr, "Testing instance reset with a counting allocator...\n");
+  od_test_alloc_init(&alloc, &ac);
+  daala_info_init(&di);
+  di.pic_width = 176;
+  di.pic_height = 144;
+  di.pixel_aspect_numerator = 1;
+  di.pixel_aspect_denominator = 1;
+  di.timebase_numerator = 30;
+  di.timebase_denominator = 1;
+  di.frame_duration = 1;
+  di.keyframe_rate = 4;
+  di.nplanes = 3;
+  for (pli = 0; pli < 3; pli++) {
+    di.plane_info[pli].xdec = di.plane_info[pli].ydec = pli > 0;
+  }
+  img.nplanes = 3;
+  img.width = di.pic_width;
+  img.height = di.pic_height;
+  for (pli = 0; pli < 3; pli++) {
+    img.planes[pli].xdec = img.planes[pli].ydec = pli > 0;
+    img.planes[pli].xstride = 1;
+    img.planes[pli].ystride = img.width >> (pli > 0);
+    img.planes[pli].data = (unsigned char *)malloc(
+     img.planes[pli].ystride*(img.height >> (pli > 0)));
+  }
+  enc = daala_encode_create_with_allocator(&di, &alloc);
+  if (enc == NULL) {
+    fprintf(stderr, "Failed to create the encoder.\n");
+    return EXIT_FAILURE;
+  }
+  quant = 30;
+  daala_encode_ctl(enc, OD_SET_QUANT, &quant, sizeof(quant));
+  dec = NULL;
+  dsi = NULL;
+  if (code_stream(&h1, enc, &dec, &dsi, &alloc, &img) != 0) {
+    fprintf(stderr, "The first pass failed.\n");
+    return EXIT_FAILURE;
+  }
+  if (ac.nallocs == 0) {
+    fprintf(stderr, "The allocator was not used.\n");
+    failed = 1;
+  }
+  if (daala_encode_reset(enc, NULL) != 0
+   || daala_decode_reset(dec, NULL) != 0) {
+    fprintf(stderr, "Failed to reset the instances.\n");
+    return EXIT_FAILURE;
+  }
+  nallocs = ac.nallocs;
+  if (code_stream(&h2, enc, &dec, &dsi, &alloc, &img) != 0) {
+    fprintf(stderr, "The second pass failed.\n");
+    return EXIT_FAILURE;
+  }
+  if (h2 != h1) {
+    fprintf(stderr, "The stream changed after a reset.\n");
+    failed = 1;
+  }
+  if (ac.nallocs != nallocs) {
+    fprintf(stderr, "%li allocations after the reset.\n",
+     ac.nallocs - nallocs);
+    failed = 1;
+  }
+  daala_encode_free(enc);
+  daala_decode_free(dec);
+  daala_setup_free(dsi);
+  if (ac.nlive != 0) {
+    fprintf(stderr, "%li blocks were not released.\n", ac.nlive);
+    failed = 1;
+  }
+  for (pli = 0; pli < 3; pli++) free(img.planes[pli].data);
+  if (failed) return EXIT_FAILURE;
+  fprintf(stderr, "Passed!\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,222 @@
+/*Daala video codec
+Copyright (c) 2016 Daala project contributors.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+- Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+- Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS”
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/*Checks the rows reported through OD_DECCTL_SET_ROW_CALLBACK.
+  Each stream is decoded twice, with and without the callback.
+  The rows must be reported top-down, each exactly once, and must already
+   hold their final values when they are reported, and setting the callback
+   must not change the decoded frames.*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "daala/daalaenc.h"
+#include "daala/daaladec.h"
+#include "test_util.h"
+
+typedef struct {
+  /*A copy of each row, taken when it was reported.*/
+  unsigned char *planes[3];
+  int width;
+  int height;
+  int next_row;
+  int failed;
+} row_check;
+
+static int test_failed;
+
+static void row_cb(void *ctx, const od_img *img, int y0, int y1) {
+  row_check *rc;
+  int pli;
+  rc = (row_check *)ctx;
+  if (img->width != rc->width || img->height != rc->height
+   || y0 != rc->next_row || y1 <= y0 || y1 > rc->height) {
+    fprintf(stderr, "Bad row range [%i, %i) after row %i (%ix%i).\n",
+     y0, y1, rc->next_row, img->width, img->height);
+    rc->failed = 1;
+    return;
+  }
+  rc->next_row = y1;
+  for (pli = 0; pli < img->nplanes; pli++) {
+    const od_img_plane *p;
+    int w;
+    int y;
+    p = img->planes + pli;
+    w = (rc->width + (1 << p->xdec) - 1) >> p->xdec;
+    for (y = y0 >> p->ydec; y < (y1 + (1 << p->ydec) - 1) >> p->ydec; y++) {
+      int x;
+      for (x = 0; x < w; x++) {
+        rc->planes[pli][y*w + x] = p->data[y*p->ystride + x*p->xstride];
+      }
+    }
+  }
+}
+
+/*Returns 0 if the visible parts of a and b match.*/
+static int compare_planes(const od_img *a, const unsigned char *b,
+ int pli) {
+  const od_img_plane *p;
+  int w;
+  int h;
+  int y;
+  p = a->planes + pli;
+  w = (a->width + (1 << p->xdec) - 1) >> p->xdec;
+  h = (a->height + (1 << p->ydec) - 1) >> p->ydec;
+  for (y = 0; y < h; y++) {
+    int x;
+    for (x = 0; x < w; x++) {
+      if (p->data[y*p->ystride + x*p->xstride] != b[y*w + x]) return 1;
+    }
+  }
+  return 0;
+}
+
+static void test_stream(int w, int h, int dec_shift, int quant,
+ int nframes) {
+  daala_info di;
+  daala_comment dc;
+  daala_enc_ctx *enc;
+  daala_setup_info *dsi;
+  daala_info ddi;
+  daala_comment ddc;
+  daala_dec_ctx *dec;
+  daala_dec_ctx *dec_cb;
+  daala_row_callback cb;
+  row_check rc;
+  ogg_packet op;
+  od_img img;
+  int complexity;
+  int pli;
+  int f;
+  fprintf(stderr, "  %ix%i, decimation %i, quantizer %i...\n",
+   w, h, dec_shift, quant);
+  daala_info_init(&di);
+  di.pic_width = w;
+  di.pic_height = h;
+  di.pixel_aspect_numerator = 1;
+  di.pixel_aspect_denominator = 1;
+  di.timebase_numerator = 30;
+  di.timebase_denominator = 1;
+  di.frame_duration = 1;
+  di.keyframe_rate = 4;
+  di.nplanes = 3;
+  for (pli = 0; pli < 3; pli++) {
+    di.plane_info[pli].xdec = di.plane_info[pli].ydec = pli ? dec_shift : 0;
+  }
+  daala_comment_init(&dc);
+  enc = daala_encode_create(&di);
+  complexity = 2;
+  daala_encode_ctl(enc, OD_SET_QUANT, &quant, sizeof(quant));
+  daala_encode_ctl(enc, OD_SET_COMPLEXITY, &complexity, sizeof(complexity));
+  daala_info_init(&ddi);
+  daala_comment_init(&ddc);
+  dsi = NULL;
+  while (daala_encode_flush_header(enc, &dc, &op) > 0) {
+    daala_decode_header_in(&ddi, &ddc, &dsi, &op);
+  }
+  dec = daala_decode_alloc(&ddi, dsi);
+  dec_cb = daala_decode_alloc(&ddi, dsi);
+  rc.width = w;
+  rc.height = h;
+  rc.failed = 0;
+  img.nplanes = 3;
+  img.width = w;
+  img.height = h;
+  for (pli = 0; pli < 3; pli++) {
+    int d;
+    d = pli ? dec_shift : 0;
+    img.planes[pli].xdec = img.planes[pli].ydec = d;
+    img.planes[pli].xstride = 1;
+    img.planes[pli].ystride = (w + (1 << d) - 1) >> d;
+    img.planes[pli].data = (unsigned char *)malloc(
+     img.planes[pli].ystride*((h + (1 << d) - 1) >> d));
+    rc.planes[pli] = (unsigned char *)malloc(
+     img.planes[pli].ystride*((h + (1 << d) - 1) >> d));
+  }
+  cb.func = row_cb;
+  cb.ctx = &rc;
+  daala_decode_ctl(dec_cb, OD_DECCTL_SET_ROW_CALLBACK, &cb, sizeof(cb));
+  for (f = 0; f < nframes; f++) {
+    od_test_fill_frame(&img, w, h, f);
+    daala_encode_img_in(enc, &img, 0);
+    while (daala_encode_packet_out(enc, f == nframes - 1, &op) > 0) {
+      od_img out;
+      od_img out_cb;
+      rc.next_row = 0;
+      if (daala_decode_packet_in(dec, &out, &op) != 0
+       || daala_decode_packet_in(dec_cb, &out_cb, &op) != 0) {
+        fprintf(stderr, "Failed to decode frame %i.\n", f);
+        test_failed = 1;
+        break;
+      }
+      if (rc.next_row != h) {
+        fprintf(stderr, "Frame %i: only rows [0, %i) of %i were reported.\n",
+         f, rc.next_row, h);
+        rc.failed = 1;
+      }
+      for (pli = 0; pli < 3; pli++) {
+        if (compare_planes(&out_cb, rc.planes[pli], pli)) {
+          fprintf(stderr, "Frame %i: plane %i changed after its rows were "
+           "reported.\n", f, pli);
+          rc.failed = 1;
+        }
+        /*Check the output of the decoder without the callback against the
+           rows reported by the other one.*/
+        if (compare_planes(&out, rc.planes[pli], pli)) {
+          fprintf(stderr, "Frame %i: plane %i differs from the decoder "
+           "without a callback.\n", f, pli);
+          rc.failed = 1;
+        }
+      }
+    }
+  }
+  if (rc.failed) test_failed = 1;
+  for (pli = 0; pli < 3; pli++) {
+    free(img.planes[pli].data);
+    free(rc.planes[pli]);
+  }
+  daala_decode_free(dec);
+  daala_decode_free(dec_cb);
+  daala_setup_free(dsi);
+  daala_encode_free(enc);
+}
+
+int main(void) {
+  fprintf(stderr, "Testing the decoder row callback...\n");
+  test_stream(176, 144, 1, 30, 6);
+  /*A height that is not a multiple of the superblock size and 4:4:4.*/
+  test_stream(100, 70, 0, 20, 5);
+  /*Odd chroma sizes.*/
+  test_stream(71, 45, 1, 40, 3);
+  /*Lossless frames use the Haar wavelet.*/
+  test_stream(64, 48, 1, 0, 3);
+  if (test_failed) return EXIT_FAILURE;
+  fprintf(stderr, "Passed!\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,326 @@
+/*Daala video codec
+Copyright (c) 2016 Daala project contributors.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+- Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+- Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS”
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/*Checks the keyframe seek index.
+  A stream is muxed into small Ogg pages, so that packets span pages and
+   several packets start on the same page, with the pages of a second logical
+   stream interleaved.
+  The index is built from those pages, saved and loaded again, and seeking to
+   every frame through either copy must land on the packet of the keyframe
+   at or before it.*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "daala/daalaenc.h"
+#include "daala/daaladec.h"
+#include "test_util.h"
+
+#define NFRAMES (30)
+#define KEYFRAME_RATE (8)
+#define SERIALNO (0x5EEC)
+#define OTHER_SERIALNO (0x07E4)
+/*The page size to aim for.
+  This is much smaller than a keyframe, so those always span pages.*/
+#define PAGE_FILL (256)
+
+typedef struct {
+  unsigned char *data;
+  long size;
+  long storage;
+} file_buf;
+
+static int test_failed;
+
+/*The hash of the packet of each frame.*/
+static unsigned long packet_hashes[NFRAMES];
+
+static long write_page(file_buf *file, const ogg_page *og) {
+  long offset;
+  long size;
+  offset = file->size;
+  size = og->header_len + og->body_len;
+  if (file->size + size > file->storage) {
+    file->storage = 2*(file->size + size);
+    file->data = (unsigned char *)realloc(file->data, file->storage);
+  }
+  memcpy(file->data + file->size, og->header, og->header_len);
+  memcpy(file->data + file->size + og->header_len, og->body, og->body_len);
+  file->size += size;
+  return offset;
+}
+
+/*Writes a page to the file and adds it to the index.*/
+static void add_page(file_buf *file, daala_seek_index *idx,
+ const ogg_page *og) {
+  long offset;
+  offset = write_page(file, og);
+  if (daala_seek_index_add_page(idx, (ogg_page *)og, offset) != 0) {
+    fprintf(stderr, "Failed to index the page at %li.\n", offset);
+    test_failed = 1;
+  }
+}
+
+/*Adds a page of the other logical stream, which the index must skip.*/
+static void add_other_page(file_buf *file, daala_seek_index *idx,
+ ogg_stream_state *other) {
+  static unsigned char junk[100];
+  ogg_packet op;
+  ogg_page og;
+  memset(&op, 0, sizeof(op));
+  op.packet = junk;
+  op.bytes = sizeof(junk);
+  op.b_o_s = other->packetno == 0;
+  op.packetno = other->packetno;
+  ogg_stream_packetin(other, &op);
+  while (ogg_stream_flush(other, &og) > 0) add_page(file, idx, &og);
+}
+
+/*Encodes the stream, muxes it into file, and indexes it.
+  Returns the number of Daala pages that continue a packet from the previous
+   one.*/
+static int build_file(file_buf *file, daala_seek_index *idx) {
+  daala_info di;
+  daala_comment dc;
+  daala_enc_ctx *enc;
+  ogg_stream_state os;
+  ogg_stream_state other;
+  ogg_packet op;
+  ogg_page og;
+  od_img img;
+  int ncontinued;
+  int quant;
+  int pli;
+  int f;
+  daala_info_init(&di);
+  di.pic_width = 96;
+  di.pic_height = 64;
+  di.pixel_aspect_numerator = 1;
+  di.pixel_aspect_denominator = 1;
+  di.timebase_numerator = 30;
+  di.timebase_denominator = 1;
+  di.frame_duration = 1;
+  di.keyframe_rate = KEYFRAME_RATE;
+  di.nplanes = 3;
+  for (pli = 0; pli < 3; pli++) {
+    di.plane_info[pli].xdec = di.plane_info[pli].ydec = pli > 0;
+  }
+  enc = daala_encode_create(&di);
+  quant = 50;
+  daala_encode_ctl(enc, OD_SET_QUANT, &quant, sizeof(quant));
+  daala_comment_init(&dc);
+  ogg_stream_init(&os, SERIALNO);
+  ogg_stream_init(&other, OTHER_SERIALNO);
+  ncontinued = 0;
+  /*The first header packet goes on a page of its own.*/
+  if (daala_encode_flush_header(enc, &dc, &op) > 0) {
+    ogg_stream_packetin(&os, &op);
+    while (ogg_stream_flush(&os, &og) > 0) add_page(file, idx, &og);
+  }
+  add_other_page(file, idx, &other);
+  while (daala_encode_flush_header(enc, &dc, &op) > 0) {
+    ogg_stream_packetin(&os, &op);
+  }
+  while (ogg_stream_flush(&os, &og) > 0) add_page(file, idx, &og);
+  img.nplanes = 3;
+  img.width = di.pic_width;
+  img.height = di.pic_height;
+  for (pli = 0; pli < 3; pli++) {
+    img.planes[pli].xdec = img.planes[pli].ydec = pli > 0;
+    img.planes[pli].xstride = 1;
+    img.planes[pli].ystride = img.width >> (pli > 0);
+    img.planes[pli].data = (unsigned char *)malloc(
+     img.planes[pli].ystride*(img.height >> (pli > 0)));
+  }
+  for (f = 0; f < NFRAMES; f++) {
+    od_test_fill_frame(&img, img.width, img.height, f);
+    daala_encode_img_in(enc, &img, 0);
+    while (daala_encode_packet_out(enc, f == NFRAMES - 1, &op) > 0) {
+      packet_hashes[f] = od_test_hash(OD_TEST_HASH_INIT, op.packet, op.bytes);
+      ogg_stream_packetin(&os, &op);
+      while (ogg_stream_pageout_fill(&os, &og, PAGE_FILL) > 0) {
+        ncontinued += ogg_page_continued(&og) != 0;
+        add_page(file, idx, &og);
+        if (f % 3 == 0) add_other_page(file, idx, &other);
+      }
+    }
+  }
+  while (ogg_stream_flush(&os, &og) > 0) add_page(file, idx, &og);
+  for (pli = 0; pli < 3; pli++) free(img.planes[pli].data);
+  ogg_stream_clear(&other);
+  ogg_stream_clear(&os);
+  daala_encode_free(enc);
+  return ncontinued;
+}
+
+/*Reads the file from offset, discards skip packets, and checks that the
+   packets that follow are those of frames keyframe through frame.*/
+static void check_seek(const file_buf *file, int64_t keyframe,
+ int64_t offset, int skip, int64_t frame) {
+  ogg_sync_state oy;
+  ogg_stream_state os;
+  ogg_page og;
+  ogg_packet op;
+  int64_t next;
+  char *buf;
+  ogg_sync_init(&oy);
+  ogg_stream_init(&os, SERIALNO);
+  buf = ogg_sync_buffer(&oy, file->size - (long)offset);
+  memcpy(buf, file->data + offset, file->size - (long)offset);
+  ogg_sync_wrote(&oy, file->size - (long)offset);
+  next = keyframe;
+  while (next <= frame && ogg_sync_pageout(&oy, &og) > 0) {
+    int ret;
+    if (ogg_page_serialno(&og) != SERIALNO) continue;
+    ogg_stream_pagein(&os, &og);
+    while (next <= frame && (ret = ogg_stream_packetout(&os, &op)) != 0) {
+      if (ret < 0) continue;
+      if (skip > 0) {
+        skip--;
+        continue;
+      }
+      if (od_test_hash(OD_TEST_HASH_INIT, op.packet, op.bytes)
+       != packet_hashes[next]) {
+        fprintf(stderr, "Seeking to frame %li did not give frame %li.\n",
+         (long)frame, (long)next);
+        test_failed = 1;
+        next = frame;
+      }
+      next++;
+    }
+  }
+  if (next <= frame) {
+    fprintf(stderr, "Seeking to frame %li ran out of pages.\n", (long)frame);
+    test_failed = 1;
+  }
+  ogg_stream_clear(&os);
+  ogg_sync_clear(&oy);
+}
+
+int main(void) {
+  file_buf file;
+  daala_seek_index *idx;
+  daala_seek_index *loaded;
+  const unsigned char *saved;
+  unsigned char *copy;
+  int64_t keyframe;
+  int64_t offset;
+  int64_t frame;
+  int nskipped;
+  int size;
+  int skip;
+  fprintf(stderr, "Testing the keyframe seek index...\n");
+  memset(&file, 0, sizeof(file));
+  idx = daala_seek_index_alloc(SERIALNO);
+  if (build_file(&file, idx) == 0) {
+    fprintf(stderr, "No packet spans pages, so the test covers nothing.\n");
+    test_failed = 1;
+  }
+  size = daala_seek_index_save(idx, &saved);
+  if (size <= 0) {
+    fprintf(stderr, "Failed to save the index.\n");
+    return EXIT_FAILURE;
+  }
+  copy = (unsigned char *)malloc(size);
+  memcpy(copy, saved, size);
+  loaded = daala_seek_index_load(copy, size);
+  if (loaded == NULL) {
+    fprintf(stderr, "Failed to load the index.\n");
+    return EXIT_FAILURE;
+  }
+  nskipped = 0;
+  for (frame = 0; frame < NFRAMES; frame++) {
+    int64_t loaded_keyframe;
+    int64_t loaded_offset;
+    int loaded_skip;
+    if (daala_seek_index_lookup(idx, frame, &keyframe, &offset, &skip) != 0
+     || daala_seek_index_lookup(loaded, frame, &loaded_keyframe,
+     &loaded_offset, &loaded_skip) != 0) {
+      fprintf(stderr, "Failed to look up frame %li.\n", (long)frame);
+      test_failed = 1;
+      continue;
+    }
+    if (loaded_keyframe != keyframe || loaded_offset != offset
+     || loaded_skip != skip) {
+      fprintf(stderr, "The loaded index differs at frame %li.\n",
+       (long)frame);
+      test_failed = 1;
+    }
+    if (keyframe != frame - frame % KEYFRAME_RATE) {
+      fprintf(stderr, "Frame %li found keyframe %li.\n", (long)frame,
+       (long)keyframe);
+      test_failed = 1;
+    }
+    nskipped += skip > 0;
+    check_seek(&file, keyframe, offset, skip, frame);
+  }
+  if (nskipped == 0) {
+    fprintf(stderr, "No keyframe shares its page, so the test covers "
+     "nothing.\n");
+    test_failed = 1;
+  }
+  if (daala_seek_index_lookup(loaded, -1, &keyframe, &offset, &skip)
+   != OD_EINVAL) {
+    fprintf(stderr, "Found a keyframe before the first one.\n");
+    test_failed = 1;
+  }
+  /*The stream state the index was built with is not saved.*/
+  {
+    ogg_sync_state oy;
+    ogg_page og;
+    char *buf;
+    ogg_sync_init(&oy);
+    buf = ogg_sync_buffer(&oy, file.size);
+    memcpy(buf, file.data, file.size);
+    ogg_sync_wrote(&oy, file.size);
+    if (ogg_sync_pageout(&oy, &og) > 0
+     && daala_seek_index_add_page(loaded, &og, file.size) != OD_EINVAL) {
+      fprintf(stderr, "A loaded index accepted another page.\n");
+      test_failed = 1;
+    }
+    ogg_sync_clear(&oy);
+  }
+  /*Damaged indexes must be rejected.*/
+  if (daala_seek_index_load(copy, size - 1) != NULL) {
+    fprintf(stderr, "Loaded a truncated index.\n");
+    test_failed = 1;
+  }
+  copy[0] ^= 1;
+  if (daala_seek_index_load(copy, size) != NULL) {
+    fprintf(stderr, "Loaded an index with a bad magic number.\n");
+    test_failed = 1;
+  }
+  daala_seek_index_free(loaded);
+  daala_seek_index_free(idx);
+  free(copy);
+  free(file.data);
+  if (test_failed) return EXIT_FAILURE;
+  fprintf(stderr, "Passed!\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,329 @@
+/*Daala video codec
+Copyright (c) 2016 Daala project contributors.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+- Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+- Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS”
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/*Checks daala_encode_img_submit().
+  Frames queued in batches must encode to the same packets as the same
+   frames passed to daala_encode_img_in() one at a time, each release
+   callback must run exactly once, in order, by the time the frame's packet
+   comes out, and daala_encode_reset() and daala_encode_free() must release
+   the frames still queued.
+  Frames laid out like the encoder's own input buffer, submitted with
+   OD_SUBMIT_PADDED or passed to daala_encode_img_in() with
+   OD_SET_INPUT_PADDED, must also give the same packets.*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "daala/daalaenc.h"
+#include "test_util.h"
+
+#define NFRAMES (6)
+
+/*How the frames are given to the encoder.*/
+#define MODE_IMG_IN (0)
+#define MODE_SUBMIT (1)
+#define MODE_SUBMIT_PADDED (2)
+#define MODE_IMG_IN_PADDED (3)
+
+typedef struct {
+  /*The number of frames submitted so far.*/
+  int nsubmitted;
+  /*The number of release callbacks so far.*/
+  int nreleased;
+  /*The data pointer of each frame, in submission order.*/
+  unsigned char *data[NFRAMES];
+  int failed;
+} release_check;
+
+static int test_failed;
+
+static void release_img(void *ctx, od_img *img) {
+  release_check *rc;
+  rc = (release_check *)ctx;
+  if (rc->nreleased >= rc->nsubmitted
+   || img->planes[0].data != rc->data[rc->nreleased]) {
+    fprintf(stderr, "Release %i is out of order.\n", rc->nreleased);
+    rc->failed = 1;
+  }
+  rc->nreleased++;
+}
+
+static void count_release(void *ctx, od_img *img) {
+  (void)img;
+  (*(int *)ctx)++;
+}
+
+static daala_enc_ctx *create_encoder(int w, int h) {
+  daala_info di;
+  daala_enc_ctx *enc;
+  int quant;
+  int pli;
+  daala_info_init(&di);
+  di.pic_width = w;
+  di.pic_height = h;
+  di.pixel_aspect_numerator = 1;
+  di.pixel_aspect_denominator = 1;
+  di.timebase_numerator = 30;
+  di.timebase_denominator = 1;
+  di.frame_duration = 1;
+  di.keyframe_rate = 4;
+  di.nplanes = 3;
+  for (pli = 0; pli < 3; pli++) {
+    di.plane_info[pli].xdec = di.plane_info[pli].ydec = pli > 0;
+  }
+  enc = daala_encode_create(&di);
+  quant = 30;
+  daala_encode_ctl(enc, OD_SET_QUANT, &quant, sizeof(quant));
+  return enc;
+}
+
+/*Returns the number of packets, and adds them to *hash.*/
+static int drain_packets(daala_enc_ctx *enc, int last, unsigned long *hash,
+ int *neos) {
+  ogg_packet op;
+  int npackets;
+  npackets = 0;
+  while (daala_encode_packet_out(enc, last, &op) > 0) {
+    *hash = od_test_hash(*hash, op.packet, op.bytes);
+    *neos += op.e_o_s;
+    npackets++;
+  }
+  return npackets;
+}
+
+/*Encodes NFRAMES frames of w by h pixels and returns a hash of the packets.
+  With MODE_SUBMIT, the frames are queued batch at a time before draining
+   the packets.*/
+static unsigned long encode_stream(int w, int h, int mode, int batch) {
+  daala_enc_ctx *enc;
+  daala_comment dc;
+  ogg_packet op;
+  release_check rc;
+  od_img imgs[NFRAMES];
+  unsigned long hash;
+  int padded;
+  int npackets;
+  int neos;
+  int pad;
+  int fw;
+  int fh;
+  int pli;
+  int f;
+  enc = create_encoder(w, h);
+  padded = mode == MODE_SUBMIT_PADDED || mode == MODE_IMG_IN_PADDED;
+  pad = 0;
+  fw = w;
+  fh = h;
+  if (padded) {
+    daala_encode_ctl(enc, OD_GET_INPUT_PADDING, &pad, sizeof(pad));
+    fw = (w + 31) & ~31;
+    fh = (h + 31) & ~31;
+  }
+  if (mode == MODE_IMG_IN_PADDED) {
+    int one;
+    one = 1;
+    daala_encode_ctl(enc, OD_SET_INPUT_PADDED, &one, sizeof(one));
+  }
+  daala_comment_init(&dc);
+  hash = OD_TEST_HASH_INIT;
+  while (daala_encode_flush_header(enc, &dc, &op) > 0) {
+    hash = od_test_hash(hash, op.packet, op.bytes);
+  }
+  memset(&rc, 0, sizeof(rc));
+  /*Each frame gets its own buffers, so a frame released late or read after
+     its release would be noticed.*/
+  for (f = 0; f < NFRAMES; f++) {
+    imgs[f].nplanes = 3;
+    imgs[f].width = fw;
+    imgs[f].height = fh;
+    for (pli = 0; pli < 3; pli++) {
+      od_img_plane *p;
+      p = imgs[f].planes + pli;
+      p->xdec = p->ydec = pli > 0;
+      p->xstride = 1;
+      p->ystride = (fw + 2*pad) >> p->xdec;
+      p->data = (unsigned char *)malloc(p->ystride*((fh + 2*pad) >> p->ydec))
+       + (pad >> p->xdec) + p->ystride*(pad >> p->ydec);
+    }
+    od_test_fill_frame(imgs + f, w, h, f);
+  }
+  npackets = 0;
+  neos = 0;
+  for (f = 0; f < NFRAMES; f++) {
+    if (mode == MODE_IMG_IN || mode == MODE_IMG_IN_PADDED) {
+      if (daala_encode_img_in(enc, imgs + f, 0) != 0) {
+        fprintf(stderr, "Failed to encode frame %i.\n", f);
+        test_failed = 1;
+      }
+    }
+    else {
+      daala_img_release release;
+      release.func = release_img;
+      release.ctx = &rc;
+      rc.data[rc.nsubmitted++] = imgs[f].planes[0].data;
+      if (daala_encode_img_submit(enc, imgs + f, 0,
+       mode == MODE_SUBMIT_PADDED ? OD_SUBMIT_PADDED : 0, &release) != 0) {
+        fprintf(stderr, "Failed to submit frame %i.\n", f);
+        test_failed = 1;
+      }
+      if (daala_encode_img_in(enc, imgs + f, 0) != OD_EINVAL) {
+        fprintf(stderr, "daala_encode_img_in() accepted a frame while "
+         "others were queued.\n");
+        test_failed = 1;
+      }
+      if ((f + 1) % batch != 0 && f + 1 < NFRAMES) continue;
+    }
+    npackets += drain_packets(enc, f == NFRAMES - 1, &hash, &neos);
+    /*Every frame whose packet is out must have been released.*/
+    if (mode != MODE_IMG_IN && mode != MODE_IMG_IN_PADDED
+     && rc.nreleased != npackets) {
+      fprintf(stderr, "%i frames released after %i packets.\n",
+       rc.nreleased, npackets);
+      test_failed = 1;
+    }
+  }
+  if (npackets != NFRAMES || neos != 1) {
+    fprintf(stderr, "Got %i packets and %i end-of-stream flags.\n",
+     npackets, neos);
+    test_failed = 1;
+  }
+  if (rc.failed) test_failed = 1;
+  daala_encode_free(enc);
+  for (f = 0; f < NFRAMES; f++) {
+    for (pli = 0; pli < 3; pli++) {
+      od_img_plane *p;
+      p = imgs[f].planes + pli;
+      free(p->data - (pad >> p->xdec) - p->ystride*(pad >> p->ydec));
+    }
+  }
+  return hash;
+}
+
+static void test_stream(int w, int h) {
+  unsigned long ref;
+  int batch;
+  fprintf(stderr, "  %ix%i...\n", w, h);
+  ref = encode_stream(w, h, MODE_IMG_IN, 1);
+  for (batch = 1; batch <= NFRAMES; batch *= 2) {
+    if (encode_stream(w, h, MODE_SUBMIT, batch) != ref) {
+      fprintf(stderr, "Queued frames in batches of %i changed the stream.\n",
+       batch);
+      test_failed = 1;
+    }
+    if (encode_stream(w, h, MODE_SUBMIT_PADDED, batch) != ref) {
+      fprintf(stderr, "Queued padded frames in batches of %i changed the "
+       "stream.\n", batch);
+      test_failed = 1;
+    }
+  }
+  if (encode_stream(w, h, MODE_IMG_IN_PADDED, 1) != ref) {
+    fprintf(stderr, "OD_SET_INPUT_PADDED changed the stream.\n");
+    test_failed = 1;
+  }
+}
+
+/*Frames still queued must be released by a reset or free, and the queue
+   must be usable again after a reset.*/
+static void test_drop(void) {
+  daala_enc_ctx *enc;
+  od_img img;
+  daala_img_release release;
+  int nreleased;
+  int pli;
+  int f;
+  fprintf(stderr, "  Dropping queued frames...\n");
+  enc = create_encoder(64, 64);
+  img.nplanes = 3;
+  img.width = 64;
+  img.height = 64;
+  for (pli = 0; pli < 3; pli++) {
+    od_img_plane *p;
+    p = img.planes + pli;
+    p->xdec = p->ydec = pli > 0;
+    p->xstride = 1;
+    p->ystride = 64 >> p->xdec;
+    p->data = (unsigned char *)malloc(64*64);
+  }
+  od_test_fill_frame(&img, 64, 64, 0);
+  nreleased = 0;
+  release.func = count_release;
+  release.ctx = &nreleased;
+  /*The strides leave no room for the padding, so this layout must be
+     refused where a padded one is required.*/
+  if (daala_encode_img_submit(enc, &img, 0, OD_SUBMIT_PADDED, &release)
+   != OD_EINVAL) {
+    fprintf(stderr, "An unpadded frame was queued with OD_SUBMIT_PADDED.\n");
+    test_failed = 1;
+  }
+  for (f = 0; f < OD_SUBMIT_QUEUE_MAX; f++) {
+    if (daala_encode_img_submit(enc, &img, 0, 0, &release) != 0) {
+      fprintf(stderr, "Failed to queue frame %i.\n", f);
+      test_failed = 1;
+    }
+  }
+  if (daala_encode_img_submit(enc, &img, 0, 0, &release) != OD_EINVAL) {
+    fprintf(stderr, "A frame was queued past OD_SUBMIT_QUEUE_MAX.\n");
+    test_failed = 1;
+  }
+  if (nreleased != 0) {
+    fprintf(stderr, "A frame was released while still queued.\n");
+    test_failed = 1;
+  }
+  if (daala_encode_reset(enc, NULL) != 0
+   || nreleased != OD_SUBMIT_QUEUE_MAX) {
+    fprintf(stderr, "The reset released %i of %i queued frames.\n",
+     nreleased, OD_SUBMIT_QUEUE_MAX);
+    test_failed = 1;
+  }
+  nreleased = 0;
+  for (f = 0; f < 3; f++) {
+    if (daala_encode_img_submit(enc, &img, 0, 0, &release) != 0) {
+      fprintf(stderr, "Failed to queue a frame after the reset.\n");
+      test_failed = 1;
+    }
+  }
+  daala_encode_free(enc);
+  if (nreleased != 3) {
+    fprintf(stderr, "Freeing the encoder released %i of 3 queued frames.\n",
+     nreleased);
+    test_failed = 1;
+  }
+  for (pli = 0; pli < 3; pli++) free(img.planes[pli].data);
+}
+
+int main(void) {
+  fprintf(stderr, "Testing queued frame submission...\n");
+  test_stream(176, 144);
+  /*A size that is not a multiple of the superblock size.*/
+  test_stream(100, 70);
+  test_drop();
+  if (test_failed) return EXIT_FAILURE;
+  fprintf(stderr, "Passed!\n");
+  return EXIT_SUCCESS;
+}
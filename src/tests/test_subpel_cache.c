@@ -0,0 +1,164 @@
+/*Daala video codec
+Copyright (c) 2016 Daala project contributors.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+- Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+- Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS”
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/*Checks that OD_SET_MC_SUBPEL_CACHE does not change the encoded stream.
+  Each stream is encoded with the cache on and off, at every minimum motion
+   vector resolution, and the packets must be identical.
+  The cache must be allocated by the ctl that turns it on, never while
+   encoding a frame, and freed by the one that turns it off.*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "daala/daalaenc.h"
+#include "test_util.h"
+
+#define NFRAMES (4)
+
+static int test_failed;
+
+/*Encodes a stream and returns a hash of its packets.
+  *nframe_allocs is set to the number of allocations made while encoding the
+   frames.*/
+static unsigned long encode_stream(int w, int h, int dec_shift, int mv_res_min,
+ int cache, long *nframe_allocs) {
+  daala_info di;
+  daala_comment dc;
+  daala_enc_ctx *enc;
+  daala_allocator alloc;
+  od_test_alloc_counter ac;
+  ogg_packet op;
+  od_img img;
+  unsigned long hash;
+  long nlive;
+  int quant;
+  int pli;
+  int f;
+  daala_info_init(&di);
+  di.pic_width = w;
+  di.pic_height = h;
+  di.pixel_aspect_numerator = 1;
+  di.pixel_aspect_denominator = 1;
+  di.timebase_numerator = 30;
+  di.timebase_denominator = 1;
+  di.frame_duration = 1;
+  di.keyframe_rate = 256;
+  di.nplanes = 3;
+  for (pli = 0; pli < 3; pli++) {
+    di.plane_info[pli].xdec = di.plane_info[pli].ydec = pli ? dec_shift : 0;
+  }
+  daala_comment_init(&dc);
+  od_test_alloc_init(&alloc, &ac);
+  enc = daala_encode_create_with_allocator(&di, &alloc);
+  quant = 20;
+  daala_encode_ctl(enc, OD_SET_QUANT, &quant, sizeof(quant));
+  daala_encode_ctl(enc, OD_SET_MV_RES_MIN, &mv_res_min, sizeof(mv_res_min));
+  nlive = ac.nlive;
+  if (daala_encode_ctl(enc, OD_SET_MC_SUBPEL_CACHE, &cache, sizeof(cache))
+   != 0 || (cache && ac.nlive <= nlive)) {
+    fprintf(stderr, "Failed to allocate the sub-pel cache.\n");
+    test_failed = 1;
+  }
+  hash = OD_TEST_HASH_INIT;
+  while (daala_encode_flush_header(enc, &dc, &op) > 0) {
+    hash = od_test_hash(hash, op.packet, op.bytes);
+  }
+  img.nplanes = 3;
+  img.width = w;
+  img.height = h;
+  for (pli = 0; pli < 3; pli++) {
+    int d;
+    d = pli ? dec_shift : 0;
+    img.planes[pli].xdec = img.planes[pli].ydec = d;
+    img.planes[pli].xstride = 1;
+    img.planes[pli].ystride = (w + (1 << d) - 1) >> d;
+    img.planes[pli].data = (unsigned char *)malloc(
+     img.planes[pli].ystride*((h + (1 << d) - 1) >> d));
+  }
+  *nframe_allocs = 0;
+  for (f = 0; f < NFRAMES; f++) {
+    long nallocs;
+    od_test_fill_frame(&img, w, h, f);
+    nallocs = ac.nallocs;
+    daala_encode_img_in(enc, &img, 0);
+    *nframe_allocs += ac.nallocs - nallocs;
+    while (daala_encode_packet_out(enc, f == NFRAMES - 1, &op) > 0) {
+      hash = od_test_hash(hash, op.packet, op.bytes);
+    }
+  }
+  for (pli = 0; pli < 3; pli++) free(img.planes[pli].data);
+  /*Turning the cache off must give all of its memory back.*/
+  if (cache) {
+    int off;
+    off = 0;
+    daala_encode_ctl(enc, OD_SET_MC_SUBPEL_CACHE, &off, sizeof(off));
+    if (ac.nlive != nlive) {
+      fprintf(stderr, "Turning the sub-pel cache off kept %li blocks.\n",
+       ac.nlive - nlive);
+      test_failed = 1;
+    }
+  }
+  daala_encode_free(enc);
+  return hash;
+}
+
+static void test_stream(int w, int h, int dec_shift) {
+  int mv_res_min;
+  for (mv_res_min = 0; mv_res_min <= 2; mv_res_min++) {
+    unsigned long h_off;
+    unsigned long h_on;
+    long nallocs_off;
+    long nallocs_on;
+    fprintf(stderr, "  %ix%i, decimation %i, mv_res_min %i...\n",
+     w, h, dec_shift, mv_res_min);
+    h_off = encode_stream(w, h, dec_shift, mv_res_min, 0, &nallocs_off);
+    h_on = encode_stream(w, h, dec_shift, mv_res_min, 1, &nallocs_on);
+    if (h_on != h_off) {
+      fprintf(stderr, "The sub-pel cache changed the stream.\n");
+      test_failed = 1;
+    }
+    /*Both streams grow their output buffers the same way, so any other
+       allocation while encoding came from the cache.*/
+    if (nallocs_on != nallocs_off) {
+      fprintf(stderr, "The sub-pel cache allocated %li blocks while "
+       "encoding.\n", nallocs_on - nallocs_off);
+      test_failed = 1;
+    }
+  }
+}
+
+int main(void) {
+  fprintf(stderr, "Testing the sub-pel motion search cache...\n");
+  test_stream(128, 96, 1);
+  /*A size that is not a multiple of the superblock size and 4:4:4.*/
+  test_stream(100, 70, 0);
+  if (test_failed) return EXIT_FAILURE;
+  fprintf(stderr, "Passed!\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,88 @@
+/*Daala video codec
+Copyright (c) 2016 Daala project contributors.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+- Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+- Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS”
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include "test_util.h"
+
+unsigned long od_test_hash(unsigned long h, const unsigned char *p, long n) {
+  long i;
+  for (i = 0; i < n; i++) {
+    h ^= p[i];
+    h = h*16777619UL & 0xFFFFFFFFUL;
+  }
+  return h;
+}
+
+void od_test_fill_frame(od_img *img, int w, int h, int frame) {
+  int pli;
+  for (pli = 0; pli < img->nplanes; pli++) {
+    od_img_plane *p;
+    int pw;
+    int ph;
+    int x;
+    int y;
+    p = img->planes + pli;
+    pw = (w + (1 << p->xdec) - 1) >> p->xdec;
+    ph = (h + (1 << p->ydec) - 1) >> p->ydec;
+    for (y = 0; y < ph; y++) {
+      for (x = 0; x < pw; x++) {
+        int xx;
+        int yy;
+        xx = (x << p->xdec) + 3*frame;
+        yy = (y << p->ydec) + frame;
+        p->data[y*p->ystride + x*p->xstride] = (unsigned char)(
+         (xx*xx + 3*yy*yy)/37 + ((xx/8 + yy/8) & 1)*40 + 16*pli
+         + ((xx*7 + yy*13) & 7));
+      }
+    }
+  }
+}
+
+static void *od_test_alloc(void *ctx, size_t size) {
+  od_test_alloc_counter *ac;
+  ac = (od_test_alloc_counter *)ctx;
+  ac->nallocs++;
+  ac->nlive++;
+  return malloc(size);
+}
+
+static void od_test_release(void *ctx, void *ptr) {
+  od_test_alloc_counter *ac;
+  ac = (od_test_alloc_counter *)ctx;
+  ac->nlive--;
+  free(ptr);
+}
+
+void od_test_alloc_init(daala_allocator *alloc, od_test_alloc_counter *ac) {
+  ac->nallocs = 0;
+  ac->nlive = 0;
+  alloc->alloc = od_test_alloc;
+  alloc->release = od_test_release;
+  alloc->ctx = ac;
+}
@@ -0,0 +1,58 @@
+/*Daala video codec
+Copyright (c) 2016 Daala project contributors.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+- Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+- Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS”
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+
+#if !defined(_tests_test_util_H)
+# define _tests_test_util_H (1)
+
+/*Helpers shared by the tests that run whole streams through the codec.*/
+
+# include <stddef.h>
+# include "daala/codec.h"
+
+/*The initial value of a hash computed with od_test_hash().*/
+# define OD_TEST_HASH_INIT (2166136261UL)
+
+/*Counts the calls made to an allocator set up by od_test_alloc_init().*/
+typedef struct od_test_alloc_counter od_test_alloc_counter;
+
+struct od_test_alloc_counter {
+  /*The number of calls to alloc.*/
+  long nallocs;
+  /*The number of blocks not yet released.*/
+  long nlive;
+};
+
+/*Adds n bytes to a 32-bit FNV-1a hash, and returns the new hash.*/
+unsigned long od_test_hash(unsigned long h, const unsigned char *p, long n);
+/*Fills the top-left w by h pixels of each plane of an image with frame number
+   frame of a deterministic test sequence.
+  The sequence has both smooth gradients and fine texture, and moves a little
+   from frame to frame, so that it exercises intra and inter coding alike.*/
+void od_test_fill_frame(od_img *img, int w, int h, int frame);
+/*Sets up alloc to count its calls in ac, which is cleared, and to get its
+   memory from the C library heap.*/
+void od_test_alloc_init(daala_allocator *alloc, od_test_alloc_counter *ac);
+
+#endif
@@ -0,0 +1,200 @@
+/*Daala video codec
+Copyright (c) 2016 Daala project contributors.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+- Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+- Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+
+#if defined(HAVE_CONFIG_H)
+# include "config.h"
+#endif
+
+#include <immintrin.h>
+#include "x86int.h"
+#include "../filter.h"
+
+/*Filters eight pixels with the constrained lowpass filter, given their four
+   neighbors.*/
+OD_SIMD_INLINE __m256i od_clpf_kernel_avx2(__m256i x, __m256i a, __m256i b,
+ __m256i c, __m256i d) {
+  __m256i sum;
+  __m256i delta;
+  __m256i off;
+  sum = _mm256_add_epi32(_mm256_add_epi32(a, b), _mm256_add_epi32(c, d));
+  sum = _mm256_sub_epi32(sum, _mm256_slli_epi32(x, 2));
+  delta = _mm256_abs_epi32(sum);
+  /*Turn off the filter above a threshold of 16 pixels.*/
+  off = _mm256_cmpgt_epi32(delta, _mm256_set1_epi32(16 << OD_COEFF_SHIFT));
+  delta = _mm256_srai_epi32(_mm256_add_epi32(delta, _mm256_set1_epi32(2)), 2);
+  delta = _mm256_min_epi32(delta, _mm256_set1_epi32(1 << OD_COEFF_SHIFT));
+  delta = _mm256_andnot_si256(off, delta);
+  return _mm256_add_epi32(x, _mm256_sign_epi32(delta, sum));
+}
+
+/*Filters one row of n >= 16 pixels.
+  See od_clpf_row_sse41() for the handling of the frame edges.*/
+static void od_clpf_row_avx2(od_coeff *y, const od_coeff *x,
+ const od_coeff *a, const od_coeff *d, int n, int left, int right) {
+  __m256i xx;
+  __m256i bb;
+  __m256i cc;
+  int j;
+  xx = _mm256_loadu_si256((const __m256i *)x);
+  if (left) {
+    bb = _mm256_permutevar8x32_epi32(xx,
+     _mm256_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6));
+  }
+  else bb = _mm256_loadu_si256((const __m256i *)(x - 1));
+  cc = _mm256_loadu_si256((const __m256i *)(x + 1));
+  _mm256_storeu_si256((__m256i *)y, od_clpf_kernel_avx2(xx,
+   _mm256_loadu_si256((const __m256i *)a), bb, cc,
+   _mm256_loadu_si256((const __m256i *)d)));
+  for (j = 8; j < n - 8; j += 8) {
+    xx = _mm256_loadu_si256((const __m256i *)(x + j));
+    bb = _mm256_loadu_si256((const __m256i *)(x + j - 1));
+    cc = _mm256_loadu_si256((const __m256i *)(x + j + 1));
+    _mm256_storeu_si256((__m256i *)(y + j), od_clpf_kernel_avx2(xx,
+     _mm256_loadu_si256((const __m256i *)(a + j)), bb, cc,
+     _mm256_loadu_si256((const __m256i *)(d + j))));
+  }
+  xx = _mm256_loadu_si256((const __m256i *)(x + j));
+  bb = _mm256_loadu_si256((const __m256i *)(x + j - 1));
+  if (right) {
+    cc = _mm256_permutevar8x32_epi32(xx,
+     _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 7));
+  }
+  else cc = _mm256_loadu_si256((const __m256i *)(x + j + 1));
+  _mm256_storeu_si256((__m256i *)(y + j), od_clpf_kernel_avx2(xx,
+   _mm256_loadu_si256((const __m256i *)(a + j)), bb, cc,
+   _mm256_loadu_si256((const __m256i *)(d + j))));
+}
+
+void od_clpf_avx2(od_coeff *y, int ystride, const od_coeff *x, int xstride,
+ int ln, int sbx, int sby, int nhsb, int nvsb) {
+  int i;
+  int n;
+  n = 1 << ln;
+  if (n < 16) {
+    od_clpf_c(y, ystride, x, xstride, ln, sbx, sby, nhsb, nvsb);
+    return;
+  }
+  for (i = 0; i < n; i++) {
+    const od_coeff *row;
+    row = x + i*xstride;
+    od_clpf_row_avx2(y + i*ystride, row,
+     sby > 0 || i > 0 ? row - xstride : row,
+     sby < nvsb - 1 || i < n - 1 ? row + xstride : row,
+     n, sbx == 0, sbx == nhsb - 1);
+  }
+#if defined(OD_CHECKASM)
+  {
+    od_coeff ref[OD_BSIZE_MAX*OD_BSIZE_MAX];
+    od_clpf_c(ref, OD_BSIZE_MAX, x, xstride, ln, sbx, sby, nhsb, nvsb);
+    od_filter_check("od_clpf", ref, OD_BSIZE_MAX, y, ystride, n);
+  }
+#endif
+}
+
+/*Evaluates eight pixels of the bilinear surface of a row.
+  See od_bilinear_pred_sse41().*/
+OD_SIMD_INLINE __m256i od_bilinear_pred_avx2(__m256i jj, __m256i a0,
+ __m256i a1, __m256i ia3, __m256i base, __m128i shift) {
+  __m256i t;
+  t = _mm256_sra_epi32(_mm256_mullo_epi32(jj, ia3), shift);
+  t = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(jj, a1), base), t);
+  return _mm256_add_epi32(a0, _mm256_sra_epi32(t, shift));
+}
+
+void od_bilinear_smooth_avx2(od_coeff *x, int ln, int stride, int q,
+ int pli) {
+  od_coeff a[4];
+  __m256i a0;
+  __m256i a1;
+  __m128i shift;
+  __m256i dist;
+  __m128i dist4;
+  __m256i ww;
+  __m256i jj;
+  int w;
+  int i;
+  int j;
+  int n;
+#if defined(OD_CHECKASM)
+  od_coeff ref[OD_BSIZE_MAX*OD_BSIZE_MAX];
+#endif
+  n = 1 << ln;
+  if (n < 8) {
+    od_bilinear_smooth_c(x, ln, stride, q, pli);
+    return;
+  }
+#if defined(OD_CHECKASM)
+  for (i = 0; i < n; i++) OD_COPY(ref + i*OD_BSIZE_MAX, x + i*stride, n);
+  od_bilinear_smooth_c(ref, ln, OD_BSIZE_MAX, q, pli);
+#endif
+  od_bilinear_smooth_coeffs(a, x, ln, stride);
+  a0 = _mm256_set1_epi32(a[0]);
+  a1 = _mm256_set1_epi32(a[1]);
+  shift = _mm_cvtsi32_si128(ln);
+  dist = _mm256_setzero_si256();
+  for (i = 0; i < n; i++) {
+    __m256i base;
+    __m256i ia3;
+    base = _mm256_set1_epi32(i*a[2] + n/2);
+    ia3 = _mm256_set1_epi32(i*a[3]);
+    jj = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    for (j = 0; j < n; j += 8) {
+      __m256i diff;
+      diff = _mm256_sub_epi32(od_bilinear_pred_avx2(jj, a0, a1, ia3, base,
+       shift), _mm256_loadu_si256((__m256i *)(x + i*stride + j)));
+      dist = _mm256_add_epi32(dist, _mm256_mullo_epi32(diff, diff));
+      jj = _mm256_add_epi32(jj, _mm256_set1_epi32(8));
+    }
+  }
+  dist4 = _mm_add_epi32(_mm256_castsi256_si128(dist),
+   _mm256_extracti128_si256(dist, 1));
+  dist4 = _mm_add_epi32(dist4, _mm_shuffle_epi32(dist4,
+   _MM_SHUFFLE(1, 0, 3, 2)));
+  dist4 = _mm_add_epi32(dist4, _mm_shuffle_epi32(dist4,
+   _MM_SHUFFLE(2, 3, 0, 1)));
+  w = od_bilinear_smooth_weight(_mm_cvtsi128_si32(dist4) >> 2*ln, q, pli);
+  ww = _mm256_set1_epi32(w);
+  for (i = 0; i < n; i++) {
+    __m256i base;
+    __m256i ia3;
+    base = _mm256_set1_epi32(i*a[2] + n/2);
+    ia3 = _mm256_set1_epi32(i*a[3]);
+    jj = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    for (j = 0; j < n; j += 8) {
+      __m256i xx;
+      __m256i t;
+      xx = _mm256_loadu_si256((__m256i *)(x + i*stride + j));
+      t = _mm256_sub_epi32(xx, od_bilinear_pred_avx2(jj, a0, a1, ia3, base,
+       shift));
+      t = _mm256_add_epi32(_mm256_mullo_epi32(ww, t), _mm256_set1_epi32(128));
+      _mm256_storeu_si256((__m256i *)(x + i*stride + j),
+       _mm256_sub_epi32(xx, _mm256_srai_epi32(t, 8)));
+      jj = _mm256_add_epi32(jj, _mm256_set1_epi32(8));
+    }
+  }
+#if defined(OD_CHECKASM)
+  od_filter_check("od_bilinear_smooth", ref, OD_BSIZE_MAX, x, stride, n);
+#endif
+}
@@ -0,0 +1,99 @@
+/*Daala video codec
+Copyright (c) 2016 Daala project contributors.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+- Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+- Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+
+#if defined(HAVE_CONFIG_H)
+# include "config.h"
+#endif
+
+#include "x86enc.h"
+
+#if defined(OD_SSE2_INTRINSICS)
+# include <emmintrin.h>
+# include "x86int.h"
+
+/*Sign-extends the low (hi = 0) or high (hi = 1) eight bytes of x to 16 bits.*/
+#define OD_SSE2_EXTEND_EPI8(x, hi) \
+  _mm_srai_epi16(hi ? _mm_unpackhi_epi8(x, x) : _mm_unpacklo_epi8(x, x), 8)
+
+/*Computes the sums and sums of squares of eight 2x2 blocks, given the 16
+   signed values in each of the two rows.*/
+OD_SIMD_INLINE void od_bs_sums_2x2_kernel_sse2(int32_t *sx2, int32_t *sxx2,
+ __m128i r0, __m128i r1) {
+  __m128i ones;
+  __m128i a;
+  __m128i b;
+  ones = _mm_set1_epi16(1);
+  a = OD_SSE2_EXTEND_EPI8(r0, 0);
+  b = OD_SSE2_EXTEND_EPI8(r1, 0);
+  _mm_storeu_si128((__m128i *)sx2,
+   _mm_madd_epi16(_mm_add_epi16(a, b), ones));
+  _mm_storeu_si128((__m128i *)sxx2,
+   _mm_add_epi32(_mm_madd_epi16(a, a), _mm_madd_epi16(b, b)));
+  a = OD_SSE2_EXTEND_EPI8(r0, 1);
+  b = OD_SSE2_EXTEND_EPI8(r1, 1);
+  _mm_storeu_si128((__m128i *)(sx2 + 4),
+   _mm_madd_epi16(_mm_add_epi16(a, b), ones));
+  _mm_storeu_si128((__m128i *)(sxx2 + 4),
+   _mm_add_epi32(_mm_madd_epi16(a, a), _mm_madd_epi16(b, b)));
+}
+
+void od_bs_sums_2x2_sse2(int32_t *sx2, int32_t *sxx2,
+ const unsigned char *img, int istride, const unsigned char *pred,
+ int pstride, int n) {
+  __m128i bias;
+  int j;
+  /*Flipping the top bit maps [0, 255] to [-128, 127], and the saturating
+     signed subtraction of two such values is the clamped residual.*/
+  bias = _mm_set1_epi8((char)0x80);
+  if (pred == NULL) {
+    for (j = 0; j + 8 <= n; j += 8) {
+      od_bs_sums_2x2_kernel_sse2(sx2 + j, sxx2 + j,
+       _mm_xor_si128(_mm_loadu_si128((const __m128i *)(img + 2*j)), bias),
+       _mm_xor_si128(_mm_loadu_si128(
+       (const __m128i *)(img + istride + 2*j)), bias));
+    }
+  }
+  else {
+    for (j = 0; j + 8 <= n; j += 8) {
+      __m128i r0;
+      __m128i r1;
+      r0 = _mm_subs_epi8(
+       _mm_xor_si128(_mm_loadu_si128((const __m128i *)(img + 2*j)), bias),
+       _mm_xor_si128(_mm_loadu_si128((const __m128i *)(pred + 2*j)), bias));
+      r1 = _mm_subs_epi8(
+       _mm_xor_si128(_mm_loadu_si128(
+       (const __m128i *)(img + istride + 2*j)), bias),
+       _mm_xor_si128(_mm_loadu_si128(
+       (const __m128i *)(pred + pstride + 2*j)), bias));
+      od_bs_sums_2x2_kernel_sse2(sx2 + j, sxx2 + j, r0, r1);
+    }
+  }
+  if (j < n) {
+    od_bs_sums_2x2_c(sx2 + j, sxx2 + j, img + 2*j, istride,
+     pred == NULL ? NULL : pred + 2*j, pstride, n - j);
+  }
+}
+
+#endif
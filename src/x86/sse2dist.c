@@ -0,0 +1,246 @@
+/*Daala video codec
+Copyright (c) 2016 Daala project contributors.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+- Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+- Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+
+#if defined(HAVE_CONFIG_H)
+# include "config.h"
+#endif
+
+#include "x86enc.h"
+
+#if defined(OD_SSE2_INTRINSICS)
+# include <stdlib.h>
+# include <string.h>
+# include <emmintrin.h>
+# include "x86int.h"
+
+/*Computes the sum of squared errors over n contiguous coefficients, with n a
+   multiple of 4.
+  The squares are accumulated exactly in 64-bit integers, so the result is
+   identical to the C version.*/
+double od_compute_sse_sse2(const od_coeff *x, const od_coeff *y, int n) {
+  __m128i sum;
+  int64_t out[2];
+  int i;
+  OD_ASSERT((n & 3) == 0);
+  sum = _mm_setzero_si128();
+  for (i = 0; i < n; i += 4) {
+    __m128i d;
+    __m128i s;
+    d = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(x + i)),
+     _mm_loadu_si128((const __m128i *)(y + i)));
+    /*SSE2 only has an unsigned 32x32->64 bit multiply, so square |d|.*/
+    s = _mm_srai_epi32(d, 31);
+    d = _mm_sub_epi32(_mm_xor_si128(d, s), s);
+    sum = _mm_add_epi64(sum, _mm_mul_epu32(d, d));
+    d = _mm_srli_epi64(d, 32);
+    sum = _mm_add_epi64(sum, _mm_mul_epu32(d, d));
+  }
+  _mm_storeu_si128((__m128i *)out, sum);
+  return (double)(out[0] + out[1]);
+}
+
+/*Computes the sum of the squared 8x8 transform coefficients in et, each
+   scaled by the matching entry of w.
+  This sums in a different order than the C version, so the result may differ
+   in the last few bits.*/
+double od_compute_weighted_sse_8x8_sse2(const od_coeff *et, const double *w) {
+  __m128d sum0;
+  __m128d sum1;
+  double out[2];
+  int i;
+  sum0 = _mm_setzero_pd();
+  sum1 = _mm_setzero_pd();
+  for (i = 0; i < 8*8; i += 4) {
+    __m128i e;
+    __m128d e0;
+    __m128d e1;
+    e = _mm_loadu_si128((const __m128i *)(et + i));
+    e0 = _mm_cvtepi32_pd(e);
+    e1 = _mm_cvtepi32_pd(_mm_shuffle_epi32(e, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum0 = _mm_add_pd(sum0,
+     _mm_mul_pd(_mm_mul_pd(e0, e0), _mm_loadu_pd(w + i)));
+    sum1 = _mm_add_pd(sum1,
+     _mm_mul_pd(_mm_mul_pd(e1, e1), _mm_loadu_pd(w + i + 2)));
+  }
+  sum0 = _mm_add_pd(sum0, sum1);
+  _mm_storeu_pd(out, sum0);
+  return out[0] + out[1];
+}
+
+/*Loads 4 bytes from an unaligned address into the low lane.*/
+OD_SIMD_INLINE __m128i od_load4_si128(const unsigned char *p) {
+  int32_t v;
+  memcpy(&v, p, sizeof(v));
+  return _mm_cvtsi32_si128(v);
+}
+
+/*Adds the two 64-bit halves of a psadbw accumulator.*/
+OD_SIMD_INLINE int od_hsum_sad_epi64(__m128i sum) {
+  sum = _mm_add_epi64(sum, _mm_unpackhi_epi64(sum, sum));
+  return _mm_cvtsi128_si32(sum);
+}
+
+/*Computes the SAD of a single row of w pixels, using the widest loads that
+   fit.*/
+OD_SIMD_INLINE __m128i od_mc_sad_row_sse2(__m128i sum,
+ const unsigned char *src, const unsigned char *ref, int w, int *tail) {
+  int i;
+  for (i = 0; i + 16 <= w; i += 16) {
+    sum = _mm_add_epi64(sum,
+     _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(src + i)),
+     _mm_loadu_si128((const __m128i *)(ref + i))));
+  }
+  if (i + 8 <= w) {
+    sum = _mm_add_epi64(sum,
+     _mm_sad_epu8(_mm_loadl_epi64((const __m128i *)(src + i)),
+     _mm_loadl_epi64((const __m128i *)(ref + i))));
+    i += 8;
+  }
+  if (i + 4 <= w) {
+    sum = _mm_add_epi64(sum,
+     _mm_sad_epu8(od_load4_si128(src + i), od_load4_si128(ref + i)));
+    i += 4;
+  }
+  for (; i < w; i++) *tail += abs(src[i] - ref[i]);
+  return sum;
+}
+
+int od_mc_compute_sad_32x32_xstride_1_sse2(const unsigned char *src,
+ int systride, const unsigned char *ref, int dystride) {
+  __m128i sum0;
+  __m128i sum1;
+  int ret;
+  int j;
+  sum0 = _mm_setzero_si128();
+  sum1 = _mm_setzero_si128();
+  for (j = 0; j < 32; j++) {
+    sum0 = _mm_add_epi64(sum0,
+     _mm_sad_epu8(_mm_loadu_si128((const __m128i *)src),
+     _mm_loadu_si128((const __m128i *)ref)));
+    sum1 = _mm_add_epi64(sum1,
+     _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(src + 16)),
+     _mm_loadu_si128((const __m128i *)(ref + 16))));
+    src += systride;
+    ref += dystride;
+  }
+  ret = od_hsum_sad_epi64(_mm_add_epi64(sum0, sum1));
+#if defined(OD_CHECKASM)
+  od_mc_compute_sad_check(src - 32*systride, systride, ref - 32*dystride,
+   dystride, 1, 32, 32, ret);
+#endif
+  return ret;
+}
+
+/*Handles blocks of any size, e.g., those clipped against the picture edge.*/
+int od_mc_compute_sad_xstride_1_sse2(const unsigned char *src, int systride,
+ const unsigned char *ref, int dystride, int w, int h) {
+  __m128i sum;
+  int tail;
+  int ret;
+  int j;
+  sum = _mm_setzero_si128();
+  tail = 0;
+  for (j = 0; j < h; j++) {
+    sum = od_mc_sad_row_sse2(sum, src + j*systride, ref + j*dystride, w,
+     &tail);
+  }
+  ret = od_hsum_sad_epi64(sum) + tail;
+#if defined(OD_CHECKASM)
+  od_mc_compute_sad_check(src, systride, ref, dystride, 1, w, h, ret);
+#endif
+  return ret;
+}
+
+/*Computes the SADs of one source block against four predictors that share
+   the same stride.
+  Each row of the source is loaded once and compared against all four.*/
+void od_mc_compute_sad4_xstride_1_sse2(int32_t sad[4],
+ const unsigned char *src, int systride, const unsigned char *const ref[4],
+ int dystride, int w, int h) {
+  __m128i sum[4];
+  int tail[4];
+  int j;
+  int k;
+  for (k = 0; k < 4; k++) {
+    sum[k] = _mm_setzero_si128();
+    tail[k] = 0;
+  }
+  if ((w & 15) == 0) {
+    for (j = 0; j < h; j++) {
+      const unsigned char *s;
+      ptrdiff_t o;
+      int i;
+      s = src + j*systride;
+      o = (ptrdiff_t)j*dystride;
+      for (i = 0; i < w; i += 16) {
+        __m128i a;
+        a = _mm_loadu_si128((const __m128i *)(s + i));
+        sum[0] = _mm_add_epi64(sum[0], _mm_sad_epu8(a,
+         _mm_loadu_si128((const __m128i *)(ref[0] + o + i))));
+        sum[1] = _mm_add_epi64(sum[1], _mm_sad_epu8(a,
+         _mm_loadu_si128((const __m128i *)(ref[1] + o + i))));
+        sum[2] = _mm_add_epi64(sum[2], _mm_sad_epu8(a,
+         _mm_loadu_si128((const __m128i *)(ref[2] + o + i))));
+        sum[3] = _mm_add_epi64(sum[3], _mm_sad_epu8(a,
+         _mm_loadu_si128((const __m128i *)(ref[3] + o + i))));
+      }
+    }
+  }
+  else if (w == 8) {
+    for (j = 0; j < h; j++) {
+      const unsigned char *s;
+      ptrdiff_t o;
+      __m128i a;
+      s = src + j*systride;
+      o = (ptrdiff_t)j*dystride;
+      a = _mm_loadl_epi64((const __m128i *)s);
+      sum[0] = _mm_add_epi64(sum[0], _mm_sad_epu8(a,
+       _mm_loadl_epi64((const __m128i *)(ref[0] + o))));
+      sum[1] = _mm_add_epi64(sum[1], _mm_sad_epu8(a,
+       _mm_loadl_epi64((const __m128i *)(ref[1] + o))));
+      sum[2] = _mm_add_epi64(sum[2], _mm_sad_epu8(a,
+       _mm_loadl_epi64((const __m128i *)(ref[2] + o))));
+      sum[3] = _mm_add_epi64(sum[3], _mm_sad_epu8(a,
+       _mm_loadl_epi64((const __m128i *)(ref[3] + o))));
+    }
+  }
+  else {
+    /*Clipped or 4-wide blocks.*/
+    for (j = 0; j < h; j++) {
+      for (k = 0; k < 4; k++) {
+        sum[k] = od_mc_sad_row_sse2(sum[k], src + j*systride,
+         ref[k] + j*dystride, w, tail + k);
+      }
+    }
+  }
+  for (k = 0; k < 4; k++) {
+    sad[k] = od_hsum_sad_epi64(sum[k]) + tail[k];
+#if defined(OD_CHECKASM)
+    od_mc_compute_sad_check(src, systride, ref[k], dystride, 1, w, h, sad[k]);
+#endif
+  }
+}
+
+#endif
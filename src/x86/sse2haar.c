@@ -0,0 +1,177 @@
+/*Daala video codec
+Copyright (c) 2016 Daala project contributors.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+- Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+- Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+
+#if defined(HAVE_CONFIG_H)
+# include "config.h"
+#endif
+
+#include "x86int.h"
+
+#if defined(OD_SSE2_INTRINSICS)
+# include <emmintrin.h>
+# include "../tf.h"
+
+/*Applies OD_HAAR_KERNEL to four sets of coefficients at once.*/
+OD_SIMD_INLINE void od_haar_kernel_sse2(__m128i *ll, __m128i *lh,
+ __m128i *hl, __m128i *hh) {
+  __m128i llmhh_2;
+  *ll = _mm_add_epi32(*ll, *hl);
+  *hh = _mm_sub_epi32(*hh, *lh);
+  llmhh_2 = _mm_srai_epi32(_mm_sub_epi32(*ll, *hh), 1);
+  *lh = _mm_sub_epi32(llmhh_2, *lh);
+  *hl = _mm_sub_epi32(llmhh_2, *hl);
+  *ll = _mm_sub_epi32(*ll, *lh);
+  *hh = _mm_add_epi32(*hh, *hl);
+}
+
+/*Loads 8 consecutive coefficients and splits them into the even and odd
+   ones.*/
+OD_SIMD_INLINE void od_load_deinterleave_sse2(__m128i *even, __m128i *odd,
+ const od_coeff *x) {
+  __m128 lo;
+  __m128 hi;
+  lo = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)x));
+  hi = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)(x + 4)));
+  *even = _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+  *odd = _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+}
+
+/*Stores 8 consecutive coefficients, taking them alternately from even and
+   odd.*/
+OD_SIMD_INLINE void od_store_interleave_sse2(od_coeff *x, __m128i even,
+ __m128i odd) {
+  _mm_storeu_si128((__m128i *)x, _mm_unpacklo_epi32(even, odd));
+  _mm_storeu_si128((__m128i *)(x + 4), _mm_unpackhi_epi32(even, odd));
+}
+
+/*Same as od_haar(), but processes four 2x2 blocks at a time on the levels
+   with at least four of them in a row.
+  The arithmetic is identical, so the output matches the C version exactly.*/
+void od_haar_sse2(od_coeff *y, int ystride,
+ const od_coeff *x, int xstride, int ln) {
+  int i;
+  int j;
+  int level;
+  int tstride;
+  int n;
+  od_coeff tmp[OD_BSIZE_MAX*OD_BSIZE_MAX];
+  n = 1 << ln;
+  tstride = n;
+  for (i = 0; i < n; i++) {
+    for (j = 0; j < n; j++) {
+      tmp[i*tstride + j] = x[i*xstride + j];
+    }
+  }
+  for (level = 0; level < ln; level++) {
+    int npairs;
+    npairs = n >> level >> 1;
+    for (i = 0; i < npairs; i++) {
+      j = 0;
+      for (; j + 4 <= npairs; j += 4) {
+        __m128i a;
+        __m128i b;
+        __m128i c;
+        __m128i d;
+        od_load_deinterleave_sse2(&a, &c, tmp + 2*i*tstride + 2*j);
+        od_load_deinterleave_sse2(&b, &d, tmp + (2*i + 1)*tstride + 2*j);
+        od_haar_kernel_sse2(&a, &b, &c, &d);
+        _mm_storeu_si128((__m128i *)(tmp + i*tstride + j), a);
+        _mm_storeu_si128((__m128i *)(y + i*ystride + j + npairs), b);
+        _mm_storeu_si128((__m128i *)(y + (i + npairs)*ystride + j), c);
+        _mm_storeu_si128((__m128i *)(y + (i + npairs)*ystride + j + npairs),
+         d);
+      }
+      for (; j < npairs; j++) {
+        od_coeff a;
+        od_coeff b;
+        od_coeff c;
+        od_coeff d;
+        a = tmp[2*i*tstride + 2*j];
+        b = tmp[(2*i + 1)*tstride + 2*j];
+        c = tmp[2*i*tstride + 2*j + 1];
+        d = tmp[(2*i + 1)*tstride + 2*j + 1];
+        OD_HAAR_KERNEL(a, b, c, d);
+        tmp[i*tstride + j] = a;
+        y[i*ystride + j + npairs] = b;
+        y[(i + npairs)*ystride + j] = c;
+        y[(i + npairs)*ystride + j + npairs] = d;
+      }
+    }
+  }
+  y[0] = tmp[0];
+}
+
+/*Same as od_haar_inv(), but processes four 2x2 blocks at a time on the levels
+   with at least four of them in a row.
+  Blocks are still visited from the bottom-right, so reconstructing in place
+   never overwrites a coefficient that has not been read yet.*/
+void od_haar_inv_sse2(od_coeff *x, int xstride,
+ const od_coeff *y, int ystride, int ln) {
+  int i;
+  int j;
+  int level;
+  x[0] = y[0];
+  for (level = ln - 1; level >= 0; level--) {
+    int npairs;
+    npairs = 1 << (ln - 1 - level);
+    for (i = npairs - 1; i >= 0; i--) {
+      if (npairs >= 4) {
+        for (j = npairs - 4; j >= 0; j -= 4) {
+          __m128i a;
+          __m128i b;
+          __m128i c;
+          __m128i d;
+          a = _mm_loadu_si128((const __m128i *)(x + i*xstride + j));
+          b = _mm_loadu_si128((const __m128i *)(y + i*ystride + j + npairs));
+          c = _mm_loadu_si128((const __m128i *)(y + (i + npairs)*ystride + j));
+          d = _mm_loadu_si128(
+           (const __m128i *)(y + (i + npairs)*ystride + j + npairs));
+          od_haar_kernel_sse2(&a, &b, &c, &d);
+          od_store_interleave_sse2(x + 2*i*xstride + 2*j, a, c);
+          od_store_interleave_sse2(x + (2*i + 1)*xstride + 2*j, b, d);
+        }
+      }
+      else {
+        for (j = npairs - 1; j >= 0; j--) {
+          od_coeff a;
+          od_coeff b;
+          od_coeff c;
+          od_coeff d;
+          a = x[i*xstride + j];
+          b = y[i*ystride + j + npairs];
+          c = y[(i + npairs)*ystride + j];
+          d = y[(i + npairs)*ystride + j + npairs];
+          OD_HAAR_KERNEL(a, b, c, d);
+          x[2*i*xstride + 2*j] = a;
+          x[(2*i + 1)*xstride + 2*j] = b;
+          x[2*i*xstride + 2*j + 1] = c;
+          x[(2*i + 1)*xstride + 2*j + 1] = d;
+        }
+      }
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,195 @@
+/*Daala video codec
+Copyright (c) 2016 Daala project contributors.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+- Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+- Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+
+#if defined(HAVE_CONFIG_H)
+# include "config.h"
+#endif
+
+#include <smmintrin.h>
+#include "x86int.h"
+#include "../filter.h"
+
+/*Filters four pixels with the constrained lowpass filter, given their four
+   neighbors.*/
+OD_SIMD_INLINE __m128i od_clpf_kernel_sse41(__m128i x, __m128i a, __m128i b,
+ __m128i c, __m128i d) {
+  __m128i sum;
+  __m128i delta;
+  __m128i off;
+  sum = _mm_add_epi32(_mm_add_epi32(a, b), _mm_add_epi32(c, d));
+  sum = _mm_sub_epi32(sum, _mm_slli_epi32(x, 2));
+  delta = _mm_abs_epi32(sum);
+  /*Turn off the filter above a threshold of 16 pixels.*/
+  off = _mm_cmpgt_epi32(delta, _mm_set1_epi32(16 << OD_COEFF_SHIFT));
+  delta = _mm_srai_epi32(_mm_add_epi32(delta, _mm_set1_epi32(2)), 2);
+  delta = _mm_min_epi32(delta, _mm_set1_epi32(1 << OD_COEFF_SHIFT));
+  delta = _mm_andnot_si128(off, delta);
+  return _mm_add_epi32(x, _mm_sign_epi32(delta, sum));
+}
+
+/*Filters one row of n >= 8 pixels.
+  a and d are the rows above and below, which the caller points back at x on
+   the frame edges.
+  The left and right frame edges are only checked outside the inner loop, by
+   duplicating the edge pixel into the missing neighbor.*/
+static void od_clpf_row_sse41(od_coeff *y, const od_coeff *x,
+ const od_coeff *a, const od_coeff *d, int n, int left, int right) {
+  __m128i xx;
+  __m128i bb;
+  __m128i cc;
+  int j;
+  xx = _mm_loadu_si128((const __m128i *)x);
+  if (left) bb = _mm_shuffle_epi32(xx, _MM_SHUFFLE(2, 1, 0, 0));
+  else bb = _mm_loadu_si128((const __m128i *)(x - 1));
+  cc = _mm_loadu_si128((const __m128i *)(x + 1));
+  _mm_storeu_si128((__m128i *)y, od_clpf_kernel_sse41(xx,
+   _mm_loadu_si128((const __m128i *)a), bb, cc,
+   _mm_loadu_si128((const __m128i *)d)));
+  for (j = 4; j < n - 4; j += 4) {
+    xx = _mm_loadu_si128((const __m128i *)(x + j));
+    bb = _mm_loadu_si128((const __m128i *)(x + j - 1));
+    cc = _mm_loadu_si128((const __m128i *)(x + j + 1));
+    _mm_storeu_si128((__m128i *)(y + j), od_clpf_kernel_sse41(xx,
+     _mm_loadu_si128((const __m128i *)(a + j)), bb, cc,
+     _mm_loadu_si128((const __m128i *)(d + j))));
+  }
+  xx = _mm_loadu_si128((const __m128i *)(x + j));
+  bb = _mm_loadu_si128((const __m128i *)(x + j - 1));
+  if (right) cc = _mm_shuffle_epi32(xx, _MM_SHUFFLE(3, 3, 2, 1));
+  else cc = _mm_loadu_si128((const __m128i *)(x + j + 1));
+  _mm_storeu_si128((__m128i *)(y + j), od_clpf_kernel_sse41(xx,
+   _mm_loadu_si128((const __m128i *)(a + j)), bb, cc,
+   _mm_loadu_si128((const __m128i *)(d + j))));
+}
+
+void od_clpf_sse41(od_coeff *y, int ystride, const od_coeff *x, int xstride,
+ int ln, int sbx, int sby, int nhsb, int nvsb) {
+  int i;
+  int n;
+  n = 1 << ln;
+  if (n < 8) {
+    od_clpf_c(y, ystride, x, xstride, ln, sbx, sby, nhsb, nvsb);
+    return;
+  }
+  for (i = 0; i < n; i++) {
+    const od_coeff *row;
+    row = x + i*xstride;
+    od_clpf_row_sse41(y + i*ystride, row,
+     sby > 0 || i > 0 ? row - xstride : row,
+     sby < nvsb - 1 || i < n - 1 ? row + xstride : row,
+     n, sbx == 0, sbx == nhsb - 1);
+  }
+#if defined(OD_CHECKASM)
+  {
+    od_coeff ref[OD_BSIZE_MAX*OD_BSIZE_MAX];
+    od_clpf_c(ref, OD_BSIZE_MAX, x, xstride, ln, sbx, sby, nhsb, nvsb);
+    od_filter_check("od_clpf", ref, OD_BSIZE_MAX, y, ystride, n);
+  }
+#endif
+}
+
+/*Evaluates four pixels of the bilinear surface of a row.
+  jj holds the column indices, base the terms that are constant along the
+   row, and ia3 the x*y coefficient already multiplied by the row index.*/
+OD_SIMD_INLINE __m128i od_bilinear_pred_sse41(__m128i jj, __m128i a0,
+ __m128i a1, __m128i ia3, __m128i base, __m128i shift) {
+  __m128i t;
+  t = _mm_sra_epi32(_mm_mullo_epi32(jj, ia3), shift);
+  t = _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi32(jj, a1), base), t);
+  return _mm_add_epi32(a0, _mm_sra_epi32(t, shift));
+}
+
+/*The bilinear surface is recomputed on the second pass instead of being
+   stored, which avoids the intermediate block buffer of the C version.*/
+void od_bilinear_smooth_sse41(od_coeff *x, int ln, int stride, int q,
+ int pli) {
+  od_coeff a[4];
+  __m128i a0;
+  __m128i a1;
+  __m128i shift;
+  __m128i dist;
+  __m128i ww;
+  __m128i jj;
+  int w;
+  int i;
+  int j;
+  int n;
+#if defined(OD_CHECKASM)
+  od_coeff ref[OD_BSIZE_MAX*OD_BSIZE_MAX];
+#endif
+  n = 1 << ln;
+  if (n < 4) {
+    od_bilinear_smooth_c(x, ln, stride, q, pli);
+    return;
+  }
+#if defined(OD_CHECKASM)
+  for (i = 0; i < n; i++) OD_COPY(ref + i*OD_BSIZE_MAX, x + i*stride, n);
+  od_bilinear_smooth_c(ref, ln, OD_BSIZE_MAX, q, pli);
+#endif
+  od_bilinear_smooth_coeffs(a, x, ln, stride);
+  a0 = _mm_set1_epi32(a[0]);
+  a1 = _mm_set1_epi32(a[1]);
+  shift = _mm_cvtsi32_si128(ln);
+  dist = _mm_setzero_si128();
+  for (i = 0; i < n; i++) {
+    __m128i base;
+    __m128i ia3;
+    base = _mm_set1_epi32(i*a[2] + n/2);
+    ia3 = _mm_set1_epi32(i*a[3]);
+    jj = _mm_setr_epi32(0, 1, 2, 3);
+    for (j = 0; j < n; j += 4) {
+      __m128i diff;
+      diff = _mm_sub_epi32(od_bilinear_pred_sse41(jj, a0, a1, ia3, base,
+       shift), _mm_loadu_si128((__m128i *)(x + i*stride + j)));
+      dist = _mm_add_epi32(dist, _mm_mullo_epi32(diff, diff));
+      jj = _mm_add_epi32(jj, _mm_set1_epi32(4));
+    }
+  }
+  dist = _mm_add_epi32(dist, _mm_shuffle_epi32(dist, _MM_SHUFFLE(1, 0, 3, 2)));
+  dist = _mm_add_epi32(dist, _mm_shuffle_epi32(dist, _MM_SHUFFLE(2, 3, 0, 1)));
+  w = od_bilinear_smooth_weight(_mm_cvtsi128_si32(dist) >> 2*ln, q, pli);
+  ww = _mm_set1_epi32(w);
+  for (i = 0; i < n; i++) {
+    __m128i base;
+    __m128i ia3;
+    base = _mm_set1_epi32(i*a[2] + n/2);
+    ia3 = _mm_set1_epi32(i*a[3]);
+    jj = _mm_setr_epi32(0, 1, 2, 3);
+    for (j = 0; j < n; j += 4) {
+      __m128i xx;
+      __m128i t;
+      xx = _mm_loadu_si128((__m128i *)(x + i*stride + j));
+      t = _mm_sub_epi32(xx, od_bilinear_pred_sse41(jj, a0, a1, ia3, base,
+       shift));
+      t = _mm_add_epi32(_mm_mullo_epi32(ww, t), _mm_set1_epi32(128));
+      _mm_storeu_si128((__m128i *)(x + i*stride + j),
+       _mm_sub_epi32(xx, _mm_srai_epi32(t, 8)));
+      jj = _mm_add_epi32(jj, _mm_set1_epi32(4));
+    }
+  }
+#if defined(OD_CHECKASM)
+  od_filter_check("od_bilinear_smooth", ref, OD_BSIZE_MAX, x, stride, n);
+#endif
+}
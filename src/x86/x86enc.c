@@ -47,6 +47,18 @@ void od_enc_opt_vtbl_init_x86(od_enc_ctx *enc) {
      od_mc_compute_sad_16x16_xstride_1_sse2;
   }
 #endif
+#if defined(OD_SSE2_INTRINSICS)
+  if (enc->state.cpu_flags & OD_CPU_X86_SSE2) {
+    enc->opt_vtbl.mc_compute_sad_32x32_xstride_1 =
+     od_mc_compute_sad_32x32_xstride_1_sse2;
+    enc->opt_vtbl.mc_compute_sad_xstride_1 = od_mc_compute_sad_xstride_1_sse2;
+    enc->opt_vtbl.mc_compute_sad4_xstride_1 =
+     od_mc_compute_sad4_xstride_1_sse2;
+    enc->opt_vtbl.compute_sse = od_compute_sse_sse2;
+    enc->opt_vtbl.compute_weighted_sse_8x8 = od_compute_weighted_sse_8x8_sse2;
+    enc->opt_vtbl.bs_sums_2x2 = od_bs_sums_2x2_sse2;
+  }
+#endif
 }
 
 #endif
@@ -35,4 +35,24 @@ int od_mc_compute_sad_8x8_xstride_1_sse(const unsigned char *_src,
 int od_mc_compute_sad_16x16_xstride_1_sse2(const unsigned char *src,
  int systride, const unsigned char *ref, int dystride);
 
+# if defined(OD_CHECKASM)
+void od_mc_compute_sad_check(const unsigned char *src, int systride,
+ const unsigned char *ref, int dystride, int dxstride, int w, int h, int sad);
+# endif
+
+# if defined(OD_SSE2_INTRINSICS)
+int od_mc_compute_sad_32x32_xstride_1_sse2(const unsigned char *src,
+ int systride, const unsigned char *ref, int dystride);
+int od_mc_compute_sad_xstride_1_sse2(const unsigned char *src, int systride,
+ const unsigned char *ref, int dystride, int w, int h);
+void od_mc_compute_sad4_xstride_1_sse2(int32_t sad[4],
+ const unsigned char *src, int systride, const unsigned char *const ref[4],
+ int dystride, int w, int h);
+double od_compute_sse_sse2(const od_coeff *x, const od_coeff *y, int n);
+double od_compute_weighted_sse_8x8_sse2(const od_coeff *et, const double *w);
+void od_bs_sums_2x2_sse2(int32_t *sx2, int32_t *sxx2,
+ const unsigned char *img, int istride, const unsigned char *pred,
+ int pstride, int n);
+# endif
+
 #endif
@@ -67,5 +67,17 @@ void od_bin_fdct8x8_avx2(od_coeff *y, int ystride,
  const od_coeff *x, int xstride);
 void od_bin_idct8x8_avx2(od_coeff *x, int xstride,
  const od_coeff *y, int ystride);
+void od_clpf_sse41(od_coeff *y, int ystride, const od_coeff *x, int xstride,
+ int ln, int sbx, int sby, int nhsb, int nvsb);
+void od_clpf_avx2(od_coeff *y, int ystride, const od_coeff *x, int xstride,
+ int ln, int sbx, int sby, int nhsb, int nvsb);
+void od_bilinear_smooth_sse41(od_coeff *x, int ln, int stride, int q,
+ int pli);
+void od_bilinear_smooth_avx2(od_coeff *x, int ln, int stride, int q,
+ int pli);
+void od_haar_sse2(od_coeff *y, int ystride,
+ const od_coeff *x, int xstride, int ln);
+void od_haar_inv_sse2(od_coeff *x, int xstride,
+ const od_coeff *y, int ystride, int ln);
 
 #endif
@@ -55,6 +55,8 @@ void od_state_opt_vtbl_init_x86(od_state *_state){
     _state->opt_vtbl.idct_2d[0] = od_bin_idct4x4_sse2;
     _state->opt_vtbl.fdct_2d[1] = od_bin_fdct8x8_sse2;
     _state->opt_vtbl.idct_2d[1] = od_bin_idct8x8_sse2;
+    _state->opt_vtbl.haar = od_haar_sse2;
+    _state->opt_vtbl.haar_inv = od_haar_inv_sse2;
 #endif
 #if defined(OD_SSE41_INTRINSICS)
     if (_state->cpu_flags&OD_CPU_X86_SSE4_1) {
@@ -62,12 +64,16 @@ void od_state_opt_vtbl_init_x86(od_state *_state){
       _state->opt_vtbl.idct_2d[0] = od_bin_idct4x4_sse41;
       _state->opt_vtbl.fdct_2d[1] = od_bin_fdct8x8_sse41;
       _state->opt_vtbl.idct_2d[1] = od_bin_idct8x8_sse41;
+      _state->opt_vtbl.clpf = od_clpf_sse41;
+      _state->opt_vtbl.bilinear_smooth = od_bilinear_smooth_sse41;
     }
 #endif
 #if defined(OD_AVX2_INTRINSICS)
     if (_state->cpu_flags & OD_CPU_X86_AVX2) {
       _state->opt_vtbl.fdct_2d[1] = od_bin_fdct8x8_avx2;
       _state->opt_vtbl.idct_2d[1] = od_bin_idct8x8_avx2;
+      _state->opt_vtbl.clpf = od_clpf_avx2;
+      _state->opt_vtbl.bilinear_smooth = od_bilinear_smooth_avx2;
     }
 #endif
   }
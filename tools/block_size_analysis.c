@@ -367,12 +367,17 @@ int switch_decision(unsigned char *img, int w, int h, int stride, int ow, int oh
   {
     od_block_size_comp bs;
 
+    if(od_block_size_comp_init(&bs,w32-2,h32-2,NULL)<0){
+      fprintf(stderr,"Out of memory.\n");
+      exit(1);
+    }
+    od_compute_frame_stats(&bs,img+32*stride+32,stride,NULL,0,NULL,
+     od_bs_sums_2x2_c);
     for(i=1;i<h32-1;i++){
       for(j=1;j<w32-1;j++){
         int k,m;
         int dec[4][4];
-        od_split_superblock(&bs, img+32*stride*i+32*j, stride, NULL, 0,
-         dec, 21 << OD_COEFF_SHIFT);
+        od_split_superblock(&bs,j-1,i-1,dec,21 << OD_COEFF_SHIFT);
         for(k=0;k<4;k++)
           for(m=0;m<4;m++)
             dec8[4*i+k][4*j+m]=dec[k][m];
@@ -381,8 +386,8 @@ int switch_decision(unsigned char *img, int w, int h, int stride, int ow, int oh
         {
           for(m=0;m<16;m++)
           {
-            var[16*i+k][16*j+m]=bs.img_stats.Var4[k+3][m+3];
-            var_1[16*i+k][16*j+m]=bs.img_stats.invVar4[k+3][m+3];
+            var[16*i+k][16*j+m]=bs.img_stats.Var4[(k+3)*bs.img_stats.stride4+m+3];
+            var_1[16*i+k][16*j+m]=bs.img_stats.invVar4[(k+3)*bs.img_stats.stride4+m+3];
           }
         }
         for(k=0;k<8;k++)
@@ -403,13 +408,14 @@ int switch_decision(unsigned char *img, int w, int h, int stride, int ow, int oh
         {
           for(m=0;m<8;m++)
           {
-            var8[8*i+k][8*j+m]=bs.img_stats.Var8[k+2][m+2];
-            var8_1[8*i+k][8*j+m]=bs.img_stats.invVar8[k+2][m+2];
+            var8[8*i+k][8*j+m]=bs.img_stats.Var8[(k+2)*bs.img_stats.stride8+m+2];
+            var8_1[8*i+k][8*j+m]=bs.img_stats.invVar8[(k+2)*bs.img_stats.stride8+m+2];
           }
         }
 #endif
       }
     }
+    od_block_size_comp_clear(&bs);
   }
 
 #if 0
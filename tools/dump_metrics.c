@@ -0,0 +1,433 @@
+/*Daala video codec
+Copyright (c) 2016 Daala project contributors.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+- Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+- Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "vidinput.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+/*Yes, yes, we're going to hell.*/
+#if defined(_WIN32)
+#include <io.h>
+#include <fcntl.h>
+#endif
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+#include "getopt.h"
+#include "metrics.h"
+
+/*Computes PSNR, PSNR-HVS, SSIM and Fast SSIM in a single pass over both
+   inputs.
+  Frames are read in batches, and every (frame, metric) pair of a batch is
+   an independent job scheduled over all of the OpenMP threads.
+  The per-frame results are identical to those of the dump_psnr,
+   dump_psnrhvs, dump_ssim and dump_fastssim -c tools.*/
+
+const char *optstring = "rst:y";
+const struct option options[]={
+  {"raw",no_argument,NULL,'r'},
+  {"summary",no_argument,NULL,'s'},
+  {"threads",required_argument,NULL,'t'},
+  {"luma-only",no_argument,NULL,'y'},
+  {NULL,0,NULL,0}
+};
+
+static int summary_only;
+static int luma_only;
+
+#define METRIC_PSNR     (0)
+#define METRIC_PSNRHVS  (1)
+#define METRIC_SSIM     (2)
+#define METRIC_FASTSSIM (3)
+#define NMETRICS        (4)
+
+/*The number of frames buffered per thread in each batch.*/
+#define FRAMES_PER_THREAD (4)
+
+typedef struct metrics_frame metrics_frame;
+
+struct metrics_frame{
+  /*Copies of the picture region of each plane of both inputs, with a
+     stride equal to the width.*/
+  unsigned char *data[2][3];
+  double         score[NMETRICS][3];
+};
+
+typedef struct metrics_plane metrics_plane;
+
+/*The picture region of one plane.*/
+struct metrics_plane{
+  int xoffs[2];
+  int yoffs[2];
+  int w;
+  int h;
+};
+
+static void usage(char *_argv[]){
+  fprintf(stderr,"Usage: %s [options] <video1> <video2>\n"
+   "    <video1> and <video2> may be either YUV4MPEG or Ogg Theora files.\n\n"
+   "    Options:\n\n"
+   "      -r --raw           Show raw SSIM and Fast SSIM scores, instead of"
+   " 10*log10(1/(1-ssim)).\n"
+   "      -s --summary       Only output the summary lines.\n"
+   "      -t --threads <n>   Number of threads to use.\n"
+   "      -y --luma-only     Only output values for the luma channel.\n",
+   _argv[0]);
+}
+
+typedef double (*convert_ssim_func)(double _ssim,double _weight);
+
+static double convert_ssim_raw(double _ssim,double _weight){
+  return _ssim/_weight;
+}
+
+static double convert_ssim_db(double _ssim,double _weight){
+  return 10*(log10(_weight)-log10(_weight-_ssim));
+}
+
+static double convert_psnrhvs_db(double _score,double _weight){
+  return 10*(log10(255*255)-log10(_weight*_score));
+}
+
+static double convert_sqerr_db(double _sqerr,double _npixels){
+  return 10*(log10(255*255)+log10(_npixels)-log10(_sqerr));
+}
+
+/*Copies the picture region of one plane out of the decoder's buffer, which
+   is overwritten by the next fetch.*/
+static int copy_plane(unsigned char **_dst,const struct video_input_plane *_src,
+ const metrics_plane *_plane,int _ii){
+  const unsigned char *src;
+  int                  y;
+  if(*_dst==NULL){
+    *_dst=(unsigned char *)malloc(_plane->w*(size_t)_plane->h);
+    if(*_dst==NULL)return -1;
+  }
+  src=_src->data+_plane->yoffs[_ii]*_src->stride+_plane->xoffs[_ii];
+  for(y=0;y<_plane->h;y++){
+    memcpy(*_dst+y*_plane->w,src,_plane->w);
+    src+=_src->stride;
+  }
+  return 0;
+}
+
+static void calc_frame_metric(metrics_frame *_frame,
+ const metrics_plane _planes[3],double _par,int _metric,int _nplanes){
+  int pli;
+  for(pli=0;pli<_nplanes;pli++){
+    const unsigned char *src;
+    const unsigned char *dst;
+    int                  w;
+    int                  h;
+    src=_frame->data[0][pli];
+    dst=_frame->data[1][pli];
+    w=_planes[pli].w;
+    h=_planes[pli].h;
+    switch(_metric){
+      case METRIC_PSNR:{
+        _frame->score[_metric][pli]=(double)calc_sqerr(src,w,dst,w,w,h);
+      }break;
+      case METRIC_PSNRHVS:{
+        _frame->score[_metric][pli]=calc_psnrhvs(src,w,dst,w,_par,w,h,7,
+         pli==0?csf_y:pli==1?csf_cb420:csf_cr420);
+      }break;
+      case METRIC_SSIM:{
+        _frame->score[_metric][pli]=calc_ssim(src,w,dst,w,_par,w,h);
+      }break;
+      case METRIC_FASTSSIM:{
+        _frame->score[_metric][pli]=calc_fastssim(src,w,dst,w,w,h);
+      }break;
+    }
+  }
+}
+
+static const char *const METRIC_NAMES[NMETRICS]={
+  "PSNR","PSNRHVS","SSIM","FASTSSIM"
+};
+
+int main(int _argc,char *_argv[]){
+  video_input        vid1;
+  video_input_info   info1;
+  video_input        vid2;
+  video_input_info   info2;
+  convert_ssim_func  convert;
+  metrics_plane      planes[3];
+  metrics_frame     *frames;
+  double             gscore[NMETRICS][3];
+  double             npixels[3];
+  double             cweight;
+  double             par;
+  int                nthreads;
+  int                nbatch;
+  int                nplanes;
+  int                frameno;
+  int                done;
+  int                pli;
+  FILE              *fin;
+  int                long_option_index;
+  int                c;
+#ifdef _WIN32
+  /*We need to set stdin/stdout to binary mode on windows.
+    Beware the evil ifdef.
+    We avoid these where we can, but this one we cannot.
+    Don't add any more, you'll probably go to hell if you do.*/
+  _setmode(_fileno(stdin),_O_BINARY);
+#endif
+  metrics_init();
+#if defined(_OPENMP)
+  nthreads=omp_get_max_threads();
+#else
+  nthreads=1;
+#endif
+  /*Process option arguments.*/
+  convert=convert_ssim_db;
+  while((c=getopt_long(_argc,_argv,optstring,options,&long_option_index))!=EOF){
+    switch(c){
+      case 'r':convert=convert_ssim_raw;break;
+      case 's':summary_only=1;break;
+      case 't':{
+        nthreads=atoi(optarg);
+        if(nthreads<1){
+          fprintf(stderr,"Invalid number of threads: %s\n",optarg);
+          exit(EXIT_FAILURE);
+        }
+      }break;
+      case 'y':luma_only=1;break;
+      default:{
+        usage(_argv);
+        exit(EXIT_FAILURE);
+      }break;
+    }
+  }
+  if(optind+2!=_argc){
+    usage(_argv);
+    exit(EXIT_FAILURE);
+  }
+#if defined(_OPENMP)
+  omp_set_num_threads(nthreads);
+#else
+  if(nthreads>1){
+    fprintf(stderr,"Warning: built without OpenMP, using a single thread.\n");
+    nthreads=1;
+  }
+#endif
+  fin=strcmp(_argv[optind],"-")==0?stdin:fopen(_argv[optind],"rb");
+  if(fin==NULL){
+    fprintf(stderr,"Unable to open '%s' for extraction.\n",_argv[optind]);
+    exit(EXIT_FAILURE);
+  }
+  fprintf(stderr,"Opening %s...\n",_argv[optind]);
+  if(video_input_open(&vid1,fin)<0)exit(EXIT_FAILURE);
+  video_input_get_info(&vid1,&info1);
+  fin=strcmp(_argv[optind+1],"-")==0?stdin:fopen(_argv[optind+1],"rb");
+  if(fin==NULL){
+    fprintf(stderr,"Unable to open '%s' for extraction.\n",_argv[optind+1]);
+    exit(EXIT_FAILURE);
+  }
+  fprintf(stderr,"Opening %s...\n",_argv[optind+1]);
+  if(video_input_open(&vid2,fin)<0)exit(EXIT_FAILURE);
+  video_input_get_info(&vid2,&info2);
+  /*Check to make sure these videos are compatible.*/
+  if(info1.pic_w!=info2.pic_w||info1.pic_h!=info2.pic_h){
+    fprintf(stderr,"Video resolution does not match.\n");
+    exit(EXIT_FAILURE);
+  }
+  if(info1.pixel_fmt!=info2.pixel_fmt){
+    fprintf(stderr,"Pixel formats do not match.\n");
+    exit(EXIT_FAILURE);
+  }
+  if((info1.pic_x&!(info1.pixel_fmt&1))!=(info2.pic_x&!(info2.pixel_fmt&1))||
+   (info1.pic_y&!(info1.pixel_fmt&2))!=(info2.pic_y&!(info2.pixel_fmt&2))){
+    fprintf(stderr,"Chroma subsampling offsets do not match.\n");
+    exit(EXIT_FAILURE);
+  }
+  if(info1.fps_n*(int64_t)info2.fps_d!=
+   info2.fps_n*(int64_t)info1.fps_d){
+    fprintf(stderr,"Warning: framerates do not match.\n");
+  }
+  if(info1.par_n*(int64_t)info2.par_d!=
+   info2.par_n*(int64_t)info1.par_d){
+    fprintf(stderr,"Warning: aspect ratios do not match.\n");
+  }
+  par=info1.par_n>0&&info2.par_d>0?
+   info1.par_n/(double)info2.par_d:1;
+  for(pli=0;pli<3;pli++){
+    int xdec;
+    int ydec;
+    xdec=pli&&!(info1.pixel_fmt&1);
+    ydec=pli&&!(info1.pixel_fmt&2);
+    planes[pli].xoffs[0]=info1.pic_x>>xdec;
+    planes[pli].yoffs[0]=info1.pic_y>>ydec;
+    planes[pli].xoffs[1]=info2.pic_x>>xdec;
+    planes[pli].yoffs[1]=info2.pic_y>>ydec;
+    planes[pli].w=((info1.pic_x+info1.pic_w+xdec)>>xdec)-(info1.pic_x>>xdec);
+    planes[pli].h=((info1.pic_y+info1.pic_h+ydec)>>ydec)-(info1.pic_y>>ydec);
+    npixels[pli]=0;
+  }
+  nplanes=luma_only?1:3;
+  nbatch=nthreads*FRAMES_PER_THREAD;
+  frames=(metrics_frame *)calloc(nbatch,sizeof(*frames));
+  if(frames==NULL){
+    fprintf(stderr,"Error allocating frame buffers.\n");
+    exit(EXIT_FAILURE);
+  }
+  memset(gscore,0,sizeof(gscore));
+  /*We just use a simple weighting to get a single full-color score.
+    In reality the CSF for chroma is not the same as luma.*/
+  cweight=0.25*(4>>(!(info1.pixel_fmt&1)+!(info1.pixel_fmt&2)));
+  for(frameno=done=0;!done;){
+    int nframes;
+    int njobs;
+    int fi;
+    int ji;
+    /*Read the next batch of frames from both inputs.*/
+    for(nframes=0;nframes<nbatch;nframes++){
+      video_input_ycbcr f1;
+      video_input_ycbcr f2;
+      int               ret1;
+      int               ret2;
+      ret1=video_input_fetch_frame(&vid1,f1,NULL);
+      ret2=video_input_fetch_frame(&vid2,f2,NULL);
+      if(ret1<=0||ret2<=0){
+        if(ret1==0&&ret2>0){
+          fprintf(stderr,"%s ended before %s.\n",
+           _argv[optind],_argv[optind+1]);
+        }
+        else if(ret2==0&&ret1>0){
+          fprintf(stderr,"%s ended before %s.\n",
+           _argv[optind+1],_argv[optind]);
+        }
+        done=1;
+        break;
+      }
+      /*Okay, we got one frame from each.*/
+      for(pli=0;pli<nplanes;pli++){
+        if(copy_plane(&frames[nframes].data[0][pli],&f1[pli],
+         planes+pli,0)<0||copy_plane(&frames[nframes].data[1][pli],&f2[pli],
+         planes+pli,1)<0){
+          fprintf(stderr,"Error allocating frame buffers.\n");
+          exit(EXIT_FAILURE);
+        }
+      }
+    }
+    njobs=nframes*NMETRICS;
+#if defined(_OPENMP)
+    #pragma omp parallel for schedule(dynamic)
+#endif
+    for(ji=0;ji<njobs;ji++){
+      calc_frame_metric(frames+ji/NMETRICS,planes,par,ji%NMETRICS,nplanes);
+    }
+    for(fi=0;fi<nframes;fi++,frameno++){
+      double *score[NMETRICS];
+      int     mi;
+      for(mi=0;mi<NMETRICS;mi++){
+        score[mi]=frames[fi].score[mi];
+        for(pli=0;pli<nplanes;pli++)gscore[mi][pli]+=score[mi][pli];
+      }
+      for(pli=0;pli<nplanes;pli++){
+        npixels[pli]+=planes[pli].w*(double)planes[pli].h;
+      }
+      if(summary_only)continue;
+      if(luma_only){
+        printf("%08i: PSNR %-7G  PSNRHVS %-8G  SSIM %-8G  FASTSSIM %-8G\n",
+         frameno,convert_sqerr_db(score[METRIC_PSNR][0],
+         planes[0].w*(double)planes[0].h),
+         convert_psnrhvs_db(score[METRIC_PSNRHVS][0],1),
+         convert(score[METRIC_SSIM][0],1),
+         convert(score[METRIC_FASTSSIM][0],1));
+      }
+      else{
+        double fsqerr;
+        double fnpixels;
+        fsqerr=fnpixels=0;
+        for(pli=0;pli<3;pli++){
+          fsqerr+=score[METRIC_PSNR][pli];
+          fnpixels+=planes[pli].w*(double)planes[pli].h;
+        }
+        printf("%08i: PSNR %-7G  PSNRHVS %-8G  SSIM %-8G  FASTSSIM %-8G\n",
+         frameno,convert_sqerr_db(fsqerr,fnpixels),
+         convert_psnrhvs_db(score[METRIC_PSNRHVS][0]
+         +cweight*(score[METRIC_PSNRHVS][1]+score[METRIC_PSNRHVS][2]),
+         1+2*cweight),
+         convert(score[METRIC_SSIM][0]
+         +cweight*(score[METRIC_SSIM][1]+score[METRIC_SSIM][2]),1+2*cweight),
+         convert(score[METRIC_FASTSSIM][0]
+         +cweight*(score[METRIC_FASTSSIM][1]+score[METRIC_FASTSSIM][2]),
+         1+2*cweight));
+      }
+    }
+  }
+  /*Each summary line has the same layout as the Total line of the
+     corresponding single-metric tool, prefixed with the metric name.*/
+  if(luma_only){
+    printf("%-8s Total: %-8G\n",METRIC_NAMES[METRIC_PSNR],
+     convert_sqerr_db(gscore[METRIC_PSNR][0],npixels[0]));
+    printf("%-8s Total: %-8G\n",METRIC_NAMES[METRIC_PSNRHVS],
+     convert_psnrhvs_db(gscore[METRIC_PSNRHVS][0],1./frameno));
+    printf("%-8s Total: %-8G\n",METRIC_NAMES[METRIC_SSIM],
+     convert(gscore[METRIC_SSIM][0],frameno));
+    printf("%-8s Total: %-8G\n",METRIC_NAMES[METRIC_FASTSSIM],
+     convert(gscore[METRIC_FASTSSIM][0],frameno));
+  }
+  else{
+    double *g;
+    g=gscore[METRIC_PSNR];
+    printf("%-8s Total: %-8G  (Y': %-8G  Cb: %-8G  Cr: %-8G)\n",
+     METRIC_NAMES[METRIC_PSNR],
+     convert_sqerr_db(g[0]+g[1]+g[2],npixels[0]+npixels[1]+npixels[2]),
+     convert_sqerr_db(g[0],npixels[0]),convert_sqerr_db(g[1],npixels[1]),
+     convert_sqerr_db(g[2],npixels[2]));
+    g=gscore[METRIC_PSNRHVS];
+    printf("%-8s Total: %-8G  (Y': %-8G  Cb: %-8G  Cr: %-8G)\n",
+     METRIC_NAMES[METRIC_PSNRHVS],
+     convert_psnrhvs_db(g[0]+cweight*(g[1]+g[2]),(1+2*cweight)*1./frameno),
+     convert_psnrhvs_db(g[0],1./frameno),convert_psnrhvs_db(g[1],1./frameno),
+     convert_psnrhvs_db(g[2],1./frameno));
+    g=gscore[METRIC_SSIM];
+    printf("%-8s Total: %-8G  (Y': %-8G  Cb: %-8G  Cr: %-8G)\n",
+     METRIC_NAMES[METRIC_SSIM],
+     convert(g[0]+cweight*(g[1]+g[2]),(1+2*cweight)*frameno),
+     convert(g[0],frameno),convert(g[1],frameno),convert(g[2],frameno));
+    g=gscore[METRIC_FASTSSIM];
+    printf("%-8s Total: %-8G  (Y': %-8G  Cb: %-8G  Cr: %-8G)\n",
+     METRIC_NAMES[METRIC_FASTSSIM],
+     convert(g[0]+cweight*(g[1]+g[2]),(1+2*cweight)*frameno),
+     convert(g[0],frameno),convert(g[1],frameno),convert(g[2],frameno));
+  }
+  while(nbatch-->0){
+    for(pli=0;pli<3;pli++){
+      free(frames[nbatch].data[0][pli]);
+      free(frames[nbatch].data[1][pli]);
+    }
+  }
+  free(frames);
+  video_input_close(&vid1);
+  video_input_close(&vid2);
+  return EXIT_SUCCESS;
+}
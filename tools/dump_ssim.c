@@ -12,6 +12,7 @@
 #include <fcntl.h>
 #endif
 #include "getopt.h"
+#include "metrics.h"
 
 const char *optstring = "frsy";
 const struct option options[]={
@@ -26,156 +27,6 @@ static int show_frame_type;
 static int summary_only;
 static int luma_only;
 
-#define KERNEL_SHIFT (8)
-#define KERNEL_WEIGHT (1<<KERNEL_SHIFT)
-#define KERNEL_ROUND ((1<<KERNEL_SHIFT)>>1)
-
-static int gaussian_filter_init(unsigned **_kernel,double _sigma,int _max_len){
-  unsigned *kernel;
-  double    scale;
-  double    nhisigma2;
-  double    s;
-  double    len;
-  unsigned  sum;
-  int       kernel_len;
-  int       kernel_sz;
-  int       ci;
-  scale=1/(sqrt(2*M_PI)*_sigma);
-  nhisigma2=-0.5/(_sigma*_sigma);
-  /*Compute the kernel size so that the error in the first truncated
-     coefficient is no larger than 0.5*KERNEL_WEIGHT.
-    There is no point in going beyond this given our working precision.*/
-  s=sqrt(0.5*M_PI)*_sigma*(1.0/KERNEL_WEIGHT);
-  if(s>=1)len=0;
-  else len=floor(_sigma*sqrt(-2*log(s)));
-  kernel_len=len>=_max_len?_max_len-1:(int)len;
-  kernel_sz=kernel_len<<1|1;
-  kernel=(unsigned *)malloc(kernel_sz*sizeof(*kernel));
-  sum=0;
-  for(ci=kernel_len;ci>0;ci--){
-    kernel[kernel_len-ci]=kernel[kernel_len+ci]=
-     (unsigned)(KERNEL_WEIGHT*scale*exp(nhisigma2*ci*ci)+0.5);
-    sum+=kernel[kernel_len-ci];
-  }
-  kernel[kernel_len]=KERNEL_WEIGHT-(sum<<1);
-  *_kernel=kernel;
-  return kernel_sz;
-}
-
-typedef struct ssim_moments ssim_moments;
-
-struct ssim_moments{
-  unsigned mux;
-  unsigned muy;
-  unsigned x2;
-  unsigned xy;
-  unsigned y2;
-  unsigned w;
-};
-
-#define SSIM_C1 (255*255*0.01*0.01)
-#define SSIM_C2 (255*255*0.03*0.03)
-
-static double calc_ssim(const unsigned char *_src,int _systride,
- const unsigned char *_dst,int _dystride,double _par,int _w,int _h){
-  ssim_moments  *line_buf;
-  ssim_moments **lines;
-  double         ssim;
-  double         ssimw;
-  unsigned      *hkernel;
-  int            hkernel_sz;
-  int            hkernel_offs;
-  unsigned      *vkernel;
-  int            vkernel_sz;
-  int            vkernel_offs;
-  int            log_line_sz;
-  int            line_sz;
-  int            line_mask;
-  int            x;
-  int            y;
-  vkernel_sz=gaussian_filter_init(&vkernel,_h*(1.5/256),_w<_h?_w:_h);
-  vkernel_offs=vkernel_sz>>1;
-  for(line_sz=1,log_line_sz=0;line_sz<vkernel_sz;line_sz<<=1,log_line_sz++);
-  line_mask=line_sz-1;
-  lines=(ssim_moments **)malloc(line_sz*sizeof(*lines));
-  lines[0]=line_buf=(ssim_moments *)malloc(line_sz*_w*sizeof(*line_buf));
-  for(y=1;y<line_sz;y++)lines[y]=lines[y-1]+_w;
-  hkernel_sz=gaussian_filter_init(&hkernel,_h*(1.5/256)/_par,_w<_h?_w:_h);
-  hkernel_offs=hkernel_sz>>1;
-  ssim=0;
-  ssimw=0;
-  for(y=0;y<_h+vkernel_offs;y++){
-    ssim_moments *buf;
-    int           k;
-    int           k_min;
-    int           k_max;
-    if(y<_h){
-      buf=lines[y&line_mask];
-      for(x=0;x<_w;x++){
-        ssim_moments m;
-        memset(&m,0,sizeof(m));
-        k_min=hkernel_offs-x<=0?0:hkernel_offs-x;
-        k_max=x+hkernel_offs-_w+1<=0?
-         hkernel_sz:hkernel_sz-(x+hkernel_offs-_w+1);
-        for(k=k_min;k<k_max;k++){
-          unsigned s;
-          unsigned d;
-          unsigned window;
-          s=_src[x-hkernel_offs+k];
-          d=_dst[x-hkernel_offs+k];
-          window=hkernel[k];
-          m.mux+=window*s;
-          m.muy+=window*d;
-          m.x2+=window*s*s;
-          m.xy+=window*s*d;
-          m.y2+=window*d*d;
-          m.w+=window;
-        }
-        *(buf+x)=*&m;
-      }
-      _src+=_systride;
-      _dst+=_dystride;
-    }
-    if(y>=vkernel_offs){
-      k_min=vkernel_sz-y-1<=0?0:vkernel_sz-y-1;
-      k_max=y+1-_h<=0?vkernel_sz:vkernel_sz-(y+1-_h);
-      for(x=0;x<_w;x++){
-        ssim_moments m;
-        double       c1;
-        double       c2;
-        double       mx2;
-        double       mxy;
-        double       my2;
-        double       w;
-        memset(&m,0,sizeof(m));
-        for(k=k_min;k<k_max;k++){
-          unsigned window;
-          buf=lines[y+1-vkernel_sz+k&line_mask]+x;
-          window=vkernel[k];
-          m.mux+=window*buf->mux;
-          m.muy+=window*buf->muy;
-          m.x2+=window*buf->x2;
-          m.xy+=window*buf->xy;
-          m.y2+=window*buf->y2;
-          m.w+=window*buf->w;
-        }
-        w=m.w;
-        c1=SSIM_C1*w*w;
-        c2=SSIM_C2*w*w;
-        mx2=m.mux*(double)m.mux;
-        mxy=m.mux*(double)m.muy;
-        my2=m.muy*(double)m.muy;
-        ssim+=m.w*(2*mxy+c1)*(c2+2*(m.xy*w-mxy))/
-         ((mx2+my2+c1)*(m.x2*w-mx2+m.y2*w-my2+c2));
-        ssimw+=m.w;
-      }
-    }
-  }
-  free(line_buf);
-  free(lines);
-  return ssim/ssimw;
-}
-
 static void usage(char *_argv[]){
   fprintf(stderr,"Usage: %s [options] <video1> <video2>\n"
    "    <video1> and <video2> may be either YUV4MPEG or Ogg Theora files.\n\n"
@@ -217,6 +68,7 @@ int main(int _argc,char *_argv[]){
     Don't add any more, you'll probably go to hell if you do.*/
   _setmode(_fileno(stdin),_O_BINARY);
 #endif
+  metrics_init();
   /*Process option arguments.*/
   convert=convert_ssim_db;
   while((c=getopt_long(_argc,_argv,optstring,options,&long_option_index))!=EOF){
@@ -0,0 +1,310 @@
+/*Daala video codec
+Copyright (c) 2015 Daala project contributors.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+- Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+- Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS”
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+/*Encodes one YUV4MPEG2 input at several quality levels in a single pass,
+   using daala_encode_img_in_multi() so the input is only read and padded
+   once.*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(_WIN32)
+# include <io.h>
+# include <fcntl.h>
+#endif
+#include "getopt.h"
+#include "vidinput.h"
+#include "daala/daalaenc.h"
+
+#define OD_LADDER_MAX (16)
+
+typedef struct od_rendition od_rendition;
+
+struct od_rendition {
+  int quality;
+  FILE *fout;
+  ogg_stream_state os;
+  daala_enc_ctx *enc;
+  long bytes;
+};
+
+static void usage(char **_argv) {
+  fprintf(stderr, "Usage: %s [options] <input>\n"
+   "    <input> must be a YUV4MPEG file.\n\n"
+   "    Options:\n\n"
+   "      -o --output <prefix>       Output files are named\n"
+   "                                 <prefix>-<quality>.ogv (default: out).\n"
+   "      -v --video-quality <list>  Comma-separated list of Daala quality\n"
+   "                                 selectors from 0 to 511 (at most %i).\n"
+   "      -k --keyframe-rate <n>     Frequency of keyframes in output.\n"
+   "      -l --limit <n>             Maximum number of frames to encode.\n"
+   "      -z --complexity <n>        Computational complexity: 0...10.\n",
+   _argv[0], OD_LADDER_MAX);
+}
+
+static void write_page(od_rendition *_r, ogg_page *_og) {
+  if (fwrite(_og->header, 1, _og->header_len, _r->fout)
+   < (size_t)_og->header_len
+   || fwrite(_og->body, 1, _og->body_len, _r->fout) < (size_t)_og->body_len) {
+    fprintf(stderr, "Could not complete write to file.\n");
+    exit(EXIT_FAILURE);
+  }
+  _r->bytes += _og->header_len + _og->body_len;
+}
+
+static void write_headers(od_rendition *_r, daala_comment *_dc) {
+  ogg_packet op;
+  ogg_page og;
+  int ret;
+  /*The first packet gets its own page.*/
+  if (daala_encode_flush_header(_r->enc, _dc, &op) <= 0) {
+    fprintf(stderr, "Internal Daala library error.\n");
+    exit(EXIT_FAILURE);
+  }
+  ogg_stream_packetin(&_r->os, &op);
+  if (ogg_stream_pageout(&_r->os, &og) != 1) {
+    fprintf(stderr, "Internal Ogg library error.\n");
+    exit(EXIT_FAILURE);
+  }
+  write_page(_r, &og);
+  for (;;) {
+    ret = daala_encode_flush_header(_r->enc, _dc, &op);
+    if (ret < 0) {
+      fprintf(stderr, "Internal Daala library error.\n");
+      exit(EXIT_FAILURE);
+    }
+    else if (!ret) break;
+    ogg_stream_packetin(&_r->os, &op);
+  }
+  while (ogg_stream_flush(&_r->os, &og) > 0) write_page(_r, &og);
+}
+
+static void drain_packets(od_rendition *_r, int _last) {
+  ogg_packet op;
+  ogg_page og;
+  while (daala_encode_packet_out(_r->enc, _last, &op)) {
+    ogg_stream_packetin(&_r->os, &op);
+  }
+  while (ogg_stream_pageout(&_r->os, &og) > 0) write_page(_r, &og);
+  if (_last) {
+    while (ogg_stream_flush(&_r->os, &og) > 0) write_page(_r, &og);
+  }
+}
+
+int main(int _argc, char **_argv) {
+  const char *optstring = "ho:v:k:l:z:";
+  const struct option long_options[] = {
+    { "help", no_argument, NULL, 'h' },
+    { "output", required_argument, NULL, 'o' },
+    { "video-quality", required_argument, NULL, 'v' },
+    { "keyframe-rate", required_argument, NULL, 'k' },
+    { "limit", required_argument, NULL, 'l' },
+    { "complexity", required_argument, NULL, 'z' },
+    { NULL, 0, NULL, 0 }
+  };
+  od_rendition renditions[OD_LADDER_MAX];
+  daala_enc_ctx *encs[OD_LADDER_MAX];
+  const char *prefix;
+  FILE *fin;
+  video_input vid;
+  video_input_info info;
+  daala_info di;
+  daala_comment dc;
+  od_img img;
+  unsigned serial;
+  int nrenditions;
+  int keyframe_rate;
+  int complexity;
+  int limit;
+  int nframes;
+  int ri;
+  int pli;
+  int c;
+  prefix = "out";
+  nrenditions = 0;
+  keyframe_rate = 256;
+  complexity = 7;
+  limit = -1;
+  while ((c = getopt_long(_argc, _argv, optstring, long_options, NULL))
+   != EOF) {
+    switch (c) {
+      case 'o': prefix = optarg; break;
+      case 'v': {
+        char *p;
+        p = optarg;
+        for (nrenditions = 0; *p != '\0'; nrenditions++) {
+          if (nrenditions >= OD_LADDER_MAX) {
+            fprintf(stderr, "Too many quality levels (at most %i).\n",
+             OD_LADDER_MAX);
+            exit(EXIT_FAILURE);
+          }
+          renditions[nrenditions].quality = (int)strtol(p, &p, 10);
+          if (renditions[nrenditions].quality < 0
+           || renditions[nrenditions].quality > 511) {
+            fprintf(stderr, "Illegal video quality (use 0 through 511)\n");
+            exit(EXIT_FAILURE);
+          }
+          if (*p == ',') p++;
+          else if (*p != '\0') {
+            fprintf(stderr, "Malformed quality list '%s'.\n", optarg);
+            exit(EXIT_FAILURE);
+          }
+        }
+        break;
+      }
+      case 'k': {
+        keyframe_rate = atoi(optarg);
+        if (keyframe_rate < 1 || keyframe_rate > 1000) {
+          fprintf(stderr,
+           "Illegal video keyframe rate (use 1 through 1000)\n");
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+      case 'l': limit = atoi(optarg); break;
+      case 'z': {
+        complexity = atoi(optarg);
+        if (complexity < 0 || complexity > 10) {
+          fprintf(stderr,
+           "Illegal complexity setting (must be 0...10, inclusive)\n");
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+      case 'h':
+      default: {
+        usage(_argv);
+        exit(c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+      }
+    }
+  }
+  if (optind + 1 != _argc || nrenditions == 0) {
+    usage(_argv);
+    exit(EXIT_FAILURE);
+  }
+  fin = strcmp(_argv[optind], "-") == 0 ? stdin : fopen(_argv[optind], "rb");
+  if (fin == NULL) {
+    fprintf(stderr, "Unable to open '%s' for extraction.\n", _argv[optind]);
+    exit(EXIT_FAILURE);
+  }
+#if defined(_WIN32)
+  if (fin == stdin) _setmode(_fileno(stdin), _O_BINARY);
+#endif
+  if (video_input_open(&vid, fin) < 0) exit(EXIT_FAILURE);
+  video_input_get_info(&vid, &info);
+  if (info.depth != 8) {
+    fprintf(stderr, "Only 8-bit input is supported.\n");
+    exit(EXIT_FAILURE);
+  }
+  daala_info_init(&di);
+  di.pic_width = info.pic_w;
+  di.pic_height = info.pic_h;
+  di.timebase_numerator = info.fps_n;
+  di.timebase_denominator = info.fps_d;
+  di.frame_duration = 1;
+  di.pixel_aspect_numerator = info.par_n;
+  di.pixel_aspect_denominator = info.par_d;
+  di.nplanes = 3;
+  for (pli = 0; pli < 3; pli++) {
+    di.plane_info[pli].xdec = pli && !(info.pixel_fmt & 1);
+    di.plane_info[pli].ydec = pli && !(info.pixel_fmt & 2);
+  }
+  di.keyframe_rate = keyframe_rate;
+  daala_comment_init(&dc);
+  srand(time(NULL));
+  serial = rand();
+  for (ri = 0; ri < nrenditions; ri++) {
+    od_rendition *r;
+    char name[1024];
+    r = renditions + ri;
+    /*Leave room for "-<quality>.ogv".*/
+    if (strlen(prefix) > sizeof(name) - 16) {
+      fprintf(stderr, "Output prefix is too long.\n");
+      exit(EXIT_FAILURE);
+    }
+    sprintf(name, "%s-%i.ogv", prefix, r->quality);
+    r->fout = fopen(name, "wb");
+    if (r->fout == NULL) {
+      fprintf(stderr, "Unable to open output file '%s'\n", name);
+      exit(EXIT_FAILURE);
+    }
+    r->bytes = 0;
+    ogg_stream_init(&r->os, serial + ri);
+    r->enc = daala_encode_create(&di);
+    if (r->enc == NULL) {
+      fprintf(stderr, "Internal Daala library error.\n");
+      exit(EXIT_FAILURE);
+    }
+    daala_encode_ctl(r->enc, OD_SET_QUANT, &r->quality, sizeof(r->quality));
+    daala_encode_ctl(r->enc, OD_SET_COMPLEXITY, &complexity,
+     sizeof(complexity));
+    write_headers(r, &dc);
+    encs[ri] = r->enc;
+  }
+  fprintf(stderr, "Compressing %i renditions...\n", nrenditions);
+  for (nframes = 0; limit < 0 || nframes < limit; nframes++) {
+    video_input_ycbcr in;
+    char tag[5];
+    if (video_input_fetch_frame(&vid, in, tag) <= 0) break;
+    /*Pull the packets from the previous frame.*/
+    for (ri = 0; ri < nrenditions; ri++) drain_packets(renditions + ri, 0);
+    img.nplanes = 3;
+    img.width = info.pic_w;
+    img.height = info.pic_h;
+    for (pli = 0; pli < 3; pli++) {
+      int xdec;
+      int ydec;
+      xdec = di.plane_info[pli].xdec;
+      ydec = di.plane_info[pli].ydec;
+      img.planes[pli].data = in[pli].data
+       + (info.pic_y >> ydec)*in[pli].stride + (info.pic_x >> xdec);
+      img.planes[pli].xdec = xdec;
+      img.planes[pli].ydec = ydec;
+      img.planes[pli].xstride = 1;
+      img.planes[pli].ystride = in[pli].stride;
+    }
+    if (daala_encode_img_in_multi(encs, nrenditions, &img, 0) < 0) {
+      fprintf(stderr, "Internal Daala library error.\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (ri = 0; ri < nrenditions; ri++) {
+    od_rendition *r;
+    r = renditions + ri;
+    drain_packets(r, 1);
+    fprintf(stderr, "%s-%i.ogv: %i frames, %li bytes\n",
+     prefix, r->quality, nframes, r->bytes);
+    ogg_stream_clear(&r->os);
+    daala_encode_free(r->enc);
+    fclose(r->fout);
+  }
+  daala_comment_clear(&dc);
+  video_input_close(&vid);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,474 @@
+/*Daala video codec
+Copyright (c) 2016 Daala project contributors.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+- Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+- Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS”
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+/*Encodes a YUV4MPEG2 input by splitting it into chunks at the keyframes and
+   encoding each chunk with its own encoder, scheduled over all of the OpenMP
+   threads.
+  Each encoder is told where its chunk starts with OD_SET_START_TIME, so the
+   packets are identical to those of a single encoder for the whole input,
+   and are simply written out in order.*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(_WIN32)
+# include <io.h>
+# include <fcntl.h>
+#endif
+#if defined(_OPENMP)
+# include <omp.h>
+#endif
+#include "getopt.h"
+#include "vidinput.h"
+#include "daala/daalaenc.h"
+
+typedef struct od_chunk od_chunk;
+
+/*A run of frames starting with a keyframe, and the packets they encode to.*/
+struct od_chunk {
+  int64_t start_time;
+  int nframes;
+  /*The cropped input frames, each plane stored contiguously.*/
+  unsigned char *frames;
+  /*The data of all the packets, one after the other.*/
+  unsigned char *data;
+  long ndata;
+  long cdata;
+  long *bytes;
+  ogg_int64_t *granulepos;
+  int npackets;
+  int error;
+};
+
+static void usage(char **_argv) {
+  fprintf(stderr, "Usage: %s [options] <input>\n"
+   "    <input> must be a YUV4MPEG file.\n\n"
+   "    Options:\n\n"
+   "      -o --output <filename.ogv> file name for encoded output;\n"
+   "                                 If this option is not given, the\n"
+   "                                 compressed data is sent to stdout.\n"
+   "      -v --video-quality <n>     Daala quality selector from 0 to 511.\n"
+   "      -k --keyframe-rate <n>     Frequency of keyframes in output.\n"
+   "                                 Each thread buffers this many input\n"
+   "                                 frames.\n"
+   "      -l --limit <n>             Maximum number of frames to encode.\n"
+   "      -z --complexity <n>        Computational complexity: 0...10.\n"
+   "      -t --threads <n>           Number of threads to use.\n",
+   _argv[0]);
+}
+
+static long write_page(FILE *_fout, ogg_page *_og) {
+  if (fwrite(_og->header, 1, _og->header_len, _fout)
+   < (size_t)_og->header_len
+   || fwrite(_og->body, 1, _og->body_len, _fout) < (size_t)_og->body_len) {
+    fprintf(stderr, "Could not complete write to file.\n");
+    exit(EXIT_FAILURE);
+  }
+  return _og->header_len + _og->body_len;
+}
+
+static long write_headers(FILE *_fout, ogg_stream_state *_os,
+ daala_enc_ctx *_enc, daala_comment *_dc) {
+  ogg_packet op;
+  ogg_page og;
+  long bytes;
+  int ret;
+  /*The first packet gets its own page.*/
+  if (daala_encode_flush_header(_enc, _dc, &op) <= 0) {
+    fprintf(stderr, "Internal Daala library error.\n");
+    exit(EXIT_FAILURE);
+  }
+  ogg_stream_packetin(_os, &op);
+  if (ogg_stream_pageout(_os, &og) != 1) {
+    fprintf(stderr, "Internal Ogg library error.\n");
+    exit(EXIT_FAILURE);
+  }
+  bytes = write_page(_fout, &og);
+  for (;;) {
+    ret = daala_encode_flush_header(_enc, _dc, &op);
+    if (ret < 0) {
+      fprintf(stderr, "Internal Daala library error.\n");
+      exit(EXIT_FAILURE);
+    }
+    else if (!ret) break;
+    ogg_stream_packetin(_os, &op);
+  }
+  while (ogg_stream_flush(_os, &og) > 0) bytes += write_page(_fout, &og);
+  return bytes;
+}
+
+static int chunk_add_packet(od_chunk *_c, ogg_packet *_op) {
+  if (_c->ndata + _op->bytes > _c->cdata) {
+    unsigned char *data;
+    long cdata;
+    cdata = 2*_c->cdata;
+    if (cdata < _c->ndata + _op->bytes) cdata = _c->ndata + _op->bytes;
+    data = (unsigned char *)realloc(_c->data, cdata);
+    if (data == NULL) return -1;
+    _c->data = data;
+    _c->cdata = cdata;
+  }
+  memcpy(_c->data + _c->ndata, _op->packet, _op->bytes);
+  _c->ndata += _op->bytes;
+  _c->bytes[_c->npackets] = _op->bytes;
+  _c->granulepos[_c->npackets] = _op->granulepos;
+  _c->npackets++;
+  return 0;
+}
+
+/*Encodes one chunk with a fresh encoder.
+  This runs on its own thread, so errors are only recorded here and reported
+   once all the threads are done.*/
+static void encode_chunk(od_chunk *_c, const daala_info *_di, od_img *_img,
+ int _quality, int _complexity) {
+  daala_enc_ctx *enc;
+  ogg_packet op;
+  od_img img;
+  unsigned char *frame;
+  int fi;
+  int pli;
+  _c->ndata = 0;
+  _c->npackets = 0;
+  _c->error = 1;
+  enc = daala_encode_create(_di);
+  if (enc == NULL) return;
+  daala_encode_ctl(enc, OD_SET_QUANT, &_quality, sizeof(_quality));
+  daala_encode_ctl(enc, OD_SET_COMPLEXITY, &_complexity,
+   sizeof(_complexity));
+  if (daala_encode_ctl(enc, OD_SET_START_TIME, &_c->start_time,
+   sizeof(_c->start_time)) < 0) {
+    daala_encode_free(enc);
+    return;
+  }
+  img = *_img;
+  frame = _c->frames;
+  for (fi = 0; fi < _c->nframes; fi++) {
+    for (pli = 0; pli < img.nplanes; pli++) {
+      img.planes[pli].data = frame;
+      frame += img.planes[pli].ystride*(((_img->height
+       + img.planes[pli].ydec) >> img.planes[pli].ydec));
+    }
+    if (daala_encode_img_in(enc, &img, 0) < 0) {
+      daala_encode_free(enc);
+      return;
+    }
+    while (daala_encode_packet_out(enc, 0, &op) > 0) {
+      if (chunk_add_packet(_c, &op) < 0) {
+        daala_encode_free(enc);
+        return;
+      }
+    }
+  }
+  daala_encode_free(enc);
+  _c->error = 0;
+}
+
+int main(int _argc, char **_argv) {
+  const char *optstring = "ho:v:k:l:z:t:";
+  const struct option long_options[] = {
+    { "help", no_argument, NULL, 'h' },
+    { "output", required_argument, NULL, 'o' },
+    { "video-quality", required_argument, NULL, 'v' },
+    { "keyframe-rate", required_argument, NULL, 'k' },
+    { "limit", required_argument, NULL, 'l' },
+    { "complexity", required_argument, NULL, 'z' },
+    { "threads", required_argument, NULL, 't' },
+    { NULL, 0, NULL, 0 }
+  };
+  od_chunk *chunks;
+  FILE *fin;
+  FILE *fout;
+  video_input vid;
+  video_input_info info;
+  daala_info di;
+  daala_comment dc;
+  daala_enc_ctx *enc;
+  ogg_stream_state os;
+  ogg_packet held;
+  ogg_page og;
+  od_img img;
+  long held_sz;
+  long frame_sz;
+  long bytes;
+  int quality;
+  int keyframe_rate;
+  int complexity;
+  int nthreads;
+  int limit;
+  int nframes;
+  int done;
+  int pli;
+  int c;
+  fout = stdout;
+  quality = 10;
+  keyframe_rate = 256;
+  complexity = 7;
+  limit = -1;
+#if defined(_OPENMP)
+  nthreads = omp_get_max_threads();
+#else
+  nthreads = 1;
+#endif
+  while ((c = getopt_long(_argc, _argv, optstring, long_options, NULL))
+   != EOF) {
+    switch (c) {
+      case 'o': {
+        fout = fopen(optarg, "wb");
+        if (fout == NULL) {
+          fprintf(stderr, "Unable to open output file '%s'\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+      case 'v': {
+        quality = atoi(optarg);
+        if (quality < 0 || quality > 511) {
+          fprintf(stderr, "Illegal video quality (use 0 through 511)\n");
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+      case 'k': {
+        keyframe_rate = atoi(optarg);
+        if (keyframe_rate < 1 || keyframe_rate > 1000) {
+          fprintf(stderr,
+           "Illegal video keyframe rate (use 1 through 1000)\n");
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+      case 'l': limit = atoi(optarg); break;
+      case 'z': {
+        complexity = atoi(optarg);
+        if (complexity < 0 || complexity > 10) {
+          fprintf(stderr,
+           "Illegal complexity setting (must be 0...10, inclusive)\n");
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+      case 't': {
+        nthreads = atoi(optarg);
+        if (nthreads < 1) {
+          fprintf(stderr, "Invalid number of threads: %s\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+      case 'h':
+      default: {
+        usage(_argv);
+        exit(c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+      }
+    }
+  }
+  if (optind + 1 != _argc) {
+    usage(_argv);
+    exit(EXIT_FAILURE);
+  }
+#if defined(_OPENMP)
+  omp_set_num_threads(nthreads);
+#else
+  if (nthreads > 1) {
+    fprintf(stderr, "Warning: built without OpenMP, using a single thread.\n");
+    nthreads = 1;
+  }
+#endif
+  fin = strcmp(_argv[optind], "-") == 0 ? stdin : fopen(_argv[optind], "rb");
+  if (fin == NULL) {
+    fprintf(stderr, "Unable to open '%s' for extraction.\n", _argv[optind]);
+    exit(EXIT_FAILURE);
+  }
+#if defined(_WIN32)
+  if (fin == stdin) _setmode(_fileno(stdin), _O_BINARY);
+  if (fout == stdout) _setmode(_fileno(stdout), _O_BINARY);
+#endif
+  if (video_input_open(&vid, fin) < 0) exit(EXIT_FAILURE);
+  video_input_get_info(&vid, &info);
+  if (info.depth != 8) {
+    fprintf(stderr, "Only 8-bit input is supported.\n");
+    exit(EXIT_FAILURE);
+  }
+  daala_info_init(&di);
+  di.pic_width = info.pic_w;
+  di.pic_height = info.pic_h;
+  di.timebase_numerator = info.fps_n;
+  di.timebase_denominator = info.fps_d;
+  di.frame_duration = 1;
+  di.pixel_aspect_numerator = info.par_n;
+  di.pixel_aspect_denominator = info.par_d;
+  di.nplanes = 3;
+  img.nplanes = 3;
+  img.width = info.pic_w;
+  img.height = info.pic_h;
+  frame_sz = 0;
+  for (pli = 0; pli < 3; pli++) {
+    int xdec;
+    int ydec;
+    xdec = di.plane_info[pli].xdec = pli && !(info.pixel_fmt & 1);
+    ydec = di.plane_info[pli].ydec = pli && !(info.pixel_fmt & 2);
+    img.planes[pli].data = NULL;
+    img.planes[pli].xdec = xdec;
+    img.planes[pli].ydec = ydec;
+    img.planes[pli].xstride = 1;
+    img.planes[pli].ystride = (info.pic_w + xdec) >> xdec;
+    frame_sz += img.planes[pli].ystride*(long)((info.pic_h + ydec) >> ydec);
+  }
+  di.keyframe_rate = keyframe_rate;
+  daala_comment_init(&dc);
+  srand(time(NULL));
+  ogg_stream_init(&os, rand());
+  /*Every chunk encoder would produce the same headers, so we use a separate
+     one for them.*/
+  enc = daala_encode_create(&di);
+  if (enc == NULL) {
+    fprintf(stderr, "Internal Daala library error.\n");
+    exit(EXIT_FAILURE);
+  }
+  bytes = write_headers(fout, &os, enc, &dc);
+  daala_encode_free(enc);
+  chunks = (od_chunk *)calloc(nthreads, sizeof(*chunks));
+  if (chunks == NULL) {
+    fprintf(stderr, "Error allocating chunk buffers.\n");
+    exit(EXIT_FAILURE);
+  }
+  for (c = 0; c < nthreads; c++) {
+    chunks[c].frames = (unsigned char *)malloc(keyframe_rate*frame_sz);
+    chunks[c].bytes = (long *)malloc(keyframe_rate*sizeof(*chunks[c].bytes));
+    chunks[c].granulepos = (ogg_int64_t *)malloc(
+     keyframe_rate*sizeof(*chunks[c].granulepos));
+    if (chunks[c].frames == NULL || chunks[c].bytes == NULL
+     || chunks[c].granulepos == NULL) {
+      fprintf(stderr, "Error allocating chunk buffers.\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  memset(&held, 0, sizeof(held));
+  held_sz = 0;
+  fprintf(stderr, "Compressing with %i threads...\n", nthreads);
+  for (nframes = done = 0; !done;) {
+    int nchunks;
+    int ci;
+    /*Read one chunk for every thread.*/
+    for (nchunks = 0; nchunks < nthreads && !done; nchunks++) {
+      od_chunk *ch;
+      ch = chunks + nchunks;
+      ch->start_time = nframes;
+      for (ch->nframes = 0; ch->nframes < keyframe_rate; ch->nframes++) {
+        video_input_ycbcr in;
+        unsigned char *frame;
+        char tag[5];
+        if ((limit >= 0 && nframes >= limit)
+         || video_input_fetch_frame(&vid, in, tag) <= 0) {
+          done = 1;
+          break;
+        }
+        frame = ch->frames + ch->nframes*frame_sz;
+        for (pli = 0; pli < 3; pli++) {
+          int xdec;
+          int ydec;
+          int w;
+          int h;
+          int y;
+          xdec = img.planes[pli].xdec;
+          ydec = img.planes[pli].ydec;
+          w = img.planes[pli].ystride;
+          h = (info.pic_h + ydec) >> ydec;
+          for (y = 0; y < h; y++) {
+            memcpy(frame, in[pli].data + ((info.pic_y >> ydec) + y)
+             *in[pli].stride + (info.pic_x >> xdec), w);
+            frame += w;
+          }
+        }
+        nframes++;
+      }
+      if (ch->nframes == 0) break;
+    }
+#if defined(_OPENMP)
+    #pragma omp parallel for schedule(dynamic)
+#endif
+    for (ci = 0; ci < nchunks; ci++) {
+      encode_chunk(chunks + ci, &di, &img, quality, complexity);
+    }
+    /*Stitch the packets together in order.
+      The encoders already computed the right granulepos for each one.*/
+    for (ci = 0; ci < nchunks; ci++) {
+      od_chunk *ch;
+      long offset;
+      int pi;
+      ch = chunks + ci;
+      if (ch->error) {
+        fprintf(stderr, "Internal Daala library error.\n");
+        exit(EXIT_FAILURE);
+      }
+      for (offset = pi = 0; pi < ch->npackets; pi++) {
+        /*We can only tell which packet is the last one once the input runs
+           out, which may not happen until the next batch, so we always hold
+           one back.*/
+        if (held.bytes > 0) {
+          ogg_stream_packetin(&os, &held);
+          while (ogg_stream_pageout(&os, &og) > 0) {
+            bytes += write_page(fout, &og);
+          }
+        }
+        if (ch->bytes[pi] > held_sz) {
+          held_sz = ch->bytes[pi];
+          held.packet = (unsigned char *)realloc(held.packet, held_sz);
+          if (held.packet == NULL) {
+            fprintf(stderr, "Error allocating packet buffer.\n");
+            exit(EXIT_FAILURE);
+          }
+        }
+        memcpy(held.packet, ch->data + offset, ch->bytes[pi]);
+        held.bytes = ch->bytes[pi];
+        held.granulepos = ch->granulepos[pi];
+        offset += ch->bytes[pi];
+      }
+    }
+  }
+  if (held.bytes > 0) {
+    held.e_o_s = 1;
+    ogg_stream_packetin(&os, &held);
+  }
+  while (ogg_stream_flush(&os, &og) > 0) bytes += write_page(fout, &og);
+  free(held.packet);
+  fprintf(stderr, "%i frames, %li bytes\n", nframes, bytes);
+  for (c = 0; c < nthreads; c++) {
+    free(chunks[c].frames);
+    free(chunks[c].data);
+    free(chunks[c].bytes);
+    free(chunks[c].granulepos);
+  }
+  free(chunks);
+  ogg_stream_clear(&os);
+  daala_comment_clear(&dc);
+  video_input_close(&vid);
+  if (fout != stdout) fclose(fout);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,779 @@
+/*Daala video codec
+Copyright (c) 2016 Daala project contributors.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+- Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+- Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#if !defined(M_PI)
+# define M_PI (3.141592653589793238462643)
+#endif
+#include "metrics.h"
+#include "../src/dct.h"
+#if defined(OD_X86ASM)
+# include "../src/x86/cpu.h"
+# include "../src/x86/x86int.h"
+#endif
+
+static od_dct_func_2d metrics_fdct8x8=od_bin_fdct8x8;
+static ssim_hfilter_func ssim_hfilter=ssim_hfilter_c;
+static ssim_vfilter_func ssim_vfilter=ssim_vfilter_c;
+static fs_downsample_level0_func fs_downsample_level0=fs_downsample_level0_c;
+
+void metrics_init(void){
+#if defined(OD_X86ASM)
+  uint32_t cpu_flags;
+  cpu_flags=od_cpu_flags_get();
+  if(cpu_flags&OD_CPU_X86_SSE2){
+# if defined(OD_SSE2_INTRINSICS)
+    metrics_fdct8x8=od_bin_fdct8x8_sse2;
+    ssim_hfilter=ssim_hfilter_sse2;
+    ssim_vfilter=ssim_vfilter_sse2;
+    fs_downsample_level0=fs_downsample_level0_sse2;
+# endif
+# if defined(OD_SSE41_INTRINSICS)
+    if(cpu_flags&OD_CPU_X86_SSE4_1)metrics_fdct8x8=od_bin_fdct8x8_sse41;
+# endif
+# if defined(OD_AVX2_INTRINSICS)
+    if(cpu_flags&OD_CPU_X86_AVX2)metrics_fdct8x8=od_bin_fdct8x8_avx2;
+# endif
+  }
+#endif
+}
+
+int64_t calc_sqerr(const unsigned char *_src,int _systride,
+ const unsigned char *_dst,int _dystride,int _w,int _h){
+  int64_t sqerr;
+  int     x;
+  int     y;
+  sqerr=0;
+  for(y=0;y<_h;y++){
+    for(x=0;x<_w;x++){
+      int d;
+      d=_src[x]-_dst[x];
+      sqerr+=d*d;
+    }
+    _src+=_systride;
+    _dst+=_dystride;
+  }
+  return sqerr;
+}
+
+/*Normalized inverse quantization matrix for 8x8 DCT at the point of transparency.
+  This is not the JPEG based matrix from the paper,
+  this one gives a slightly higher MOS agreement.*/
+float csf_y[8][8]={{1.6193873005, 2.2901594831, 2.08509755623, 1.48366094411, 1.00227514334, 0.678296995242, 0.466224900598, 0.3265091542},
+                 {2.2901594831, 1.94321815382, 2.04793073064, 1.68731108984, 1.2305666963, 0.868920337363, 0.61280991668, 0.436405793551},
+                 {2.08509755623, 2.04793073064, 1.34329019223, 1.09205635862, 0.875748795257, 0.670882927016, 0.501731932449, 0.372504254596},
+                 {1.48366094411, 1.68731108984, 1.09205635862, 0.772819797575, 0.605636379554, 0.48309405692, 0.380429446972, 0.295774038565},
+                 {1.00227514334, 1.2305666963, 0.875748795257, 0.605636379554, 0.448996256676, 0.352889268808, 0.283006984131, 0.226951348204},
+                 {0.678296995242, 0.868920337363, 0.670882927016, 0.48309405692, 0.352889268808, 0.27032073436, 0.215017739696, 0.17408067321},
+                 {0.466224900598, 0.61280991668, 0.501731932449, 0.380429446972, 0.283006984131, 0.215017739696, 0.168869545842, 0.136153931001},
+                 {0.3265091542, 0.436405793551, 0.372504254596, 0.295774038565, 0.226951348204, 0.17408067321, 0.136153931001, 0.109083846276}};
+float csf_cb420[8][8]={{1.91113096927, 2.46074210438, 1.18284184739, 1.14982565193, 1.05017074788, 0.898018824055, 0.74725392039, 0.615105596242},
+                       {2.46074210438, 1.58529308355, 1.21363250036, 1.38190029285, 1.33100189972, 1.17428548929, 0.996404342439, 0.830890433625},
+                       {1.18284184739, 1.21363250036, 0.978712413627, 1.02624506078, 1.03145147362, 0.960060382087, 0.849823426169, 0.731221236837},
+                       {1.14982565193, 1.38190029285, 1.02624506078, 0.861317501629, 0.801821139099, 0.751437590932, 0.685398513368, 0.608694761374},
+                       {1.05017074788, 1.33100189972, 1.03145147362, 0.801821139099, 0.676555426187, 0.605503172737, 0.55002013668, 0.495804539034},
+                       {0.898018824055, 1.17428548929, 0.960060382087, 0.751437590932, 0.605503172737, 0.514674450957, 0.454353482512, 0.407050308965},
+                       {0.74725392039, 0.996404342439, 0.849823426169, 0.685398513368, 0.55002013668, 0.454353482512, 0.389234902883, 0.342353999733},
+                       {0.615105596242, 0.830890433625, 0.731221236837, 0.608694761374, 0.495804539034, 0.407050308965, 0.342353999733, 0.295530605237}};
+float csf_cr420[8][8]={{2.03871978502, 2.62502345193, 1.26180942886, 1.11019789803, 1.01397751469, 0.867069376285, 0.721500455585, 0.593906509971},
+                       {2.62502345193, 1.69112867013, 1.17180569821, 1.3342742857, 1.28513006198, 1.13381474809, 0.962064122248, 0.802254508198},
+                       {1.26180942886, 1.17180569821, 0.944981930573, 0.990876405848, 0.995903384143, 0.926972725286, 0.820534991409, 0.706020324706},
+                       {1.11019789803, 1.3342742857, 0.990876405848, 0.831632933426, 0.77418706195, 0.725539939514, 0.661776842059, 0.587716619023},
+                       {1.01397751469, 1.28513006198, 0.995903384143, 0.77418706195, 0.653238524286, 0.584635025748, 0.531064164893, 0.478717061273},
+                       {0.867069376285, 1.13381474809, 0.926972725286, 0.725539939514, 0.584635025748, 0.496936637883, 0.438694579826, 0.393021669543},
+                       {0.721500455585, 0.962064122248, 0.820534991409, 0.661776842059, 0.531064164893, 0.438694579826, 0.375820256136, 0.330555063063},
+                       {0.593906509971, 0.802254508198, 0.706020324706, 0.587716619023, 0.478717061273, 0.393021669543, 0.330555063063, 0.285345396658}};
+
+double calc_psnrhvs(const unsigned char *_src,int _systride,
+ const unsigned char *_dst,int _dystride,double _par,int _w,int _h,int _step,
+ float _csf[8][8]){
+  float    ret;
+  od_coeff dct_s[8*8];
+  od_coeff dct_d[8*8];
+  float mask[8][8];
+  int pixels;
+  int x;
+  int y;
+  (void)_par;
+  ret=pixels=0;
+  /*In the PSNR-HVS-M paper[1] the authors describe the construction of
+     their masking table as "we have used the quantization table for the
+     color component Y of JPEG [6] that has been also obtained on the
+     basis of CSF. Note that the values in quantization table JPEG have
+     been normalized and then squared." Their CSF matrix (from PSNR-HVS)
+     was also constructed from the JPEG matrices. I can not find any obvious
+     scheme of normalizing to produce their table, but if I multiply their
+     CSF by 0.38857 and square the result I get their masking table.
+     I have no idea where this constant comes from, but deviating from it
+     too greatly hurts MOS agreement.
+
+    [1] Nikolay Ponomarenko, Flavia Silvestri, Karen Egiazarian, Marco Carli,
+        Jaakko Astola, Vladimir Lukin, "On between-coefficient contrast masking
+        of DCT basis functions", CD-ROM Proceedings of the Third
+        International Workshop on Video Processing and Quality Metrics for Consumer
+        Electronics VPQM-07, Scottsdale, Arizona, USA, 25-26 January, 2007, 4 p.*/
+  for(x=0;x<8;x++)for(y=0;y<8;y++)mask[x][y]=(_csf[x][y]*0.3885746225901003)*(_csf[x][y]*0.3885746225901003);
+  for(y=0;y<_h-7;y+=_step){
+    for(x=0;x<_w-7;x+=_step){
+      int i;
+      int j;
+      float s_means[4];
+      float d_means[4];
+      float s_vars[4];
+      float d_vars[4];
+      float s_gmean=0;
+      float d_gmean=0;
+      float s_gvar=0;
+      float d_gvar=0;
+      float s_mask=0;
+      float d_mask=0;
+      for(i=0;i<4;i++)s_means[i]=d_means[i]=s_vars[i]=d_vars[i]=0;
+      for(i=0;i<8;i++){
+        for(j=0;j<8;j++){
+          int sub=((i&12)>>2)+((j&12)>>1);
+          dct_s[i*8+j]=_src[(y+i)*_systride+(j+x)];
+          dct_d[i*8+j]=_dst[(y+i)*_dystride+(j+x)];
+          s_gmean+=dct_s[i*8+j];
+          d_gmean+=dct_d[i*8+j];
+          s_means[sub]+=dct_s[i*8+j];
+          d_means[sub]+=dct_d[i*8+j];
+        }
+      }
+      s_gmean/=64.f;
+      d_gmean/=64.f;
+      for(i=0;i<4;i++)s_means[i]/=16.f;
+      for(i=0;i<4;i++)d_means[i]/=16.f;
+      for(i=0;i<8;i++){
+        for(j=0;j<8;j++){
+          int sub=((i&12)>>2)+((j&12)>>1);
+          s_gvar+=(dct_s[i*8+j]-s_gmean)*(dct_s[i*8+j]-s_gmean);
+          d_gvar+=(dct_d[i*8+j]-d_gmean)*(dct_d[i*8+j]-d_gmean);
+          s_vars[sub]+=(dct_s[i*8+j]-s_means[sub])*(dct_s[i*8+j]-s_means[sub]);
+          d_vars[sub]+=(dct_d[i*8+j]-d_means[sub])*(dct_d[i*8+j]-d_means[sub]);
+        }
+      }
+      s_gvar*=1/63.f*64;
+      d_gvar*=1/63.f*64;
+      for(i=0;i<4;i++)s_vars[i]*=1/15.f*16;
+      for(i=0;i<4;i++)d_vars[i]*=1/15.f*16;
+      if(s_gvar>0)s_gvar=(s_vars[0]+s_vars[1]+s_vars[2]+s_vars[3])/s_gvar;
+      if(d_gvar>0)d_gvar=(d_vars[0]+d_vars[1]+d_vars[2]+d_vars[3])/d_gvar;
+      (*metrics_fdct8x8)(dct_s,8,dct_s,8);
+      (*metrics_fdct8x8)(dct_d,8,dct_d,8);
+      for(i=0;i<8;i++)for(j=(i==0);j<8;j++)s_mask+=dct_s[i*8+j]*dct_s[i*8+j]*mask[i][j];
+      for(i=0;i<8;i++)for(j=(i==0);j<8;j++)d_mask+=dct_d[i*8+j]*dct_d[i*8+j]*mask[i][j];
+      s_mask=sqrt(s_mask*s_gvar)/32.f;
+      d_mask=sqrt(d_mask*d_gvar)/32.f;
+      if(d_mask>s_mask)s_mask=d_mask;
+      for(i=0;i<8;i++){
+        for(j=0;j<8;j++){
+          float err;
+          err=fabs(dct_s[i*8+j]-dct_d[i*8+j]);
+          if(i!=0||j!=0)err=err<s_mask/mask[i][j]?0:err-s_mask/mask[i][j];
+          ret+=(err*_csf[i][j])*(err*_csf[i][j]);
+          pixels++;
+        }
+      }
+    }
+  }
+  ret/=pixels;
+  return ret;
+}
+
+#define KERNEL_SHIFT (8)
+#define KERNEL_WEIGHT (1<<KERNEL_SHIFT)
+#define KERNEL_ROUND ((1<<KERNEL_SHIFT)>>1)
+
+static int gaussian_filter_init(unsigned **_kernel,double _sigma,int _max_len){
+  unsigned *kernel;
+  double    scale;
+  double    nhisigma2;
+  double    s;
+  double    len;
+  unsigned  sum;
+  int       kernel_len;
+  int       kernel_sz;
+  int       ci;
+  scale=1/(sqrt(2*M_PI)*_sigma);
+  nhisigma2=-0.5/(_sigma*_sigma);
+  /*Compute the kernel size so that the error in the first truncated
+     coefficient is no larger than 0.5*KERNEL_WEIGHT.
+    There is no point in going beyond this given our working precision.*/
+  s=sqrt(0.5*M_PI)*_sigma*(1.0/KERNEL_WEIGHT);
+  if(s>=1)len=0;
+  else len=floor(_sigma*sqrt(-2*log(s)));
+  kernel_len=len>=_max_len?_max_len-1:(int)len;
+  kernel_sz=kernel_len<<1|1;
+  kernel=(unsigned *)malloc(kernel_sz*sizeof(*kernel));
+  sum=0;
+  for(ci=kernel_len;ci>0;ci--){
+    kernel[kernel_len-ci]=kernel[kernel_len+ci]=
+     (unsigned)(KERNEL_WEIGHT*scale*exp(nhisigma2*ci*ci)+0.5);
+    sum+=kernel[kernel_len-ci];
+  }
+  kernel[kernel_len]=KERNEL_WEIGHT-(sum<<1);
+  *_kernel=kernel;
+  return kernel_sz;
+}
+
+void ssim_hfilter_c(unsigned *_m,int _w,
+ const unsigned char *_src,const unsigned char *_dst,
+ const unsigned *_kernel,int _kernel_sz,int _x0,int _x1){
+  int offs;
+  int x;
+  offs=_kernel_sz>>1;
+  for(x=_x0;x<_x1;x++){
+    unsigned mux;
+    unsigned muy;
+    unsigned x2;
+    unsigned xy;
+    unsigned y2;
+    unsigned w;
+    int      k;
+    int      k_min;
+    int      k_max;
+    mux=muy=x2=xy=y2=w=0;
+    k_min=offs-x<=0?0:offs-x;
+    k_max=x+offs-_w+1<=0?_kernel_sz:_kernel_sz-(x+offs-_w+1);
+    for(k=k_min;k<k_max;k++){
+      unsigned s;
+      unsigned d;
+      unsigned window;
+      s=_src[x-offs+k];
+      d=_dst[x-offs+k];
+      window=_kernel[k];
+      mux+=window*s;
+      muy+=window*d;
+      x2+=window*s*s;
+      xy+=window*s*d;
+      y2+=window*d*d;
+      w+=window;
+    }
+    _m[SSIM_MUX*_w+x]=mux;
+    _m[SSIM_MUY*_w+x]=muy;
+    _m[SSIM_X2*_w+x]=x2;
+    _m[SSIM_XY*_w+x]=xy;
+    _m[SSIM_Y2*_w+x]=y2;
+    _m[SSIM_W*_w+x]=w;
+  }
+}
+
+void ssim_vfilter_c(unsigned *_m,int _w,
+ const unsigned *const *_lines,const unsigned *_kernel,int _k_min,int _k_max,
+ int _x0,int _x1){
+  int j;
+  int x;
+  for(j=0;j<SSIM_NMOMENTS;j++){
+    for(x=_x0;x<_x1;x++){
+      unsigned m;
+      int      k;
+      m=0;
+      for(k=_k_min;k<_k_max;k++)m+=_kernel[k]*_lines[k][j*_w+x];
+      _m[j*_w+x]=m;
+    }
+  }
+}
+
+#define SSIM_C1 (255*255*0.01*0.01)
+#define SSIM_C2 (255*255*0.03*0.03)
+
+double calc_ssim(const unsigned char *_src,int _systride,
+ const unsigned char *_dst,int _dystride,double _par,int _w,int _h){
+  unsigned      *line_buf;
+  unsigned     **lines;
+  const unsigned **taps;
+  unsigned      *m;
+  double         ssim;
+  double         ssimw;
+  unsigned      *hkernel;
+  int            hkernel_sz;
+  unsigned      *vkernel;
+  int            vkernel_sz;
+  int            vkernel_offs;
+  int            line_sz;
+  int            line_mask;
+  int            x;
+  int            y;
+  vkernel_sz=gaussian_filter_init(&vkernel,_h*(1.5/256),_w<_h?_w:_h);
+  vkernel_offs=vkernel_sz>>1;
+  for(line_sz=1;line_sz<vkernel_sz;line_sz<<=1);
+  line_mask=line_sz-1;
+  lines=(unsigned **)malloc(line_sz*sizeof(*lines));
+  lines[0]=line_buf=(unsigned *)malloc(
+   (line_sz+1)*SSIM_NMOMENTS*_w*sizeof(*line_buf));
+  for(y=1;y<line_sz;y++)lines[y]=lines[y-1]+SSIM_NMOMENTS*_w;
+  m=lines[line_sz-1]+SSIM_NMOMENTS*_w;
+  taps=(const unsigned **)malloc(vkernel_sz*sizeof(*taps));
+  hkernel_sz=gaussian_filter_init(&hkernel,_h*(1.5/256)/_par,_w<_h?_w:_h);
+  ssim=0;
+  ssimw=0;
+  for(y=0;y<_h+vkernel_offs;y++){
+    int k;
+    int k_min;
+    int k_max;
+    if(y<_h){
+      (*ssim_hfilter)(lines[y&line_mask],_w,_src,_dst,hkernel,hkernel_sz,
+       0,_w);
+      _src+=_systride;
+      _dst+=_dystride;
+    }
+    if(y>=vkernel_offs){
+      k_min=vkernel_sz-y-1<=0?0:vkernel_sz-y-1;
+      k_max=y+1-_h<=0?vkernel_sz:vkernel_sz-(y+1-_h);
+      for(k=k_min;k<k_max;k++)taps[k]=lines[y+1-vkernel_sz+k&line_mask];
+      (*ssim_vfilter)(m,_w,taps,vkernel,k_min,k_max,0,_w);
+      for(x=0;x<_w;x++){
+        unsigned mux;
+        unsigned muy;
+        double   c1;
+        double   c2;
+        double   mx2;
+        double   mxy;
+        double   my2;
+        double   w;
+        mux=m[SSIM_MUX*_w+x];
+        muy=m[SSIM_MUY*_w+x];
+        w=m[SSIM_W*_w+x];
+        c1=SSIM_C1*w*w;
+        c2=SSIM_C2*w*w;
+        mx2=mux*(double)mux;
+        mxy=mux*(double)muy;
+        my2=muy*(double)muy;
+        ssim+=w*(2*mxy+c1)*(c2+2*(m[SSIM_XY*_w+x]*w-mxy))/
+         ((mx2+my2+c1)*(m[SSIM_X2*_w+x]*w-mx2+m[SSIM_Y2*_w+x]*w-my2+c2));
+        ssimw+=w;
+      }
+    }
+  }
+  free(taps);
+  free(hkernel);
+  free(vkernel);
+  free(line_buf);
+  free(lines);
+  return ssim/ssimw;
+}
+
+typedef struct fs_level fs_level;
+typedef struct fs_ctx   fs_ctx;
+
+#define FS_MINI(_a,_b) ((_a)<(_b)?(_a):(_b))
+#define FS_MAXI(_a,_b) ((_a)>(_b)?(_a):(_b))
+
+struct fs_level{
+  uint16_t *im1;
+  uint16_t *im2;
+  double       *ssim;
+  int           w;
+  int           h;
+};
+
+struct fs_ctx{
+  fs_level *level;
+  int       nlevels;
+  unsigned *col_buf;
+};
+
+static void fs_ctx_init(fs_ctx *_ctx,int _w,int _h,int _nlevels){
+  unsigned char *data;
+  size_t         data_size;
+  int            lw;
+  int            lh;
+  int            l;
+  lw=_w+1>>1;
+  lh=_h+1>>1;
+  data_size=_nlevels*sizeof(fs_level)+2*(lw+8)*8*sizeof(*_ctx->col_buf);
+  for(l=0;l<_nlevels;l++){
+    size_t im_size;
+    size_t level_size;
+    im_size=lw*(size_t)lh;
+    level_size=2*im_size*sizeof(*_ctx->level[l].im1);
+    level_size+=sizeof(*_ctx->level[l].ssim)-1;
+    level_size/=sizeof(*_ctx->level[l].ssim);
+    level_size+=im_size;
+    level_size*=sizeof(*_ctx->level[l].ssim);
+    data_size+=level_size;
+    lw=lw+1>>1;
+    lh=lh+1>>1;
+  }
+  data=(unsigned char *)malloc(data_size);
+  _ctx->level=(fs_level *)data;
+  _ctx->nlevels=_nlevels;
+  data+=_nlevels*sizeof(*_ctx->level);
+  lw=_w+1>>1;
+  lh=_h+1>>1;
+  for(l=0;l<_nlevels;l++){
+    size_t im_size;
+    size_t level_size;
+    _ctx->level[l].w=lw;
+    _ctx->level[l].h=lh;
+    im_size=lw*(size_t)lh;
+    level_size=2*im_size*sizeof(*_ctx->level[l].im1);
+    level_size+=sizeof(*_ctx->level[l].ssim)-1;
+    level_size/=sizeof(*_ctx->level[l].ssim);
+    level_size*=sizeof(*_ctx->level[l].ssim);
+    _ctx->level[l].im1=(uint16_t *)data;
+    _ctx->level[l].im2=_ctx->level[l].im1+im_size;
+    data+=level_size;
+    _ctx->level[l].ssim=(double *)data;
+    data+=im_size*sizeof(*_ctx->level[l].ssim);
+    lw=lw+1>>1;
+    lh=lh+1>>1;
+  }
+  _ctx->col_buf=(unsigned *)data;
+}
+
+static void fs_ctx_clear(fs_ctx *_ctx){
+  free(_ctx->level);
+}
+
+static void fs_downsample_level(fs_ctx *_ctx,int _l){
+  const uint16_t *src1;
+  const uint16_t *src2;
+  uint16_t       *dst1;
+  uint16_t       *dst2;
+  int                 w2;
+  int                 h2;
+  int                 w;
+  int                 h;
+  int                 i;
+  int                 j;
+  w=_ctx->level[_l].w;
+  h=_ctx->level[_l].h;
+  dst1=_ctx->level[_l].im1;
+  dst2=_ctx->level[_l].im2;
+  w2=_ctx->level[_l-1].w;
+  h2=_ctx->level[_l-1].h;
+  src1=_ctx->level[_l-1].im1;
+  src2=_ctx->level[_l-1].im2;
+  for(j=0;j<h;j++){
+    int j0offs;
+    int j1offs;
+    j0offs=2*j*w2;
+    j1offs=FS_MINI(2*j+1,h2-1)*w2;
+    for(i=0;i<w;i++){
+      int i0;
+      int i1;
+      i0=2*i;
+      i1=FS_MINI(i0+1,w2-1);
+      dst1[j*w+i]=src1[j0offs+i0]+src1[j0offs+i1]
+       +src1[j1offs+i0]+src1[j1offs+i1];
+      dst2[j*w+i]=src2[j0offs+i0]+src2[j0offs+i1]
+       +src2[j1offs+i0]+src2[j1offs+i1];
+    }
+  }
+}
+
+void fs_downsample_level0_c(uint16_t *_dst1,uint16_t *_dst2,
+ int _dw,int _dh,const unsigned char *_src1,int _s1ystride,
+ const unsigned char *_src2,int _s2ystride,int _w,int _h){
+  int i;
+  int j;
+  for(j=0;j<_dh;j++){
+    int j0;
+    int j1;
+    j0=2*j;
+    j1=FS_MINI(j0+1,_h-1);
+    for(i=0;i<_dw;i++){
+      int i0;
+      int i1;
+      i0=2*i;
+      i1=FS_MINI(i0+1,_w-1);
+      _dst1[j*_dw+i]=_src1[j0*_s1ystride+i0]+_src1[j0*_s1ystride+i1]
+       +_src1[j1*_s1ystride+i0]+_src1[j1*_s1ystride+i1];
+      _dst2[j*_dw+i]=_src2[j0*_s2ystride+i0]+_src2[j0*_s2ystride+i1]
+       +_src2[j1*_s2ystride+i0]+_src2[j1*_s2ystride+i1];
+    }
+  }
+}
+
+static void fs_apply_luminance(fs_ctx *_ctx,int _l){
+  unsigned     *col_sums_x;
+  unsigned     *col_sums_y;
+  uint16_t *im1;
+  uint16_t *im2;
+  double       *ssim;
+  double        c1;
+  int           w;
+  int           h;
+  int           j0offs;
+  int           j1offs;
+  int           i;
+  int           j;
+  w=_ctx->level[_l].w;
+  h=_ctx->level[_l].h;
+  col_sums_x=_ctx->col_buf;
+  col_sums_y=col_sums_x+w;
+  im1=_ctx->level[_l].im1;
+  im2=_ctx->level[_l].im2;
+  for(i=0;i<w;i++)col_sums_x[i]=5*im1[i];
+  for(i=0;i<w;i++)col_sums_y[i]=5*im2[i];
+  for(j=1;j<4;j++){
+    j1offs=FS_MINI(j,h-1)*w;
+    for(i=0;i<w;i++)col_sums_x[i]+=im1[j1offs+i];
+    for(i=0;i<w;i++)col_sums_y[i]+=im2[j1offs+i];
+  }
+  ssim=_ctx->level[_l].ssim;
+  c1=(double)(SSIM_C1*4096*(1<<4*_l));
+  for(j=0;j<h;j++){
+    unsigned mux;
+    unsigned muy;
+    int      i0;
+    int      i1;
+    mux=5*col_sums_x[0];
+    muy=5*col_sums_y[0];
+    for(i=1;i<4;i++){
+      i1=FS_MINI(i,w-1);
+      mux+=col_sums_x[i1];
+      muy+=col_sums_y[i1];
+    }
+    for(i=0;i<w;i++){
+      ssim[j*w+i]*=(2*mux*(double)muy+c1)/(mux*(double)mux+muy*(double)muy+c1);
+      if(i+1<w){
+        i0=FS_MAXI(0,i-4);
+        i1=FS_MINI(i+4,w-1);
+        mux+=col_sums_x[i1]-col_sums_x[i0];
+        muy+=col_sums_x[i1]-col_sums_x[i0];
+      }
+    }
+    if(j+1<h){
+      j0offs=FS_MAXI(0,j-4)*w;
+      for(i=0;i<w;i++)col_sums_x[i]-=im1[j0offs+i];
+      for(i=0;i<w;i++)col_sums_y[i]-=im2[j0offs+i];
+      j1offs=FS_MINI(j+4,h-1)*w;
+      for(i=0;i<w;i++)col_sums_x[i]+=im1[j1offs+i];
+      for(i=0;i<w;i++)col_sums_y[i]+=im2[j1offs+i];
+    }
+  }
+}
+
+#define FS_COL_SET(_col,_joffs,_ioffs) \
+  do{ \
+    unsigned gx; \
+    unsigned gy; \
+    gx=gx_buf[(j+(_joffs)&7)*stride+i+(_ioffs)]; \
+    gy=gy_buf[(j+(_joffs)&7)*stride+i+(_ioffs)]; \
+    col_sums_gx2[(_col)]=gx*(double)gx; \
+    col_sums_gy2[(_col)]=gy*(double)gy; \
+    col_sums_gxgy[(_col)]=gx*(double)gy; \
+  } \
+  while(0)
+
+#define FS_COL_ADD(_col,_joffs,_ioffs) \
+  do{ \
+    unsigned gx; \
+    unsigned gy; \
+    gx=gx_buf[(j+(_joffs)&7)*stride+i+(_ioffs)]; \
+    gy=gy_buf[(j+(_joffs)&7)*stride+i+(_ioffs)]; \
+    col_sums_gx2[(_col)]+=gx*(double)gx; \
+    col_sums_gy2[(_col)]+=gy*(double)gy; \
+    col_sums_gxgy[(_col)]+=gx*(double)gy; \
+  } \
+  while(0)
+
+#define FS_COL_SUB(_col,_joffs,_ioffs) \
+  do{ \
+    unsigned gx; \
+    unsigned gy; \
+    gx=gx_buf[(j+(_joffs)&7)*stride+i+(_ioffs)]; \
+    gy=gy_buf[(j+(_joffs)&7)*stride+i+(_ioffs)]; \
+    col_sums_gx2[(_col)]-=gx*(double)gx; \
+    col_sums_gy2[(_col)]-=gy*(double)gy; \
+    col_sums_gxgy[(_col)]-=gx*(double)gy; \
+  } \
+  while(0)
+
+#define FS_COL_COPY(_col1,_col2) \
+  do{ \
+    col_sums_gx2[(_col1)]=col_sums_gx2[(_col2)]; \
+    col_sums_gy2[(_col1)]=col_sums_gy2[(_col2)]; \
+    col_sums_gxgy[(_col1)]=col_sums_gxgy[(_col2)]; \
+  } \
+  while(0)
+
+#define FS_COL_HALVE(_col1,_col2) \
+  do{ \
+    col_sums_gx2[(_col1)]=col_sums_gx2[(_col2)]*0.5; \
+    col_sums_gy2[(_col1)]=col_sums_gy2[(_col2)]*0.5; \
+    col_sums_gxgy[(_col1)]=col_sums_gxgy[(_col2)]*0.5; \
+  } \
+  while(0)
+
+#define FS_COL_DOUBLE(_col1,_col2) \
+  do{ \
+    col_sums_gx2[(_col1)]=col_sums_gx2[(_col2)]*2; \
+    col_sums_gy2[(_col1)]=col_sums_gy2[(_col2)]*2; \
+    col_sums_gxgy[(_col1)]=col_sums_gxgy[(_col2)]*2; \
+  } \
+  while(0)
+
+static void fs_calc_structure(fs_ctx *_ctx,int _l){
+  uint16_t *im1;
+  uint16_t *im2;
+  unsigned     *gx_buf;
+  unsigned     *gy_buf;
+  double       *ssim;
+  double        col_sums_gx2[8];
+  double        col_sums_gy2[8];
+  double        col_sums_gxgy[8];
+  double        c2;
+  int           stride;
+  int           w;
+  int           h;
+  int           i;
+  int           j;
+  w=_ctx->level[_l].w;
+  h=_ctx->level[_l].h;
+  im1=_ctx->level[_l].im1;
+  im2=_ctx->level[_l].im2;
+  ssim=_ctx->level[_l].ssim;
+  gx_buf=_ctx->col_buf;
+  stride=w+8;
+  gy_buf=gx_buf+8*stride;
+  memset(gx_buf,0,2*8*stride*sizeof(*gx_buf));
+  c2=SSIM_C2*(1<<4*_l)*16*104;
+  for(j=0;j<h+4;j++){
+    if(j<h-1){
+      for(i=0;i<w-1;i++){
+        unsigned g1;
+        unsigned g2;
+        unsigned gx;
+        unsigned gy;
+        g1=abs(im1[(j+1)*w+i+1]-im1[j*w+i]);
+        g2=abs(im1[(j+1)*w+i]-im1[j*w+i+1]);
+        gx=4*FS_MAXI(g1,g2)+FS_MINI(g1,g2);
+        g1=abs(im2[(j+1)*w+i+1]-im2[j*w+i]);
+        g2=abs(im2[(j+1)*w+i]-im2[j*w+i+1]);
+        gy=4*FS_MAXI(g1,g2)+FS_MINI(g1,g2);
+        gx_buf[(j&7)*stride+i+4]=gx;
+        gy_buf[(j&7)*stride+i+4]=gy;
+      }
+    }
+    else{
+      memset(gx_buf+(j&7)*stride,0,stride*sizeof(*gx_buf));
+      memset(gy_buf+(j&7)*stride,0,stride*sizeof(*gy_buf));
+    }
+    if(j>=4){
+      int k;
+      col_sums_gx2[3]=col_sums_gx2[2]=col_sums_gx2[1]=col_sums_gx2[0]=0;
+      col_sums_gy2[3]=col_sums_gy2[2]=col_sums_gy2[1]=col_sums_gy2[0]=0;
+      col_sums_gxgy[3]=col_sums_gxgy[2]=col_sums_gxgy[1]=col_sums_gxgy[0]=0;
+      for(i=4;i<8;i++){
+        FS_COL_SET(i,-1,0);
+        FS_COL_ADD(i,0,0);
+        for(k=1;k<8-i;k++){
+          FS_COL_DOUBLE(i,i);
+          FS_COL_ADD(i,-k-1,0);
+          FS_COL_ADD(i,k,0);
+        }
+      }
+      for(i=0;i<w;i++){
+        double   mugx2;
+        double   mugy2;
+        double   mugxgy;
+        mugx2=col_sums_gx2[0];
+        for(k=1;k<8;k++)mugx2+=col_sums_gx2[k];
+        mugy2=col_sums_gy2[0];
+        for(k=1;k<8;k++)mugy2+=col_sums_gy2[k];
+        mugxgy=col_sums_gxgy[0];
+        for(k=1;k<8;k++)mugxgy+=col_sums_gxgy[k];
+        ssim[(j-4)*w+i]=(2*mugxgy+c2)/(mugx2+mugy2+c2);
+        if(i+1<w){
+          FS_COL_SET(0,-1,1);
+          FS_COL_ADD(0,0,1);
+          FS_COL_SUB(2,-3,2);
+          FS_COL_SUB(2,2,2);
+          FS_COL_HALVE(1,2);
+          FS_COL_SUB(3,-4,3);
+          FS_COL_SUB(3,3,3);
+          FS_COL_HALVE(2,3);
+          FS_COL_COPY(3,4);
+          FS_COL_DOUBLE(4,5);
+          FS_COL_ADD(4,-4,5);
+          FS_COL_ADD(4,3,5);
+          FS_COL_DOUBLE(5,6);
+          FS_COL_ADD(5,-3,6);
+          FS_COL_ADD(5,2,6);
+          FS_COL_DOUBLE(6,7);
+          FS_COL_ADD(6,-2,7);
+          FS_COL_ADD(6,1,7);
+          FS_COL_SET(7,-1,8);
+          FS_COL_ADD(7,0,8);
+        }
+      }
+    }
+  }
+}
+
+#define FS_NLEVELS (4)
+
+/*These weights were derived from the default weights found in Wang's original
+   Matlab implementation: {0.0448, 0.2856, 0.2363, 0.1333}.
+  We drop the finest scale and renormalize the rest to sum to 1.*/
+
+static const double FS_WEIGHTS[FS_NLEVELS]={
+  0.2989654541015625,0.3141326904296875,0.2473602294921875,0.1395416259765625
+};
+
+static double fs_average(fs_ctx *_ctx,int _l){
+  double *ssim;
+  double  ret;
+  int     w;
+  int     h;
+  int     i;
+  int     j;
+  w=_ctx->level[_l].w;
+  h=_ctx->level[_l].h;
+  ssim=_ctx->level[_l].ssim;
+  ret=0;
+  for(j=0;j<h;j++)for(i=0;i<w;i++)ret+=ssim[j*w+i];
+  return pow(ret/(w*h),FS_WEIGHTS[_l]);
+}
+
+double calc_fastssim(const unsigned char *_src,int _systride,
+ const unsigned char *_dst,int _dystride,int _w,int _h){
+  fs_ctx ctx;
+  double ret;
+  int    l;
+  ret=1;
+  fs_ctx_init(&ctx,_w,_h,FS_NLEVELS);
+  (*fs_downsample_level0)(ctx.level[0].im1,ctx.level[0].im2,
+   ctx.level[0].w,ctx.level[0].h,_src,_systride,_dst,_dystride,_w,_h);
+  for(l=0;l<FS_NLEVELS-1;l++){
+    fs_calc_structure(&ctx,l);
+    ret*=fs_average(&ctx,l);
+    fs_downsample_level(&ctx,l+1);
+  }
+  fs_calc_structure(&ctx,l);
+  fs_apply_luminance(&ctx,l);
+  ret*=fs_average(&ctx,l);
+  fs_ctx_clear(&ctx);
+  return ret;
+}
+
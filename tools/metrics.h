@@ -0,0 +1,101 @@
+/*Daala video codec
+Copyright (c) 2016 Daala project contributors.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+- Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+- Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+#if !defined(_metrics_H)
+# define _metrics_H (1)
+# include <stdint.h>
+
+/*Quality metrics shared by dump_psnrhvs, dump_ssim, dump_fastssim and
+   dump_metrics.
+  All of them compare a single plane of 8-bit samples.*/
+
+/*Normalized inverse quantization matrices for the 8x8 DCT used by
+   PSNR-HVS.*/
+extern float csf_y[8][8];
+extern float csf_cb420[8][8];
+extern float csf_cr420[8][8];
+
+/*Selects the fastest kernels supported by the current CPU.
+  This must be called before any metric is computed from more than one
+   thread.
+  The C kernels are used if it is never called.*/
+void metrics_init(void);
+
+int64_t calc_sqerr(const unsigned char *_src,int _systride,
+ const unsigned char *_dst,int _dystride,int _w,int _h);
+double calc_psnrhvs(const unsigned char *_src,int _systride,
+ const unsigned char *_dst,int _dystride,double _par,int _w,int _h,int _step,
+ float _csf[8][8]);
+double calc_ssim(const unsigned char *_src,int _systride,
+ const unsigned char *_dst,int _dystride,double _par,int _w,int _h);
+double calc_fastssim(const unsigned char *_src,int _systride,
+ const unsigned char *_dst,int _dystride,int _w,int _h);
+
+/*The Gaussian SSIM filters keep their five moments and the total weight in
+   separate rows of _w entries each, in this order.*/
+# define SSIM_MUX (0)
+# define SSIM_MUY (1)
+# define SSIM_X2  (2)
+# define SSIM_XY  (3)
+# define SSIM_Y2  (4)
+# define SSIM_W   (5)
+# define SSIM_NMOMENTS (6)
+
+/*Horizontal Gaussian filter for columns [_x0,_x1) of one row.*/
+typedef void (*ssim_hfilter_func)(unsigned *_m,int _w,
+ const unsigned char *_src,const unsigned char *_dst,
+ const unsigned *_kernel,int _kernel_sz,int _x0,int _x1);
+/*Vertical Gaussian filter for columns [_x0,_x1), combining the rows
+   _lines[_k_min],...,_lines[_k_max-1].*/
+typedef void (*ssim_vfilter_func)(unsigned *_m,int _w,
+ const unsigned *const *_lines,const unsigned *_kernel,int _k_min,int _k_max,
+ int _x0,int _x1);
+/*2x2 box filter building the first level of the Fast SSIM pyramid.*/
+typedef void (*fs_downsample_level0_func)(uint16_t *_dst1,uint16_t *_dst2,
+ int _dw,int _dh,const unsigned char *_src1,int _s1ystride,
+ const unsigned char *_src2,int _s2ystride,int _w,int _h);
+
+void ssim_hfilter_c(unsigned *_m,int _w,
+ const unsigned char *_src,const unsigned char *_dst,
+ const unsigned *_kernel,int _kernel_sz,int _x0,int _x1);
+void ssim_vfilter_c(unsigned *_m,int _w,
+ const unsigned *const *_lines,const unsigned *_kernel,int _k_min,int _k_max,
+ int _x0,int _x1);
+void fs_downsample_level0_c(uint16_t *_dst1,uint16_t *_dst2,
+ int _dw,int _dh,const unsigned char *_src1,int _s1ystride,
+ const unsigned char *_src2,int _s2ystride,int _w,int _h);
+
+# if defined(OD_SSE2_INTRINSICS)
+void ssim_hfilter_sse2(unsigned *_m,int _w,
+ const unsigned char *_src,const unsigned char *_dst,
+ const unsigned *_kernel,int _kernel_sz,int _x0,int _x1);
+void ssim_vfilter_sse2(unsigned *_m,int _w,
+ const unsigned *const *_lines,const unsigned *_kernel,int _k_min,int _k_max,
+ int _x0,int _x1);
+void fs_downsample_level0_sse2(uint16_t *_dst1,uint16_t *_dst2,
+ int _dw,int _dh,const unsigned char *_src1,int _s1ystride,
+ const unsigned char *_src2,int _s2ystride,int _w,int _h);
+# endif
+
+#endif
@@ -231,6 +231,10 @@ if [ -z "$DUMP_FASTSSIM" ]; then
   export DUMP_FASTSSIM=$DAALA_ROOT/tools/dump_fastssim
 fi
 
+if [ -z "$DUMP_METRICS" ]; then
+  export DUMP_METRICS=$DAALA_ROOT/tools/dump_metrics
+fi
+
 if [ ! -x "$YUV2YUV4MPEG" ]; then
   echo "Executable not found YUV2YUV4MPEG=$YUV2YUV4MPEG"
   echo "Do you have the right DAALA_ROOT=$DAALA_ROOT"
@@ -261,6 +265,12 @@ if [ ! -x "$DUMP_FASTSSIM" ]; then
   exit 1
 fi
 
+if [ ! -x "$DUMP_METRICS" ]; then
+  echo "Executable not found DUMP_METRICS=$DUMP_METRICS"
+  echo "Do you have the right DAALA_ROOT=$DAALA_ROOT"
+  exit 1
+fi
+
 if [ -z "$CORES" ]; then
   if [ "$(uname -s)" = "Darwin" ]; then
     CORES=$(sysctl -n hw.ncpu)
@@ -0,0 +1,194 @@
+/*Daala video codec
+Copyright (c) 2016 Daala project contributors.  All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+- Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+- Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "metrics.h"
+#include "../src/odintrin.h"
+
+#if defined(OD_SSE2_INTRINSICS)
+# include <emmintrin.h>
+
+/*The low 32 bits of the products of each 32-bit lane.*/
+static __m128i metrics_mullo_epi32(__m128i _a,__m128i _b){
+  __m128i lo;
+  __m128i hi;
+  lo=_mm_mul_epu32(_a,_b);
+  hi=_mm_mul_epu32(_mm_srli_epi64(_a,32),_mm_srli_epi64(_b,32));
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(lo,_MM_SHUFFLE(0,0,2,0)),
+   _mm_shuffle_epi32(hi,_MM_SHUFFLE(0,0,2,0)));
+}
+
+/*Accumulates the 32-bit products of eight 16-bit lanes into two vectors.*/
+#define SSIM_MADD16(_acc,_a,_b) \
+  do{ \
+    __m128i plo; \
+    __m128i phi; \
+    plo=_mm_mullo_epi16(_a,_b); \
+    phi=_mm_mulhi_epu16(_a,_b); \
+    (_acc)[0]=_mm_add_epi32((_acc)[0],_mm_unpacklo_epi16(plo,phi)); \
+    (_acc)[1]=_mm_add_epi32((_acc)[1],_mm_unpackhi_epi16(plo,phi)); \
+  } \
+  while(0)
+
+/*Eight columns at a time wherever the whole kernel lies inside the row.
+  Samples are at most 255 and taps at most KERNEL_WEIGHT, so all of the
+   per-tap products fit in 16-bit multiplies with 32-bit results.*/
+void ssim_hfilter_sse2(unsigned *_m,int _w,
+ const unsigned char *_src,const unsigned char *_dst,
+ const unsigned *_kernel,int _kernel_sz,int _x0,int _x1){
+  __m128i  zero;
+  unsigned wsum;
+  int      offs;
+  int      xi0;
+  int      xi1;
+  int      x;
+  int      k;
+  offs=_kernel_sz>>1;
+  xi0=OD_MAXI(_x0,offs);
+  xi1=OD_MINI(_x1,_w-offs);
+  if(xi1-xi0<8){
+    ssim_hfilter_c(_m,_w,_src,_dst,_kernel,_kernel_sz,_x0,_x1);
+    return;
+  }
+  ssim_hfilter_c(_m,_w,_src,_dst,_kernel,_kernel_sz,_x0,xi0);
+  zero=_mm_setzero_si128();
+  for(wsum=0,k=0;k<_kernel_sz;k++)wsum+=_kernel[k];
+  for(x=xi0;x+8<=xi1;x+=8){
+    __m128i mux[2];
+    __m128i muy[2];
+    __m128i x2[2];
+    __m128i xy[2];
+    __m128i y2[2];
+    mux[0]=mux[1]=muy[0]=muy[1]=zero;
+    x2[0]=x2[1]=xy[0]=xy[1]=y2[0]=y2[1]=zero;
+    for(k=0;k<_kernel_sz;k++){
+      __m128i s;
+      __m128i d;
+      __m128i window;
+      s=_mm_unpacklo_epi8(
+       _mm_loadl_epi64((const __m128i *)(_src+x-offs+k)),zero);
+      d=_mm_unpacklo_epi8(
+       _mm_loadl_epi64((const __m128i *)(_dst+x-offs+k)),zero);
+      window=_mm_set1_epi16((short)_kernel[k]);
+      SSIM_MADD16(mux,s,window);
+      SSIM_MADD16(muy,d,window);
+      SSIM_MADD16(x2,_mm_mullo_epi16(s,s),window);
+      SSIM_MADD16(xy,_mm_mullo_epi16(s,d),window);
+      SSIM_MADD16(y2,_mm_mullo_epi16(d,d),window);
+    }
+    _mm_storeu_si128((__m128i *)(_m+SSIM_MUX*_w+x),mux[0]);
+    _mm_storeu_si128((__m128i *)(_m+SSIM_MUX*_w+x+4),mux[1]);
+    _mm_storeu_si128((__m128i *)(_m+SSIM_MUY*_w+x),muy[0]);
+    _mm_storeu_si128((__m128i *)(_m+SSIM_MUY*_w+x+4),muy[1]);
+    _mm_storeu_si128((__m128i *)(_m+SSIM_X2*_w+x),x2[0]);
+    _mm_storeu_si128((__m128i *)(_m+SSIM_X2*_w+x+4),x2[1]);
+    _mm_storeu_si128((__m128i *)(_m+SSIM_XY*_w+x),xy[0]);
+    _mm_storeu_si128((__m128i *)(_m+SSIM_XY*_w+x+4),xy[1]);
+    _mm_storeu_si128((__m128i *)(_m+SSIM_Y2*_w+x),y2[0]);
+    _mm_storeu_si128((__m128i *)(_m+SSIM_Y2*_w+x+4),y2[1]);
+    _mm_storeu_si128((__m128i *)(_m+SSIM_W*_w+x),_mm_set1_epi32(wsum));
+    _mm_storeu_si128((__m128i *)(_m+SSIM_W*_w+x+4),_mm_set1_epi32(wsum));
+  }
+  ssim_hfilter_c(_m,_w,_src,_dst,_kernel,_kernel_sz,x,_x1);
+}
+
+/*The moments wrap modulo 2**32 exactly as they do in the C version.*/
+void ssim_vfilter_sse2(unsigned *_m,int _w,
+ const unsigned *const *_lines,const unsigned *_kernel,int _k_min,int _k_max,
+ int _x0,int _x1){
+  int x;
+  for(x=_x0;x+4<=_x1;x+=4){
+    __m128i m[SSIM_NMOMENTS];
+    int     j;
+    int     k;
+    for(j=0;j<SSIM_NMOMENTS;j++)m[j]=_mm_setzero_si128();
+    for(k=_k_min;k<_k_max;k++){
+      __m128i window;
+      window=_mm_set1_epi32(_kernel[k]);
+      for(j=0;j<SSIM_NMOMENTS;j++){
+        m[j]=_mm_add_epi32(m[j],metrics_mullo_epi32(window,
+         _mm_loadu_si128((const __m128i *)(_lines[k]+j*_w+x))));
+      }
+    }
+    for(j=0;j<SSIM_NMOMENTS;j++){
+      _mm_storeu_si128((__m128i *)(_m+j*_w+x),m[j]);
+    }
+  }
+  ssim_vfilter_c(_m,_w,_lines,_kernel,_k_min,_k_max,x,_x1);
+}
+
+/*Sums 16 pixels from each of two rows down to 8 2x2 box sums.*/
+static __m128i fs_box2x2(const unsigned char *_r0,const unsigned char *_r1){
+  __m128i zero;
+  __m128i mask;
+  __m128i a;
+  __m128i b;
+  __m128i r0;
+  __m128i r1;
+  zero=_mm_setzero_si128();
+  mask=_mm_set1_epi32(0xFFFF);
+  r0=_mm_loadu_si128((const __m128i *)_r0);
+  r1=_mm_loadu_si128((const __m128i *)_r1);
+  a=_mm_add_epi16(_mm_unpacklo_epi8(r0,zero),_mm_unpacklo_epi8(r1,zero));
+  b=_mm_add_epi16(_mm_unpackhi_epi8(r0,zero),_mm_unpackhi_epi8(r1,zero));
+  a=_mm_add_epi32(_mm_and_si128(a,mask),_mm_srli_epi32(a,16));
+  b=_mm_add_epi32(_mm_and_si128(b,mask),_mm_srli_epi32(b,16));
+  return _mm_packs_epi32(a,b);
+}
+
+void fs_downsample_level0_sse2(uint16_t *_dst1,uint16_t *_dst2,
+ int _dw,int _dh,const unsigned char *_src1,int _s1ystride,
+ const unsigned char *_src2,int _s2ystride,int _w,int _h){
+  int i;
+  int j;
+  for(j=0;j<_dh;j++){
+    int j0;
+    int j1;
+    j0=2*j;
+    j1=OD_MINI(j0+1,_h-1);
+    /*Only columns whose right neighbor lies inside the plane are handled
+       here; the clamped right edge is left to the scalar loop below.*/
+    for(i=0;i+8<=_w>>1;i+=8){
+      _mm_storeu_si128((__m128i *)(_dst1+j*_dw+i),
+       fs_box2x2(_src1+j0*_s1ystride+2*i,_src1+j1*_s1ystride+2*i));
+      _mm_storeu_si128((__m128i *)(_dst2+j*_dw+i),
+       fs_box2x2(_src2+j0*_s2ystride+2*i,_src2+j1*_s2ystride+2*i));
+    }
+    for(;i<_dw;i++){
+      int i0;
+      int i1;
+      i0=2*i;
+      i1=OD_MINI(i0+1,_w-1);
+      _dst1[j*_dw+i]=_src1[j0*_s1ystride+i0]+_src1[j0*_s1ystride+i1]
+       +_src1[j1*_s1ystride+i0]+_src1[j1*_s1ystride+i1];
+      _dst2[j*_dw+i]=_src2[j0*_s2ystride+i0]+_src2[j0*_s2ystride+i1]
+       +_src2[j1*_s2ystride+i0]+_src2[j1*_s2ystride+i1];
+    }
+  }
+}
+
+#endif